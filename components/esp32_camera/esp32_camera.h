@@ -13,6 +13,8 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
 
+#include <atomic>
+
 #if 1
 typedef enum {
   PIXFORMAT_RGB565,    // 2BPP/RGB565
@@ -48,9 +50,11 @@ public:
 };
 
 class ESP32Camera;
+class FrameRing;
 
 /* ---------------- enum classes ---------------- */
-enum CameraRequester { IDLE, API_REQUESTER, WEB_REQUESTER };
+enum CameraRequester { IDLE, API_REQUESTER, WEB_REQUESTER, HTTP_REQUESTER };
+static const uint8_t CAMERA_REQUESTER_COUNT = HTTP_REQUESTER + 1;
 
 enum ESP32CameraFrameSize {
   ESP32_CAMERA_SIZE_160X120,   // QQVGA
@@ -77,6 +81,19 @@ enum ESP32CameraFrameSize {
   ESP32_CAMERA_SIZE_ANY
 };
 
+enum ESP32CameraTransferType {
+  ESP32_CAMERA_TRANSFER_AUTO, // measure both once per device, keep the best
+  ESP32_CAMERA_TRANSFER_BULK,
+  ESP32_CAMERA_TRANSFER_ISOC,
+};
+
+// what frames from cameras without MJPEG are turned into
+enum ESP32CameraUncompressedOutput {
+  ESP32_CAMERA_UNCOMPRESSED_JPEG,
+  ESP32_CAMERA_UNCOMPRESSED_RGB565,
+  ESP32_CAMERA_UNCOMPRESSED_GRAYSCALE,
+};
+
 /* ---------------- CameraImage class ---------------- */
 class CameraImage {
 public:
@@ -106,6 +123,23 @@ protected:
 };
 
 /* ---------------- ESP32Camera class ---------------- */
+// delay before slowing the UVC stream down or suspending it once the last
+// stream stopped
+static const uint32_t FRAME_INTERVAL_LINGER_MS = 5000;
+// thumbnails still held by consumers while the next ones are made
+static const uint8_t THUMBNAIL_BUFFER_COUNT = 2;
+// cropped images, one per region plus one still held by a consumer
+static const uint8_t ROI_BUFFER_COUNT = 4;
+
+// fractions of the frame, widened to whole MCUs when cut
+struct CameraRoi {
+  float x, y, width, height;
+  bool operator==(const CameraRoi &other) const {
+    return x == other.x && y == other.y && width == other.width &&
+           height == other.height;
+  }
+};
+
 class ESP32Camera : public Component, public EntityBase {
 public:
   ESP32Camera();
@@ -114,9 +148,34 @@ public:
   /* -- image */
   void set_frame_size(ESP32CameraFrameSize size);
   void set_drop_size(uint32_t drop_size);
+  void set_validate_frames(bool validate);
+  void set_uncompressed_output(ESP32CameraUncompressedOutput output);
+  void set_jpeg_quality(uint8_t quality);
+  void set_frame_buffer_count(uint8_t count);
+  void set_transfer_type(ESP32CameraTransferType type);
+  /* -- thumbnails, scale is 1..3 for 1/2..1/8 */
+  void set_thumbnail_scale(uint8_t shift);
+  void add_thumbnail_requester(CameraRequester requester);
+  /* -- regions of interest, cut out without re-encoding */
+  void set_roi(CameraRequester requester, float x, float y, float width,
+               float height);
   /* -- framerates */
   void set_max_update_interval(uint32_t max_update_interval);
   void set_idle_update_interval(uint32_t idle_update_interval);
+  /* -- suspend the UVC stream while no frames are requested */
+  void set_suspend_when_idle(bool suspend);
+  void set_resume_skip_frames(uint8_t count);
+  /* -- single requests answered with the last frame while it is this new */
+  void set_snapshot_max_age(uint32_t max_age_ms);
+  /* -- hold back frames of a static scene from streaming requesters */
+  void set_skip_unchanged(uint8_t luma_threshold, uint32_t keepalive_ms);
+  void add_skip_unchanged_requester(CameraRequester requester);
+  /* -- framebuffer task placement, core 0, 1 or tskNO_AFFINITY */
+  void set_framebuffer_task_core(BaseType_t core);
+  void set_framebuffer_task_priority(uint8_t priority);
+  /* -- transcoder task placement, makes the thumbnails */
+  void set_transcoder_task_core(BaseType_t core);
+  void set_transcoder_task_priority(uint8_t priority);
 
   /* public API (derivated) */
   void setup() override;
@@ -130,6 +189,23 @@ public:
   void stop_stream(CameraRequester requester);
   void request_image(CameraRequester requester);
   void update_camera_parameters();
+  /* runtime resolution, limited to what the device advertises; persisted
+   * modes are used again after a reboot */
+  bool set_resolution(uint16_t width, uint16_t height, bool persist = true);
+  // advertised modes, false past the last one or while disconnected
+  bool get_mode(size_t index, uint16_t *width, uint16_t *height) const;
+  bool get_current_mode(uint16_t *width, uint16_t *height) const;
+  /* frames are delivered at least this far apart while throttled, 0 ends
+   * throttling */
+  void set_throttle_interval(uint32_t interval_ms);
+  uint32_t get_max_update_interval() const {
+    return this->max_update_interval_;
+  }
+  std::vector<std::string> get_resolutions() const;
+  std::string get_resolution() const;
+  void add_resolution_callback(std::function<void()> &&callback);
+  // for consumers reading frames without going through loop()
+  FrameRing *get_frame_ring();
 
   void add_stream_start_callback(std::function<void()> &&callback);
   void add_stream_stop_callback(std::function<void()> &&callback);
@@ -138,28 +214,67 @@ protected:
   /* internal methods */
   bool has_requested_image_() const;
   bool can_return_image_() const;
+  uint32_t delivery_interval_() const;
+  bool snapshot_fresh_() const;
+  void cache_snapshot_(camera_fb_t *fb);
+  bool release_snapshot_();
+  void serve_snapshot_();
+  uint32_t requested_frame_interval_() const;
+  void update_frame_interval_();
+  void resume_stream_();
+  void suspend_stream_if_idle_(uint64_t now);
+  uint8_t submit_transcode_(camera_fb_t *fb, uint8_t requesters);
+  void deliver_transcoded_();
 
   static void framebuffer_task(void *pv);
 
   /* attributes */
   /* camera configuration */
   ESP32CameraFrameSize frame_size;
+  uint8_t frame_buffer_count_{3};
+  ESP32CameraTransferType transfer_type_{ESP32_CAMERA_TRANSFER_BULK};
+  uint8_t thumbnail_shift_{0};
+  uint8_t thumbnail_requesters_{0};
+  CameraRoi rois_[CAMERA_REQUESTER_COUNT];
+  uint8_t roi_requesters_{0};
   /* -- framerates */
   uint32_t max_update_interval_{1000};
+  uint32_t throttle_interval_{0};
   uint32_t idle_update_interval_{15000};
+  /* -- suspend */
+  bool suspend_when_idle_{true};
+  uint8_t resume_skip_frames_{1};
+  /* -- snapshot cache */
+  uint32_t snapshot_max_age_{0};
+  uint8_t snapshot_requesters_{0}; // served from the cache on the next loop
+  std::shared_ptr<CameraImage> snapshot_image_;
+  /* -- unchanged frames */
+  uint8_t skip_unchanged_requesters_{0};
+  /* -- tasks */
+  BaseType_t framebuffer_task_core_{tskNO_AFFINITY};
+  uint8_t framebuffer_task_priority_{2};
+  BaseType_t transcoder_task_core_{tskNO_AFFINITY};
+  uint8_t transcoder_task_priority_{1};
 
   esp_err_t init_error_{ESP_OK};
   std::shared_ptr<CameraImage> current_image_;
+  std::shared_ptr<CameraImage> thumbnail_images_[THUMBNAIL_BUFFER_COUNT];
+  std::shared_ptr<CameraImage> roi_images_[ROI_BUFFER_COUNT];
   uint8_t single_requesters_{0};
+  // their thumbnail or region failed, the next frame is sent to them whole
+  uint8_t whole_frame_requesters_{0};
   uint8_t stream_requesters_{0};
-  QueueHandle_t framebuffer_get_queue_;
-  QueueHandle_t framebuffer_return_queue_;
+  // shared with the framebuffer task, set while frames are requested
+  std::atomic<bool> frames_wanted_{false};
   CallbackManager<void(std::shared_ptr<CameraImage>)> new_image_callback_;
   CallbackManager<void()> stream_start_callback_{};
   CallbackManager<void()> stream_stop_callback_{};
+  CallbackManager<void()> resolution_callback_{};
 
   uint64_t last_idle_request_{0};
   uint64_t last_update_{0};
+  uint64_t last_stream_{0}; // ms, last time a stream stopped
+  int64_t resume_us_{0};    // until the first frame after a resume
 };
 
 // NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
@@ -182,6 +297,18 @@ public:
 protected:
 };
 
+template <typename... Ts>
+class SetResolutionAction : public Action<Ts...>, public Parented<ESP32Camera> {
+public:
+  TEMPLATABLE_VALUE(uint16_t, width)
+  TEMPLATABLE_VALUE(uint16_t, height)
+
+  void play(Ts... x) override {
+    this->parent_->set_resolution(this->width_.value(x...),
+                                  this->height_.value(x...));
+  }
+};
+
 } // namespace esp32_camera
 } // namespace esphome
 
@@ -5,20 +5,38 @@ import esphome.codegen as cg
 import esphome.config_validation as cv
 from esphome import automation
 from esphome import pins
+from esphome.components import binary_sensor, select, sensor
 from esphome.const import (
     CONF_FREQUENCY,
+    CONF_HEIGHT,
     CONF_ID,
+    CONF_PORT,
+    CONF_PRIORITY,
+    CONF_RAW_DATA_ID,
     CONF_RESOLUTION,
     CONF_TRIGGER_ID,
+    CONF_WIDTH,
+    DEVICE_CLASS_MOTION,
+    ENTITY_CATEGORY_CONFIG,
+    ENTITY_CATEGORY_DIAGNOSTIC,
+    STATE_CLASS_MEASUREMENT,
+    STATE_CLASS_TOTAL_INCREASING,
+    UNIT_MILLISECOND,
+    UNIT_PERCENT,
 )
 from esphome.core import CORE, TimePeriod
 from esphome.components.esp32 import add_idf_sdkconfig_option
 from esphome.components.esp32 import add_idf_component
 from esphome.cpp_helpers import setup_entity
 
+try:
+    from esphome.components.socket import require_wake_loop_threadsafe
+except ImportError:  # ESPHome without thread-safe loop wakeups
+    require_wake_loop_threadsafe = None
+
 DEPENDENCIES = ["esp32", "esp32_camera"]
 
-AUTO_LOAD = ["esp32_camera"]
+AUTO_LOAD = ["esp32_camera", "binary_sensor", "select", "sensor"]
 
 esp32_camera_ns = cg.esphome_ns.namespace("esp32_camera")
 ESP32Camera = esp32_camera_ns.class_("ESP32Camera", cg.PollingComponent, cg.EntityBase)
@@ -30,7 +48,44 @@ ESP32CameraStreamStopTrigger = esp32_camera_ns.class_(
     "ESP32CameraStreamStopTrigger",
     automation.Trigger.template(),
 )
+SetResolutionAction = esp32_camera_ns.class_(
+    "SetResolutionAction", automation.Action, cg.Parented.template(ESP32Camera)
+)
+ResolutionSelect = esp32_camera_ns.class_(
+    "ResolutionSelect", select.Select, cg.Component, cg.Parented.template(ESP32Camera)
+)
+SyntheticSource = esp32_camera_ns.class_("SyntheticSource", cg.Component)
+PipelineMonitor = esp32_camera_ns.class_("PipelineMonitor", cg.PollingComponent)
+TaskMonitor = esp32_camera_ns.class_("TaskMonitor", cg.PollingComponent)
+MotionDetector = esp32_camera_ns.class_("MotionDetector", cg.Component)
+FrameRecorder = esp32_camera_ns.class_("FrameRecorder", cg.Component)
+StreamServer = esp32_camera_ns.class_("StreamServer", cg.Component)
+RateController = esp32_camera_ns.class_("RateController", cg.Component)
+FrameProcessorPipeline = esp32_camera_ns.class_(
+    "FrameProcessorPipeline", cg.Component
+)
+FrameProcessor = esp32_camera_ns.class_("FrameProcessor")
+BrightnessProcessor = esp32_camera_ns.class_(
+    "BrightnessProcessor", FrameProcessor, cg.Component
+)
+RecordAction = esp32_camera_ns.class_(
+    "RecordAction", automation.Action, cg.Parented.template(FrameRecorder)
+)
+PipelineStage = esp32_camera_ns.enum("PipelineStage")
+CameraRequester = esp32_camera_ns.enum("CameraRequester")
 ESP32CameraFrameSize = esp32_camera_ns.enum("ESP32CameraFrameSize")
+ESP32CameraTransferType = esp32_camera_ns.enum("ESP32CameraTransferType")
+TRANSFER_TYPES = {
+    "auto": ESP32CameraTransferType.ESP32_CAMERA_TRANSFER_AUTO,
+    "bulk": ESP32CameraTransferType.ESP32_CAMERA_TRANSFER_BULK,
+    "isochronous": ESP32CameraTransferType.ESP32_CAMERA_TRANSFER_ISOC,
+}
+ESP32CameraUncompressedOutput = esp32_camera_ns.enum("ESP32CameraUncompressedOutput")
+UNCOMPRESSED_OUTPUTS = {
+    "jpeg": ESP32CameraUncompressedOutput.ESP32_CAMERA_UNCOMPRESSED_JPEG,
+    "rgb565": ESP32CameraUncompressedOutput.ESP32_CAMERA_UNCOMPRESSED_RGB565,
+    "grayscale": ESP32CameraUncompressedOutput.ESP32_CAMERA_UNCOMPRESSED_GRAYSCALE,
+}
 FRAME_SIZES = {
     "160X120": ESP32CameraFrameSize.ESP32_CAMERA_SIZE_160X120,
     "QQVGA": ESP32CameraFrameSize.ESP32_CAMERA_SIZE_160X120,
@@ -81,12 +136,514 @@ FRAME_SIZES = {
 CONF_MAX_FRAMERATE = "max_framerate"
 CONF_IDLE_FRAMERATE = "idle_framerate"
 CONF_DROP_FRAME_SIZE = "drop_frame_size"
+CONF_VALIDATE_FRAMES = "validate_frames"
+CONF_UNCOMPRESSED_OUTPUT = "uncompressed_output"
+CONF_JPEG_QUALITY = "jpeg_quality"
+CONF_FRAME_BUFFER_COUNT = "frame_buffer_count"
+CONF_RESOLUTION_SELECT = "resolution_select"
+CONF_SUSPEND_WHEN_IDLE = "suspend_when_idle"
+CONF_RESUME_SKIP_FRAMES = "resume_skip_frames"
+
+# USB transfers
+CONF_TRANSFER_TYPE = "transfer_type"
+CONF_URBS = "urbs"
+CONF_BULK_COUNT = "bulk_count"
+CONF_BULK_SIZE = "bulk_size"
+CONF_ISOC_COUNT = "isochronous_count"
+CONF_ISOC_PACKETS = "isochronous_packets"
+
+# thumbnails
+CONF_THUMBNAIL = "thumbnail"
+CONF_SCALE = "scale"
+CONF_REQUESTERS = "requesters"
+THUMBNAIL_SCALES = {"1/2": 1, "1/4": 2, "1/8": 3}
+CAMERA_REQUESTERS = {
+    "idle": CameraRequester.IDLE,
+    "api": CameraRequester.API_REQUESTER,
+    "web": CameraRequester.WEB_REQUESTER,
+    "http": CameraRequester.HTTP_REQUESTER,
+}
+
+# regions of interest
+CONF_ROI = "roi"
+CONF_X = "x"
+CONF_Y = "y"
+# the stream server reads the frame ring directly, crops happen in loop()
+ROI_REQUESTERS = {
+    key: value for key, value in CAMERA_REQUESTERS.items() if key != "http"
+}
+
+# unchanged frames
+CONF_SKIP_UNCHANGED = "skip_unchanged"
+CONF_KEEPALIVE = "keepalive"
+
+# snapshot cache
+CONF_SNAPSHOT_CACHE = "snapshot_cache"
+CONF_MAX_AGE = "max_age"
+
+# motion detection
+CONF_MOTION = "motion"
+CONF_ANALYSIS_INTERVAL = "analysis_interval"
+CONF_LUMA_THRESHOLD = "luma_threshold"
+CONF_AREA_THRESHOLD = "area_threshold"
+CONF_HOLD_TIME = "hold_time"
+CONF_GATED_REQUESTERS = "gated_requesters"
+CONF_MOTION_DETECTED = "motion_detected"
+CONF_MOTION_SCORE = "motion_score"
+
+# pre-event recorder
+CONF_RECORDER = "recorder"
+CONF_PATH = "path"
+CONF_PRE_EVENT = "pre_event"
+CONF_POST_EVENT = "post_event"
+CONF_BUFFER_SIZE = "buffer_size"
+CONF_RECORDING = "recording"
+
+# built-in stream server
+CONF_STREAM_SERVER = "stream_server"
+CONF_MAX_CLIENTS = "max_clients"
+CONF_CLIENTS = "clients"
+
+# rate control
+CONF_RATE_CONTROL = "rate_control"
+CONF_MIN_FRAMERATE = "min_framerate"
+CONF_EVALUATION_INTERVAL = "evaluation_interval"
+CONF_STEP_RESOLUTION = "step_resolution"
+
+# task placement
+CONF_TASKS = "tasks"
+CONF_USB = "usb"
+CONF_SAMPLE = "sample"
+CONF_FRAMEBUFFER = "framebuffer"
+CONF_TRANSCODER = "transcoder"
+CONF_CORE = "core"
+CONF_TASK_STATS = "task_stats"
+
+# frame processors
+CONF_PROCESSORS = "processors"
+CONF_QUEUE_SIZE = "queue_size"
+CONF_STACK_SIZE = "stack_size"
+CONF_BRIGHTNESS = "brightness"
+CONF_PROCESSOR_ID = "processor_id"
+
+# synthetic source
+CONF_SYNTHETIC_SOURCE = "synthetic_source"
+CONF_FILES = "files"
+CONF_FRAMERATE = "framerate"
+CONF_JITTER = "jitter"
+CONF_REPORT_INTERVAL = "report_interval"
+CONF_DRIVE_STREAM = "drive_stream"
+
+# statistics
+CONF_STATISTICS = "statistics"
+CONF_P50 = "p50"
+CONF_P95 = "p95"
+CONF_MAX = "max"
+CONF_DELIVERED_FRAMES = "delivered_frames"
+CONF_DROPPED_TOO_SMALL = "dropped_too_small"
+CONF_DROPPED_BUSY = "dropped_busy"
+CONF_OVERSIZE_FRAMES = "oversize_frames"
+CONF_DROPPED_CORRUPT = "dropped_corrupt"
+CONF_SKIPPED_UNCHANGED = "skipped_unchanged"
+CONF_THROUGHPUT = "throughput"
+LATENCY_STAGES = {
+    "handoff_latency": PipelineStage.STAGE_HANDOFF,
+    "pickup_latency": PipelineStage.STAGE_PICKUP,
+    "release_latency": PipelineStage.STAGE_RELEASE,
+    "total_latency": PipelineStage.STAGE_TOTAL,
+    "resume_latency": PipelineStage.STAGE_RESUME,
+}
 
 # stream trigger
 CONF_ON_STREAM_START = "on_stream_start"
 CONF_ON_STREAM_STOP = "on_stream_stop"
 
-CONFIG_SCHEMA = cv.ENTITY_BASE_SCHEMA.extend(
+
+def _jpeg_size(data):
+    """Return (width, height) from the SOF header of a baseline JPEG."""
+    if data[:2] != b"\xff\xd8":
+        raise cv.Invalid("not a JPEG file")
+    pos = 2
+    while pos + 4 <= len(data):
+        if data[pos] != 0xFF:
+            raise cv.Invalid(f"broken JPEG marker at offset {pos}")
+        marker = data[pos + 1]
+        length = (data[pos + 2] << 8) | data[pos + 3]
+        if marker in (0xC0, 0xC1):
+            height = (data[pos + 5] << 8) | data[pos + 6]
+            width = (data[pos + 7] << 8) | data[pos + 8]
+            return width, height
+        if marker == 0xDA:
+            break
+        pos += 2 + length
+    raise cv.Invalid("no baseline SOF header found")
+
+
+def validate_mjpeg_file(value):
+    value = cv.file_(value)
+    with open(value, "rb") as f:
+        data = f.read()
+    try:
+        width, height = _jpeg_size(data)
+    except cv.Invalid as e:
+        raise cv.Invalid(f"{value}: {e}") from e
+    return {"path": value, "data": data, "width": width, "height": height}
+
+
+SYNTHETIC_SOURCE_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(): cv.declare_id(SyntheticSource),
+        cv.GenerateID(CONF_RAW_DATA_ID): cv.declare_id(cg.uint8),
+        cv.Required(CONF_FILES): cv.All(
+            cv.ensure_list(validate_mjpeg_file), cv.Length(min=1)
+        ),
+        cv.Optional(CONF_FRAMERATE, default="15 fps"): cv.All(
+            cv.framerate, cv.Range(min=0, min_included=False, max=60)
+        ),
+        cv.Optional(
+            CONF_JITTER, default="0ms"
+        ): cv.positive_time_period_microseconds,
+        cv.Optional(
+            CONF_REPORT_INTERVAL, default="10s"
+        ): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_DRIVE_STREAM, default=True): cv.boolean,
+    }
+).extend(cv.COMPONENT_SCHEMA)
+
+THUMBNAIL_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_SCALE, default="1/4"): cv.enum(THUMBNAIL_SCALES),
+        cv.Optional(CONF_REQUESTERS, default=["idle", "api"]): cv.All(
+            cv.ensure_list(cv.enum(CAMERA_REQUESTERS, lower=True)),
+            cv.Length(min=1),
+        ),
+    }
+)
+
+
+def validate_roi(config):
+    if config[CONF_X] + config[CONF_WIDTH] > 1:
+        raise cv.Invalid("x + width must not exceed 100%")
+    if config[CONF_Y] + config[CONF_HEIGHT] > 1:
+        raise cv.Invalid("y + height must not exceed 100%")
+    return config
+
+
+ROI_SCHEMA = cv.All(
+    cv.Schema(
+        {
+            cv.Required(CONF_REQUESTERS): cv.All(
+                cv.ensure_list(cv.enum(ROI_REQUESTERS, lower=True)),
+                cv.Length(min=1),
+            ),
+            cv.Optional(CONF_X, default="0%"): cv.percentage,
+            cv.Optional(CONF_Y, default="0%"): cv.percentage,
+            cv.Required(CONF_WIDTH): cv.All(
+                cv.percentage, cv.Range(min=0, min_included=False)
+            ),
+            cv.Required(CONF_HEIGHT): cv.All(
+                cv.percentage, cv.Range(min=0, min_included=False)
+            ),
+        }
+    ),
+    validate_roi,
+)
+
+
+SKIP_UNCHANGED_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_REQUESTERS): cv.All(
+            cv.ensure_list(cv.enum(CAMERA_REQUESTERS, lower=True)),
+            cv.Length(min=1),
+        ),
+        cv.Optional(CONF_LUMA_THRESHOLD, default=4): cv.int_range(min=0, max=255),
+        cv.Optional(
+            CONF_KEEPALIVE, default="10s"
+        ): cv.positive_time_period_milliseconds,
+    }
+)
+
+
+SNAPSHOT_CACHE_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_MAX_AGE, default="1s"): cv.All(
+            cv.positive_time_period_milliseconds,
+            cv.Range(min=cv.TimePeriod(milliseconds=1)),
+        ),
+    }
+)
+
+
+def validate_skip_unchanged(config):
+    """http streams are held back by the stream server."""
+    requesters = config.get(CONF_SKIP_UNCHANGED, {}).get(CONF_REQUESTERS, [])
+    if "http" in requesters and CONF_STREAM_SERVER not in config:
+        raise cv.Invalid("skip_unchanged for http needs the stream_server")
+    return config
+
+
+def validate_roi_requesters(config):
+    """Every requester gets one image: one region, and no thumbnail on top."""
+    seen = set()
+    thumbnail = config.get(CONF_THUMBNAIL, {}).get(CONF_REQUESTERS, [])
+    for roi in config.get(CONF_ROI, []):
+        for requester in roi[CONF_REQUESTERS]:
+            if requester in seen:
+                raise cv.Invalid(f"{requester} has more than one region")
+            if requester in thumbnail:
+                raise cv.Invalid(
+                    f"{requester} cannot get both a region and a thumbnail"
+                )
+            seen.add(requester)
+    return config
+
+
+def validate_frame_buffer_count(config):
+    """Every consumer that can hold a frame slot at the same time gets one."""
+    # the USB callback fills one while loop() delivers another
+    needed = 2
+    holders = []
+    if CONF_STREAM_SERVER in config:
+        clients = config[CONF_STREAM_SERVER][CONF_MAX_CLIENTS]
+        needed += clients
+        holders.append(f"{clients} stream_server clients")
+    if CONF_PROCESSORS in config:
+        # the queued frames and the one being processed
+        queued = config[CONF_PROCESSORS][CONF_QUEUE_SIZE] + 1
+        needed += queued
+        holders.append(f"{queued} for processors")
+    if CONF_SNAPSHOT_CACHE in config:
+        needed += 1
+        holders.append("1 for snapshot_cache")
+    count = config.get(CONF_FRAME_BUFFER_COUNT)
+    if count is None:
+        if needed > 8:
+            raise cv.Invalid(
+                f"{', '.join(holders)} need {needed} frame slots, at most 8 "
+                "are supported",
+                path=[CONF_FRAME_BUFFER_COUNT],
+            )
+        config[CONF_FRAME_BUFFER_COUNT] = max(3, needed)
+    elif count < needed:
+        raise cv.Invalid(
+            f"frame_buffer_count must be at least {needed}: 2 for the "
+            f"pipeline, plus {', '.join(holders)}",
+            path=[CONF_FRAME_BUFFER_COUNT],
+        )
+    return config
+
+
+MOTION_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(): cv.declare_id(MotionDetector),
+        cv.Optional(
+            CONF_ANALYSIS_INTERVAL, default="200ms"
+        ): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_LUMA_THRESHOLD, default=12): cv.int_range(min=1, max=255),
+        cv.Optional(CONF_AREA_THRESHOLD, default="2%"): cv.percentage,
+        cv.Optional(CONF_HOLD_TIME, default="5s"): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_GATED_REQUESTERS, default=[]): cv.ensure_list(
+            cv.enum(CAMERA_REQUESTERS, lower=True)
+        ),
+        cv.Optional(CONF_MOTION_DETECTED): binary_sensor.binary_sensor_schema(
+            device_class=DEVICE_CLASS_MOTION,
+        ),
+        cv.Optional(CONF_MOTION_SCORE): sensor.sensor_schema(
+            unit_of_measurement=UNIT_PERCENT,
+            accuracy_decimals=1,
+            state_class=STATE_CLASS_MEASUREMENT,
+            icon="mdi:motion-sensor",
+        ),
+    }
+).extend(cv.COMPONENT_SCHEMA)
+
+RECORDER_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(): cv.declare_id(FrameRecorder),
+        # files are named <path>_0001.avi, ... on an already mounted VFS
+        cv.Required(CONF_PATH): cv.string_strict,
+        cv.Optional(
+            CONF_PRE_EVENT, default="5s"
+        ): cv.positive_time_period_milliseconds,
+        cv.Optional(
+            CONF_POST_EVENT, default="10s"
+        ): cv.positive_time_period_milliseconds,
+        # bytes of PSRAM, should hold pre_event plus a few seconds of frames
+        cv.Optional(CONF_BUFFER_SIZE, default=2 * 1024 * 1024): cv.int_range(
+            min=256 * 1024
+        ),
+        cv.Optional(CONF_RECORDING): binary_sensor.binary_sensor_schema(),
+    }
+).extend(cv.COMPONENT_SCHEMA)
+
+
+def validate_task_core(value):
+    if isinstance(value, str) and value.lower() == "any":
+        return "any"
+    return cv.int_range(min=0, max=1)(value)
+
+
+def task_core_expression(core):
+    return cg.RawExpression("tskNO_AFFINITY") if core == "any" else core
+
+
+def task_schema(priority):
+    return cv.Schema(
+        {
+            cv.Optional(CONF_CORE, default="any"): validate_task_core,
+            cv.Optional(CONF_PRIORITY, default=priority): cv.int_range(
+                min=0, max=24
+            ),
+        }
+    )
+
+
+STREAM_SERVER_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(): cv.declare_id(StreamServer),
+        cv.Optional(CONF_PORT, default=8081): cv.port,
+        cv.Optional(CONF_CORE, default="any"): validate_task_core,
+        cv.Optional(CONF_PRIORITY, default=1): cv.int_range(min=0, max=24),
+        cv.Optional(CONF_MAX_CLIENTS, default=4): cv.int_range(min=1, max=6),
+        cv.Optional(
+            CONF_REPORT_INTERVAL, default="60s"
+        ): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_CLIENTS): sensor.sensor_schema(
+            accuracy_decimals=0,
+            state_class=STATE_CLASS_MEASUREMENT,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            icon="mdi:account-multiple",
+        ),
+    }
+).extend(cv.COMPONENT_SCHEMA)
+
+
+TASKS_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_USB, default={}): task_schema(2),
+        cv.Optional(CONF_SAMPLE, default={}): task_schema(0),
+        cv.Optional(CONF_FRAMEBUFFER, default={}): task_schema(2),
+        cv.Optional(CONF_TRANSCODER, default={}): task_schema(1),
+    }
+)
+
+TASK_STATS_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(): cv.declare_id(TaskMonitor),
+    }
+).extend(cv.polling_component_schema("60s"))
+
+RATE_CONTROL_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(): cv.declare_id(RateController),
+        cv.Optional(CONF_MIN_FRAMERATE, default="1 fps"): cv.All(
+            cv.framerate, cv.Range(min=0, min_included=False, max=60)
+        ),
+        cv.Optional(
+            CONF_EVALUATION_INTERVAL, default="5s"
+        ): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_STEP_RESOLUTION, default=True): cv.boolean,
+        cv.Optional(CONF_FRAMERATE): sensor.sensor_schema(
+            unit_of_measurement="fps",
+            accuracy_decimals=1,
+            state_class=STATE_CLASS_MEASUREMENT,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            icon="mdi:speedometer",
+        ),
+    }
+).extend(cv.COMPONENT_SCHEMA)
+
+PROCESSORS_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(): cv.declare_id(FrameProcessorPipeline),
+        cv.Optional(CONF_QUEUE_SIZE, default=1): cv.int_range(min=1, max=4),
+        cv.Optional(CONF_STACK_SIZE, default=4096): cv.int_range(
+            min=2048, max=32768
+        ),
+        # the core the main loop does not run on by default
+        cv.Optional(CONF_CORE): validate_task_core,
+        cv.Optional(CONF_PRIORITY, default=1): cv.int_range(min=0, max=24),
+        cv.Optional(
+            CONF_REPORT_INTERVAL, default="60s"
+        ): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_BRIGHTNESS): sensor.sensor_schema(
+            unit_of_measurement=UNIT_PERCENT,
+            accuracy_decimals=1,
+            state_class=STATE_CLASS_MEASUREMENT,
+            icon="mdi:brightness-6",
+        ).extend(
+            {
+                cv.GenerateID(CONF_PROCESSOR_ID): cv.declare_id(
+                    BrightnessProcessor
+                ),
+            }
+        ),
+    }
+).extend(cv.COMPONENT_SCHEMA)
+
+_LATENCY_SENSOR_SCHEMA = sensor.sensor_schema(
+    unit_of_measurement=UNIT_MILLISECOND,
+    accuracy_decimals=1,
+    state_class=STATE_CLASS_MEASUREMENT,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+)
+_COUNTER_SENSOR_SCHEMA = sensor.sensor_schema(
+    unit_of_measurement="frames",
+    accuracy_decimals=0,
+    state_class=STATE_CLASS_TOTAL_INCREASING,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+)
+
+STATISTICS_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(): cv.declare_id(PipelineMonitor),
+        **{
+            cv.Optional(stage): cv.Schema(
+                {
+                    cv.Optional(CONF_P50): _LATENCY_SENSOR_SCHEMA,
+                    cv.Optional(CONF_P95): _LATENCY_SENSOR_SCHEMA,
+                    cv.Optional(CONF_MAX): _LATENCY_SENSOR_SCHEMA,
+                }
+            )
+            for stage in LATENCY_STAGES
+        },
+        cv.Optional(CONF_DELIVERED_FRAMES): _COUNTER_SENSOR_SCHEMA,
+        cv.Optional(CONF_DROPPED_TOO_SMALL): _COUNTER_SENSOR_SCHEMA,
+        cv.Optional(CONF_DROPPED_BUSY): _COUNTER_SENSOR_SCHEMA,
+        cv.Optional(CONF_OVERSIZE_FRAMES): _COUNTER_SENSOR_SCHEMA,
+        cv.Optional(CONF_DROPPED_CORRUPT): _COUNTER_SENSOR_SCHEMA,
+        cv.Optional(CONF_SKIPPED_UNCHANGED): _COUNTER_SENSOR_SCHEMA,
+        cv.Optional(CONF_THROUGHPUT): sensor.sensor_schema(
+            unit_of_measurement="kB/s",
+            accuracy_decimals=1,
+            state_class=STATE_CLASS_MEASUREMENT,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            icon="mdi:usb",
+        ),
+    }
+).extend(cv.polling_component_schema("30s"))
+
+def validate_bulk_size(value):
+    # whole packets of the full-speed bulk endpoint at most
+    if value % 64 != 0:
+        raise cv.Invalid("must be a multiple of 64 bytes")
+    return value
+
+
+# usb_stream URBs (USB request blocks) queued per transfer type, more and
+# bigger ones ride out longer main task stalls at the cost of internal RAM
+URBS_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_BULK_COUNT, default=3): cv.int_range(min=2, max=8),
+        cv.Optional(CONF_BULK_SIZE, default=6144): cv.All(
+            cv.int_range(min=512, max=32768), validate_bulk_size
+        ),
+        cv.Optional(CONF_ISOC_COUNT, default=3): cv.int_range(min=2, max=8),
+        cv.Optional(CONF_ISOC_PACKETS, default=4): cv.int_range(min=1, max=32),
+    }
+)
+
+CAMERA_SCHEMA = cv.ENTITY_BASE_SCHEMA.extend(
     {
         cv.GenerateID(): cv.declare_id(ESP32Camera),
         # image
@@ -98,9 +655,43 @@ CONFIG_SCHEMA = cv.ENTITY_BASE_SCHEMA.extend(
         cv.Optional(CONF_IDLE_FRAMERATE, default="0.1 fps"): cv.All(
             cv.framerate, cv.Range(min=0, max=1)
         ),
-        cv.Optional(CONF_DROP_FRAME_SIZE, default="7000"): cv.All(
+        # only a fallback for cameras producing frames the validator accepts
+        # but that are still unusable, 0 disables it
+        cv.Optional(CONF_DROP_FRAME_SIZE, default="0"): cv.All(
             cv.int_range(min=0, max=100000)
         ),
+        cv.Optional(CONF_VALIDATE_FRAMES, default=True): cv.boolean,
+        # only used by cameras sending YUY2, NV12 or grayscale frames
+        cv.Optional(CONF_UNCOMPRESSED_OUTPUT, default="jpeg"): cv.enum(
+            UNCOMPRESSED_OUTPUTS, lower=True
+        ),
+        cv.Optional(CONF_JPEG_QUALITY, default=80): cv.int_range(min=1, max=100),
+        # defaults to what the configured consumers need, at least 3
+        cv.Optional(CONF_FRAME_BUFFER_COUNT): cv.int_range(min=2, max=8),
+        cv.Optional(CONF_SUSPEND_WHEN_IDLE, default=True): cv.boolean,
+        cv.Optional(CONF_RESUME_SKIP_FRAMES, default=1): cv.int_range(min=0, max=30),
+        cv.Optional(CONF_TRANSFER_TYPE, default="bulk"): cv.enum(
+            TRANSFER_TYPES, lower=True
+        ),
+        cv.Optional(CONF_URBS, default={}): URBS_SCHEMA,
+        cv.Optional(CONF_THUMBNAIL): THUMBNAIL_SCHEMA,
+        cv.Optional(CONF_ROI): cv.ensure_list(ROI_SCHEMA),
+        cv.Optional(CONF_SKIP_UNCHANGED): SKIP_UNCHANGED_SCHEMA,
+        cv.Optional(CONF_SNAPSHOT_CACHE): SNAPSHOT_CACHE_SCHEMA,
+        cv.Optional(CONF_MOTION): MOTION_SCHEMA,
+        cv.Optional(CONF_RECORDER): RECORDER_SCHEMA,
+        cv.Optional(CONF_STREAM_SERVER): STREAM_SERVER_SCHEMA,
+        cv.Optional(CONF_RATE_CONTROL): RATE_CONTROL_SCHEMA,
+        cv.Optional(CONF_PROCESSORS): PROCESSORS_SCHEMA,
+        cv.Optional(CONF_TASKS, default={}): TASKS_SCHEMA,
+        cv.Optional(CONF_TASK_STATS): TASK_STATS_SCHEMA,
+        cv.Optional(CONF_SYNTHETIC_SOURCE): SYNTHETIC_SOURCE_SCHEMA,
+        cv.Optional(CONF_STATISTICS): STATISTICS_SCHEMA,
+        cv.Optional(CONF_RESOLUTION_SELECT): select.select_schema(
+            ResolutionSelect,
+            entity_category=ENTITY_CATEGORY_CONFIG,
+            icon="mdi:image-size-select-large",
+        ).extend(cv.COMPONENT_SCHEMA),
         cv.Optional(CONF_ON_STREAM_START): automation.validate_automation(
             {
                 cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(
@@ -118,6 +709,13 @@ CONFIG_SCHEMA = cv.ENTITY_BASE_SCHEMA.extend(
     }
 ).extend(cv.COMPONENT_SCHEMA)
 
+CONFIG_SCHEMA = cv.All(
+    CAMERA_SCHEMA,
+    validate_roi_requesters,
+    validate_skip_unchanged,
+    validate_frame_buffer_count,
+)
+
 
 async def to_code(config):
     var = cg.new_Pvariable(config[CONF_ID])
@@ -130,17 +728,78 @@ async def to_code(config):
     else:
         cg.add(var.set_idle_update_interval(1000 / config[CONF_IDLE_FRAMERATE]))
     cg.add(var.set_drop_size(config[CONF_DROP_FRAME_SIZE]))
+    cg.add(var.set_validate_frames(config[CONF_VALIDATE_FRAMES]))
+    cg.add(var.set_uncompressed_output(config[CONF_UNCOMPRESSED_OUTPUT]))
+    cg.add(var.set_jpeg_quality(config[CONF_JPEG_QUALITY]))
+    cg.add(var.set_frame_buffer_count(config[CONF_FRAME_BUFFER_COUNT]))
+    cg.add(var.set_suspend_when_idle(config[CONF_SUSPEND_WHEN_IDLE]))
+    cg.add(var.set_resume_skip_frames(config[CONF_RESUME_SKIP_FRAMES]))
+    cg.add(var.set_transfer_type(config[CONF_TRANSFER_TYPE]))
     cg.add(var.set_frame_size(config[CONF_RESOLUTION]))
+    if CONF_THUMBNAIL in config:
+        conf = config[CONF_THUMBNAIL]
+        cg.add(var.set_thumbnail_scale(conf[CONF_SCALE]))
+        for requester in conf[CONF_REQUESTERS]:
+            cg.add(var.add_thumbnail_requester(requester))
+    for conf in config.get(CONF_ROI, []):
+        for requester in conf[CONF_REQUESTERS]:
+            cg.add(
+                var.set_roi(
+                    requester,
+                    conf[CONF_X],
+                    conf[CONF_Y],
+                    conf[CONF_WIDTH],
+                    conf[CONF_HEIGHT],
+                )
+            )
+    if CONF_SKIP_UNCHANGED in config:
+        conf = config[CONF_SKIP_UNCHANGED]
+        cg.add(
+            var.set_skip_unchanged(conf[CONF_LUMA_THRESHOLD], conf[CONF_KEEPALIVE])
+        )
+        for requester in conf[CONF_REQUESTERS]:
+            # the stream server filters its clients itself
+            if requester != "http":
+                cg.add(var.add_skip_unchanged_requester(requester))
+    if CONF_SNAPSHOT_CACHE in config:
+        cg.add(var.set_snapshot_max_age(config[CONF_SNAPSHOT_CACHE][CONF_MAX_AGE]))
 
     cg.add_define("USE_ESP32_CAMERA")
+    # frames are delivered as soon as they are ready rather than on the next
+    # main loop iteration
+    if require_wake_loop_threadsafe is not None:
+        require_wake_loop_threadsafe()
 
     assert CORE.using_esp_idf
+    # printing descriptors and probe results over the serial console slows
+    # every connect down, only do it when verbose logs would show them anyway
+    verbose = CORE.config.get("logger", {}).get("level") in (
+        "VERBOSE",
+        "VERY_VERBOSE",
+    )
     add_idf_component(
         name="usb_stream",
         repo="https://github.com/ffalsk/esp-iot-solution.git",
         path="components/usb/usb_stream",
         refresh=TimePeriod(days=5),
     )
+    tasks = config[CONF_TASKS]
+    cg.add(
+        var.set_framebuffer_task_core(
+            task_core_expression(tasks[CONF_FRAMEBUFFER][CONF_CORE])
+        )
+    )
+    cg.add(
+        var.set_framebuffer_task_priority(tasks[CONF_FRAMEBUFFER][CONF_PRIORITY])
+    )
+    cg.add(
+        var.set_transcoder_task_core(
+            task_core_expression(tasks[CONF_TRANSCODER][CONF_CORE])
+        )
+    )
+    cg.add(
+        var.set_transcoder_task_priority(tasks[CONF_TRANSCODER][CONF_PRIORITY])
+    )
     # no need in cg.add_library("espressif/esp32-camera", "1.0.0")
     # esp_camera.h and sensor.h are taken from it directly
     for d, v in {
@@ -155,10 +814,9 @@ async def to_code(config):
         # "CONFIG_USB_STREAM_QUICK_START": True,
         "CONFIG_UVC_GET_DEVICE_DESC": True,
         "CONFIG_UVC_GET_CONFIG_DESC": True,
-        "CONFIG_UVC_PRINT_DESC": True,
+        "CONFIG_UVC_PRINT_DESC": verbose,
         # "CONFIG_USB_PRE_ALLOC_CTRL_TRANSFER_URB": True,
-        "CONFIG_USB_PROC_TASK_PRIORITY": 2,
-        # "CONFIG_USB_PROC_TASK_CORE": 1,
+        "CONFIG_USB_PROC_TASK_PRIORITY": tasks[CONF_USB][CONF_PRIORITY],
         "CONFIG_USB_PROC_TASK_STACK_SIZE": 3072,
         "CONFIG_USB_WAITING_AFTER_CONN_MS": 50,
         "CONFIG_USB_ENUM_FAILED_RETRY": True,
@@ -167,22 +825,176 @@ async def to_code(config):
         #
         # UVC Stream Config
         #
-        "CONFIG_SAMPLE_PROC_TASK_PRIORITY": 0,
-        # "CONFIG_SAMPLE_PROC_TASK_CORE": 0,
+        "CONFIG_SAMPLE_PROC_TASK_PRIORITY": tasks[CONF_SAMPLE][CONF_PRIORITY],
         "CONFIG_UVC_CHECK_HEADER_EOH": True,
         "CONFIG_UVC_CHECK_HEADER_EOF": True,
         "CONFIG_SAMPLE_PROC_TASK_STACK_SIZE": 3072,
-        "CONFIG_UVC_PRINT_PROBE_RESULT": True,
+        "CONFIG_UVC_PRINT_PROBE_RESULT": verbose,
         "CONFIG_UVC_CHECK_BULK_JPEG_HEADER": True,
         "CONFIG_UVC_DROP_OVERFLOW_FRAME": False,
         "CONFIG_UVC_DROP_NO_EOF_FRAME": False,
-        "CONFIG_NUM_BULK_STREAM_URBS": 3,
-        "CONFIG_NUM_BULK_BYTES_PER_URB": 6144,
-        "CONFIG_NUM_ISOC_UVC_URBS": 3,
-        "CONFIG_NUM_PACKETS_PER_URB": 4,
+        "CONFIG_NUM_BULK_STREAM_URBS": config[CONF_URBS][CONF_BULK_COUNT],
+        "CONFIG_NUM_BULK_BYTES_PER_URB": config[CONF_URBS][CONF_BULK_SIZE],
+        "CONFIG_NUM_ISOC_UVC_URBS": config[CONF_URBS][CONF_ISOC_COUNT],
+        "CONFIG_NUM_PACKETS_PER_URB": config[CONF_URBS][CONF_ISOC_PACKETS],
         # end of UVC Stream Config
     }.items():
         add_idf_sdkconfig_option(d, v)
+    # left unset the usb_stream tasks are not pinned
+    if tasks[CONF_USB][CONF_CORE] != "any":
+        add_idf_sdkconfig_option(
+            "CONFIG_USB_PROC_TASK_CORE", tasks[CONF_USB][CONF_CORE]
+        )
+    if tasks[CONF_SAMPLE][CONF_CORE] != "any":
+        add_idf_sdkconfig_option(
+            "CONFIG_SAMPLE_PROC_TASK_CORE", tasks[CONF_SAMPLE][CONF_CORE]
+        )
+
+    if CONF_SYNTHETIC_SOURCE in config:
+        conf = config[CONF_SYNTHETIC_SOURCE]
+        src = cg.new_Pvariable(conf[CONF_ID], var)
+        await cg.register_component(src, conf)
+        raw = b"".join(f["data"] for f in conf[CONF_FILES])
+        prog_arr = cg.progmem_array(conf[CONF_RAW_DATA_ID], list(raw))
+        offset = 0
+        for f in conf[CONF_FILES]:
+            cg.add(
+                src.add_frame(
+                    prog_arr, offset, len(f["data"]), f["width"], f["height"]
+                )
+            )
+            offset += len(f["data"])
+        cg.add(src.set_frame_interval(int(1000000 / conf[CONF_FRAMERATE])))
+        cg.add(src.set_jitter(conf[CONF_JITTER]))
+        cg.add(src.set_report_interval(conf[CONF_REPORT_INTERVAL]))
+        cg.add(src.set_drive_stream(conf[CONF_DRIVE_STREAM]))
+        cg.add_define("USE_USB_WEBCAM_SYNTHETIC")
+
+    if CONF_MOTION in config:
+        conf = config[CONF_MOTION]
+        motion = cg.new_Pvariable(conf[CONF_ID])
+        await cg.register_component(motion, conf)
+        cg.add(motion.set_analysis_interval(conf[CONF_ANALYSIS_INTERVAL]))
+        cg.add(motion.set_luma_threshold(conf[CONF_LUMA_THRESHOLD]))
+        cg.add(motion.set_area_threshold(conf[CONF_AREA_THRESHOLD]))
+        cg.add(motion.set_hold_time(conf[CONF_HOLD_TIME]))
+        for requester in conf[CONF_GATED_REQUESTERS]:
+            cg.add(motion.add_gated_requester(requester))
+        if CONF_MOTION_DETECTED in conf:
+            sens = await binary_sensor.new_binary_sensor(conf[CONF_MOTION_DETECTED])
+            cg.add(motion.set_motion_binary_sensor(sens))
+        if CONF_MOTION_SCORE in conf:
+            sens = await sensor.new_sensor(conf[CONF_MOTION_SCORE])
+            cg.add(motion.set_score_sensor(sens))
+        cg.add_define("USE_USB_WEBCAM_MOTION")
+
+    if CONF_RECORDER in config:
+        conf = config[CONF_RECORDER]
+        recorder = cg.new_Pvariable(conf[CONF_ID])
+        await cg.register_component(recorder, conf)
+        cg.add(recorder.set_path(conf[CONF_PATH]))
+        cg.add(recorder.set_pre_event(conf[CONF_PRE_EVENT]))
+        cg.add(recorder.set_post_event(conf[CONF_POST_EVENT]))
+        cg.add(recorder.set_buffer_size(conf[CONF_BUFFER_SIZE]))
+        if CONF_RECORDING in conf:
+            sens = await binary_sensor.new_binary_sensor(conf[CONF_RECORDING])
+            cg.add(recorder.set_recording_binary_sensor(sens))
+        cg.add_define("USE_USB_WEBCAM_RECORDER")
+
+    if CONF_STREAM_SERVER in config:
+        conf = config[CONF_STREAM_SERVER]
+        server = cg.new_Pvariable(conf[CONF_ID], var)
+        await cg.register_component(server, conf)
+        cg.add(server.set_port(conf[CONF_PORT]))
+        cg.add(server.set_max_clients(conf[CONF_MAX_CLIENTS]))
+        cg.add(server.set_report_interval(conf[CONF_REPORT_INTERVAL]))
+        cg.add(server.set_task_core(task_core_expression(conf[CONF_CORE])))
+        cg.add(server.set_task_priority(conf[CONF_PRIORITY]))
+        skip = config.get(CONF_SKIP_UNCHANGED, {})
+        if "http" in skip.get(CONF_REQUESTERS, []):
+            cg.add(
+                server.set_skip_unchanged(
+                    skip[CONF_LUMA_THRESHOLD], skip[CONF_KEEPALIVE]
+                )
+            )
+        if CONF_CLIENTS in conf:
+            sens = await sensor.new_sensor(conf[CONF_CLIENTS])
+            cg.add(server.set_clients_sensor(sens))
+
+    if CONF_RATE_CONTROL in config:
+        conf = config[CONF_RATE_CONTROL]
+        rate = cg.new_Pvariable(conf[CONF_ID], var)
+        await cg.register_component(rate, conf)
+        cg.add(rate.set_min_framerate(conf[CONF_MIN_FRAMERATE]))
+        cg.add(rate.set_evaluation_interval(conf[CONF_EVALUATION_INTERVAL]))
+        cg.add(rate.set_step_resolution(conf[CONF_STEP_RESOLUTION]))
+        if CONF_FRAMERATE in conf:
+            sens = await sensor.new_sensor(conf[CONF_FRAMERATE])
+            cg.add(rate.set_framerate_sensor(sens))
+        cg.add_define("USE_USB_WEBCAM_RATE_CONTROL")
+
+    if CONF_PROCESSORS in config:
+        conf = config[CONF_PROCESSORS]
+        pipeline = cg.new_Pvariable(conf[CONF_ID], var)
+        await cg.register_component(pipeline, conf)
+        cg.add(pipeline.set_queue_size(conf[CONF_QUEUE_SIZE]))
+        cg.add(pipeline.set_stack_size(conf[CONF_STACK_SIZE]))
+        cg.add(pipeline.set_report_interval(conf[CONF_REPORT_INTERVAL]))
+        if CONF_CORE in conf:
+            cg.add(pipeline.set_task_core(task_core_expression(conf[CONF_CORE])))
+        cg.add(pipeline.set_task_priority(conf[CONF_PRIORITY]))
+        if CONF_BRIGHTNESS in conf:
+            bconf = conf[CONF_BRIGHTNESS]
+            brightness = cg.new_Pvariable(bconf[CONF_PROCESSOR_ID])
+            await cg.register_component(brightness, {})
+            sens = await sensor.new_sensor(bconf)
+            cg.add(brightness.set_brightness_sensor(sens))
+            cg.add(pipeline.add_processor(brightness))
+        cg.add_define("USE_USB_WEBCAM_PROCESSORS")
+
+    if CONF_TASK_STATS in config:
+        conf = config[CONF_TASK_STATS]
+        monitor = cg.new_Pvariable(conf[CONF_ID])
+        await cg.register_component(monitor, conf)
+        cg.add_define("USE_USB_WEBCAM_TASK_STATS")
+        for d in (
+            "CONFIG_FREERTOS_USE_TRACE_FACILITY",
+            "CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS",
+            "CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID",
+        ):
+            add_idf_sdkconfig_option(d, True)
+
+    if CONF_RESOLUTION_SELECT in config:
+        conf = config[CONF_RESOLUTION_SELECT]
+        sel = await select.new_select(conf, options=[])
+        await cg.register_component(sel, conf)
+        await cg.register_parented(sel, var)
+
+    if CONF_STATISTICS in config:
+        conf = config[CONF_STATISTICS]
+        monitor = cg.new_Pvariable(conf[CONF_ID])
+        await cg.register_component(monitor, conf)
+        for stage, stage_enum in LATENCY_STAGES.items():
+            if stage not in conf:
+                continue
+            sensors = []
+            for key in (CONF_P50, CONF_P95, CONF_MAX):
+                if key in conf[stage]:
+                    sensors.append(await sensor.new_sensor(conf[stage][key]))
+                else:
+                    sensors.append(cg.nullptr)
+            cg.add(monitor.set_latency_sensors(stage_enum, *sensors))
+        for key, setter in (
+            (CONF_DELIVERED_FRAMES, monitor.set_delivered_sensor),
+            (CONF_DROPPED_TOO_SMALL, monitor.set_dropped_too_small_sensor),
+            (CONF_DROPPED_BUSY, monitor.set_dropped_busy_sensor),
+            (CONF_OVERSIZE_FRAMES, monitor.set_oversize_sensor),
+            (CONF_DROPPED_CORRUPT, monitor.set_dropped_corrupt_sensor),
+            (CONF_SKIPPED_UNCHANGED, monitor.set_skipped_unchanged_sensor),
+            (CONF_THROUGHPUT, monitor.set_throughput_sensor),
+        ):
+            if key in conf:
+                cg.add(setter(await sensor.new_sensor(conf[key])))
 
     for conf in config.get(CONF_ON_STREAM_START, []):
         trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
@@ -191,3 +1003,39 @@ async def to_code(config):
     for conf in config.get(CONF_ON_STREAM_STOP, []):
         trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
         await automation.build_automation(trigger, [], conf)
+
+
+@automation.register_action(
+    "usb_webcam.set_resolution",
+    SetResolutionAction,
+    cv.Schema(
+        {
+            cv.GenerateID(): cv.use_id(ESP32Camera),
+            cv.Required(CONF_WIDTH): cv.templatable(cv.int_range(min=1, max=65535)),
+            cv.Required(CONF_HEIGHT): cv.templatable(cv.int_range(min=1, max=65535)),
+        }
+    ),
+)
+async def set_resolution_to_code(config, action_id, template_arg, args):
+    var = cg.new_Pvariable(action_id, template_arg)
+    await cg.register_parented(var, config[CONF_ID])
+    width = await cg.templatable(config[CONF_WIDTH], args, cg.uint16)
+    cg.add(var.set_width(width))
+    height = await cg.templatable(config[CONF_HEIGHT], args, cg.uint16)
+    cg.add(var.set_height(height))
+    return var
+
+
+@automation.register_action(
+    "usb_webcam.record",
+    RecordAction,
+    cv.Schema(
+        {
+            cv.GenerateID(): cv.use_id(FrameRecorder),
+        }
+    ),
+)
+async def record_to_code(config, action_id, template_arg, args):
+    var = cg.new_Pvariable(action_id, template_arg)
+    await cg.register_parented(var, config[CONF_ID])
+    return var
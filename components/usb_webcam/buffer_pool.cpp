@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Reusable PSRAM blocks for the USB transfer buffers and frame slots
+
+#ifdef USE_ESP32
+
+#include "buffer_pool.h"
+
+#include "esphome/core/log.h"
+
+#include <esp_heap_caps.h>
+
+namespace esphome {
+namespace esp32_camera {
+
+static const char *const TAG = "usb_webcam.pool";
+
+uint8_t *BufferPool::acquire(size_t size) {
+  size = round_up(size);
+  for (size_t i = 0; i < this->cached_count_; i++) {
+    if (this->cached_[i].size != size)
+      continue;
+    uint8_t *buf = this->cached_[i].buf;
+    this->cached_[i] = this->cached_[--this->cached_count_];
+    this->in_use_ += size;
+    return buf;
+  }
+  uint8_t *buf =
+      (uint8_t *)heap_caps_malloc_prefer(size, 2, MALLOC_CAP_SPIRAM, 0);
+  if (buf == nullptr && this->cached_count_ != 0) {
+    // blocks of other sizes may be in the way, return them and try again
+    ESP_LOGD(TAG, "No room for %u bytes, trimming", size);
+    this->trim();
+    buf = (uint8_t *)heap_caps_malloc_prefer(size, 2, MALLOC_CAP_SPIRAM, 0);
+  }
+  if (buf != nullptr)
+    this->in_use_ += size;
+  return buf;
+}
+
+void BufferPool::release(uint8_t *buf, size_t size) {
+  if (buf == nullptr)
+    return;
+  size = round_up(size);
+  this->in_use_ -= size;
+  if (this->cached_count_ == MAX_CACHED) {
+    heap_caps_free(buf);
+    return;
+  }
+  this->cached_[this->cached_count_++] = Block{buf, size};
+}
+
+void BufferPool::trim() {
+  for (size_t i = 0; i < this->cached_count_; i++)
+    heap_caps_free(this->cached_[i].buf);
+  this->cached_count_ = 0;
+}
+
+size_t BufferPool::get_cached() const {
+  size_t total = 0;
+  for (size_t i = 0; i < this->cached_count_; i++)
+    total += this->cached_[i].size;
+  return total;
+}
+
+BufferPool
+    global_buffer_pool; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Reusable PSRAM blocks for the USB transfer buffers and frame slots
+
+#pragma once
+
+#ifdef USE_ESP32
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace esp32_camera {
+
+/* ---------------- BufferPool class ---------------- */
+// Hands out PSRAM blocks rounded up to whole granules. Released blocks are
+// cached and handed out again for the same rounded size, so restarting the
+// stream or switching back to an earlier resolution reuses memory instead of
+// punching differently sized holes into PSRAM. Main loop only.
+class BufferPool {
+public:
+  static const size_t GRANULE = 16 * 1024;
+  static size_t round_up(size_t size) {
+    return (size + GRANULE - 1) / GRANULE * GRANULE;
+  }
+
+  // block of exactly round_up(size) bytes, nullptr when out of memory
+  uint8_t *acquire(size_t size);
+  void release(uint8_t *buf, size_t size);
+  // gives all cached blocks back to the heap
+  void trim();
+
+  size_t get_in_use() const { return this->in_use_; }
+  size_t get_cached() const;
+
+protected:
+  static const size_t MAX_CACHED = 8;
+  struct Block {
+    uint8_t *buf;
+    size_t size;
+  };
+
+  Block cached_[MAX_CACHED];
+  size_t cached_count_{0};
+  size_t in_use_{0};
+};
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+extern BufferPool global_buffer_pool;
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Frame analysis plugins run on a worker task off the main loop
+
+#ifdef USE_ESP32
+
+#include "frame_processor.h"
+
+#include "esphome/core/log.h"
+#include "task_monitor.h"
+
+#include <algorithm>
+#include <esp_timer.h>
+
+namespace esphome {
+namespace esp32_camera {
+
+static const char *const TAG = "usb_webcam.processor";
+
+/* ---------------- constructors ---------------- */
+FrameProcessorPipeline::FrameProcessorPipeline(ESP32Camera *camera)
+    : camera_(camera) {
+  global_frame_processors = this;
+}
+
+/* ---------------- public API (derivated) ---------------- */
+void FrameProcessorPipeline::setup() {
+  this->ring_ = this->camera_->get_frame_ring();
+  this->queue_ = xQueueCreate(this->queue_size_, sizeof(camera_fb_t *));
+  if (this->queue_ == nullptr) {
+    ESP_LOGE(TAG, "Could not allocate the frame queue");
+    this->mark_failed();
+    return;
+  }
+  if (this->core_ == CORE_AUTO) {
+#if CONFIG_FREERTOS_UNICORE
+    this->core_ = tskNO_AFFINITY;
+#else
+    // setup() runs on the main loop task, take the other core
+    this->core_ = 1 - xPortGetCoreID();
+#endif
+  }
+  xTaskCreatePinnedToCore(&FrameProcessorPipeline::worker_task,
+                          "processor_tsk",   // name
+                          this->stack_size_, // stack size
+                          this,              // task pv params
+                          this->priority_,   // priority
+                          nullptr,           // handle
+                          this->core_        // core
+  );
+  this->set_interval("report", this->report_interval_ms_,
+                     [this]() { this->report_(); });
+}
+
+void FrameProcessorPipeline::dump_config() {
+  ESP_LOGCONFIG(TAG, "USB WebCamera frame processors:");
+  ESP_LOGCONFIG(TAG, "  Queue size: %u", this->queue_size_);
+  ESP_LOGCONFIG(TAG, "  Stack size: %u", this->stack_size_);
+  ESP_LOGCONFIG(TAG, "  Task: core %s, priority %u",
+                task_core_name(this->core_), this->priority_);
+  ESP_LOGCONFIG(TAG, "  Report interval: %u ms", this->report_interval_ms_);
+  const uint8_t count = this->processor_count_.load();
+  for (size_t i = 0; i < count; i++)
+    ESP_LOGCONFIG(TAG, "  Processor: %s",
+                  this->processors_[i]->get_processor_name());
+  // queued frames and the one processed hold slots, the pipeline needs two
+  if (this->ring_ != nullptr &&
+      this->ring_->slot_count() < this->queue_size_ + 3u)
+    ESP_LOGW(TAG, "  frame_buffer_count below queue_size + 3, processors "
+                  "can make the pipeline drop frames");
+  if (this->is_failed())
+    ESP_LOGE(TAG, "  Setup failed");
+}
+
+/* ---------------- public API (specific) ---------------- */
+void FrameProcessorPipeline::add_processor(FrameProcessor *processor) {
+  const uint8_t count = this->processor_count_.load();
+  if (count == FRAME_PROCESSOR_MAX_PROCESSORS) {
+    ESP_LOGE(TAG, "Cannot add processor %s, %u at most",
+             processor->get_processor_name(), FRAME_PROCESSOR_MAX_PROCESSORS);
+    return;
+  }
+  // the worker only looks at processors below the count
+  this->processors_[count] = processor;
+  this->processor_count_.store(count + 1);
+}
+
+void FrameProcessorPipeline::offer(camera_fb_t *fb) {
+  if (this->queue_ == nullptr || this->processor_count_.load() == 0)
+    return;
+  this->offered_++;
+  this->ring_->retain(fb);
+  if (xQueueSend(this->queue_, &fb, 0) != pdTRUE) {
+    // the processors are still busy, streaming never waits for them
+    this->ring_->release(fb);
+    this->dropped_++;
+  }
+}
+
+/* ---------------- worker task ---------------- */
+void FrameProcessorPipeline::worker_task(void *pv) {
+  FrameProcessorPipeline *pipeline = (FrameProcessorPipeline *)pv;
+  camera_fb_t *fb;
+  while (true) {
+    if (xQueueReceive(pipeline->queue_, &fb, portMAX_DELAY) != pdTRUE)
+      continue;
+    pipeline->process_(fb);
+    pipeline->ring_->release(fb);
+  }
+}
+
+void FrameProcessorPipeline::process_(camera_fb_t *fb) {
+  const uint8_t count = this->processor_count_.load();
+  for (size_t i = 0; i < count; i++) {
+    const int64_t start_us = esp_timer_get_time();
+    this->processors_[i]->process(fb);
+    const uint32_t elapsed_us = esp_timer_get_time() - start_us;
+    ProcessorStats &stats = this->stats_[i];
+    stats.frames++;
+    stats.busy_us += elapsed_us;
+    // only this task raises it, loop() resets it
+    if (elapsed_us > stats.max_us.load())
+      stats.max_us.store(elapsed_us);
+  }
+}
+
+/* ---------------- reporting ---------------- */
+void FrameProcessorPipeline::report_() {
+  const uint32_t offered = this->offered_.load();
+  const uint32_t dropped = this->dropped_.load();
+  if (offered == this->last_offered_)
+    return;
+  ESP_LOGD(TAG, "%u frames offered, %u dropped while busy",
+           offered - this->last_offered_, dropped - this->last_dropped_);
+  this->last_offered_ = offered;
+  this->last_dropped_ = dropped;
+
+  const uint8_t count = this->processor_count_.load();
+  for (size_t i = 0; i < count; i++) {
+    ProcessorStats &stats = this->stats_[i];
+    const uint32_t frames = stats.frames.load() - this->last_frames_[i];
+    const uint32_t busy_us = stats.busy_us.load() - this->last_busy_us_[i];
+    this->last_frames_[i] += frames;
+    this->last_busy_us_[i] += busy_us;
+    const uint32_t max_us = stats.max_us.exchange(0);
+    if (frames == 0)
+      continue;
+    ESP_LOGD(TAG, "  %s: %u frames, %.1f ms average, %.1f ms max, %.1f%% busy",
+             this->processors_[i]->get_processor_name(), frames,
+             busy_us / 1000.0f / frames, max_us / 1000.0f,
+             busy_us / 10.0f / this->report_interval_ms_);
+  }
+}
+
+FrameProcessorPipeline *global_frame_processors =
+    nullptr; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+/* ---------------- BrightnessProcessor class ---------------- */
+BrightnessProcessor::BrightnessProcessor() {
+  this->decoder_.set_block_size(1);
+}
+
+void BrightnessProcessor::loop() {
+  const uint32_t measured = this->measured_.load();
+  if (measured == this->last_measured_)
+    return;
+  this->last_measured_ = measured;
+#ifdef USE_SENSOR
+  if (this->brightness_sensor_ != nullptr)
+    this->brightness_sensor_->publish_state(this->brightness_.load());
+#endif
+}
+
+void BrightnessProcessor::dump_config() {
+  ESP_LOGCONFIG(TAG, "USB WebCamera brightness processor:");
+#ifdef USE_SENSOR
+  LOG_SENSOR("  ", "Brightness", this->brightness_sensor_);
+#endif
+}
+
+void BrightnessProcessor::process(const camera_fb_t *fb) {
+  if (fb->format != PIXFORMAT_JPEG ||
+      this->decoder_.begin(fb->buf, fb->len) != JPEG_OK)
+    return;
+  const JpegDecoder &decoder = this->decoder_;
+  const size_t mcus = decoder.get_mcus_x() * decoder.get_mcus_y();
+  const uint8_t count = decoder.get_component_count();
+  int64_t sum = 0;
+  size_t blocks = 0;
+  for (size_t mcu = 0; mcu < mcus; mcu++) {
+    if (!this->decoder_.begin_mcu())
+      return;
+    for (size_t c = 0; c < count; c++) {
+      const JpegComponent &component = decoder.get_component(c);
+      for (size_t block = 0; block < component.h * component.v; block++) {
+        int32_t dc;
+        if (!this->decoder_.decode_block(c, &dc))
+          return;
+        if (c == 0) {
+          sum += dc;
+          blocks++;
+        }
+      }
+    }
+  }
+  if (!this->decoder_.end() || blocks == 0)
+    return;
+  // DC is 8 times the block mean less 128
+  const float luma = sum / 8.0f / blocks + 128;
+  this->brightness_ = std::min(std::max(luma, 0.0f), 255.0f) * 100 / 255;
+  this->measured_++;
+}
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
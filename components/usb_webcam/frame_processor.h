@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Frame analysis plugins run on a worker task off the main loop
+
+#pragma once
+
+#ifdef USE_ESP32
+
+#include "../esp32_camera/esp32_camera.h"
+#include "esphome/core/component.h"
+#include "esphome/core/defines.h"
+#include "frame_ring.h"
+#include "jpeg_codec.h"
+
+#ifdef USE_SENSOR
+#include "esphome/components/sensor/sensor.h"
+#endif
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include <atomic>
+
+namespace esphome {
+namespace esp32_camera {
+
+static const uint8_t FRAME_PROCESSOR_MAX_PROCESSORS = 8;
+
+/* ---------------- FrameProcessor class ---------------- */
+// Interface of analysis plugins. process() runs on the worker task with the
+// frame still in its ring slot: it must not write to it or keep the pointer,
+// and it must hand results to loop() through atomics like the built-in
+// components do.
+class FrameProcessor {
+public:
+  virtual ~FrameProcessor() = default;
+  virtual const char *get_processor_name() const = 0;
+  // a complete frame, JPEG or whatever uncompressed_output delivers
+  virtual void process(const camera_fb_t *fb) = 0;
+};
+
+/* ---------------- FrameProcessorPipeline class ---------------- */
+// The framebuffer task offers every frame by taking a reference on its ring
+// slot and putting it in a bounded queue without waiting: when the queue is
+// full the frame is dropped for the processors only. A worker task pinned to
+// the core the main loop does not run on runs every processor on it in turn
+// and releases the slot. Processing time is measured per processor and logged
+// from loop().
+class FrameProcessorPipeline : public Component {
+public:
+  explicit FrameProcessorPipeline(ESP32Camera *camera);
+
+  /* setters */
+  void set_queue_size(uint8_t queue_size) { this->queue_size_ = queue_size; }
+  void set_stack_size(uint32_t stack_size) { this->stack_size_ = stack_size; }
+  // without a core the worker takes the one the main loop does not run on
+  void set_task_core(BaseType_t core) { this->core_ = core; }
+  void set_task_priority(uint8_t priority) { this->priority_ = priority; }
+  void set_report_interval(uint32_t report_interval_ms) {
+    this->report_interval_ms_ = report_interval_ms;
+  }
+  // processors added after setup() take part from the next frame on
+  void add_processor(FrameProcessor *processor);
+
+  /* public API (derivated) */
+  void setup() override;
+  void dump_config() override;
+  /* public API (specific) */
+  // called from the framebuffer task, never blocks
+  void offer(camera_fb_t *fb);
+
+protected:
+  static const BaseType_t CORE_AUTO = -1;
+
+  struct ProcessorStats {
+    std::atomic<uint32_t> frames{0};
+    std::atomic<uint32_t> busy_us{0};
+    std::atomic<uint32_t> max_us{0};
+  };
+
+  static void worker_task(void *pv);
+  void process_(camera_fb_t *fb);
+  void report_();
+
+  ESP32Camera *camera_;
+  FrameRing *ring_{nullptr};
+  uint8_t queue_size_{1};
+  uint32_t stack_size_{4096};
+  uint32_t report_interval_ms_{60000};
+  FrameProcessor *processors_[FRAME_PROCESSOR_MAX_PROCESSORS]{};
+  std::atomic<uint8_t> processor_count_{0};
+  QueueHandle_t queue_{nullptr};
+  BaseType_t core_{CORE_AUTO};
+  uint8_t priority_{1};
+
+  /* shared with loop() */
+  std::atomic<uint32_t> offered_{0};
+  std::atomic<uint32_t> dropped_{0};
+  ProcessorStats stats_[FRAME_PROCESSOR_MAX_PROCESSORS];
+
+  /* loop() only, stats of the previous report */
+  uint32_t last_offered_{0};
+  uint32_t last_dropped_{0};
+  uint32_t last_frames_[FRAME_PROCESSOR_MAX_PROCESSORS]{};
+  uint32_t last_busy_us_[FRAME_PROCESSOR_MAX_PROCESSORS]{};
+};
+
+/* ---------------- BrightnessProcessor class ---------------- */
+// Mean luma of JPEG frames from the DC coefficients alone, a light meter for
+// automations that costs the main loop nothing.
+class BrightnessProcessor : public FrameProcessor, public Component {
+public:
+  BrightnessProcessor();
+
+#ifdef USE_SENSOR
+  void set_brightness_sensor(sensor::Sensor *sensor) {
+    this->brightness_sensor_ = sensor;
+  }
+#endif
+
+  /* public API (derivated) */
+  void loop() override;
+  void dump_config() override;
+  const char *get_processor_name() const override { return "brightness"; }
+  void process(const camera_fb_t *fb) override;
+
+protected:
+#ifdef USE_SENSOR
+  sensor::Sensor *brightness_sensor_{nullptr};
+#endif
+
+  /* worker task only */
+  JpegDecoder decoder_;
+
+  /* shared with loop() */
+  std::atomic<float> brightness_{0};
+  std::atomic<uint32_t> measured_{0};
+
+  /* loop() only */
+  uint32_t last_measured_{0};
+};
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+extern FrameProcessorPipeline *global_frame_processors;
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
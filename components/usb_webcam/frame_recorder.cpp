@@ -0,0 +1,442 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Pre-event recording of MJPEG frames into AVI clips
+
+#ifdef USE_ESP32
+
+#include "frame_recorder.h"
+
+#include "esphome/core/log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <sys/stat.h>
+
+namespace esphome {
+namespace esp32_camera {
+
+static const char *const TAG = "usb_webcam.recorder";
+// file writes go out in blocks of this size, aligned to the file start
+static const size_t WRITE_BLOCK_SIZE = 16 * 1024;
+// frames bigger than this part of the ring are not kept
+static const size_t MAX_FRAME_SHARE = 4;
+static const uint32_t MAX_CLIP_NUMBER = 9999;
+// RIFF + hdrl list + movi list header
+static const size_t AVI_HEADER_SIZE = 224;
+static const size_t AVI_MOVI_OFFSET = AVI_HEADER_SIZE - 4;
+
+static uint32_t now_ms() { return esp_timer_get_time() / 1000; }
+static size_t align4(size_t len) { return (len + 3) & ~(size_t)3; }
+
+/* ---------------- AVI helpers ---------------- */
+static uint8_t *put_u16(uint8_t *out, uint16_t value) {
+  out[0] = value;
+  out[1] = value >> 8;
+  return out + 2;
+}
+static uint8_t *put_u32(uint8_t *out, uint32_t value) {
+  out = put_u16(out, value);
+  return put_u16(out, value >> 16);
+}
+static uint8_t *put_fourcc(uint8_t *out, const char *fourcc) {
+  memcpy(out, fourcc, 4);
+  return out + 4;
+}
+
+// MJPEG AVI header for a single video stream, the movi list follows it
+static void build_avi_header(uint8_t *out, uint32_t riff_size,
+                             uint32_t movi_size, uint32_t frames,
+                             uint32_t us_per_frame, uint16_t width,
+                             uint16_t height, uint32_t max_frame) {
+  out = put_fourcc(out, "RIFF");
+  out = put_u32(out, riff_size);
+  out = put_fourcc(out, "AVI ");
+  out = put_fourcc(out, "LIST");
+  out = put_u32(out, 192);
+  out = put_fourcc(out, "hdrl");
+  out = put_fourcc(out, "avih");
+  out = put_u32(out, 56);
+  out = put_u32(out, us_per_frame);
+  out = put_u32(out, us_per_frame != 0
+                         ? (uint64_t)max_frame * 1000000 / us_per_frame
+                         : 0);          // max bytes per second
+  out = put_u32(out, 0);                // padding granularity
+  out = put_u32(out, 0x10);             // AVIF_HASINDEX
+  out = put_u32(out, frames);           // total frames
+  out = put_u32(out, 0);                // initial frames
+  out = put_u32(out, 1);                // streams
+  out = put_u32(out, max_frame);        // suggested buffer size
+  out = put_u32(out, width);
+  out = put_u32(out, height);
+  for (size_t i = 0; i < 4; i++)
+    out = put_u32(out, 0);
+  out = put_fourcc(out, "LIST");
+  out = put_u32(out, 116);
+  out = put_fourcc(out, "strl");
+  out = put_fourcc(out, "strh");
+  out = put_u32(out, 56);
+  out = put_fourcc(out, "vids");
+  out = put_fourcc(out, "MJPG");
+  out = put_u32(out, 0);                // flags
+  out = put_u32(out, 0);                // priority, language
+  out = put_u32(out, 0);                // initial frames
+  out = put_u32(out, us_per_frame);     // scale
+  out = put_u32(out, 1000000);          // rate
+  out = put_u32(out, 0);                // start
+  out = put_u32(out, frames);           // length
+  out = put_u32(out, max_frame);        // suggested buffer size
+  out = put_u32(out, UINT32_MAX);       // quality
+  out = put_u32(out, 0);                // sample size
+  out = put_u16(out, 0);
+  out = put_u16(out, 0);
+  out = put_u16(out, width);
+  out = put_u16(out, height);
+  out = put_fourcc(out, "strf");
+  out = put_u32(out, 40);
+  out = put_u32(out, 40);               // BITMAPINFOHEADER size
+  out = put_u32(out, width);
+  out = put_u32(out, height);
+  out = put_u16(out, 1);                // planes
+  out = put_u16(out, 24);               // bit count
+  out = put_fourcc(out, "MJPG");
+  out = put_u32(out, (uint32_t)width * height * 3);
+  for (size_t i = 0; i < 4; i++)
+    out = put_u32(out, 0);
+  out = put_fourcc(out, "LIST");
+  out = put_u32(out, movi_size);
+  put_fourcc(out, "movi");
+}
+
+/* ---------------- constructors ---------------- */
+FrameRecorder::FrameRecorder() { global_frame_recorder = this; }
+
+/* ---------------- public API (derivated) ---------------- */
+void FrameRecorder::setup() {
+  this->buffer_ = (uint8_t *)heap_caps_malloc(this->buffer_size_ & ~(size_t)3,
+                                              MALLOC_CAP_SPIRAM);
+  // DMA capable so SD card writes need no bounce buffer
+  this->block_ = (uint8_t *)heap_caps_malloc(WRITE_BLOCK_SIZE,
+                                             MALLOC_CAP_DMA);
+  this->lock_ = xSemaphoreCreateMutex();
+  if (this->buffer_ == nullptr || this->block_ == nullptr ||
+      this->lock_ == nullptr) {
+    ESP_LOGE(TAG, "Could not allocate the recording buffers");
+    this->mark_failed();
+    return;
+  }
+  this->buffer_size_ &= ~(size_t)3;
+  xTaskCreate(&FrameRecorder::writer_task,
+              "recorder_tsk", // name
+              4096,           // stack size, room for VFS and FATFS
+              this,           // task pv params
+              1,              // priority
+              &this->writer_task_ // handle
+  );
+#ifdef USE_BINARY_SENSOR
+  if (this->recording_binary_sensor_ != nullptr)
+    this->recording_binary_sensor_->publish_initial_state(false);
+#endif
+}
+
+void FrameRecorder::loop() {
+  const bool recording = this->recording_;
+  if (recording != this->published_recording_) {
+#ifdef USE_BINARY_SENSOR
+    if (this->recording_binary_sensor_ != nullptr)
+      this->recording_binary_sensor_->publish_state(recording);
+#endif
+    this->published_recording_ = recording;
+  }
+
+  const uint32_t clips = this->clips_.load();
+  if (clips == this->last_clips_)
+    return;
+  this->last_clips_ = clips;
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  const std::string name = this->last_clip_name_;
+  const uint32_t frames = this->last_clip_frames_;
+  const bool failed = this->last_clip_failed_;
+  xSemaphoreGive(this->lock_);
+  if (failed) {
+    ESP_LOGW(TAG, "Could not write %s", name.c_str());
+    return;
+  }
+  ESP_LOGI(TAG, "Recorded %s: %u frames, %u dropped so far", name.c_str(),
+           frames, this->dropped_.load());
+}
+
+void FrameRecorder::dump_config() {
+  ESP_LOGCONFIG(TAG, "USB WebCamera recorder:");
+  ESP_LOGCONFIG(TAG, "  Path: %s_NNNN.avi", this->path_.c_str());
+  ESP_LOGCONFIG(TAG, "  Pre-event: %u ms", this->pre_event_ms_);
+  ESP_LOGCONFIG(TAG, "  Post-event: %u ms", this->post_event_ms_);
+  ESP_LOGCONFIG(TAG, "  Buffer size: %u bytes", this->buffer_size_);
+#ifdef USE_BINARY_SENSOR
+  LOG_BINARY_SENSOR("  ", "Recording", this->recording_binary_sensor_);
+#endif
+  if (this->is_failed())
+    ESP_LOGE(TAG, "  Setup failed");
+}
+
+/* ---------------- public API (specific) ---------------- */
+void FrameRecorder::add_frame(const camera_fb_t *fb) {
+  if (this->buffer_ == nullptr || fb->format != PIXFORMAT_JPEG)
+    return;
+  const size_t size = sizeof(Record) + align4(fb->len);
+  if (size > this->buffer_size_ / MAX_FRAME_SHARE) {
+    this->dropped_++;
+    return;
+  }
+  const uint32_t time_ms =
+      fb->timestamp.tv_sec * 1000 + fb->timestamp.tv_usec / 1000;
+
+  size_t offset;
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  if (!this->draining_) {
+    // keep the pre-event window only, older frames make room
+    const Record *oldest;
+    while ((oldest = this->oldest_()) != nullptr &&
+           time_ms - oldest->time_ms > this->pre_event_ms_)
+      this->pop_();
+    while (!this->reserve_(size, &offset) && this->count_ != 0)
+      this->pop_();
+  }
+  const bool reserved = this->reserve_(size, &offset);
+  xSemaphoreGive(this->lock_);
+  if (!reserved) {
+    // the writer fell behind, the frame is lost for the clip
+    this->dropped_++;
+    return;
+  }
+
+  // the reserved space is invisible to the writer until counted
+  Record *record = (Record *)(this->buffer_ + offset);
+  *record = Record{(uint32_t)fb->len, time_ms, (uint16_t)fb->width,
+                   (uint16_t)fb->height};
+  memcpy(record + 1, fb->buf, fb->len);
+
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->tail_ = offset + size;
+  this->used_ += size;
+  this->count_++;
+  const bool draining = this->draining_;
+  xSemaphoreGive(this->lock_);
+  if (draining)
+    xTaskNotifyGive(this->writer_task_);
+}
+
+void FrameRecorder::trigger() {
+  if (this->writer_task_ == nullptr)
+    return;
+  this->stop_ms_ = now_ms() + this->post_event_ms_;
+  if (!this->recording_.exchange(true))
+    xTaskNotifyGive(this->writer_task_);
+}
+
+/* ---------------- ring ---------------- */
+// finds contiguous room behind the tail, a record never wraps around
+bool FrameRecorder::reserve_(size_t size, size_t *offset) {
+  if (this->count_ == 0) {
+    this->head_ = this->tail_ = this->used_ = 0;
+  }
+  if (this->used_ == this->buffer_size_)
+    return false;
+  if (this->tail_ >= this->head_) {
+    if (this->buffer_size_ - this->tail_ >= size) {
+      *offset = this->tail_;
+      return true;
+    }
+    if (this->head_ < size)
+      return false;
+    // skip the end, the reader follows the marker back to the start
+    if (this->buffer_size_ - this->tail_ >= sizeof(uint32_t))
+      *(uint32_t *)(this->buffer_ + this->tail_) = WRAP_MARKER;
+    this->used_ += this->buffer_size_ - this->tail_;
+    this->tail_ = 0;
+  }
+  if (this->head_ - this->tail_ < size)
+    return false;
+  *offset = this->tail_;
+  return true;
+}
+
+const FrameRecorder::Record *FrameRecorder::oldest_() {
+  if (this->count_ == 0)
+    return nullptr;
+  if (this->buffer_size_ - this->head_ < sizeof(uint32_t) ||
+      *(uint32_t *)(this->buffer_ + this->head_) == WRAP_MARKER) {
+    this->used_ -= this->buffer_size_ - this->head_;
+    this->head_ = 0;
+  }
+  return (const Record *)(this->buffer_ + this->head_);
+}
+
+void FrameRecorder::pop_() {
+  const Record *record = this->oldest_();
+  const size_t size = sizeof(Record) + align4(record->len);
+  this->head_ += size;
+  this->used_ -= size;
+  this->count_--;
+}
+
+/* ---------------- writer task ---------------- */
+void FrameRecorder::writer_task(void *pv) {
+  FrameRecorder *recorder = (FrameRecorder *)pv;
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    while (recorder->recording_) {
+      recorder->write_clip_();
+      recorder->recording_ = false;
+      // triggered again after the clip ended, record another one
+      if ((int32_t)(recorder->stop_ms_ - now_ms()) > 0)
+        recorder->recording_ = true;
+    }
+  }
+}
+
+void FrameRecorder::write_clip_() {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->draining_ = true;
+  xSemaphoreGive(this->lock_);
+
+  const bool opened = this->open_clip_();
+  uint32_t first_ms = 0, last_ms = 0;
+  while (true) {
+    xSemaphoreTake(this->lock_, portMAX_DELAY);
+    const Record *record = this->oldest_();
+    xSemaphoreGive(this->lock_);
+    if (record == nullptr) {
+      if ((int32_t)(now_ms() - this->stop_ms_) >= 0)
+        break;
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+      continue;
+    }
+    // later frames stay in the ring as pre-event footage for the next clip
+    if ((int32_t)(record->time_ms - this->stop_ms_) > 0)
+      break;
+    if (opened) {
+      if (this->chunk_sizes_.empty()) {
+        first_ms = record->time_ms;
+        this->width_ = record->width;
+        this->height_ = record->height;
+      }
+      last_ms = record->time_ms;
+      const uint8_t chunk[8] = {'0', '0', 'd', 'c',
+                                (uint8_t)record->len,
+                                (uint8_t)(record->len >> 8),
+                                (uint8_t)(record->len >> 16),
+                                (uint8_t)(record->len >> 24)};
+      this->write_(chunk, sizeof(chunk));
+      this->write_(record + 1, record->len);
+      if (record->len & 1)
+        this->write_("", 1);
+      this->chunk_sizes_.push_back(record->len);
+      this->max_frame_ = std::max(this->max_frame_, record->len);
+    }
+    xSemaphoreTake(this->lock_, portMAX_DELAY);
+    this->pop_();
+    xSemaphoreGive(this->lock_);
+  }
+
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->draining_ = false;
+  xSemaphoreGive(this->lock_);
+  if (!opened) {
+    this->finish_clip_(0, true);
+    return;
+  }
+
+  // index entries point at chunks relative to the movi fourcc
+  const size_t frames = this->chunk_sizes_.size();
+  const uint32_t movi_size = this->file_size_ - AVI_MOVI_OFFSET;
+  uint8_t entry[16];
+  put_u32(put_fourcc(entry, "idx1"), frames * sizeof(entry));
+  this->write_(entry, 8);
+  uint32_t offset = 4;
+  for (uint32_t len : this->chunk_sizes_) {
+    uint8_t *out = put_fourcc(entry, "00dc");
+    out = put_u32(out, 0x10); // AVIIF_KEYFRAME
+    out = put_u32(out, offset);
+    put_u32(out, len);
+    this->write_(entry, sizeof(entry));
+    offset += 8 + len + (len & 1);
+  }
+  this->flush_block_();
+
+  uint8_t header[AVI_HEADER_SIZE];
+  const uint32_t us_per_frame =
+      frames > 1 ? (uint64_t)(last_ms - first_ms) * 1000 / (frames - 1) : 0;
+  build_avi_header(header, this->file_size_ - 8, movi_size, frames,
+                   us_per_frame, this->width_, this->height_,
+                   this->max_frame_);
+  bool ok = !ferror(this->file_) && fseek(this->file_, 0, SEEK_SET) == 0 &&
+            fwrite(header, 1, sizeof(header), this->file_) == sizeof(header);
+  ok = fclose(this->file_) == 0 && ok;
+  this->file_ = nullptr;
+  this->finish_clip_(frames, !ok);
+}
+
+// file_name_ belongs to the writer, loop() gets a copy under lock_
+void FrameRecorder::finish_clip_(uint32_t frames, bool failed) {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->last_clip_name_ = this->file_name_;
+  this->last_clip_frames_ = frames;
+  this->last_clip_failed_ = failed;
+  xSemaphoreGive(this->lock_);
+  this->clips_++;
+}
+
+// the ring is drained into the void when the file cannot be opened, so the
+// producer does not stall
+bool FrameRecorder::open_clip_() {
+  char name[16];
+  struct stat st;
+  for (uint32_t number = 1; number <= MAX_CLIP_NUMBER; number++) {
+    snprintf(name, sizeof(name), "_%04u.avi", number);
+    this->file_name_ = this->path_ + name;
+    if (stat(this->file_name_.c_str(), &st) != 0)
+      break;
+  }
+  this->file_ = fopen(this->file_name_.c_str(), "wb");
+  if (this->file_ == nullptr)
+    return false;
+  // writes are already batched into blocks
+  setvbuf(this->file_, nullptr, _IONBF, 0);
+  this->block_used_ = 0;
+  this->file_size_ = 0;
+  this->chunk_sizes_.clear();
+  this->max_frame_ = 0;
+  uint8_t header[AVI_HEADER_SIZE];
+  build_avi_header(header, 0, 0, 0, 0, 0, 0, 0);
+  this->write_(header, sizeof(header));
+  return true;
+}
+
+void FrameRecorder::write_(const void *data, size_t len) {
+  const uint8_t *src = (const uint8_t *)data;
+  this->file_size_ += len;
+  while (len != 0) {
+    const size_t chunk = std::min(len, WRITE_BLOCK_SIZE - this->block_used_);
+    memcpy(this->block_ + this->block_used_, src, chunk);
+    this->block_used_ += chunk;
+    src += chunk;
+    len -= chunk;
+    if (this->block_used_ == WRITE_BLOCK_SIZE)
+      this->flush_block_();
+  }
+}
+
+void FrameRecorder::flush_block_() {
+  if (this->block_used_ != 0)
+    fwrite(this->block_, 1, this->block_used_, this->file_);
+  this->block_used_ = 0;
+}
+
+FrameRecorder *
+    global_frame_recorder; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
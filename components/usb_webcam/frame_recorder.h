@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Pre-event recording of MJPEG frames into AVI clips
+
+#pragma once
+
+#ifdef USE_ESP32
+
+#include "../esp32_camera/esp32_camera.h"
+#include "esphome/core/automation.h"
+#include "esphome/core/component.h"
+#include "esphome/core/defines.h"
+
+#ifdef USE_BINARY_SENSOR
+#include "esphome/components/binary_sensor/binary_sensor.h"
+#endif
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace esphome {
+namespace esp32_camera {
+
+/* ---------------- FrameRecorder class ---------------- */
+// Keeps the last pre_event milliseconds of frames packed back to back in a
+// PSRAM byte ring, fed from the framebuffer task like motion detection. A
+// trigger wakes a writer task that drains the ring into an AVI file and keeps
+// following it until post_event milliseconds after the last trigger. Frames
+// get no allocation of their own and the file is written in whole blocks.
+class FrameRecorder : public Component {
+public:
+  FrameRecorder();
+
+  /* setters */
+  void set_path(const std::string &path) { this->path_ = path; }
+  void set_pre_event(uint32_t pre_event_ms) {
+    this->pre_event_ms_ = pre_event_ms;
+  }
+  void set_post_event(uint32_t post_event_ms) {
+    this->post_event_ms_ = post_event_ms;
+  }
+  void set_buffer_size(size_t buffer_size) {
+    this->buffer_size_ = buffer_size;
+  }
+#ifdef USE_BINARY_SENSOR
+  void set_recording_binary_sensor(binary_sensor::BinarySensor *sensor) {
+    this->recording_binary_sensor_ = sensor;
+  }
+#endif
+
+  /* public API (derivated) */
+  void setup() override;
+  void loop() override;
+  void dump_config() override;
+  /* public API (specific) */
+  // called from the framebuffer task with complete frames
+  void add_frame(const camera_fb_t *fb);
+  // starts a clip or extends the running one
+  void trigger();
+  bool is_recording() const { return this->recording_; }
+
+protected:
+  // ring record header, followed by len bytes padded to 4
+  struct Record {
+    uint32_t len; // WRAP_MARKER: continue at the start of the ring
+    uint32_t time_ms;
+    uint16_t width;
+    uint16_t height;
+  };
+  static const uint32_t WRAP_MARKER = UINT32_MAX;
+
+  /* ring, under lock_ */
+  bool reserve_(size_t size, size_t *offset);
+  const Record *oldest_();
+  void pop_();
+
+  /* writer task */
+  static void writer_task(void *pv);
+  void write_clip_();
+  bool open_clip_();
+  void finish_clip_(uint32_t frames, bool failed);
+  void write_(const void *data, size_t len);
+  void flush_block_();
+
+  std::string path_;
+  uint32_t pre_event_ms_{5000};
+  uint32_t post_event_ms_{10000};
+  size_t buffer_size_{2 * 1024 * 1024};
+#ifdef USE_BINARY_SENSOR
+  binary_sensor::BinarySensor *recording_binary_sensor_{nullptr};
+#endif
+
+  /* under lock_: ring of records, head_ is the oldest one */
+  uint8_t *buffer_{nullptr};
+  SemaphoreHandle_t lock_{nullptr};
+  size_t head_{0};
+  size_t tail_{0};
+  size_t used_{0}; // including bytes skipped at the end by a wrap
+  size_t count_{0};
+  bool draining_{false}; // the writer consumes, the producer keeps all
+  // the last finished clip, for loop() to report
+  std::string last_clip_name_;
+  uint32_t last_clip_frames_{0};
+  bool last_clip_failed_{false};
+
+  /* writer task only */
+  TaskHandle_t writer_task_{nullptr};
+  FILE *file_{nullptr};
+  std::string file_name_;
+  uint8_t *block_{nullptr};
+  size_t block_used_{0};
+  size_t file_size_{0};
+  std::vector<uint32_t> chunk_sizes_; // AVI index
+  uint16_t width_{0};
+  uint16_t height_{0};
+  uint32_t max_frame_{0};
+
+  /* shared with loop() */
+  std::atomic<bool> recording_{false};
+  std::atomic<uint32_t> stop_ms_{0};
+  std::atomic<uint32_t> dropped_{0};
+  std::atomic<uint32_t> clips_{0};
+
+  /* loop() only */
+  uint32_t last_clips_{0};
+  bool published_recording_{false};
+};
+
+template <typename... Ts>
+class RecordAction : public Action<Ts...>, public Parented<FrameRecorder> {
+public:
+  void play(Ts... x) override { this->parent_->trigger(); }
+};
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+extern FrameRecorder *global_frame_recorder;
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
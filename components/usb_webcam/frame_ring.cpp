@@ -0,0 +1,246 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Multi-slot frame store between the UVC callback and camera consumers
+
+#ifdef USE_ESP32
+
+#include "frame_ring.h"
+
+#include "buffer_pool.h"
+
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace esp32_camera {
+
+static const char *const TAG = "usb_webcam.ring";
+
+bool FrameRing::init(size_t slot_count, size_t slot_size) {
+  slot_size = BufferPool::round_up(slot_size);
+  this->slots_ = new Slot[slot_count];
+  for (size_t i = 0; i < slot_count; i++) {
+    Slot &slot = this->slots_[i];
+    memset(&slot.fb, 0, sizeof(camera_fb_t));
+    slot.fb.buf = global_buffer_pool.acquire(slot_size);
+    if (slot.fb.buf == nullptr) {
+      ESP_LOGE(TAG, "Could not allocate frame slot %u (%u bytes)", i,
+               slot_size);
+      for (size_t j = 0; j < i; j++)
+        global_buffer_pool.release(this->slots_[j].fb.buf, slot_size);
+      delete[] this->slots_;
+      this->slots_ = nullptr;
+      return false;
+    }
+    slot.capacity = slot_size;
+  }
+  this->slot_count_ = slot_count;
+  this->slot_size_ = slot_size;
+  return true;
+}
+
+void FrameRing::resize(size_t slot_size) {
+  slot_size = BufferPool::round_up(slot_size);
+  if (slot_size == this->slot_size_)
+    return;
+  ESP_LOGD(TAG, "Resizing frame slots %u -> %u bytes", this->slot_size_,
+           slot_size);
+  this->slot_size_ = slot_size;
+  this->resize_pending_ = true;
+  this->reallocate_idle();
+}
+
+void FrameRing::reallocate_idle() {
+  bool pending = false;
+  for (size_t i = 0; i < this->slot_count_; i++) {
+    Slot &slot = this->slots_[i];
+    if (slot.capacity == this->slot_size_)
+      continue;
+    // take the slot away from the producer while its buffer is swapped
+    uint32_t expected = slot.state.load(std::memory_order_acquire);
+    if ((expected != SLOT_FREE && expected != SLOT_READY) ||
+        !slot.state.compare_exchange_strong(expected, SLOT_WRITING,
+                                            std::memory_order_acq_rel)) {
+      pending = true;
+      continue;
+    }
+    uint8_t *buf = global_buffer_pool.acquire(this->slot_size_);
+    if (buf == nullptr) {
+      ESP_LOGW(TAG, "Could not resize frame slot %u to %u bytes", i,
+               this->slot_size_);
+      slot.state.store(expected, std::memory_order_release);
+      continue;
+    }
+    global_buffer_pool.release(slot.fb.buf, slot.capacity);
+    slot.fb.buf = buf;
+    slot.fb.len = 0;
+    slot.capacity = this->slot_size_;
+    slot.state.store(SLOT_FREE, std::memory_order_release);
+  }
+  this->resize_pending_ = pending;
+}
+
+/* ---------------- producer side ---------------- */
+camera_fb_t *FrameRing::begin_write(size_t len) {
+  for (size_t attempt = 0; attempt < this->slot_count_; attempt++) {
+    // prefer a never used slot, otherwise the oldest frame nobody holds
+    Slot *victim = nullptr;
+    for (size_t i = 0; i < this->slot_count_; i++) {
+      Slot &slot = this->slots_[i];
+      if (slot.capacity < len)
+        continue;
+      uint32_t state = slot.state.load(std::memory_order_acquire);
+      if (state == SLOT_FREE) {
+        victim = &slot;
+        break;
+      }
+      if (state == SLOT_READY &&
+          (victim == nullptr ||
+           newer_(victim->sequence.load(), slot.sequence.load())))
+        victim = &slot;
+    }
+    if (victim == nullptr)
+      break;
+
+    uint32_t expected = victim->state.load(std::memory_order_acquire);
+    if (expected != SLOT_FREE && expected != SLOT_READY)
+      continue;
+    if (!victim->state.compare_exchange_strong(expected, SLOT_WRITING,
+                                               std::memory_order_acq_rel))
+      continue; // a consumer took a reference meanwhile, pick again
+    if (victim->capacity < len) {
+      // reallocated by the main loop between the scan and the claim
+      victim->state.store(expected, std::memory_order_release);
+      continue;
+    }
+    if (expected == SLOT_READY)
+      this->overwritten_++;
+    return &victim->fb;
+  }
+  // too big for every slot is not a busy ring
+  if (this->fits(len))
+    this->dropped_busy_++;
+  return nullptr;
+}
+
+void FrameRing::commit_write(camera_fb_t *fb) {
+  Slot *slot = this->slot_of_(fb);
+  slot->sequence.store(++this->next_sequence_, std::memory_order_relaxed);
+  slot->state.store(SLOT_READY, std::memory_order_release);
+  this->written_++;
+
+  for (auto &waiter : this->waiters_) {
+    TaskHandle_t task = waiter.load();
+    if (task != nullptr)
+      xTaskNotifyGive(task);
+  }
+}
+
+void FrameRing::abort_write(camera_fb_t *fb) {
+  this->slot_of_(fb)->state.store(SLOT_FREE, std::memory_order_release);
+}
+
+/* ---------------- consumer side ---------------- */
+camera_fb_t *FrameRing::acquire_latest(uint32_t *cursor) {
+  for (size_t attempt = 0; attempt < this->slot_count_; attempt++) {
+    Slot *best = nullptr;
+    uint32_t best_sequence = *cursor;
+    for (size_t i = 0; i < this->slot_count_; i++) {
+      Slot &slot = this->slots_[i];
+      if ((slot.state.load(std::memory_order_acquire) & STATE_MASK) !=
+          SLOT_READY)
+        continue;
+      uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+      if (newer_(sequence, best_sequence)) {
+        best = &slot;
+        best_sequence = sequence;
+      }
+    }
+    if (best == nullptr)
+      return nullptr;
+
+    uint32_t state = best->state.load(std::memory_order_acquire);
+    if ((state & STATE_MASK) != SLOT_READY ||
+        !best->state.compare_exchange_strong(state, state + REF_ONE,
+                                             std::memory_order_acq_rel))
+      continue;
+    // the slot may have been recycled between the scan and the reference
+    uint32_t sequence = best->sequence.load(std::memory_order_relaxed);
+    if (!newer_(sequence, *cursor)) {
+      this->release(&best->fb);
+      continue;
+    }
+    *cursor = sequence;
+    return &best->fb;
+  }
+  return nullptr;
+}
+
+camera_fb_t *FrameRing::wait_latest(uint32_t *cursor, TickType_t timeout) {
+  // the task stays registered, later waits are woken by commit_write() too
+  this->add_waiter(xTaskGetCurrentTaskHandle());
+  camera_fb_t *fb = this->acquire_latest(cursor);
+  while (fb == nullptr) {
+    if (ulTaskNotifyTake(pdTRUE, timeout) == 0)
+      break;
+    fb = this->acquire_latest(cursor);
+  }
+  return fb;
+}
+
+bool FrameRing::add_waiter(TaskHandle_t task) {
+  for (auto &waiter : this->waiters_) {
+    if (waiter.load() == task)
+      return true;
+  }
+  for (auto &waiter : this->waiters_) {
+    TaskHandle_t expected = nullptr;
+    if (waiter.compare_exchange_strong(expected, task))
+      return true;
+  }
+  return false;
+}
+
+void FrameRing::retain(camera_fb_t *fb) {
+  this->slot_of_(fb)->state.fetch_add(REF_ONE, std::memory_order_acq_rel);
+}
+
+void FrameRing::release(camera_fb_t *fb) {
+  this->slot_of_(fb)->state.fetch_sub(REF_ONE, std::memory_order_acq_rel);
+}
+
+uint32_t FrameRing::sequence_of(const camera_fb_t *fb) const {
+  return this->slot_of_(fb)->sequence.load(std::memory_order_relaxed);
+}
+
+FrameTimes *FrameRing::times_of(const camera_fb_t *fb) {
+  return &this->slot_of_(fb)->times;
+}
+
+FrameSignature *FrameRing::signature_of(const camera_fb_t *fb) {
+  return &this->slot_of_(fb)->signature;
+}
+
+size_t FrameRing::capacity_of(const camera_fb_t *fb) const {
+  return this->slot_of_(fb)->capacity.load(std::memory_order_acquire);
+}
+
+bool FrameRing::fits(size_t len) const {
+  for (size_t i = 0; i < this->slot_count_; i++) {
+    if (this->slots_[i].capacity.load(std::memory_order_acquire) >= len)
+      return true;
+  }
+  return false;
+}
+
+FrameRing::Slot *FrameRing::slot_of_(const camera_fb_t *fb) const {
+  for (size_t i = 0; i < this->slot_count_; i++) {
+    if (&this->slots_[i].fb == fb)
+      return &this->slots_[i];
+  }
+  assert(0);
+  return nullptr;
+}
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Multi-slot frame store between the UVC callback and camera consumers
+
+#pragma once
+
+#ifdef USE_ESP32
+
+#include "../esp32_camera/esp32_camera.h"
+
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+namespace esphome {
+namespace esp32_camera {
+
+// esp_timer stamps of the pipeline stages a frame went through
+struct FrameTimes {
+  int64_t captured_us{0}; // UVC callback entry
+  int64_t queued_us{0};   // handed to loop() by the framebuffer task
+  int64_t picked_us{0};   // picked up by loop()
+};
+
+// mean luma of a grid of cells over the frame, to tell a changed scene from
+// noise whatever the encoder made of it
+static const uint8_t SIGNATURE_COLUMNS = 16;
+static const uint8_t SIGNATURE_ROWS = 12;
+struct FrameSignature {
+  uint8_t luma[SIGNATURE_ROWS][SIGNATURE_COLUMNS];
+  uint16_t width{0}; // of the frame, 0 without a signature
+  uint16_t height{0};
+};
+
+// tasks woken by commit_write(): the framebuffer task and the stream server
+static const size_t RING_MAX_WAITERS = 4;
+
+/* ---------------- FrameRing class ---------------- */
+// N PSRAM slots filled by a single producer (the usb_stream sample task).
+// The producer never blocks: it claims a free slot, recycles the oldest slot
+// nobody holds, or drops the frame when every slot is referenced. Consumers
+// take references on the newest ready frame and release them when done.
+class FrameRing {
+public:
+  bool init(size_t slot_count, size_t slot_size);
+  size_t slot_count() const { return this->slot_count_; }
+  // the size slots are being resized to, not what each one holds yet
+  size_t slot_size() const { return this->slot_size_; }
+  /* main loop only: slots currently held by consumers are reallocated later
+   * by reallocate_idle() once they have been released */
+  void resize(size_t slot_size);
+  bool resize_pending() const { return this->resize_pending_; }
+  void reallocate_idle();
+
+  /* producer side, single task only */
+  // nullptr when every slot holding len is referenced, or none is that big
+  camera_fb_t *begin_write(size_t len);
+  void commit_write(camera_fb_t *fb);
+  void abort_write(camera_fb_t *fb);
+
+  /* consumer side, any task */
+  camera_fb_t *acquire_latest(uint32_t *cursor);
+  camera_fb_t *wait_latest(uint32_t *cursor, TickType_t timeout);
+  // the task gets a notification for every committed frame from now on,
+  // false when RING_MAX_WAITERS tasks are registered already
+  bool add_waiter(TaskHandle_t task);
+  void retain(camera_fb_t *fb);
+  void release(camera_fb_t *fb);
+  uint32_t sequence_of(const camera_fb_t *fb) const;
+  FrameTimes *times_of(const camera_fb_t *fb);
+  // written by the producer before the frame is published
+  FrameSignature *signature_of(const camera_fb_t *fb);
+  // bytes the buffer of this slot holds
+  size_t capacity_of(const camera_fb_t *fb) const;
+  // false while no slot holds len, e.g. before growing slots were swapped
+  bool fits(size_t len) const;
+
+  /* counters */
+  uint32_t get_written() const { return this->written_.load(); }
+  uint32_t get_overwritten() const { return this->overwritten_.load(); }
+  uint32_t get_dropped_busy() const { return this->dropped_busy_.load(); }
+
+protected:
+  // Slot state word: low byte is the slot state, the rest is the number of
+  // consumer references. A slot may only be reclaimed by the producer when the
+  // word is exactly FREE or READY (no references).
+  enum SlotState : uint32_t { SLOT_FREE = 0, SLOT_WRITING = 1, SLOT_READY = 2 };
+  static constexpr uint32_t STATE_MASK = 0xFF;
+  static constexpr uint32_t REF_ONE = 0x100;
+
+  struct Slot {
+    camera_fb_t fb;
+    FrameTimes times;
+    FrameSignature signature;
+    std::atomic<size_t> capacity{0};
+    std::atomic<uint32_t> sequence{0};
+    std::atomic<uint32_t> state{SLOT_FREE};
+  };
+
+  Slot *slot_of_(const camera_fb_t *fb) const;
+  static bool newer_(uint32_t a, uint32_t b) { return (int32_t)(a - b) > 0; }
+
+  Slot *slots_{nullptr};
+  size_t slot_count_{0};
+  size_t slot_size_{0};
+  bool resize_pending_{false};
+  uint32_t next_sequence_{0};
+  std::atomic<TaskHandle_t> waiters_[RING_MAX_WAITERS]{};
+
+  std::atomic<uint32_t> written_{0};
+  std::atomic<uint32_t> overwritten_{0};
+  std::atomic<uint32_t> dropped_busy_{0};
+};
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Coarse luma signatures to hold back frames of a static scene
+
+#ifdef USE_ESP32
+
+#include "frame_signature.h"
+
+#include <cstring>
+
+namespace esphome {
+namespace esp32_camera {
+
+/* ---------------- SignatureBuilder class ---------------- */
+SignatureBuilder::SignatureBuilder() { this->decoder_.set_block_size(1); }
+
+bool SignatureBuilder::from_jpeg(const uint8_t *data, size_t len,
+                                 FrameSignature *out) {
+  out->width = 0;
+  out->height = 0;
+  if (this->decoder_.begin(data, len) != JPEG_OK)
+    return false;
+  const JpegDecoder &decoder = this->decoder_;
+  const size_t mcus_x = decoder.get_mcus_x();
+  const size_t mcus_y = decoder.get_mcus_y();
+  const uint8_t count = decoder.get_component_count();
+  this->clear_();
+  for (size_t y = 0; y < mcus_y; y++) {
+    const size_t row = y * SIGNATURE_ROWS / mcus_y;
+    for (size_t x = 0; x < mcus_x; x++) {
+      const size_t column = x * SIGNATURE_COLUMNS / mcus_x;
+      if (!this->decoder_.begin_mcu())
+        return false;
+      // every block has to be decoded to get to the next one
+      for (size_t c = 0; c < count; c++) {
+        const JpegComponent &component = decoder.get_component(c);
+        for (size_t block = 0; block < component.h * component.v; block++) {
+          int32_t dc;
+          if (!this->decoder_.decode_block(c, &dc))
+            return false;
+          if (c != 0)
+            continue;
+          // DC is 8 times the block mean less 128
+          this->sums_[row][column] += dc + 128 * 8;
+          this->counts_[row][column]++;
+        }
+      }
+    }
+  }
+  if (!this->decoder_.end())
+    return false;
+  this->finish_(decoder.get_width(), decoder.get_height(), out);
+  return true;
+}
+
+bool SignatureBuilder::from_raw(RawFormat format, const uint8_t *data,
+                                size_t len, uint16_t width, uint16_t height,
+                                FrameSignature *out) {
+  out->width = 0;
+  out->height = 0;
+  if (width == 0 || height == 0 || len < raw_frame_size(format, width, height))
+    return false;
+  // luma is every byte of the first plane, or every other one when packed
+  const size_t step = format == RAW_YUYV || format == RAW_UYVY ? 2 : 1;
+  const uint8_t *luma = data + (format == RAW_UYVY ? 1 : 0);
+  this->clear_();
+  for (size_t y = 0; y < height; y += 2) {
+    const uint8_t *src = luma + y * width * step;
+    const size_t row = y * SIGNATURE_ROWS / height;
+    for (size_t column = 0; column < SIGNATURE_COLUMNS; column++) {
+      const size_t end = (column + 1) * width / SIGNATURE_COLUMNS;
+      int32_t sum = 0;
+      uint32_t pixels = 0;
+      for (size_t x = column * width / SIGNATURE_COLUMNS; x < end; x += 2) {
+        sum += src[x * step];
+        pixels++;
+      }
+      this->sums_[row][column] += sum * 8;
+      this->counts_[row][column] += pixels;
+    }
+  }
+  this->finish_(width, height, out);
+  return true;
+}
+
+void SignatureBuilder::clear_() {
+  memset(this->sums_, 0, sizeof(this->sums_));
+  memset(this->counts_, 0, sizeof(this->counts_));
+}
+
+// sums are in eighths of a luma level, cells without pixels stay 0
+void SignatureBuilder::finish_(uint16_t width, uint16_t height,
+                               FrameSignature *out) const {
+  for (size_t row = 0; row < SIGNATURE_ROWS; row++) {
+    for (size_t column = 0; column < SIGNATURE_COLUMNS; column++) {
+      const uint32_t count = this->counts_[row][column];
+      int32_t luma = 0;
+      if (count != 0)
+        luma = (this->sums_[row][column] / (int32_t)count + 4) / 8;
+      out->luma[row][column] = luma < 0 ? 0 : luma > 255 ? 255 : luma;
+    }
+  }
+  out->width = width;
+  out->height = height;
+}
+
+/* ---------------- UnchangedFilter class ---------------- */
+bool UnchangedFilter::pass(const FrameSignature &signature, uint32_t now_ms) {
+  const FrameSignature &reference = this->reference_;
+  if (this->has_reference_ && signature.width != 0 &&
+      signature.width == reference.width &&
+      signature.height == reference.height &&
+      now_ms - this->passed_ms_ < this->keepalive_ms_) {
+    bool changed = false;
+    for (size_t row = 0; row < SIGNATURE_ROWS && !changed; row++) {
+      for (size_t column = 0; column < SIGNATURE_COLUMNS; column++) {
+        const int diff = signature.luma[row][column] -
+                         reference.luma[row][column];
+        if (diff > this->luma_threshold_ || diff < -this->luma_threshold_) {
+          changed = true;
+          break;
+        }
+      }
+    }
+    if (!changed)
+      return false;
+  }
+  this->has_reference_ = true;
+  this->reference_ = signature;
+  this->passed_ms_ = now_ms;
+  return true;
+}
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
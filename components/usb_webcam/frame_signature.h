@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Coarse luma signatures to hold back frames of a static scene
+
+#pragma once
+
+#ifdef USE_ESP32
+
+#include "../esp32_camera/esp32_camera.h"
+#include "frame_ring.h"
+#include "jpeg_codec.h"
+#include "raw_convert.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace esp32_camera {
+
+/* ---------------- SignatureBuilder class ---------------- */
+// Averages the luma of every cell of the signature grid. MJPEG frames are
+// read from their DC coefficients alone, uncompressed ones from every other
+// pixel of every other row. Sensor noise averages out over a cell, while an
+// object that moves shifts the mean of the cells it leaves and enters.
+class SignatureBuilder {
+public:
+  SignatureBuilder();
+  // false, and out has no signature, when the frame cannot be read
+  bool from_jpeg(const uint8_t *data, size_t len, FrameSignature *out);
+  bool from_raw(RawFormat format, const uint8_t *data, size_t len,
+                uint16_t width, uint16_t height, FrameSignature *out);
+
+protected:
+  void clear_();
+  void finish_(uint16_t width, uint16_t height, FrameSignature *out) const;
+
+  JpegDecoder decoder_;
+  int32_t sums_[SIGNATURE_ROWS][SIGNATURE_COLUMNS];
+  uint32_t counts_[SIGNATURE_ROWS][SIGNATURE_COLUMNS];
+};
+
+/* ---------------- UnchangedFilter class ---------------- */
+// Remembers the signature of the last frame it let through. Later frames of
+// the same size whose cells all stay within the luma threshold of it are
+// held back until the keepalive interval has passed. Comparing against the
+// last frame let through, not the previous one, a slow change still passes
+// once it adds up.
+class UnchangedFilter {
+public:
+  void set_luma_threshold(uint8_t luma_threshold) {
+    this->luma_threshold_ = luma_threshold;
+  }
+  void set_keepalive(uint32_t keepalive_ms) {
+    this->keepalive_ms_ = keepalive_ms;
+  }
+  uint8_t get_luma_threshold() const { return this->luma_threshold_; }
+  uint32_t get_keepalive() const { return this->keepalive_ms_; }
+
+  // true when the frame should be delivered, it is then the new reference
+  bool pass(const FrameSignature &signature, uint32_t now_ms);
+  // the next frame passes
+  void reset() { this->has_reference_ = false; }
+
+protected:
+  uint8_t luma_threshold_{4};
+  uint32_t keepalive_ms_{10000};
+
+  bool has_reference_{false};
+  FrameSignature reference_;
+  uint32_t passed_ms_{0};
+};
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
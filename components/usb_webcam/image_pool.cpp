@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Fixed storage for the CameraImage objects handed to consumers
+
+#ifdef USE_ESP32
+
+#include "image_pool.h"
+
+#include "esphome/core/log.h"
+
+#include <new>
+
+namespace esphome {
+namespace esp32_camera {
+
+static const char *const TAG = "usb_webcam.pool";
+
+void *ImagePool::allocate(size_t size) {
+  uint32_t used = this->used_.load();
+  while (size <= NODE_SIZE) {
+    uint8_t index = 0;
+    while (index < NODE_COUNT && (used & (1U << index)))
+      index++;
+    if (index == NODE_COUNT)
+      break;
+    // on failure used is reloaded and the search starts over
+    if (this->used_.compare_exchange_weak(used, used | (1U << index)))
+      return this->nodes_[index];
+  }
+  if (this->heap_fallbacks_++ == 0)
+    ESP_LOGW(TAG, "Image pool cannot hold %u bytes, using the heap", size);
+  return ::operator new(size);
+}
+
+void ImagePool::deallocate(void *node) {
+  const uint8_t *bytes = (const uint8_t *)node;
+  if (bytes < this->nodes_[0] || bytes >= this->nodes_[NODE_COUNT]) {
+    ::operator delete(node);
+    return;
+  }
+  const size_t index = (bytes - this->nodes_[0]) / NODE_SIZE;
+  this->used_.fetch_and(~(1U << index));
+}
+
+uint8_t ImagePool::get_in_use() const {
+  return __builtin_popcount(this->used_.load());
+}
+
+ImagePool
+    global_image_pool; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Fixed storage for the CameraImage objects handed to consumers
+
+#pragma once
+
+#ifdef USE_ESP32
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace esp32_camera {
+
+/* ---------------- ImagePool class ---------------- */
+// Nodes for std::allocate_shared, which puts the reference counts and the
+// image in one allocation, so delivering a frame never touches the heap.
+// Images are made in loop() but the last reference may be dropped by any
+// consumer task, so nodes are claimed and returned with a CAS on a bitmap.
+// Should the pool ever run dry the heap is used and counted.
+class ImagePool {
+public:
+  static const size_t NODE_SIZE = 48;
+  static const uint8_t NODE_COUNT = 10;
+
+  void *allocate(size_t size);
+  void deallocate(void *node);
+
+  uint8_t get_in_use() const;
+  uint32_t get_heap_fallbacks() const { return this->heap_fallbacks_.load(); }
+
+protected:
+  alignas(8) uint8_t nodes_[NODE_COUNT][NODE_SIZE];
+  std::atomic<uint32_t> used_{0}; // bit per node
+  std::atomic<uint32_t> heap_fallbacks_{0};
+};
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+extern ImagePool global_image_pool;
+
+// allocator for std::allocate_shared, it rebinds to its control block type
+template<typename T> class ImagePoolAllocator {
+public:
+  using value_type = T;
+
+  ImagePoolAllocator() = default;
+  template<typename U> ImagePoolAllocator(const ImagePoolAllocator<U> &) {}
+
+  T *allocate(size_t count) {
+    return (T *)global_image_pool.allocate(count * sizeof(T));
+  }
+  void deallocate(T *node, size_t) { global_image_pool.deallocate(node); }
+
+  template<typename U> bool operator==(const ImagePoolAllocator<U> &) const {
+    return true;
+  }
+  template<typename U> bool operator!=(const ImagePoolAllocator<U> &) const {
+    return false;
+  }
+};
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
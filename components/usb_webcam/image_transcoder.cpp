@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Thumbnails and regions are made from delivered frames on a worker task
+
+#ifdef USE_ESP32
+
+#include "image_transcoder.h"
+
+#include "esphome/core/application.h"
+#include "esphome/core/defines.h"
+#include "esphome/core/log.h"
+
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+
+namespace esphome {
+namespace esp32_camera {
+
+static const char *const TAG = "usb_webcam.transcoder";
+
+bool ImageTranscoder::start(BaseType_t core, uint8_t priority) {
+  this->queue_ = xQueueCreate(1, sizeof(camera_fb_t *));
+  if (this->queue_ == nullptr) {
+    ESP_LOGE(TAG, "Could not allocate the frame queue");
+    return false;
+  }
+  xTaskCreatePinnedToCore(&ImageTranscoder::worker_task,
+                          "transcoder_tsk", // name
+                          4096,             // stack size
+                          this,             // task pv params
+                          priority,         // priority
+                          nullptr,          // handle
+                          core              // core
+  );
+  return true;
+}
+
+/* ---------------- loop() side ---------------- */
+bool ImageTranscoder::submit(camera_fb_t *fb, const TranscodeJob *jobs,
+                             size_t count) {
+  if (this->busy() || count == 0 || count > TRANSCODE_MAX_JOBS)
+    return false;
+  for (size_t i = 0; i < count; i++)
+    this->jobs_[i] = jobs[i];
+  this->job_count_ = count;
+  this->ring_->retain(fb);
+  this->source_ = fb;
+  // the queue is empty whenever nothing is in flight
+  xQueueSend(this->queue_, &fb, 0);
+  return true;
+}
+
+size_t ImageTranscoder::collect(TranscodeJob *jobs) {
+  if (!this->busy() || !this->done_.load())
+    return 0;
+  this->done_.store(false);
+  const size_t count = this->job_count_;
+  for (size_t i = 0; i < count; i++)
+    jobs[i] = this->jobs_[i];
+  this->ring_->release(this->source_);
+  this->source_ = nullptr;
+  return count;
+}
+
+/* ---------------- worker task ---------------- */
+void ImageTranscoder::worker_task(void *pv) {
+  ImageTranscoder *transcoder = (ImageTranscoder *)pv;
+  camera_fb_t *fb;
+  while (true) {
+    if (xQueueReceive(transcoder->queue_, &fb, portMAX_DELAY) != pdTRUE)
+      continue;
+    transcoder->transcode_(fb);
+    transcoder->done_.store(true);
+#ifdef USE_WAKE_LOOP_THREADSAFE
+    App.wake_loop_threadsafe();
+#endif
+  }
+}
+
+void ImageTranscoder::transcode_(camera_fb_t *fb) {
+  for (size_t i = 0; i < this->job_count_; i++) {
+    TranscodeJob &job = this->jobs_[i];
+    job.elapsed_us = 0;
+    job.status = JPEG_OVERFLOW;
+    if (!reserve_(job.buffer, job.capacity))
+      continue;
+    const int64_t start_us = esp_timer_get_time();
+    ImageBuffer &image = *job.buffer;
+    uint16_t width, height;
+    if (job.shift != 0) {
+      job.status = this->scaler_.scale(fb->buf, fb->len, job.shift,
+                                       image.fb.buf, image.capacity,
+                                       &image.fb.len, &width, &height);
+    } else {
+      job.status = this->cropper_.crop(
+          fb->buf, fb->len, job.x, job.y, job.width, job.height, image.fb.buf,
+          image.capacity, &image.fb.len, &width, &height);
+    }
+    job.elapsed_us = esp_timer_get_time() - start_us;
+    if (job.status != JPEG_OK)
+      continue;
+    image.fb.width = width;
+    image.fb.height = height;
+    image.fb.format = PIXFORMAT_JPEG;
+    image.fb.timestamp = fb->timestamp;
+  }
+}
+
+/* grows an image buffer, false if memory ran out */
+bool ImageTranscoder::reserve_(ImageBuffer *buffer, size_t capacity) {
+  if (buffer->capacity >= capacity)
+    return true;
+  heap_caps_free(buffer->fb.buf);
+  buffer->fb.buf = (uint8_t *)heap_caps_malloc_prefer(capacity, 2,
+                                                      MALLOC_CAP_SPIRAM, 0);
+  buffer->capacity = buffer->fb.buf != nullptr ? capacity : 0;
+  if (buffer->fb.buf == nullptr) {
+    ESP_LOGW(TAG, "Could not allocate image buffer (%u bytes)", capacity);
+    return false;
+  }
+  return true;
+}
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
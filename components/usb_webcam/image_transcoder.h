@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Thumbnails and regions are made from delivered frames on a worker task
+
+#pragma once
+
+#ifdef USE_ESP32
+
+#include "../esp32_camera/esp32_camera.h"
+#include "frame_ring.h"
+#include "jpeg_codec.h"
+#include "mjpeg.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include <atomic>
+
+namespace esphome {
+namespace esp32_camera {
+
+// an image made from a frame, grown as needed and kept for the next one
+struct ImageBuffer {
+  camera_fb_t fb;
+  size_t capacity;
+};
+
+static const uint8_t TRANSCODE_MAX_JOBS =
+    THUMBNAIL_BUFFER_COUNT + ROI_BUFFER_COUNT;
+
+struct TranscodeJob {
+  /* set by loop() */
+  ImageBuffer *buffer;
+  size_t capacity;    // the buffer is grown to
+  uint8_t index;      // of the buffer, for loop() to find its image again
+  uint8_t requesters; // the image is for
+  uint8_t singles;    // single requests among them, asked again on failure
+  uint8_t shift;      // 1..3 for 1/2..1/8, 0 for a region
+  uint16_t x, y, width, height; // region in pixels, widened to whole MCUs
+  /* set by the worker */
+  JpegStatus status;
+  uint32_t elapsed_us;
+};
+
+/* ---------------- ImageTranscoder class ---------------- */
+// loop() hands a delivered frame over together with the images to make from
+// it and goes on; a worker task takes a reference on the ring slot, scales
+// the frame or cuts regions out of it into the image buffers and wakes loop()
+// up, which delivers the images on its next iteration and drops the
+// reference. One frame is worked on at a time, frames coming in meanwhile get
+// no images.
+class ImageTranscoder {
+public:
+  explicit ImageTranscoder(FrameRing *ring) : ring_(ring) {}
+
+  bool start(BaseType_t core, uint8_t priority);
+
+  /* loop() only */
+  // a frame is handed over and not collected yet
+  bool busy() const { return this->source_ != nullptr; }
+  // false while busy, takes a reference on fb otherwise
+  bool submit(camera_fb_t *fb, const TranscodeJob *jobs, size_t count);
+  // the jobs of the frame once they are done, 0 while they are not
+  size_t collect(TranscodeJob *jobs);
+
+protected:
+  static void worker_task(void *pv);
+  void transcode_(camera_fb_t *fb);
+  static bool reserve_(ImageBuffer *buffer, size_t capacity);
+
+  FrameRing *ring_;
+  QueueHandle_t queue_{nullptr};
+
+  /* loop() only */
+  camera_fb_t *source_{nullptr};
+
+  /* written by whoever owns the frame, handed over through done_ */
+  TranscodeJob jobs_[TRANSCODE_MAX_JOBS];
+  size_t job_count_{0};
+  std::atomic<bool> done_{false};
+
+  /* worker task only */
+  MjpegScaler scaler_;
+  MjpegCropper cropper_;
+};
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
@@ -0,0 +1,699 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Baseline JPEG building blocks: header parsing, block decoding and encoding
+
+#include "jpeg_codec.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace esphome {
+namespace esp32_camera {
+
+const uint8_t JPEG_ZIGZAG[64] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+/* ---------------- quantization tables (ITU T.81 Annex K.1) ------------- */
+// natural order, for quality 50
+static const uint8_t QUANT_LUMA[64] = {
+    16, 11, 10, 16, 24,  40,  51,  61,  12, 12, 14, 19, 26,  58,  60,  55,
+    14, 13, 16, 24, 40,  57,  69,  56,  14, 17, 22, 29, 51,  87,  80,  62,
+    18, 22, 37, 56, 68,  109, 103, 77,  24, 35, 55, 64, 81,  104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99};
+static const uint8_t QUANT_CHROMA[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99};
+
+void jpeg_quality_tables(uint8_t quality, uint16_t (*quant)[64]) {
+  // same scaling as libjpeg
+  quality = quality < 1 ? 1 : quality > 100 ? 100 : quality;
+  const uint32_t scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+  for (size_t k = 0; k < 64; k++) {
+    const uint8_t natural = JPEG_ZIGZAG[k];
+    const uint32_t luma = (QUANT_LUMA[natural] * scale + 50) / 100;
+    const uint32_t chroma = (QUANT_CHROMA[natural] * scale + 50) / 100;
+    quant[0][k] = luma < 1 ? 1 : luma > 255 ? 255 : luma;
+    quant[1][k] = chroma < 1 ? 1 : chroma > 255 ? 255 : chroma;
+  }
+}
+
+/* ---------------- standard Huffman tables (ITU T.81 Annex K.3) --------- */
+static const uint8_t DC_LUMA_BITS[16] = {0, 1, 5, 1, 1, 1, 1, 1,
+                                         1, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t DC_CHROMA_BITS[16] = {0, 3, 1, 1, 1, 1, 1, 1,
+                                           1, 1, 1, 0, 0, 0, 0, 0};
+static const uint8_t DC_VALUES[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+static const uint8_t AC_LUMA_BITS[16] = {0, 2, 1, 3, 3, 2, 4, 3,
+                                         5, 5, 4, 4, 0, 0, 1, 0x7d};
+static const uint8_t AC_LUMA_VALUES[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06,
+    0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+    0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72,
+    0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45,
+    0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75,
+    0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3,
+    0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+    0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9,
+    0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4,
+    0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+
+static const uint8_t AC_CHROMA_BITS[16] = {0, 2, 1, 2, 4, 4, 3, 4,
+                                           7, 5, 4, 4, 0, 1, 2, 0x77};
+static const uint8_t AC_CHROMA_VALUES[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41,
+    0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+    0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1,
+    0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44,
+    0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+    0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74,
+    0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a,
+    0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+    0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7,
+    0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4,
+    0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+
+/* ---------------- JPEG markers ---------------- */
+static const uint8_t MARKER_SOF0 = 0xC0;
+static const uint8_t MARKER_SOF1 = 0xC1;
+static const uint8_t MARKER_DHT = 0xC4;
+static const uint8_t MARKER_JPG = 0xC8;
+static const uint8_t MARKER_DAC = 0xCC;
+static const uint8_t MARKER_RST0 = 0xD0;
+static const uint8_t MARKER_SOI = 0xD8;
+static const uint8_t MARKER_EOI = 0xD9;
+static const uint8_t MARKER_SOS = 0xDA;
+static const uint8_t MARKER_DQT = 0xDB;
+static const uint8_t MARKER_DRI = 0xDD;
+static const uint8_t MARKER_APP0 = 0xE0;
+
+const char *jpeg_status_to_string(JpegStatus status) {
+  switch (status) {
+  case JPEG_OK:
+    return "ok";
+  case JPEG_CORRUPT:
+    return "corrupt";
+  case JPEG_UNSUPPORTED:
+    return "unsupported";
+  case JPEG_OVERFLOW:
+    return "overflow";
+  default:
+    return "unknown";
+  }
+}
+
+static inline uint16_t read_u16(const uint8_t *p) { return (p[0] << 8) | p[1]; }
+
+/* ---------------- JpegHuffmanTable struct ---------------- */
+bool JpegHuffmanTable::build(const uint8_t *bits, const uint8_t *values) {
+  size_t count = 0;
+  for (size_t i = 0; i < 16; i++)
+    count += bits[i];
+  if (count > 256)
+    return false;
+  memcpy(this->values, values, count);
+  memset(this->lookup, 0, sizeof(this->lookup));
+
+  // canonical codes, ITU T.81 F.2.2.3
+  int32_t code = 0;
+  size_t k = 0;
+  for (uint8_t length = 1; length <= 16; length++) {
+    this->valptr[length] = k - code;
+    for (size_t i = 0; i < bits[length - 1]; i++, k++, code++) {
+      if (length <= LOOKUP_BITS) {
+        const size_t shift = LOOKUP_BITS - length;
+        for (size_t fill = 0; fill < (1U << shift); fill++) {
+          this->lookup[(code << shift) | fill] =
+              (length << 8) | this->values[k];
+        }
+      }
+    }
+    this->maxcode[length] = bits[length - 1] ? code - 1 : -1;
+    if (code > (1 << length))
+      return false; // over-subscribed
+    code <<= 1;
+  }
+  this->maxcode[17] = INT32_MAX; // stops the decode loop on garbage
+  this->present = true;
+  return true;
+}
+
+/* ---------------- JpegDecoder class ---------------- */
+JpegStatus JpegDecoder::begin(const uint8_t *data, size_t len) {
+  if (len < 4 || data[0] != 0xFF || data[1] != MARKER_SOI)
+    return JPEG_CORRUPT;
+  this->component_count_ = 0;
+  this->restart_interval_ = 0;
+  for (auto &table : this->dc_tables_)
+    table.present = false;
+  for (auto &table : this->ac_tables_)
+    table.present = false;
+
+  size_t pos = 2;
+  while (true) {
+    if (pos + 4 > len || data[pos] != 0xFF)
+      return JPEG_CORRUPT;
+    const uint8_t marker = data[pos + 1];
+    if (marker == 0xFF) {
+      pos++; // fill byte
+      continue;
+    }
+    const size_t length = read_u16(data + pos + 2);
+    if (length < 2 || pos + 2 + length > len)
+      return JPEG_CORRUPT;
+    const uint8_t *segment = data + pos + 4;
+    const size_t segment_len = length - 2;
+    pos += 2 + length;
+
+    JpegStatus status = JPEG_OK;
+    if (marker == MARKER_DQT) {
+      status = this->parse_dqt_(segment, segment_len);
+    } else if (marker == MARKER_DHT) {
+      status = this->parse_dht_(segment, segment_len);
+    } else if (marker == MARKER_SOF0 || marker == MARKER_SOF1) {
+      status = this->parse_sof_(segment, segment_len);
+    } else if (marker >= MARKER_SOF0 && marker <= 0xCF &&
+               marker != MARKER_JPG && marker != MARKER_DAC) {
+      return JPEG_UNSUPPORTED; // progressive, lossless or arithmetic
+    } else if (marker == MARKER_DRI) {
+      if (segment_len < 2)
+        return JPEG_CORRUPT;
+      this->restart_interval_ = read_u16(segment);
+    } else if (marker == MARKER_SOS) {
+      status = this->parse_sos_(segment, segment_len);
+      if (status != JPEG_OK)
+        return status;
+      break;
+    }
+    if (status != JPEG_OK)
+      return status;
+  }
+
+  // UVC MJPEG usually omits DHT and relies on the standard tables
+  if (!this->dc_tables_[0].present)
+    this->dc_tables_[0].build(DC_LUMA_BITS, DC_VALUES);
+  if (!this->dc_tables_[1].present)
+    this->dc_tables_[1].build(DC_CHROMA_BITS, DC_VALUES);
+  if (!this->ac_tables_[0].present)
+    this->ac_tables_[0].build(AC_LUMA_BITS, AC_LUMA_VALUES);
+  if (!this->ac_tables_[1].present)
+    this->ac_tables_[1].build(AC_CHROMA_BITS, AC_CHROMA_VALUES);
+
+  this->data_ = data;
+  this->len_ = len;
+  this->pos_ = pos;
+  this->bits_ = 0;
+  this->bit_count_ = 0;
+  this->marker_hit_ = false;
+  this->padding_bytes_ = 0;
+  this->mcus_to_restart_ = this->restart_interval_;
+  this->next_restart_ = 0;
+  memset(this->dc_pred_, 0, sizeof(this->dc_pred_));
+  this->set_block_size(this->block_size_);
+  return JPEG_OK;
+}
+
+JpegStatus JpegDecoder::parse_dqt_(const uint8_t *segment, size_t len) {
+  size_t pos = 0;
+  while (pos < len) {
+    const uint8_t precision = segment[pos] >> 4;
+    const uint8_t id = segment[pos] & 0x0F;
+    const size_t size = precision ? 128 : 64;
+    if (id > 3 || pos + 1 + size > len)
+      return JPEG_CORRUPT;
+    for (size_t k = 0; k < 64; k++) {
+      this->quant_[id][k] = precision ? read_u16(segment + pos + 1 + 2 * k)
+                                      : segment[pos + 1 + k];
+    }
+    pos += 1 + size;
+  }
+  return JPEG_OK;
+}
+
+JpegStatus JpegDecoder::parse_dht_(const uint8_t *segment, size_t len) {
+  size_t pos = 0;
+  while (pos < len) {
+    if (pos + 17 > len)
+      return JPEG_CORRUPT;
+    const uint8_t table_class = segment[pos] >> 4;
+    const uint8_t id = segment[pos] & 0x0F;
+    const uint8_t *bits = segment + pos + 1;
+    size_t count = 0;
+    for (size_t i = 0; i < 16; i++)
+      count += bits[i];
+    if (table_class > 1 || id > 1 || pos + 17 + count > len)
+      return id > 1 ? JPEG_UNSUPPORTED : JPEG_CORRUPT;
+    JpegHuffmanTable &table =
+        table_class ? this->ac_tables_[id] : this->dc_tables_[id];
+    if (!table.build(bits, segment + pos + 17))
+      return JPEG_CORRUPT;
+    pos += 17 + count;
+  }
+  return JPEG_OK;
+}
+
+JpegStatus JpegDecoder::parse_sof_(const uint8_t *segment, size_t len) {
+  if (len < 6)
+    return JPEG_CORRUPT;
+  if (segment[0] != 8)
+    return JPEG_UNSUPPORTED;
+  this->height_ = read_u16(segment + 1);
+  this->width_ = read_u16(segment + 3);
+  this->component_count_ = segment[5];
+  if (this->width_ == 0 || this->height_ == 0)
+    return JPEG_UNSUPPORTED; // height defined by DNL
+  if (this->component_count_ == 0 ||
+      this->component_count_ > JPEG_MAX_COMPONENTS)
+    return JPEG_UNSUPPORTED;
+  if (len < 6 + 3 * (size_t)this->component_count_)
+    return JPEG_CORRUPT;
+
+  this->hmax_ = 1;
+  this->vmax_ = 1;
+  for (size_t i = 0; i < this->component_count_; i++) {
+    JpegComponent &component = this->components_[i];
+    const uint8_t *p = segment + 6 + 3 * i;
+    component.id = p[0];
+    component.h = p[1] >> 4;
+    component.v = p[1] & 0x0F;
+    component.tq = p[2];
+    if (component.h == 0 || component.v == 0 || component.tq > 3)
+      return JPEG_CORRUPT;
+    if (component.h > 2 || component.v > 2)
+      return JPEG_UNSUPPORTED;
+    if (component.h > this->hmax_)
+      this->hmax_ = component.h;
+    if (component.v > this->vmax_)
+      this->vmax_ = component.v;
+  }
+  if (this->component_count_ == 1) {
+    // a single component scan is never interleaved, one block per MCU
+    this->components_[0].h = 1;
+    this->components_[0].v = 1;
+    this->hmax_ = 1;
+    this->vmax_ = 1;
+  }
+  this->mcus_x_ = (this->width_ + 8 * this->hmax_ - 1) / (8 * this->hmax_);
+  this->mcus_y_ = (this->height_ + 8 * this->vmax_ - 1) / (8 * this->vmax_);
+  return JPEG_OK;
+}
+
+JpegStatus JpegDecoder::parse_sos_(const uint8_t *segment, size_t len) {
+  if (this->component_count_ == 0)
+    return JPEG_CORRUPT; // no frame header
+  if (len < 1 || len < 1 + 2 * (size_t)segment[0] + 3)
+    return JPEG_CORRUPT;
+  if (segment[0] != this->component_count_)
+    return JPEG_UNSUPPORTED; // non-interleaved scans
+  for (size_t i = 0; i < this->component_count_; i++) {
+    const uint8_t *p = segment + 1 + 2 * i;
+    size_t c = 0;
+    while (c < this->component_count_ && this->components_[c].id != p[0])
+      c++;
+    if (c == this->component_count_)
+      return JPEG_CORRUPT;
+    this->components_[c].td = p[1] >> 4;
+    this->components_[c].ta = p[1] & 0x0F;
+    if (this->components_[c].td > 1 || this->components_[c].ta > 1)
+      return JPEG_UNSUPPORTED;
+  }
+  const uint8_t *p = segment + 1 + 2 * this->component_count_;
+  if (p[0] != 0 || p[1] != 63 || p[2] != 0)
+    return JPEG_UNSUPPORTED; // spectral selection or successive approximation
+  return JPEG_OK;
+}
+
+void JpegDecoder::set_block_size(uint8_t size) {
+  this->block_size_ = size;
+  for (size_t k = 0; k < 64; k++) {
+    const uint8_t row = JPEG_ZIGZAG[k] / 8;
+    const uint8_t col = JPEG_ZIGZAG[k] % 8;
+    this->block_index_[k] =
+        row < size && col < size ? row * size + col : 0xFF;
+  }
+}
+
+uint8_t JpegDecoder::next_byte_() {
+  // past a marker the stream is padded with zeros, consuming any of them
+  // means the data was cut short, see overrun_()
+  if (this->marker_hit_ || this->pos_ >= this->len_) {
+    this->marker_hit_ = true;
+    this->padding_bytes_++;
+    return 0;
+  }
+  const uint8_t byte = this->data_[this->pos_];
+  if (byte != 0xFF) {
+    this->pos_++;
+    return byte;
+  }
+  if (this->pos_ + 1 < this->len_ && this->data_[this->pos_ + 1] == 0x00) {
+    this->pos_ += 2; // stuffed byte
+    return 0xFF;
+  }
+  this->marker_hit_ = true;
+  this->padding_bytes_++;
+  return 0;
+}
+
+void JpegDecoder::fill_() {
+  while (this->bit_count_ <= 24) {
+    this->bits_ |= (uint32_t)this->next_byte_() << (24 - this->bit_count_);
+    this->bit_count_ += 8;
+  }
+}
+
+uint32_t JpegDecoder::get_bits_(uint8_t count) {
+  if (count == 0)
+    return 0;
+  if (this->bit_count_ < count)
+    this->fill_();
+  const uint32_t value = this->bits_ >> (32 - count);
+  this->bits_ <<= count;
+  this->bit_count_ -= count;
+  return value;
+}
+
+int JpegDecoder::decode_(const JpegHuffmanTable &table) {
+  if (this->bit_count_ < 16)
+    this->fill_();
+  const uint16_t entry =
+      table.lookup[this->bits_ >> (32 - JpegHuffmanTable::LOOKUP_BITS)];
+  if (entry != 0) {
+    const uint8_t length = entry >> 8;
+    this->bits_ <<= length;
+    this->bit_count_ -= length;
+    return entry & 0xFF;
+  }
+  // longer codes, F.2.2.3
+  uint8_t length = JpegHuffmanTable::LOOKUP_BITS + 1;
+  int32_t code = this->bits_ >> (32 - length);
+  while (code > table.maxcode[length]) {
+    if (++length > 16)
+      return -1;
+    code = this->bits_ >> (32 - length);
+  }
+  this->bits_ <<= length;
+  this->bit_count_ -= length;
+  return table.values[table.valptr[length] + code];
+}
+
+static inline int32_t extend(uint32_t value, uint8_t size) {
+  return value < (1U << (size - 1)) ? (int32_t)value - (1 << size) + 1
+                                    : (int32_t)value;
+}
+
+bool JpegDecoder::begin_mcu() {
+  if (this->restart_interval_ == 0)
+    return true;
+  if (this->mcus_to_restart_ == 0) {
+    if (this->overrun_())
+      return false;
+    // drop the padding bits and expect RSTn where the bit reader stopped
+    this->bits_ = 0;
+    this->bit_count_ = 0;
+    this->marker_hit_ = false;
+    this->padding_bytes_ = 0;
+    while (this->pos_ + 1 < this->len_ && this->data_[this->pos_] == 0xFF &&
+           this->data_[this->pos_ + 1] == 0xFF)
+      this->pos_++;
+    if (this->pos_ + 1 >= this->len_ || this->data_[this->pos_] != 0xFF ||
+        this->data_[this->pos_ + 1] != MARKER_RST0 + this->next_restart_)
+      return false;
+    this->pos_ += 2;
+    this->next_restart_ = (this->next_restart_ + 1) & 7;
+    memset(this->dc_pred_, 0, sizeof(this->dc_pred_));
+    this->mcus_to_restart_ = this->restart_interval_;
+  }
+  this->mcus_to_restart_--;
+  return true;
+}
+
+bool JpegDecoder::decode_block(size_t component, int32_t *coef) {
+  const JpegComponent &c = this->components_[component];
+  const JpegHuffmanTable &dc = this->dc_tables_[c.td];
+  const JpegHuffmanTable &ac = this->ac_tables_[c.ta];
+  const uint16_t *quant = this->quant_[c.tq];
+  memset(coef, 0, this->block_size_ * this->block_size_ * sizeof(int32_t));
+
+  int size = this->decode_(dc);
+  if (size < 0 || size > 11)
+    return false;
+  if (size != 0)
+    this->dc_pred_[component] += extend(this->get_bits_(size), size);
+  coef[0] = this->dc_pred_[component] * quant[0];
+
+  for (size_t k = 1; k < 64;) {
+    const int symbol = this->decode_(ac);
+    if (symbol < 0)
+      return false;
+    const uint8_t run = symbol >> 4;
+    size = symbol & 0x0F;
+    if (size == 0) {
+      if (run != 15)
+        break; // end of block
+      k += 16;
+      continue;
+    }
+    k += run;
+    if (k > 63)
+      return false;
+    const int32_t value = extend(this->get_bits_(size), size);
+    const uint8_t index = this->block_index_[k];
+    if (index != 0xFF)
+      coef[index] = value * quant[k];
+    k++;
+  }
+  return true;
+}
+
+/* ---------------- JpegEncoder class ---------------- */
+JpegEncoder::JpegEncoder() {
+  build_codes_(DC_LUMA_BITS, DC_VALUES, &this->dc_codes_[0]);
+  build_codes_(DC_CHROMA_BITS, DC_VALUES, &this->dc_codes_[1]);
+  build_codes_(AC_LUMA_BITS, AC_LUMA_VALUES, &this->ac_codes_[0]);
+  build_codes_(AC_CHROMA_BITS, AC_CHROMA_VALUES, &this->ac_codes_[1]);
+  for (size_t u = 0; u < 8; u++) {
+    const float c = u == 0 ? sqrtf(0.5f) : 1.0f;
+    for (size_t x = 0; x < 8; x++)
+      this->cos_[u][x] = c / 2 * cosf((2 * x + 1) * u * (float)M_PI / 16);
+  }
+}
+
+void JpegEncoder::build_codes_(const uint8_t *bits, const uint8_t *values,
+                               CodeTable *table) {
+  uint16_t code = 0;
+  size_t k = 0;
+  for (uint8_t length = 1; length <= 16; length++) {
+    for (size_t i = 0; i < bits[length - 1]; i++, k++, code++) {
+      table->code[values[k]] = code;
+      table->size[values[k]] = length;
+    }
+    code <<= 1;
+  }
+}
+
+void JpegEncoder::put_byte_(uint8_t byte) {
+  if (this->pos_ >= this->capacity_) {
+    this->overflow_ = true;
+    return;
+  }
+  this->out_[this->pos_++] = byte;
+}
+
+void JpegEncoder::put_marker_(uint8_t marker, uint16_t length) {
+  this->put_byte_(0xFF);
+  this->put_byte_(marker);
+  this->put_byte_(length >> 8);
+  this->put_byte_(length & 0xFF);
+}
+
+void JpegEncoder::put_bits_(uint32_t bits, uint8_t count) {
+  this->acc_ = (this->acc_ << count) | bits;
+  this->acc_count_ += count;
+  while (this->acc_count_ >= 8) {
+    const uint8_t byte = this->acc_ >> (this->acc_count_ - 8);
+    this->put_byte_(byte);
+    if (byte == 0xFF)
+      this->put_byte_(0x00);
+    this->acc_count_ -= 8;
+  }
+  this->acc_ &= (1U << this->acc_count_) - 1;
+}
+
+void JpegEncoder::put_huffman_table_(uint8_t id, const uint8_t *bits,
+                                     const uint8_t *values, size_t count) {
+  this->put_marker_(MARKER_DHT, 2 + 1 + 16 + count);
+  this->put_byte_(id);
+  for (size_t i = 0; i < 16; i++)
+    this->put_byte_(bits[i]);
+  for (size_t i = 0; i < count; i++)
+    this->put_byte_(values[i]);
+}
+
+void JpegEncoder::begin(uint8_t *out, size_t capacity, uint16_t width,
+                        uint16_t height, uint8_t component_count,
+                        const JpegComponent *components,
+                        const uint16_t (*quant)[64]) {
+  this->out_ = out;
+  this->capacity_ = capacity;
+  this->pos_ = 0;
+  this->acc_ = 0;
+  this->acc_count_ = 0;
+  this->overflow_ = false;
+  this->component_count_ = component_count;
+  memset(this->dc_pred_, 0, sizeof(this->dc_pred_));
+
+  this->put_byte_(0xFF);
+  this->put_byte_(MARKER_SOI);
+  static const uint8_t JFIF[14] = {'J', 'F', 'I', 'F', 0, 1, 1,
+                                   0,   0,   1,   0,   1, 0, 0};
+  this->put_marker_(MARKER_APP0, 2 + sizeof(JFIF));
+  for (uint8_t byte : JFIF)
+    this->put_byte_(byte);
+
+  uint8_t tables = 0;
+  for (size_t i = 0; i < component_count; i++)
+    tables |= 1 << components[i].tq;
+  for (uint8_t tq = 0; tq < 4; tq++) {
+    if (!(tables & (1 << tq)))
+      continue;
+    this->put_marker_(MARKER_DQT, 2 + 1 + 64);
+    this->put_byte_(tq);
+    for (size_t k = 0; k < 64; k++) {
+      const uint8_t q = quant[tq][k] < 1     ? 1
+                        : quant[tq][k] > 255 ? 255
+                                             : quant[tq][k];
+      this->put_byte_(q);
+      this->scale_[tq][JPEG_ZIGZAG[k]] = 1.0f / q;
+    }
+  }
+
+  this->put_marker_(MARKER_SOF0, 2 + 6 + 3 * component_count);
+  this->put_byte_(8);
+  this->put_byte_(height >> 8);
+  this->put_byte_(height & 0xFF);
+  this->put_byte_(width >> 8);
+  this->put_byte_(width & 0xFF);
+  this->put_byte_(component_count);
+  for (size_t i = 0; i < component_count; i++) {
+    this->put_byte_(components[i].id);
+    this->put_byte_((components[i].h << 4) | components[i].v);
+    this->put_byte_(components[i].tq);
+    this->tq_[i] = components[i].tq;
+    this->table_of_[i] = i == 0 ? 0 : 1;
+  }
+
+  this->put_huffman_table_(0x00, DC_LUMA_BITS, DC_VALUES, sizeof(DC_VALUES));
+  this->put_huffman_table_(0x10, AC_LUMA_BITS, AC_LUMA_VALUES,
+                           sizeof(AC_LUMA_VALUES));
+  if (component_count > 1) {
+    this->put_huffman_table_(0x01, DC_CHROMA_BITS, DC_VALUES,
+                             sizeof(DC_VALUES));
+    this->put_huffman_table_(0x11, AC_CHROMA_BITS, AC_CHROMA_VALUES,
+                             sizeof(AC_CHROMA_VALUES));
+  }
+
+  this->put_marker_(MARKER_SOS, 2 + 1 + 2 * component_count + 3);
+  this->put_byte_(component_count);
+  for (size_t i = 0; i < component_count; i++) {
+    this->put_byte_(components[i].id);
+    this->put_byte_(this->table_of_[i] * 0x11);
+  }
+  this->put_byte_(0);
+  this->put_byte_(63);
+  this->put_byte_(0);
+}
+
+static inline uint8_t magnitude_size(int32_t value) {
+  uint32_t magnitude = value < 0 ? -value : value;
+  uint8_t size = 0;
+  while (magnitude) {
+    size++;
+    magnitude >>= 1;
+  }
+  return size;
+}
+
+void JpegEncoder::encode_block(size_t component, const uint8_t *pixels,
+                               size_t stride) {
+  // separable forward DCT, rows then columns
+  float rows[8][8];
+  for (size_t y = 0; y < 8; y++) {
+    const uint8_t *line = pixels + y * stride;
+    for (size_t u = 0; u < 8; u++) {
+      float sum = 0;
+      for (size_t x = 0; x < 8; x++)
+        sum += this->cos_[u][x] * (line[x] - 128);
+      rows[y][u] = sum;
+    }
+  }
+  const float *scale = this->scale_[this->tq_[component]];
+  int32_t coef[64];
+  for (size_t u = 0; u < 8; u++) {
+    for (size_t v = 0; v < 8; v++) {
+      float sum = 0;
+      for (size_t y = 0; y < 8; y++)
+        sum += this->cos_[v][y] * rows[y][u];
+      coef[v * 8 + u] = lroundf(sum * scale[v * 8 + u]);
+    }
+  }
+  this->encode_coefficients(component, coef);
+}
+
+void JpegEncoder::encode_coefficients(size_t component, const int32_t *coef) {
+  const uint8_t table = this->table_of_[component];
+  const CodeTable &dc = this->dc_codes_[table];
+  const CodeTable &ac = this->ac_codes_[table];
+
+  const int32_t diff = coef[0] - this->dc_pred_[component];
+  this->dc_pred_[component] = coef[0];
+  uint8_t size = magnitude_size(diff);
+  this->put_bits_(dc.code[size], dc.size[size]);
+  if (size != 0)
+    this->put_bits_((diff < 0 ? diff - 1 : diff) & ((1 << size) - 1), size);
+
+  uint8_t run = 0;
+  for (size_t k = 1; k < 64; k++) {
+    const int32_t value = coef[JPEG_ZIGZAG[k]];
+    if (value == 0) {
+      run++;
+      continue;
+    }
+    while (run >= 16) {
+      this->put_bits_(ac.code[0xF0], ac.size[0xF0]);
+      run -= 16;
+    }
+    size = magnitude_size(value);
+    const uint8_t symbol = (run << 4) | size;
+    this->put_bits_(ac.code[symbol], ac.size[symbol]);
+    this->put_bits_((value < 0 ? value - 1 : value) & ((1 << size) - 1),
+                    size);
+    run = 0;
+  }
+  if (run != 0)
+    this->put_bits_(ac.code[0x00], ac.size[0x00]);
+}
+
+size_t JpegEncoder::finish() {
+  if (this->acc_count_ != 0) {
+    const uint8_t pad = 8 - this->acc_count_;
+    this->put_bits_((1U << pad) - 1, pad);
+  }
+  this->put_byte_(0xFF);
+  this->put_byte_(MARKER_EOI);
+  return this->overflow_ ? 0 : this->pos_;
+}
+
+} // namespace esp32_camera
+} // namespace esphome
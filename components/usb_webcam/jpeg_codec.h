@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Baseline JPEG building blocks: header parsing, block decoding and encoding
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace esp32_camera {
+
+static const uint8_t JPEG_MAX_COMPONENTS = 3;
+
+enum JpegStatus : uint8_t {
+  JPEG_OK,
+  JPEG_CORRUPT,     // broken headers or entropy-coded data
+  JPEG_UNSUPPORTED, // progressive, 12-bit, more than 3 components, ...
+  JPEG_OVERFLOW,    // encoded image does not fit the output buffer
+};
+const char *jpeg_status_to_string(JpegStatus status);
+
+// zigzag index -> natural (row-major) index
+extern const uint8_t JPEG_ZIGZAG[64];
+// Annex K luma (0) and chroma (1) tables scaled to quality 1..100 like
+// libjpeg does, in zigzag order
+void jpeg_quality_tables(uint8_t quality, uint16_t (*quant)[64]);
+
+struct JpegComponent {
+  uint8_t id;
+  uint8_t h, v; // sampling factors
+  uint8_t tq;   // quantization table
+  uint8_t td;   // DC Huffman table
+  uint8_t ta;   // AC Huffman table
+};
+
+/* ---------------- JpegHuffmanTable struct ---------------- */
+struct JpegHuffmanTable {
+  static const uint8_t LOOKUP_BITS = 9;
+
+  bool build(const uint8_t *bits, const uint8_t *values);
+
+  // (code length << 8) | value for codes up to LOOKUP_BITS, 0 otherwise
+  uint16_t lookup[1 << LOOKUP_BITS];
+  int32_t maxcode[18];
+  int32_t valptr[17];
+  uint8_t values[256];
+  bool present;
+};
+
+/* ---------------- JpegDecoder class ---------------- */
+// Sequential Huffman decoder for the single interleaved scan UVC cameras
+// produce. Blocks are decoded one at a time into dequantized coefficients;
+// only the top-left size x size coefficients are kept so callers can run a
+// reduced IDCT, or none at all for DC-only work.
+class JpegDecoder {
+public:
+  JpegStatus begin(const uint8_t *data, size_t len);
+  void set_block_size(uint8_t size);
+  // call once before the blocks of every MCU, handles restart markers
+  bool begin_mcu();
+  // coef receives size x size row-major coefficients
+  bool decode_block(size_t component, int32_t *coef);
+  // false if decoding ran past the entropy-coded data
+  bool end() const { return !this->overrun_(); }
+
+  uint16_t get_width() const { return this->width_; }
+  uint16_t get_height() const { return this->height_; }
+  uint8_t get_component_count() const { return this->component_count_; }
+  const JpegComponent &get_component(size_t i) const {
+    return this->components_[i];
+  }
+  uint8_t get_hmax() const { return this->hmax_; }
+  uint8_t get_vmax() const { return this->vmax_; }
+  uint16_t get_mcus_x() const { return this->mcus_x_; }
+  uint16_t get_mcus_y() const { return this->mcus_y_; }
+  // quantization tables in zigzag order
+  const uint16_t (*get_quant() const)[64] { return this->quant_; }
+
+protected:
+  JpegStatus parse_dqt_(const uint8_t *segment, size_t len);
+  JpegStatus parse_dht_(const uint8_t *segment, size_t len);
+  JpegStatus parse_sof_(const uint8_t *segment, size_t len);
+  JpegStatus parse_sos_(const uint8_t *segment, size_t len);
+  uint8_t next_byte_();
+  void fill_();
+  uint32_t get_bits_(uint8_t count);
+  int decode_(const JpegHuffmanTable &table);
+  bool overrun_() const {
+    return this->padding_bytes_ * 8 > (uint32_t)this->bit_count_;
+  }
+
+  const uint8_t *data_{nullptr};
+  size_t len_{0};
+  size_t pos_{0};
+  uint32_t bits_{0}; // MSB aligned
+  int8_t bit_count_{0};
+  bool marker_hit_{false};
+  uint32_t padding_bytes_{0}; // zeros fed in after the data ran out
+
+  uint16_t width_{0};
+  uint16_t height_{0};
+  uint8_t component_count_{0};
+  JpegComponent components_[JPEG_MAX_COMPONENTS];
+  uint8_t hmax_{1};
+  uint8_t vmax_{1};
+  uint16_t mcus_x_{0};
+  uint16_t mcus_y_{0};
+  uint16_t restart_interval_{0};
+  uint16_t mcus_to_restart_{0};
+  uint8_t next_restart_{0};
+  int32_t dc_pred_[JPEG_MAX_COMPONENTS];
+
+  uint16_t quant_[4][64];
+  JpegHuffmanTable dc_tables_[2];
+  JpegHuffmanTable ac_tables_[2];
+  uint8_t block_size_{8};
+  uint8_t block_index_[64]; // zigzag index -> coef index, 0xFF to drop
+};
+
+/* ---------------- JpegEncoder class ---------------- */
+// Baseline encoder with the standard Huffman tables, fed one 8x8 block at a
+// time in MCU order so callers only need to hold a strip of pixels.
+class JpegEncoder {
+public:
+  JpegEncoder();
+  // quant are zigzag ordered tables indexed by the components' tq
+  void begin(uint8_t *out, size_t capacity, uint16_t width, uint16_t height,
+             uint8_t component_count, const JpegComponent *components,
+             const uint16_t (*quant)[64]);
+  void encode_block(size_t component, const uint8_t *pixels, size_t stride);
+  // already quantized 8x8 row-major coefficients, entropy coded as they are
+  void encode_coefficients(size_t component, const int32_t *coef);
+  // encoded length, 0 if it did not fit
+  size_t finish();
+
+protected:
+  struct CodeTable {
+    uint16_t code[256];
+    uint8_t size[256];
+  };
+
+  static void build_codes_(const uint8_t *bits, const uint8_t *values,
+                           CodeTable *table);
+  void put_byte_(uint8_t byte);
+  void put_marker_(uint8_t marker, uint16_t length);
+  void put_bits_(uint32_t bits, uint8_t count);
+  void put_huffman_table_(uint8_t id, const uint8_t *bits,
+                          const uint8_t *values, size_t count);
+
+  uint8_t *out_{nullptr};
+  size_t capacity_{0};
+  size_t pos_{0};
+  uint32_t acc_{0};
+  uint8_t acc_count_{0};
+  bool overflow_{false};
+
+  uint8_t component_count_{0};
+  uint8_t tq_[JPEG_MAX_COMPONENTS];
+  uint8_t table_of_[JPEG_MAX_COMPONENTS]; // 0 luma, 1 chroma
+  int32_t dc_pred_[JPEG_MAX_COMPONENTS];
+  float scale_[4][64]; // natural order reciprocals of the quantizers
+  float cos_[8][8];
+  CodeTable dc_codes_[2];
+  CodeTable ac_codes_[2];
+};
+
+} // namespace esp32_camera
+} // namespace esphome
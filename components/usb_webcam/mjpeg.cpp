@@ -0,0 +1,354 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Compressed-domain helpers for the MJPEG frames delivered by UVC devices
+
+#include "mjpeg.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace esphome {
+namespace esp32_camera {
+
+/* ---------------- JPEG markers ---------------- */
+static const uint8_t MARKER_SOF0 = 0xC0;
+static const uint8_t MARKER_DHT = 0xC4;
+static const uint8_t MARKER_JPG = 0xC8;
+static const uint8_t MARKER_DAC = 0xCC;
+static const uint8_t MARKER_RST0 = 0xD0;
+static const uint8_t MARKER_RST7 = 0xD7;
+static const uint8_t MARKER_SOI = 0xD8;
+static const uint8_t MARKER_EOI = 0xD9;
+static const uint8_t MARKER_SOS = 0xDA;
+static const uint8_t MARKER_TEM = 0x01;
+
+static inline bool is_sof(uint8_t marker) {
+  return marker >= MARKER_SOF0 && marker <= 0xCF && marker != MARKER_DHT &&
+         marker != MARKER_JPG && marker != MARKER_DAC;
+}
+
+static inline bool is_standalone(uint8_t marker) {
+  return marker == MARKER_TEM || marker == MARKER_SOI ||
+         (marker >= MARKER_RST0 && marker <= MARKER_RST7);
+}
+
+/* ---------------- frame validation ---------------- */
+enum ScanEnd { SCAN_EOI, SCAN_SEGMENT, SCAN_BAD_MARKER, SCAN_TRUNCATED };
+
+// Skips entropy-coded data starting at *pos. Stops on EOI (*pos after it) or
+// on a marker segment between scans (*pos at its 0xFF).
+static ScanEnd skip_entropy_data(const uint8_t *data, size_t len,
+                                 size_t *pos) {
+  size_t p = *pos;
+  while (true) {
+    // fast path: four bytes at a time until a word contains 0xFF
+    while (p + 4 <= len) {
+      uint32_t word;
+      memcpy(&word, data + p, sizeof(word));
+      const uint32_t inverted = ~word;
+      if (((inverted - 0x01010101u) & ~inverted & 0x80808080u) != 0)
+        break;
+      p += 4;
+    }
+    // slow path: up to the 0xFF and the byte after it
+    while (p < len && data[p] != 0xFF)
+      p++;
+    if (p + 1 >= len)
+      return SCAN_TRUNCATED;
+
+    const uint8_t marker = data[p + 1];
+    if (marker == 0x00 || (marker >= MARKER_RST0 && marker <= MARKER_RST7)) {
+      p += 2; // stuffed byte or restart marker
+    } else if (marker == 0xFF) {
+      p += 1; // fill byte
+    } else if (marker == MARKER_EOI) {
+      *pos = p + 2;
+      return SCAN_EOI;
+    } else if (is_standalone(marker)) {
+      return SCAN_BAD_MARKER;
+    } else {
+      *pos = p;
+      return SCAN_SEGMENT;
+    }
+  }
+}
+
+MjpegError validate_mjpeg(const uint8_t *data, size_t len) {
+  if (len < 4 || data[0] != 0xFF || data[1] != MARKER_SOI)
+    return MJPEG_MISSING_SOI;
+
+  size_t pos = 2;
+  bool frame_header = false;
+  while (true) {
+    if (pos + 2 > len)
+      return MJPEG_TRUNCATED;
+    if (data[pos] != 0xFF)
+      return MJPEG_BAD_SEGMENT;
+    const uint8_t marker = data[pos + 1];
+    if (marker == 0xFF) {
+      pos++; // fill byte
+      continue;
+    }
+    if (marker == MARKER_EOI || is_standalone(marker))
+      return MJPEG_BAD_SEGMENT; // no image data before it
+    if (pos + 4 > len)
+      return MJPEG_TRUNCATED;
+    const size_t length = (data[pos + 2] << 8) | data[pos + 3];
+    if (length < 2)
+      return MJPEG_BAD_SEGMENT;
+    if (pos + 2 + length > len)
+      return MJPEG_TRUNCATED;
+    if (is_sof(marker))
+      frame_header = true;
+    pos += 2 + length;
+    if (marker != MARKER_SOS)
+      continue;
+
+    if (!frame_header)
+      return MJPEG_MISSING_SOF;
+    switch (skip_entropy_data(data, len, &pos)) {
+    case SCAN_EOI:
+      return MJPEG_VALID; // anything after EOI is padding
+    case SCAN_SEGMENT:
+      break; // next scan of a multi-scan image
+    case SCAN_BAD_MARKER:
+      return MJPEG_BAD_MARKER;
+    case SCAN_TRUNCATED:
+      return MJPEG_TRUNCATED;
+    }
+  }
+}
+
+const char *mjpeg_error_to_string(MjpegError error) {
+  switch (error) {
+  case MJPEG_VALID:
+    return "valid";
+  case MJPEG_MISSING_SOI:
+    return "missing SOI";
+  case MJPEG_BAD_SEGMENT:
+    return "bad segment";
+  case MJPEG_MISSING_SOF:
+    return "missing SOF";
+  case MJPEG_BAD_MARKER:
+    return "bad marker";
+  case MJPEG_TRUNCATED:
+    return "truncated";
+  default:
+    return "unknown";
+  }
+}
+
+/* ---------------- MjpegScaler class ---------------- */
+MjpegScaler::MjpegScaler() {
+  // 8-point IDCT bases sampled at the centers of 2 and 4 point blocks
+  for (size_t level = 1; level < 3; level++) {
+    const size_t size = 1 << level;
+    for (size_t x = 0; x < size; x++) {
+      for (size_t u = 0; u < size; u++) {
+        const float c = u == 0 ? sqrtf(0.5f) : 1.0f;
+        this->cos_[level][x][u] =
+            c / 2 * cosf((2 * x + 1) * u * (float)M_PI / (2 * size));
+      }
+    }
+  }
+}
+
+static inline uint8_t clamp_pixel(int32_t value) {
+  return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+void MjpegScaler::idct_(const int32_t *coef, uint8_t size, uint8_t *out,
+                        size_t stride) {
+  if (size == 1) {
+    // the block average, no transform needed
+    out[0] = clamp_pixel(128 + (coef[0] + (coef[0] < 0 ? -4 : 4)) / 8);
+    return;
+  }
+  const float(*base)[4] = this->cos_[size == 2 ? 1 : 2];
+  float rows[4][4];
+  for (size_t v = 0; v < size; v++) {
+    for (size_t x = 0; x < size; x++) {
+      float sum = 0;
+      for (size_t u = 0; u < size; u++)
+        sum += base[x][u] * coef[v * size + u];
+      rows[v][x] = sum;
+    }
+  }
+  for (size_t y = 0; y < size; y++) {
+    for (size_t x = 0; x < size; x++) {
+      float sum = 0;
+      for (size_t v = 0; v < size; v++)
+        sum += base[y][v] * rows[v][x];
+      out[y * stride + x] = clamp_pixel(128 + lroundf(sum));
+    }
+  }
+}
+
+void MjpegScaler::encode_strip_(size_t mcu_rows, uint8_t block_size) {
+  const uint8_t count = this->decoder_.get_component_count();
+  for (size_t c = 0; c < count; c++) {
+    const JpegComponent &component = this->decoder_.get_component(c);
+    const size_t width = this->plane_width_[c];
+    const size_t decoded_width = this->decoded_width_[c];
+    const size_t decoded_rows = mcu_rows * component.v * block_size;
+    uint8_t *plane = this->planes_[c].data();
+    // extend the edges into the padding of the output MCUs
+    for (size_t y = 0; y < decoded_rows && decoded_width < width; y++) {
+      uint8_t *row = plane + y * width;
+      memset(row + decoded_width, row[decoded_width - 1],
+             width - decoded_width);
+    }
+    for (size_t y = decoded_rows; y < component.v * 8u; y++)
+      memcpy(plane + y * width, plane + (decoded_rows - 1) * width, width);
+  }
+
+  for (size_t mx = 0; mx < this->out_mcus_x_; mx++) {
+    for (size_t c = 0; c < count; c++) {
+      const JpegComponent &component = this->decoder_.get_component(c);
+      const size_t width = this->plane_width_[c];
+      const uint8_t *plane = this->planes_[c].data();
+      for (size_t by = 0; by < component.v; by++) {
+        for (size_t bx = 0; bx < component.h; bx++) {
+          this->encoder_.encode_block(
+              c, plane + by * 8 * width + (mx * component.h + bx) * 8, width);
+        }
+      }
+    }
+  }
+}
+
+JpegStatus MjpegScaler::scale(const uint8_t *src, size_t src_len,
+                              uint8_t shift, uint8_t *dst, size_t capacity,
+                              size_t *dst_len, uint16_t *width,
+                              uint16_t *height) {
+  JpegStatus status = this->decoder_.begin(src, src_len);
+  if (status != JPEG_OK)
+    return status;
+  const uint8_t block_size = 8 >> shift;
+  this->decoder_.set_block_size(block_size);
+
+  const JpegDecoder &decoder = this->decoder_;
+  *width = (decoder.get_width() + (1 << shift) - 1) >> shift;
+  *height = (decoder.get_height() + (1 << shift) - 1) >> shift;
+  // the output keeps the sampling factors, so one output MCU row is made
+  // of 1 << shift input MCU rows
+  this->out_mcus_x_ =
+      (*width + 8 * decoder.get_hmax() - 1) / (8 * decoder.get_hmax());
+  const uint8_t count = decoder.get_component_count();
+  JpegComponent components[JPEG_MAX_COMPONENTS];
+  for (size_t c = 0; c < count; c++) {
+    components[c] = decoder.get_component(c);
+    this->plane_width_[c] = this->out_mcus_x_ * components[c].h * 8;
+    this->decoded_width_[c] =
+        decoder.get_mcus_x() * components[c].h * block_size;
+    this->planes_[c].resize(this->plane_width_[c] * components[c].v * 8);
+  }
+  this->encoder_.begin(dst, capacity, *width, *height, count, components,
+                       decoder.get_quant());
+
+  const size_t strip_rows = 1 << shift;
+  size_t filled = 0;
+  int32_t coef[16];
+  for (size_t my = 0; my < decoder.get_mcus_y(); my++) {
+    for (size_t mx = 0; mx < decoder.get_mcus_x(); mx++) {
+      if (!this->decoder_.begin_mcu())
+        return JPEG_CORRUPT;
+      for (size_t c = 0; c < count; c++) {
+        const size_t plane_width = this->plane_width_[c];
+        for (size_t by = 0; by < components[c].v; by++) {
+          for (size_t bx = 0; bx < components[c].h; bx++) {
+            if (!this->decoder_.decode_block(c, coef))
+              return JPEG_CORRUPT;
+            const size_t x = (mx * components[c].h + bx) * block_size;
+            const size_t y = (filled * components[c].v + by) * block_size;
+            this->idct_(coef, block_size,
+                        &this->planes_[c][y * plane_width + x], plane_width);
+          }
+        }
+      }
+    }
+    if (++filled == strip_rows || my + 1 == decoder.get_mcus_y()) {
+      this->encode_strip_(filled, block_size);
+      filled = 0;
+    }
+  }
+
+  if (!this->decoder_.end())
+    return JPEG_CORRUPT;
+  *dst_len = this->encoder_.finish();
+  return *dst_len == 0 ? JPEG_OVERFLOW : JPEG_OK;
+}
+
+/* ---------------- MjpegCropper class ---------------- */
+JpegStatus MjpegCropper::crop(const uint8_t *src, size_t src_len, uint16_t x,
+                              uint16_t y, uint16_t crop_width,
+                              uint16_t crop_height, uint8_t *dst,
+                              size_t capacity, size_t *dst_len,
+                              uint16_t *width, uint16_t *height) {
+  JpegStatus status = this->decoder_.begin(src, src_len);
+  if (status != JPEG_OK)
+    return status;
+  this->decoder_.set_block_size(8);
+
+  const JpegDecoder &decoder = this->decoder_;
+  const uint8_t count = decoder.get_component_count();
+  JpegComponent components[JPEG_MAX_COMPONENTS];
+  for (size_t c = 0; c < count; c++) {
+    components[c] = decoder.get_component(c);
+    const uint16_t *quant = decoder.get_quant()[components[c].tq];
+    for (size_t k = 0; k < 64; k++) {
+      // the encoder only writes 8-bit tables
+      if (quant[k] == 0 || quant[k] > 255)
+        return JPEG_UNSUPPORTED;
+      this->quant_[components[c].tq][JPEG_ZIGZAG[k]] = quant[k];
+    }
+  }
+
+  // at least one MCU, never past the frame
+  const size_t mcus_x = decoder.get_mcus_x();
+  const size_t mcus_y = decoder.get_mcus_y();
+  const size_t mcu_width = 8 * decoder.get_hmax();
+  const size_t mcu_height = 8 * decoder.get_vmax();
+  const size_t first_x = std::min(x / mcu_width, mcus_x - 1);
+  const size_t first_y = std::min(y / mcu_height, mcus_y - 1);
+  size_t last_x = (x + crop_width + mcu_width - 1) / mcu_width;
+  size_t last_y = (y + crop_height + mcu_height - 1) / mcu_height;
+  last_x = std::min(std::max(last_x, first_x + 1), mcus_x);
+  last_y = std::min(std::max(last_y, first_y + 1), mcus_y);
+  *width = std::min<size_t>((last_x - first_x) * mcu_width,
+                            decoder.get_width() - first_x * mcu_width);
+  *height = std::min<size_t>((last_y - first_y) * mcu_height,
+                             decoder.get_height() - first_y * mcu_height);
+  this->encoder_.begin(dst, capacity, *width, *height, count, components,
+                       decoder.get_quant());
+
+  int32_t coef[64];
+  for (size_t my = 0; my < last_y; my++) {
+    for (size_t mx = 0; mx < mcus_x; mx++) {
+      if (!this->decoder_.begin_mcu())
+        return JPEG_CORRUPT;
+      // blocks outside still have to be decoded to find the next ones
+      const bool inside = my >= first_y && mx >= first_x && mx < last_x;
+      for (size_t c = 0; c < count; c++) {
+        const uint16_t *quant = this->quant_[components[c].tq];
+        for (size_t b = 0; b < components[c].h * components[c].v; b++) {
+          if (!this->decoder_.decode_block(c, coef))
+            return JPEG_CORRUPT;
+          if (!inside)
+            continue;
+          for (size_t i = 0; i < 64; i++)
+            coef[i] /= quant[i];
+          this->encoder_.encode_coefficients(c, coef);
+        }
+      }
+    }
+  }
+
+  if (!this->decoder_.end())
+    return JPEG_CORRUPT;
+  *dst_len = this->encoder_.finish();
+  return *dst_len == 0 ? JPEG_OVERFLOW : JPEG_OK;
+}
+
+} // namespace esp32_camera
+} // namespace esphome
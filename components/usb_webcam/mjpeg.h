@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Compressed-domain helpers for the MJPEG frames delivered by UVC devices
+
+#pragma once
+
+#include "jpeg_codec.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace esphome {
+namespace esp32_camera {
+
+/* ---------------- frame validation ---------------- */
+enum MjpegError : uint8_t {
+  MJPEG_VALID,
+  MJPEG_MISSING_SOI,   // does not start with a JPEG header
+  MJPEG_BAD_SEGMENT,   // broken marker segment structure
+  MJPEG_MISSING_SOF,   // scan without a frame header
+  MJPEG_BAD_MARKER,    // unexpected marker inside entropy-coded data
+  MJPEG_TRUNCATED,     // buffer ends before the EOI marker
+  MJPEG_ERROR_COUNT
+};
+
+// Checks SOI, marker segment structure, the entropy-coded data of every scan
+// and the final EOI in a single pass, scanning entropy-coded data a 32-bit
+// word at a time.
+MjpegError validate_mjpeg(const uint8_t *data, size_t len);
+const char *mjpeg_error_to_string(MjpegError error);
+
+/* ---------------- MjpegScaler class ---------------- */
+// Shrinks baseline frames by 1/2, 1/4 or 1/8 without a full decode: blocks
+// keep only their low-frequency coefficients for a reduced IDCT (DC only at
+// 1/8), and the result is re-encoded one MCU row at a time with the source
+// quantization tables, so only a strip of pixels is ever held.
+class MjpegScaler {
+public:
+  MjpegScaler();
+  // shift is 1..3 for 1/2..1/8, width and height receive the scaled size
+  JpegStatus scale(const uint8_t *src, size_t src_len, uint8_t shift,
+                   uint8_t *dst, size_t capacity, size_t *dst_len,
+                   uint16_t *width, uint16_t *height);
+
+protected:
+  void idct_(const int32_t *coef, uint8_t size, uint8_t *out, size_t stride);
+  void encode_strip_(size_t mcu_rows, uint8_t block_size);
+
+  JpegDecoder decoder_;
+  JpegEncoder encoder_;
+  std::vector<uint8_t> planes_[JPEG_MAX_COMPONENTS];
+  size_t plane_width_[JPEG_MAX_COMPONENTS];
+  size_t decoded_width_[JPEG_MAX_COMPONENTS];
+  size_t out_mcus_x_{0};
+  float cos_[3][4][4]; // reduced IDCT bases for 1, 2 and 4 point blocks
+};
+
+/* ---------------- MjpegCropper class ---------------- */
+// Cuts a rectangle out of baseline frames at MCU boundaries without touching
+// pixels: blocks are only entropy decoded, then coded again with the same
+// quantized coefficients, so the crop is lossless and only the DC predictions
+// change. MCU rows below the rectangle are not decoded at all.
+class MjpegCropper {
+public:
+  // the rectangle is in pixels and widened to whole MCUs, width and height
+  // receive the cropped size
+  JpegStatus crop(const uint8_t *src, size_t src_len, uint16_t x, uint16_t y,
+                  uint16_t crop_width, uint16_t crop_height, uint8_t *dst,
+                  size_t capacity, size_t *dst_len, uint16_t *width,
+                  uint16_t *height);
+
+protected:
+  JpegDecoder decoder_;
+  JpegEncoder encoder_;
+  uint16_t quant_[4][64]; // natural order, to undo the dequantization
+};
+
+} // namespace esp32_camera
+} // namespace esphome
@@ -0,0 +1,167 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Compressed-domain motion detection on MJPEG frames
+
+#ifdef USE_ESP32
+
+#include "motion_detector.h"
+
+#include "esphome/core/log.h"
+
+#include <esp_timer.h>
+
+namespace esphome {
+namespace esp32_camera {
+
+static const char *const TAG = "usb_webcam.motion";
+// the background follows the scene by 1/16 of the difference per analysis
+static const uint8_t BACKGROUND_LEARN_SHIFT = 4;
+// fraction bits the background keeps below the 1/16 luma levels of the DC,
+// so that differences smaller than 16 levels still move it
+static const uint8_t BACKGROUND_FRACTION_BITS = 4;
+
+static uint32_t now_ms() { return esp_timer_get_time() / 1000; }
+
+/* ---------------- constructors ---------------- */
+MotionDetector::MotionDetector() {
+  global_motion_detector = this;
+  this->decoder_.set_block_size(1);
+}
+
+/* ---------------- public API (derivated) ---------------- */
+void MotionDetector::setup() {
+#ifdef USE_BINARY_SENSOR
+  if (this->motion_binary_sensor_ != nullptr)
+    this->motion_binary_sensor_->publish_initial_state(false);
+#endif
+}
+
+void MotionDetector::loop() {
+  // checked on every loop, the hold time also runs out without frames
+  const bool active = this->is_active();
+  if (active != this->published_active_) {
+    ESP_LOGD(TAG, "Motion %s", active ? "started" : "ended");
+#ifdef USE_BINARY_SENSOR
+    if (this->motion_binary_sensor_ != nullptr)
+      this->motion_binary_sensor_->publish_state(active);
+#endif
+    this->published_active_ = active;
+  }
+
+  // scores only change with new analyses
+  const uint32_t analyzed = this->analyzed_.load();
+  if (analyzed == this->last_analyzed_)
+    return;
+  this->last_analyzed_ = analyzed;
+#ifdef USE_SENSOR
+  if (this->score_sensor_ != nullptr)
+    this->score_sensor_->publish_state(this->score_.load() * 100.0f);
+#endif
+}
+
+void MotionDetector::dump_config() {
+  ESP_LOGCONFIG(TAG, "USB WebCamera motion detection:");
+  ESP_LOGCONFIG(TAG, "  Analysis interval: %u ms", this->analysis_interval_ms_);
+  ESP_LOGCONFIG(TAG, "  Luma threshold: %u", this->luma_threshold_);
+  ESP_LOGCONFIG(TAG, "  Area threshold: %.1f%%", this->area_threshold_ * 100);
+  ESP_LOGCONFIG(TAG, "  Hold time: %u ms", this->hold_time_ms_);
+  ESP_LOGCONFIG(TAG, "  Gated requesters:%s%s%s%s",
+                this->gated_requesters_ & (1U << IDLE) ? " idle" : "",
+                this->gated_requesters_ & (1U << API_REQUESTER) ? " api" : "",
+                this->gated_requesters_ & (1U << WEB_REQUESTER) ? " web" : "",
+                this->gated_requesters_ & (1U << HTTP_REQUESTER) ? " http"
+                                                                 : "");
+#ifdef USE_BINARY_SENSOR
+  LOG_BINARY_SENSOR("  ", "Motion", this->motion_binary_sensor_);
+#endif
+#ifdef USE_SENSOR
+  LOG_SENSOR("  ", "Score", this->score_sensor_);
+#endif
+}
+
+/* ---------------- public API (specific) ---------------- */
+void MotionDetector::analyze(const camera_fb_t *fb) {
+  const uint32_t start_ms = now_ms();
+  if (this->last_analysis_ms_ != 0 &&
+      start_ms - this->last_analysis_ms_ < this->analysis_interval_ms_)
+    return;
+  this->last_analysis_ms_ = start_ms;
+  if (fb->format != PIXFORMAT_JPEG ||
+      this->decoder_.begin(fb->buf, fb->len) != JPEG_OK)
+    return;
+
+  const JpegDecoder &decoder = this->decoder_;
+  const size_t mcus = decoder.get_mcus_x() * decoder.get_mcus_y();
+  bool learned = true;
+  if (decoder.get_width() != this->background_width_ ||
+      decoder.get_height() != this->background_height_) {
+    // first frame or resolution changed, start over
+    this->background_.assign(mcus, 0);
+    this->background_width_ = decoder.get_width();
+    this->background_height_ = decoder.get_height();
+    learned = false;
+  }
+
+  const uint8_t count = decoder.get_component_count();
+  const uint8_t luma_blocks =
+      decoder.get_component(0).h * decoder.get_component(0).v;
+  const int32_t threshold = this->luma_threshold_ * 16;
+  int32_t *background = this->background_.data();
+  size_t changed = 0;
+  for (size_t mcu = 0; mcu < mcus; mcu++) {
+    if (!this->decoder_.begin_mcu())
+      return;
+    // DC is 8 times the block mean, only luma counts but every block has to
+    // be decoded to get to the next one
+    int32_t sum = 0;
+    for (size_t c = 0; c < count; c++) {
+      const JpegComponent &component = decoder.get_component(c);
+      for (size_t block = 0; block < component.h * component.v; block++) {
+        int32_t dc;
+        if (!this->decoder_.decode_block(c, &dc))
+          return;
+        if (c == 0)
+          sum += dc;
+      }
+    }
+    const int32_t level = (sum * 2 / luma_blocks) << BACKGROUND_FRACTION_BITS;
+    if (!learned) {
+      background[mcu] = level;
+      continue;
+    }
+    const int32_t diff = level - background[mcu];
+    const int32_t levels = diff / (1 << BACKGROUND_FRACTION_BITS);
+    if (levels > threshold || levels < -threshold)
+      changed++;
+    // arithmetic shift, small negative differences still count
+    background[mcu] += diff >> BACKGROUND_LEARN_SHIFT;
+  }
+  if (!this->decoder_.end())
+    return;
+
+  const float score = learned ? (float)changed / mcus : 0.0f;
+  this->score_ = score;
+  if (learned && score >= this->area_threshold_) {
+    this->last_motion_ms_ = now_ms();
+    this->motion_seen_ = true;
+  }
+  this->analyzed_++;
+}
+
+bool MotionDetector::is_active() const {
+  return this->motion_seen_ &&
+         now_ms() - this->last_motion_ms_ < this->hold_time_ms_;
+}
+
+uint8_t MotionDetector::filter_requesters(uint8_t requesters) const {
+  if ((requesters & this->gated_requesters_) == 0 || this->is_active())
+    return requesters;
+  return requesters & ~this->gated_requesters_;
+}
+
+MotionDetector *
+    global_motion_detector; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
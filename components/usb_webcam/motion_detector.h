@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Compressed-domain motion detection on MJPEG frames
+
+#pragma once
+
+#ifdef USE_ESP32
+
+#include "../esp32_camera/esp32_camera.h"
+#include "esphome/core/component.h"
+#include "esphome/core/defines.h"
+#include "jpeg_codec.h"
+
+#ifdef USE_BINARY_SENSOR
+#include "esphome/components/binary_sensor/binary_sensor.h"
+#endif
+#ifdef USE_SENSOR
+#include "esphome/components/sensor/sensor.h"
+#endif
+
+#include <atomic>
+#include <vector>
+
+namespace esphome {
+namespace esp32_camera {
+
+/* ---------------- MotionDetector class ---------------- */
+// Compares the average luma of every MCU, taken from the DC coefficients
+// alone, against a slowly learning background. Frames are analyzed from the
+// framebuffer task before they are handed to loop(), which can then hold
+// back frames from gated requesters while the scene is quiet.
+class MotionDetector : public Component {
+public:
+  MotionDetector();
+
+  /* setters */
+  void set_analysis_interval(uint32_t analysis_interval_ms) {
+    this->analysis_interval_ms_ = analysis_interval_ms;
+  }
+  void set_luma_threshold(uint8_t luma_threshold) {
+    this->luma_threshold_ = luma_threshold;
+  }
+  void set_area_threshold(float area_threshold) {
+    this->area_threshold_ = area_threshold;
+  }
+  void set_hold_time(uint32_t hold_time_ms) {
+    this->hold_time_ms_ = hold_time_ms;
+  }
+  void add_gated_requester(CameraRequester requester) {
+    this->gated_requesters_ |= (1U << requester);
+  }
+#ifdef USE_BINARY_SENSOR
+  void set_motion_binary_sensor(binary_sensor::BinarySensor *sensor) {
+    this->motion_binary_sensor_ = sensor;
+  }
+#endif
+#ifdef USE_SENSOR
+  void set_score_sensor(sensor::Sensor *sensor) {
+    this->score_sensor_ = sensor;
+  }
+#endif
+
+  /* public API (derivated) */
+  void setup() override;
+  void loop() override;
+  void dump_config() override;
+  /* public API (specific) */
+  // called from the framebuffer task, skips frames within the interval
+  void analyze(const camera_fb_t *fb);
+  bool is_active() const;
+  // drops gated requesters while no motion is seen, only for streams and
+  // idle updates: single requests are always answered
+  uint8_t filter_requesters(uint8_t requesters) const;
+
+protected:
+  uint32_t analysis_interval_ms_{200};
+  uint8_t luma_threshold_{12};
+  float area_threshold_{0.02f};
+  uint32_t hold_time_ms_{5000};
+  uint8_t gated_requesters_{0};
+#ifdef USE_BINARY_SENSOR
+  binary_sensor::BinarySensor *motion_binary_sensor_{nullptr};
+#endif
+#ifdef USE_SENSOR
+  sensor::Sensor *score_sensor_{nullptr};
+#endif
+
+  /* framebuffer task only */
+  JpegDecoder decoder_;
+  std::vector<int32_t> background_; // per MCU, 1/256 luma levels
+  uint16_t background_width_{0};
+  uint16_t background_height_{0};
+  uint32_t last_analysis_ms_{0};
+
+  /* shared with loop() */
+  std::atomic<float> score_{0};
+  std::atomic<bool> motion_seen_{false};
+  std::atomic<uint32_t> last_motion_ms_{0};
+  std::atomic<uint32_t> analyzed_{0};
+
+  /* loop() only */
+  uint32_t last_analyzed_{0};
+  bool published_active_{false};
+};
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+extern MotionDetector *global_motion_detector;
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Frame pipeline latency and drop statistics
+
+#ifdef USE_ESP32
+
+#include "pipeline_stats.h"
+
+#include "esphome/core/log.h"
+
+#include <algorithm>
+#include <esp_timer.h>
+
+namespace esphome {
+namespace esp32_camera {
+
+static const char *const TAG = "usb_webcam.stats";
+
+/* ---------------- LatencyWindow class ---------------- */
+void LatencyWindow::add(uint32_t sample_us) {
+  this->samples_[this->next_] = sample_us;
+  this->next_ = (this->next_ + 1) % SIZE;
+  if (this->count_ < SIZE)
+    this->count_++;
+}
+
+bool LatencyWindow::summarize(uint32_t *p50_us, uint32_t *p95_us,
+                              uint32_t *max_us) const {
+  if (this->count_ == 0)
+    return false;
+  uint32_t sorted[SIZE];
+  std::copy(this->samples_, this->samples_ + this->count_, sorted);
+  std::sort(sorted, sorted + this->count_);
+  *p50_us = sorted[(this->count_ - 1) * 50 / 100];
+  *p95_us = sorted[(this->count_ - 1) * 95 / 100];
+  *max_us = sorted[this->count_ - 1];
+  return true;
+}
+
+/* ---------------- PipelineStats class ---------------- */
+void PipelineStats::record_release(const FrameTimes &times,
+                                   int64_t released_us) {
+  this->windows_[STAGE_HANDOFF].add(times.queued_us - times.captured_us);
+  this->windows_[STAGE_PICKUP].add(times.picked_us - times.queued_us);
+  this->windows_[STAGE_RELEASE].add(released_us - times.picked_us);
+  this->windows_[STAGE_TOTAL].add(released_us - times.captured_us);
+}
+
+uint32_t PipelineStats::get_corrupt() const {
+  uint32_t total = 0;
+  for (const auto &count : this->corrupt_)
+    total += count.load();
+  return total;
+}
+
+PipelineStats
+    global_pipeline_stats; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+#ifdef USE_SENSOR
+/* ---------------- PipelineMonitor class ---------------- */
+static const char *const STAGE_NAMES[STAGE_COUNT] = {
+    "Handoff", "Pickup", "Release", "Total", "Resume"};
+
+void PipelineMonitor::set_latency_sensors(PipelineStage stage,
+                                          sensor::Sensor *p50,
+                                          sensor::Sensor *p95,
+                                          sensor::Sensor *max) {
+  this->latency_sensors_[stage] = LatencySensors{p50, p95, max};
+}
+
+void PipelineMonitor::update() {
+  const PipelineStats &stats = global_pipeline_stats;
+  for (size_t stage = 0; stage < STAGE_COUNT; stage++) {
+    const LatencySensors &sensors = this->latency_sensors_[stage];
+    uint32_t p50_us, p95_us, max_us;
+    if (!stats.get_window((PipelineStage)stage)
+             .summarize(&p50_us, &p95_us, &max_us))
+      continue;
+    if (sensors.p50 != nullptr)
+      sensors.p50->publish_state(p50_us / 1000.0f);
+    if (sensors.p95 != nullptr)
+      sensors.p95->publish_state(p95_us / 1000.0f);
+    if (sensors.max != nullptr)
+      sensors.max->publish_state(max_us / 1000.0f);
+  }
+  if (this->delivered_sensor_ != nullptr)
+    this->delivered_sensor_->publish_state(stats.get_delivered());
+  if (this->dropped_too_small_sensor_ != nullptr)
+    this->dropped_too_small_sensor_->publish_state(
+        stats.get_dropped_too_small());
+  if (this->dropped_busy_sensor_ != nullptr)
+    this->dropped_busy_sensor_->publish_state(stats.get_dropped_busy());
+  if (this->oversize_sensor_ != nullptr)
+    this->oversize_sensor_->publish_state(stats.get_oversize());
+  if (this->dropped_corrupt_sensor_ != nullptr)
+    this->dropped_corrupt_sensor_->publish_state(stats.get_corrupt());
+  if (this->skipped_unchanged_sensor_ != nullptr)
+    this->skipped_unchanged_sensor_->publish_state(
+        stats.get_skipped_unchanged());
+  // USB payload delivered to the frame callback since the last update
+  const int64_t now_us = esp_timer_get_time();
+  const uint32_t received = stats.get_received();
+  if (this->throughput_sensor_ != nullptr && this->last_update_us_ != 0) {
+    this->throughput_sensor_->publish_state(
+        (received - this->last_received_) * 1000.0f /
+        (now_us - this->last_update_us_));
+  }
+  this->last_received_ = received;
+  this->last_update_us_ = now_us;
+  for (size_t error = MJPEG_VALID + 1; error < MJPEG_ERROR_COUNT; error++) {
+    uint32_t count = stats.get_corrupt((MjpegError)error);
+    if (count != 0)
+      ESP_LOGD(TAG, "Dropped corrupt frames, %s: %u",
+               mjpeg_error_to_string((MjpegError)error), count);
+  }
+}
+
+void PipelineMonitor::dump_config() {
+  ESP_LOGCONFIG(TAG, "USB WebCamera statistics:");
+  for (size_t stage = 0; stage < STAGE_COUNT; stage++) {
+    const LatencySensors &sensors = this->latency_sensors_[stage];
+    ESP_LOGCONFIG(TAG, "  %s latency:", STAGE_NAMES[stage]);
+    LOG_SENSOR("    ", "p50", sensors.p50);
+    LOG_SENSOR("    ", "p95", sensors.p95);
+    LOG_SENSOR("    ", "Max", sensors.max);
+  }
+  LOG_SENSOR("  ", "Delivered frames", this->delivered_sensor_);
+  LOG_SENSOR("  ", "Dropped too small", this->dropped_too_small_sensor_);
+  LOG_SENSOR("  ", "Dropped busy", this->dropped_busy_sensor_);
+  LOG_SENSOR("  ", "Oversize frames", this->oversize_sensor_);
+  LOG_SENSOR("  ", "Dropped corrupt", this->dropped_corrupt_sensor_);
+  LOG_SENSOR("  ", "Throughput", this->throughput_sensor_);
+  LOG_SENSOR("  ", "Skipped unchanged", this->skipped_unchanged_sensor_);
+}
+#endif
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Frame pipeline latency and drop statistics
+
+#pragma once
+
+#ifdef USE_ESP32
+
+#include "esphome/core/component.h"
+#include "esphome/core/defines.h"
+#include "frame_ring.h"
+#include "mjpeg.h"
+
+#ifdef USE_SENSOR
+#include "esphome/components/sensor/sensor.h"
+#endif
+
+#include <atomic>
+
+namespace esphome {
+namespace esp32_camera {
+
+/* ---------------- LatencyWindow class ---------------- */
+// Rolling window over the last samples, summarized on demand.
+class LatencyWindow {
+public:
+  void add(uint32_t sample_us);
+  bool summarize(uint32_t *p50_us, uint32_t *p95_us, uint32_t *max_us) const;
+
+protected:
+  static constexpr size_t SIZE = 128;
+  uint32_t samples_[SIZE];
+  size_t count_{0};
+  size_t next_{0};
+};
+
+enum PipelineStage {
+  STAGE_HANDOFF, // UVC callback -> framebuffer task handoff
+  STAGE_PICKUP,  // handoff -> loop() pickup
+  STAGE_RELEASE, // loop() pickup -> release by the last consumer
+  STAGE_TOTAL,   // UVC callback -> release by the last consumer
+  STAGE_RESUME,  // stream resumed -> first frame delivered
+  STAGE_COUNT
+};
+
+/* ---------------- PipelineStats class ---------------- */
+// Counters are bumped from the USB and framebuffer tasks, latency windows
+// are only fed from the main loop when a frame is released.
+class PipelineStats {
+public:
+  void count_delivered() { this->delivered_++; }
+  void count_received(size_t bytes) { this->received_bytes_ += bytes; }
+  void count_dropped_too_small() { this->dropped_too_small_++; }
+  void count_dropped_busy() { this->dropped_busy_++; }
+  void count_oversize() { this->oversize_++; }
+  void count_corrupt(MjpegError error) { this->corrupt_[error]++; }
+  void count_skipped_unchanged() { this->skipped_unchanged_++; }
+  void record_release(const FrameTimes &times, int64_t released_us);
+  void record_resume(uint32_t resume_us) {
+    this->windows_[STAGE_RESUME].add(resume_us);
+  }
+
+  uint32_t get_delivered() const { return this->delivered_.load(); }
+  // wraps around, only differences are meaningful
+  uint32_t get_received() const { return this->received_bytes_.load(); }
+  uint32_t get_dropped_too_small() const {
+    return this->dropped_too_small_.load();
+  }
+  uint32_t get_dropped_busy() const { return this->dropped_busy_.load(); }
+  uint32_t get_oversize() const { return this->oversize_.load(); }
+  uint32_t get_corrupt(MjpegError error) const {
+    return this->corrupt_[error].load();
+  }
+  uint32_t get_corrupt() const;
+  uint32_t get_skipped_unchanged() const {
+    return this->skipped_unchanged_.load();
+  }
+  const LatencyWindow &get_window(PipelineStage stage) const {
+    return this->windows_[stage];
+  }
+
+protected:
+  std::atomic<uint32_t> delivered_{0};
+  std::atomic<uint32_t> received_bytes_{0};
+  std::atomic<uint32_t> dropped_too_small_{0};
+  std::atomic<uint32_t> dropped_busy_{0};
+  std::atomic<uint32_t> oversize_{0};
+  std::atomic<uint32_t> corrupt_[MJPEG_ERROR_COUNT]{};
+  std::atomic<uint32_t> skipped_unchanged_{0};
+  LatencyWindow windows_[STAGE_COUNT];
+};
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+extern PipelineStats global_pipeline_stats;
+
+#ifdef USE_SENSOR
+/* ---------------- PipelineMonitor class ---------------- */
+// Publishes global_pipeline_stats as sensors.
+class PipelineMonitor : public PollingComponent {
+public:
+  /* setters */
+  void set_latency_sensors(PipelineStage stage, sensor::Sensor *p50,
+                           sensor::Sensor *p95, sensor::Sensor *max);
+  void set_delivered_sensor(sensor::Sensor *sensor) {
+    this->delivered_sensor_ = sensor;
+  }
+  void set_dropped_too_small_sensor(sensor::Sensor *sensor) {
+    this->dropped_too_small_sensor_ = sensor;
+  }
+  void set_dropped_busy_sensor(sensor::Sensor *sensor) {
+    this->dropped_busy_sensor_ = sensor;
+  }
+  void set_oversize_sensor(sensor::Sensor *sensor) {
+    this->oversize_sensor_ = sensor;
+  }
+  void set_dropped_corrupt_sensor(sensor::Sensor *sensor) {
+    this->dropped_corrupt_sensor_ = sensor;
+  }
+  void set_throughput_sensor(sensor::Sensor *sensor) {
+    this->throughput_sensor_ = sensor;
+  }
+  void set_skipped_unchanged_sensor(sensor::Sensor *sensor) {
+    this->skipped_unchanged_sensor_ = sensor;
+  }
+
+  /* public API (derivated) */
+  void update() override;
+  void dump_config() override;
+
+protected:
+  struct LatencySensors {
+    sensor::Sensor *p50{nullptr};
+    sensor::Sensor *p95{nullptr};
+    sensor::Sensor *max{nullptr};
+  };
+
+  LatencySensors latency_sensors_[STAGE_COUNT];
+  sensor::Sensor *delivered_sensor_{nullptr};
+  sensor::Sensor *dropped_too_small_sensor_{nullptr};
+  sensor::Sensor *dropped_busy_sensor_{nullptr};
+  sensor::Sensor *oversize_sensor_{nullptr};
+  sensor::Sensor *dropped_corrupt_sensor_{nullptr};
+  sensor::Sensor *throughput_sensor_{nullptr};
+  sensor::Sensor *skipped_unchanged_sensor_{nullptr};
+  uint32_t last_received_{0};
+  int64_t last_update_us_{0};
+};
+#endif
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
@@ -0,0 +1,212 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Frame rate and resolution following how fast consumers drain frames
+
+#ifdef USE_ESP32
+
+#include "rate_controller.h"
+
+#include "esphome/core/log.h"
+
+#include <algorithm>
+#include <esp_timer.h>
+
+namespace esphome {
+namespace esp32_camera {
+
+static const char *const TAG = "usb_webcam.rate";
+// consumers holding frames longer than this share of the interval stall
+// loop(), with less than the lower one there is room for more
+static const float CONGESTED_SHARE = 1.0f;
+static const float SPARE_SHARE = 0.5f;
+// bigger frames or shorter intervals must be predicted to stay below this
+static const float STEP_UP_SHARE = 0.7f;
+static const uint8_t STEP_UP_WINDOWS = 3;
+static const float INTERVAL_STEP = 1.5f;
+
+/* ---------------- constructors ---------------- */
+RateController::RateController(ESP32Camera *camera) : camera_(camera) {
+  global_rate_controller = this;
+}
+
+/* ---------------- public API (derivated) ---------------- */
+void RateController::setup() {
+  this->window_start_us_ = esp_timer_get_time();
+  this->set_interval("evaluate", this->evaluation_interval_ms_,
+                     [this]() { this->evaluate_(); });
+}
+
+void RateController::dump_config() {
+  ESP_LOGCONFIG(TAG, "USB WebCamera rate control:");
+  ESP_LOGCONFIG(TAG, "  Min framerate: %.2f fps",
+                1000.0f / this->max_interval_ms_);
+  ESP_LOGCONFIG(TAG, "  Evaluation interval: %u ms",
+                this->evaluation_interval_ms_);
+  ESP_LOGCONFIG(TAG, "  Step resolution: %s",
+                YESNO(this->step_resolution_));
+#ifdef USE_SENSOR
+  LOG_SENSOR("  ", "Framerate", this->framerate_sensor_);
+#endif
+}
+
+/* ---------------- public API (specific) ---------------- */
+void RateController::record_release(size_t bytes, uint32_t held_us) {
+  this->frames_++;
+  this->bytes_ += bytes;
+  this->held_us_ += held_us;
+}
+
+/* ---------------- internal methods ---------------- */
+void RateController::evaluate_() {
+  const int64_t now_us = esp_timer_get_time();
+  const float seconds = (now_us - this->window_start_us_) / 1e6f;
+  const uint32_t frames = this->frames_;
+  const uint64_t bytes = this->bytes_;
+  const uint64_t held_us = this->held_us_;
+  this->window_start_us_ = now_us;
+  this->frames_ = 0;
+  this->bytes_ = 0;
+  this->held_us_ = 0;
+#ifdef USE_SENSOR
+  if (this->framerate_sensor_ != nullptr)
+    this->framerate_sensor_->publish_state(frames / seconds);
+#endif
+
+  // the mode was changed from elsewhere, start over from it
+  uint16_t width, height;
+  if (this->base_width_ != 0 &&
+      this->camera_->get_current_mode(&width, &height) &&
+      (width != this->set_width_ || height != this->set_height_)) {
+    ESP_LOGD(TAG, "Resolution changed to %ux%u elsewhere", width, height);
+    this->base_width_ = 0;
+    this->base_height_ = 0;
+  }
+  if (this->settling_ || frames == 0 || held_us == 0) {
+    // nothing consumed or still measuring the previous mode
+    this->settling_ = false;
+    this->good_windows_ = 0;
+    return;
+  }
+
+  const uint32_t interval_ms =
+      std::max(this->camera_->get_max_update_interval(), this->throttle_ms_);
+  const float held_ms = held_us / 1000.0f / frames;
+  const float drain_rate = bytes * 1e6f / held_us; // bytes/s
+  const float frame_bytes = (float)bytes / frames;
+  ESP_LOGV(TAG, "%.1f fps, frames held %.0f ms of %u, drain %.0f kB/s",
+           frames / seconds, held_ms, interval_ms, drain_rate / 1000);
+
+  bool changed = false;
+  if (held_ms > interval_ms * CONGESTED_SHARE) {
+    this->good_windows_ = 0;
+    changed = this->step_down_(interval_ms);
+  } else if (held_ms < interval_ms * SPARE_SHARE) {
+    if (++this->good_windows_ >= STEP_UP_WINDOWS) {
+      this->good_windows_ = 0;
+      changed = this->step_up_(interval_ms, drain_rate, frame_bytes);
+    }
+  } else {
+    this->good_windows_ = 0;
+  }
+  this->settling_ = changed;
+}
+
+bool RateController::step_down_(uint32_t interval_ms) {
+  uint16_t width, height;
+  if (this->step_resolution_ && this->find_mode_(false, &width, &height)) {
+    if (this->base_width_ == 0)
+      this->camera_->get_current_mode(&this->base_width_, &this->base_height_);
+    ESP_LOGI(TAG, "Consumers fall behind, resolution down to %ux%u", width,
+             height);
+    return this->set_mode_(width, height);
+  }
+  if (interval_ms >= this->max_interval_ms_)
+    return false;
+  this->throttle_ms_ = std::min(
+      (uint32_t)(interval_ms * INTERVAL_STEP), this->max_interval_ms_);
+  ESP_LOGI(TAG, "Consumers fall behind, interval up to %u ms",
+           this->throttle_ms_);
+  this->camera_->set_throttle_interval(this->throttle_ms_);
+  return true;
+}
+
+bool RateController::step_up_(uint32_t interval_ms, float drain_rate,
+                              float frame_bytes) {
+  // intervals first, undoing the last steps down
+  const uint32_t base_ms = this->camera_->get_max_update_interval();
+  if (this->throttle_ms_ > base_ms) {
+    const uint32_t shorter =
+        std::max((uint32_t)(interval_ms / INTERVAL_STEP), base_ms);
+    if (frame_bytes / drain_rate * 1000 > shorter * STEP_UP_SHARE)
+      return false;
+    this->throttle_ms_ = shorter > base_ms ? shorter : 0;
+    ESP_LOGI(TAG, "Consumers keep up, interval down to %u ms", shorter);
+    this->camera_->set_throttle_interval(this->throttle_ms_);
+    return true;
+  }
+  uint16_t width, height, current_width, current_height;
+  if (this->base_width_ == 0 || !this->find_mode_(true, &width, &height) ||
+      !this->camera_->get_current_mode(&current_width, &current_height))
+    return false;
+  // frames grow roughly with the area
+  const float area = (float)width * height / (current_width * current_height);
+  if (frame_bytes * area / drain_rate * 1000 > interval_ms * STEP_UP_SHARE)
+    return false;
+  ESP_LOGI(TAG, "Consumers keep up, resolution up to %ux%u", width, height);
+  if (width == this->base_width_ && height == this->base_height_) {
+    this->base_width_ = 0;
+    this->base_height_ = 0;
+  }
+  return this->set_mode_(width, height);
+}
+
+bool RateController::find_mode_(bool larger, uint16_t *width,
+                                uint16_t *height) const {
+  uint16_t current_width, current_height;
+  if (!this->camera_->get_current_mode(&current_width, &current_height))
+    return false;
+  const uint32_t current = (uint32_t)current_width * current_height;
+  // never above the mode stepped down from
+  const uint32_t limit = this->base_width_ != 0
+                             ? (uint32_t)this->base_width_ * this->base_height_
+                             : current;
+  bool found = false, found_same_aspect = false;
+  uint32_t best = 0;
+  uint16_t mode_width, mode_height;
+  for (size_t i = 0; this->camera_->get_mode(i, &mode_width, &mode_height);
+       i++) {
+    const uint32_t area = (uint32_t)mode_width * mode_height;
+    if (larger ? area <= current || area > limit : area >= current)
+      continue;
+    // the same aspect ratio wins, then the closest size
+    const bool same_aspect = (uint32_t)mode_width * current_height ==
+                             (uint32_t)mode_height * current_width;
+    if (found && same_aspect < found_same_aspect)
+      continue;
+    if (found && same_aspect == found_same_aspect &&
+        (larger ? area >= best : area <= best))
+      continue;
+    found = true;
+    found_same_aspect = same_aspect;
+    best = area;
+    *width = mode_width;
+    *height = mode_height;
+  }
+  return found;
+}
+
+bool RateController::set_mode_(uint16_t width, uint16_t height) {
+  // adapted modes are not remembered for the next boot
+  if (!this->camera_->set_resolution(width, height, false))
+    return false;
+  this->set_width_ = width;
+  this->set_height_ = height;
+  return true;
+}
+
+RateController *global_rate_controller =
+    nullptr; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Frame rate and resolution following how fast consumers drain frames
+
+#pragma once
+
+#ifdef USE_ESP32
+
+#include "../esp32_camera/esp32_camera.h"
+#include "esphome/core/component.h"
+#include "esphome/core/defines.h"
+
+#ifdef USE_SENSOR
+#include "esphome/components/sensor/sensor.h"
+#endif
+
+namespace esphome {
+namespace esp32_camera {
+
+/* ---------------- RateController class ---------------- */
+// Measures how long consumers hold every delivered frame and how many bytes
+// per second they drain. When they need longer than the delivery interval,
+// loop() stalls on the still held image, so the controller steps down: to
+// the next smaller mode the device advertises first, then to longer
+// intervals. It steps back up, intervals first, only after several windows
+// with time to spare and when the drain rate predicts the bigger frames will
+// fit. Everything runs in loop().
+class RateController : public Component {
+public:
+  explicit RateController(ESP32Camera *camera);
+
+  /* setters */
+  void set_min_framerate(float min_framerate) {
+    this->max_interval_ms_ = 1000 / min_framerate;
+  }
+  void set_evaluation_interval(uint32_t evaluation_interval_ms) {
+    this->evaluation_interval_ms_ = evaluation_interval_ms;
+  }
+  void set_step_resolution(bool step_resolution) {
+    this->step_resolution_ = step_resolution;
+  }
+#ifdef USE_SENSOR
+  void set_framerate_sensor(sensor::Sensor *sensor) {
+    this->framerate_sensor_ = sensor;
+  }
+#endif
+
+  /* public API (derivated) */
+  void setup() override;
+  void dump_config() override;
+  /* public API (specific) */
+  // a delivered frame of this size was released by all consumers
+  void record_release(size_t bytes, uint32_t held_us);
+
+protected:
+  void evaluate_();
+  bool step_down_(uint32_t interval_ms);
+  bool step_up_(uint32_t interval_ms, float drain_rate, float frame_bytes);
+  // the advertised mode closest in size above or below the current one
+  bool find_mode_(bool larger, uint16_t *width, uint16_t *height) const;
+  bool set_mode_(uint16_t width, uint16_t height);
+
+  ESP32Camera *camera_;
+  uint32_t max_interval_ms_{1000};
+  uint32_t evaluation_interval_ms_{5000};
+  bool step_resolution_{true};
+#ifdef USE_SENSOR
+  sensor::Sensor *framerate_sensor_{nullptr};
+#endif
+
+  /* current window */
+  uint32_t frames_{0};
+  uint64_t bytes_{0};
+  uint64_t held_us_{0};
+  int64_t window_start_us_{0};
+
+  /* state */
+  uint32_t throttle_ms_{0}; // 0 while not throttled
+  uint8_t good_windows_{0};
+  bool settling_{false}; // the window after a change measures the old mode
+  // the mode stepped down from and the one set, a different current mode
+  // means somebody else picked it
+  uint16_t base_width_{0};
+  uint16_t base_height_{0};
+  uint16_t set_width_{0};
+  uint16_t set_height_{0};
+};
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+extern RateController *global_rate_controller;
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
@@ -0,0 +1,263 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Conversion of uncompressed UVC frames to the formats consumers handle
+
+#include "raw_convert.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace esphome {
+namespace esp32_camera {
+
+size_t raw_frame_size(RawFormat format, uint16_t width, uint16_t height) {
+  const size_t pixels = (size_t)width * height;
+  switch (format) {
+  case RAW_YUYV:
+  case RAW_UYVY:
+    return pixels * 2;
+  case RAW_NV12:
+    return pixels + pixels / 2;
+  default:
+    return pixels;
+  }
+}
+
+size_t raw_output_size(RawOutput output, uint16_t width, uint16_t height) {
+  const size_t pixels = (size_t)width * height;
+  switch (output) {
+  case RAW_OUTPUT_RGB565:
+    return pixels * 2;
+  case RAW_OUTPUT_GRAYSCALE:
+    return pixels;
+  default:
+    return 0;
+  }
+}
+
+/* ---------------- row kernels ---------------- */
+// Words are loaded little endian, so a YUYV word holds Y0 in its low byte,
+// then U, Y1 and V.
+static inline uint32_t load_word(const uint8_t *src) {
+  uint32_t word;
+  memcpy(&word, src, sizeof(word));
+  return word;
+}
+
+// both luma bytes of a word, packed into its low 16 bits
+static inline uint32_t luma_pair(uint32_t word, bool uyvy) {
+  const uint32_t lanes = (uyvy ? word >> 8 : word) & 0x00FF00FF;
+  return (lanes | lanes >> 8) & 0xFFFF;
+}
+
+static inline uint8_t clamp_pixel(int32_t value) {
+  return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+// BT.601 limited range, luma is 298 * (Y - 16)
+static inline void put_rgb565(uint8_t *dst, int32_t luma, int32_t u,
+                              int32_t v) {
+  const uint8_t r = clamp_pixel((luma + 409 * v + 128) >> 8);
+  const uint8_t g = clamp_pixel((luma - 100 * u - 208 * v + 128) >> 8);
+  const uint8_t b = clamp_pixel((luma + 516 * u + 128) >> 8);
+  const uint16_t pixel = (r & 0xF8) << 8 | (g & 0xFC) << 3 | b >> 3;
+  dst[0] = pixel >> 8;
+  dst[1] = pixel & 0xFF;
+}
+
+void yuv422_to_gray(const uint8_t *src, bool uyvy, uint8_t *dst,
+                    size_t width) {
+  size_t x = 0;
+  for (; x + 4 <= width; x += 4) {
+    const uint32_t luma = luma_pair(load_word(src + x * 2), uyvy) |
+                          luma_pair(load_word(src + x * 2 + 4), uyvy) << 16;
+    memcpy(dst + x, &luma, sizeof(luma));
+  }
+  for (; x < width; x++)
+    dst[x] = src[x * 2 + uyvy];
+}
+
+void yuv422_split(const uint8_t *src, bool uyvy, uint8_t *y, uint8_t *u,
+                  uint8_t *v, size_t width) {
+  for (size_t x = 0; x + 2 <= width; x += 2) {
+    const uint32_t word = load_word(src + x * 2);
+    const uint32_t luma = luma_pair(word, uyvy);
+    const uint32_t chroma = (uyvy ? word : word >> 8) & 0x00FF00FF;
+    y[x] = luma & 0xFF;
+    y[x + 1] = luma >> 8;
+    u[x / 2] = chroma & 0xFF;
+    v[x / 2] = chroma >> 16;
+  }
+}
+
+void yuv422_to_rgb565(const uint8_t *src, bool uyvy, uint8_t *dst,
+                      size_t width) {
+  for (size_t x = 0; x + 2 <= width; x += 2) {
+    const uint32_t word = load_word(src + x * 2);
+    const uint32_t luma = luma_pair(word, uyvy);
+    const uint32_t chroma = (uyvy ? word : word >> 8) & 0x00FF00FF;
+    const int32_t u = (int32_t)(chroma & 0xFF) - 128;
+    const int32_t v = (int32_t)(chroma >> 16) - 128;
+    put_rgb565(dst + x * 2, 298 * ((int32_t)(luma & 0xFF) - 16), u, v);
+    put_rgb565(dst + x * 2 + 2, 298 * ((int32_t)(luma >> 8) - 16), u, v);
+  }
+}
+
+void nv12_to_rgb565(const uint8_t *y, const uint8_t *uv, uint8_t *dst,
+                    size_t width) {
+  for (size_t x = 0; x + 2 <= width; x += 2) {
+    const int32_t u = uv[x] - 128;
+    const int32_t v = uv[x + 1] - 128;
+    put_rgb565(dst + x * 2, 298 * (y[x] - 16), u, v);
+    put_rgb565(dst + x * 2 + 2, 298 * (y[x + 1] - 16), u, v);
+  }
+}
+
+/* ---------------- RawConverter class ---------------- */
+void RawConverter::set_quality(uint8_t quality) {
+  this->quality_ = quality;
+  this->quant_ready_ = false;
+}
+
+JpegStatus RawConverter::convert(RawFormat format, const uint8_t *src,
+                                 size_t src_len, uint16_t width,
+                                 uint16_t height, RawOutput output,
+                                 uint8_t *dst, size_t capacity,
+                                 size_t *dst_len) {
+  // chroma is shared by pixel pairs, UVC sizes are always even
+  if (src_len < raw_frame_size(format, width, height) ||
+      (format != RAW_GRAY8 && (width & 1)) ||
+      (format == RAW_NV12 && (height & 1)))
+    return JPEG_CORRUPT;
+  if (output == RAW_OUTPUT_JPEG)
+    return this->encode_jpeg_(format, src, width, height, dst, capacity,
+                              dst_len);
+  const size_t len = raw_output_size(output, width, height);
+  if (len > capacity)
+    return JPEG_OVERFLOW;
+
+  const uint8_t *chroma = src + (size_t)width * height; // NV12 only
+  for (size_t y = 0; y < height; y++) {
+    const size_t pixel = y * width;
+    if (output == RAW_OUTPUT_GRAYSCALE) {
+      if (format == RAW_YUYV || format == RAW_UYVY)
+        yuv422_to_gray(src + pixel * 2, format == RAW_UYVY, dst + pixel,
+                       width);
+      else
+        memcpy(dst + pixel, src + pixel, width);
+      continue;
+    }
+    switch (format) {
+    case RAW_YUYV:
+    case RAW_UYVY:
+      yuv422_to_rgb565(src + pixel * 2, format == RAW_UYVY, dst + pixel * 2,
+                       width);
+      break;
+    case RAW_NV12:
+      nv12_to_rgb565(src + pixel, chroma + y / 2 * width, dst + pixel * 2,
+                     width);
+      break;
+    default:
+      for (size_t x = 0; x < width; x++)
+        put_rgb565(dst + (pixel + x) * 2, src[pixel + x] << 8, 0, 0);
+      break;
+    }
+  }
+  *dst_len = len;
+  return JPEG_OK;
+}
+
+JpegStatus RawConverter::encode_jpeg_(RawFormat format, const uint8_t *src,
+                                      uint16_t width, uint16_t height,
+                                      uint8_t *dst, size_t capacity,
+                                      size_t *dst_len) {
+  if (!this->quant_ready_) {
+    jpeg_quality_tables(this->quality_, this->quant_);
+    this->quant_ready_ = true;
+  }
+  // keep the source subsampling: 4:2:2 as 2x1, NV12 as 2x2
+  const uint8_t count = format == RAW_GRAY8 ? 1 : 3;
+  const uint8_t luma_v = format == RAW_NV12 ? 2 : 1;
+  const JpegComponent components[JPEG_MAX_COMPONENTS] = {
+      {1, (uint8_t)(count == 1 ? 1 : 2), luma_v, 0, 0, 0},
+      {2, 1, 1, 1, 1, 1},
+      {3, 1, 1, 1, 1, 1},
+  };
+  const size_t mcu_width = components[0].h * 8;
+  const size_t mcus_x = (width + mcu_width - 1) / mcu_width;
+  for (size_t c = 0; c < count; c++) {
+    this->plane_width_[c] = mcus_x * components[c].h * 8;
+    this->plane_rows_[c] = components[c].v * 8;
+    this->planes_[c].resize(this->plane_width_[c] * this->plane_rows_[c]);
+  }
+  this->encoder_.begin(dst, capacity, width, height, count, components,
+                       this->quant_);
+
+  const size_t strip_rows = luma_v * 8;
+  for (size_t first_row = 0; first_row < height; first_row += strip_rows) {
+    this->fill_strip_(format, src, width, height, first_row);
+    for (size_t mx = 0; mx < mcus_x; mx++) {
+      for (size_t c = 0; c < count; c++) {
+        const size_t plane_width = this->plane_width_[c];
+        const uint8_t *plane =
+            this->planes_[c].data() + mx * components[c].h * 8;
+        for (size_t by = 0; by < components[c].v; by++) {
+          for (size_t bx = 0; bx < components[c].h; bx++) {
+            this->encoder_.encode_block(
+                c, plane + by * 8 * plane_width + bx * 8, plane_width);
+          }
+        }
+      }
+    }
+  }
+  *dst_len = this->encoder_.finish();
+  return *dst_len == 0 ? JPEG_OVERFLOW : JPEG_OK;
+}
+
+// one MCU row of planes, edges repeated into the MCU padding
+void RawConverter::fill_strip_(RawFormat format, const uint8_t *src,
+                               uint16_t width, uint16_t height,
+                               size_t first_row) {
+  const size_t chroma_width = (width + 1) / 2;
+  for (size_t row = 0; row < this->plane_rows_[0]; row++) {
+    const size_t y = std::min(first_row + row, (size_t)height - 1);
+    uint8_t *luma = this->planes_[0].data() + row * this->plane_width_[0];
+    switch (format) {
+    case RAW_YUYV:
+    case RAW_UYVY:
+      yuv422_split(src + y * width * 2, format == RAW_UYVY, luma,
+                   this->planes_[1].data() + row * this->plane_width_[1],
+                   this->planes_[2].data() + row * this->plane_width_[2],
+                   width);
+      break;
+    default:
+      memcpy(luma, src + y * width, width);
+      break;
+    }
+  }
+  if (format == RAW_NV12) {
+    const uint8_t *chroma = src + (size_t)width * height;
+    for (size_t row = 0; row < this->plane_rows_[1]; row++) {
+      const size_t y = std::min(first_row / 2 + row, (size_t)height / 2 - 1);
+      const uint8_t *uv = chroma + y * width;
+      uint8_t *u = this->planes_[1].data() + row * this->plane_width_[1];
+      uint8_t *v = this->planes_[2].data() + row * this->plane_width_[2];
+      for (size_t x = 0; x < chroma_width; x++) {
+        u[x] = uv[x * 2];
+        v[x] = uv[x * 2 + 1];
+      }
+    }
+  }
+
+  const uint8_t count = format == RAW_GRAY8 ? 1 : 3;
+  for (size_t c = 0; c < count; c++) {
+    const size_t used = c == 0 ? width : chroma_width;
+    const size_t plane_width = this->plane_width_[c];
+    for (size_t row = 0; row < this->plane_rows_[c]; row++) {
+      uint8_t *line = this->planes_[c].data() + row * plane_width;
+      memset(line + used, line[used - 1], plane_width - used);
+    }
+  }
+}
+
+} // namespace esp32_camera
+} // namespace esphome
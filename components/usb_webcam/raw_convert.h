@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Conversion of uncompressed UVC frames to the formats consumers handle
+
+#pragma once
+
+#include "jpeg_codec.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace esphome {
+namespace esp32_camera {
+
+enum RawFormat : uint8_t {
+  RAW_YUYV,  // YUY2, 4:2:2 packed as Y0 U Y1 V
+  RAW_UYVY,  // 4:2:2 packed as U Y0 V Y1
+  RAW_NV12,  // 4:2:0, Y plane then interleaved U V plane
+  RAW_GRAY8, // Y only
+};
+
+enum RawOutput : uint8_t {
+  RAW_OUTPUT_JPEG,
+  RAW_OUTPUT_RGB565, // big endian like the esp32-camera driver
+  RAW_OUTPUT_GRAYSCALE,
+};
+
+// bytes of a complete source frame
+size_t raw_frame_size(RawFormat format, uint16_t width, uint16_t height);
+// bytes of the converted frame, 0 when only known after encoding
+size_t raw_output_size(RawOutput output, uint16_t width, uint16_t height);
+
+/* ---------------- row kernels ---------------- */
+// Packed 4:2:2 rows are read a 32-bit word (two pixels) at a time and luma
+// is gathered four pixels per store; they are the scalar reference for any
+// platform specific version.
+void yuv422_to_gray(const uint8_t *src, bool uyvy, uint8_t *dst,
+                    size_t width);
+void yuv422_split(const uint8_t *src, bool uyvy, uint8_t *y, uint8_t *u,
+                  uint8_t *v, size_t width);
+void yuv422_to_rgb565(const uint8_t *src, bool uyvy, uint8_t *dst,
+                      size_t width);
+// uv is the interleaved chroma row shared by two luma rows
+void nv12_to_rgb565(const uint8_t *y, const uint8_t *uv, uint8_t *dst,
+                    size_t width);
+
+/* ---------------- RawConverter class ---------------- */
+// Converts a whole frame straight into the destination buffer. JPEG output is
+// encoded one MCU row at a time from a strip of planes, so no second
+// full-size frame is ever held.
+class RawConverter {
+public:
+  void set_quality(uint8_t quality);
+  JpegStatus convert(RawFormat format, const uint8_t *src, size_t src_len,
+                     uint16_t width, uint16_t height, RawOutput output,
+                     uint8_t *dst, size_t capacity, size_t *dst_len);
+
+protected:
+  JpegStatus encode_jpeg_(RawFormat format, const uint8_t *src,
+                          uint16_t width, uint16_t height, uint8_t *dst,
+                          size_t capacity, size_t *dst_len);
+  void fill_strip_(RawFormat format, const uint8_t *src, uint16_t width,
+                   uint16_t height, size_t first_row);
+
+  JpegEncoder encoder_;
+  uint16_t quant_[2][64];
+  bool quant_ready_{false};
+  uint8_t quality_{80};
+  std::vector<uint8_t> planes_[JPEG_MAX_COMPONENTS]; // one MCU row
+  size_t plane_width_[JPEG_MAX_COMPONENTS];
+  uint8_t plane_rows_[JPEG_MAX_COMPONENTS];
+};
+
+} // namespace esp32_camera
+} // namespace esphome
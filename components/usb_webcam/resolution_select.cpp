@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Select entity switching the webcam resolution at runtime
+
+#ifdef USE_ESP32
+
+#include "resolution_select.h"
+
+#ifdef USE_SELECT
+
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace esp32_camera {
+
+static const char *const TAG = "usb_webcam.select";
+
+void ResolutionSelect::setup() {
+  this->parent_->add_resolution_callback([this]() { this->refresh_(); });
+}
+
+void ResolutionSelect::dump_config() {
+  LOG_SELECT("", "USB WebCamera Resolution", this);
+}
+
+void ResolutionSelect::control(const std::string &value) {
+  unsigned width, height;
+  if (sscanf(value.c_str(), "%ux%u", &width, &height) != 2) {
+    ESP_LOGW(TAG, "Invalid resolution '%s'", value.c_str());
+    return;
+  }
+  // on success the resolution callback publishes the new state
+  if (!this->parent_->set_resolution(width, height))
+    this->publish_state(this->parent_->get_resolution());
+}
+
+void ResolutionSelect::refresh_() {
+  std::vector<std::string> options = this->parent_->get_resolutions();
+  if (options.empty())
+    return; // device is reconnecting
+  this->traits.set_options(options);
+  this->publish_state(this->parent_->get_resolution());
+}
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
+#endif
@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Select entity switching the webcam resolution at runtime
+
+#pragma once
+
+#ifdef USE_ESP32
+
+#include "../esp32_camera/esp32_camera.h"
+#include "esphome/core/defines.h"
+
+#ifdef USE_SELECT
+#include "esphome/components/select/select.h"
+
+namespace esphome {
+namespace esp32_camera {
+
+/* ---------------- ResolutionSelect class ---------------- */
+// Options are the frame sizes the connected device advertises, they are
+// refreshed whenever the device (re)connects or the resolution changes.
+class ResolutionSelect : public select::Select,
+                         public Component,
+                         public Parented<ESP32Camera> {
+public:
+  /* public API (derivated) */
+  void setup() override;
+  void dump_config() override;
+
+protected:
+  void control(const std::string &value) override;
+  void refresh_();
+};
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
+#endif
@@ -0,0 +1,345 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// multipart/x-mixed-replace MJPEG server reading the frame ring directly
+
+#ifdef USE_ESP32
+
+#include "stream_server.h"
+
+#include "esphome/core/log.h"
+#include "pipeline_stats.h"
+#include "task_monitor.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <esp_timer.h>
+#include <fcntl.h>
+#include <freertos/task.h>
+#include <lwip/sockets.h>
+
+namespace esphome {
+namespace esp32_camera {
+
+static const char *const TAG = "usb_webcam.server";
+#define STREAM_BOUNDARY "frame"
+static const char *const RESPONSE_HEADER =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: multipart/x-mixed-replace;boundary=" STREAM_BOUNDARY "\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: close\r\n"; // the first part header ends it
+// every part starts by ending the previous one
+static const char *const PART_HEADER =
+    "\r\n--" STREAM_BOUNDARY "\r\n"
+    "Content-Type: image/jpeg\r\n"
+    "Content-Length: %u\r\n"
+    "X-Timestamp: %u.%06u\r\n\r\n";
+static const char *const BUSY_RESPONSE =
+    "HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\n\r\n";
+// while clients wait for a frame, the task sleeps on the ring and looks at
+// the sockets in between this often
+static const uint32_t SOCKET_CHECK_MS = 100;
+// while other clients are sending, a new frame is noticed this late at most
+static const uint32_t SEND_CHECK_MS = 10;
+static const uint32_t IDLE_POLL_MS = 1000;
+
+/* ---------------- constructors ---------------- */
+StreamServer::StreamServer(ESP32Camera *camera) : camera_(camera) {}
+
+/* ---------------- setters ---------------- */
+void StreamServer::set_skip_unchanged(uint8_t luma_threshold,
+                                      uint32_t keepalive_ms) {
+  this->skip_unchanged_ = true;
+  this->luma_threshold_ = luma_threshold;
+  this->keepalive_ms_ = keepalive_ms;
+}
+
+/* ---------------- public API (derivated) ---------------- */
+void StreamServer::setup() {
+  this->ring_ = this->camera_->get_frame_ring();
+  this->listen_fd_ = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+  if (this->listen_fd_ < 0) {
+    ESP_LOGE(TAG, "Could not create socket: %d", errno);
+    this->mark_failed();
+    return;
+  }
+  int enable = 1;
+  setsockopt(this->listen_fd_, SOL_SOCKET, SO_REUSEADDR, &enable,
+             sizeof(enable));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(this->port_);
+  if (bind(this->listen_fd_, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(this->listen_fd_, this->max_clients_) != 0) {
+    ESP_LOGE(TAG, "Could not listen on port %u: %d", this->port_, errno);
+    close(this->listen_fd_);
+    this->listen_fd_ = -1;
+    this->mark_failed();
+    return;
+  }
+  fcntl(this->listen_fd_, F_SETFL, O_NONBLOCK);
+
+  xTaskCreatePinnedToCore(&StreamServer::server_task,
+                          "stream_srv_tsk",      // name
+                          4096,                  // stack size
+                          this,                  // task pv params
+                          this->task_priority_,  // priority
+                          nullptr,               // handle
+                          this->task_core_       // core
+  );
+  this->last_report_us_ = esp_timer_get_time();
+  this->set_interval("report", this->report_interval_ms_,
+                     [this]() { this->report_(); });
+}
+
+void StreamServer::loop() {
+  // frames keep flowing at max_framerate while anybody watches
+  const uint8_t clients = this->client_count_.load();
+  if (clients == this->published_clients_)
+    return;
+  if (this->published_clients_ == 0)
+    this->camera_->start_stream(HTTP_REQUESTER);
+  else if (clients == 0)
+    this->camera_->stop_stream(HTTP_REQUESTER);
+  ESP_LOGD(TAG, "Stream clients: %u", clients);
+#ifdef USE_SENSOR
+  if (this->clients_sensor_ != nullptr)
+    this->clients_sensor_->publish_state(clients);
+#endif
+  this->published_clients_ = clients;
+}
+
+void StreamServer::dump_config() {
+  ESP_LOGCONFIG(TAG, "USB WebCamera stream server:");
+  ESP_LOGCONFIG(TAG, "  Port: %u", this->port_);
+  ESP_LOGCONFIG(TAG, "  Max clients: %u", this->max_clients_);
+  ESP_LOGCONFIG(TAG, "  Report interval: %u ms", this->report_interval_ms_);
+  ESP_LOGCONFIG(TAG, "  Task: core %s, priority %u",
+                task_core_name(this->task_core_), this->task_priority_);
+  if (this->skip_unchanged_)
+    ESP_LOGCONFIG(TAG, "  Skip unchanged: luma threshold %u, %u ms keepalive",
+                  this->luma_threshold_, this->keepalive_ms_);
+#ifdef USE_SENSOR
+  LOG_SENSOR("  ", "Clients", this->clients_sensor_);
+#endif
+  // every client may hold a slot, the pipeline needs two more
+  if (this->ring_ != nullptr &&
+      this->ring_->slot_count() < this->max_clients_ + 2u)
+    ESP_LOGW(TAG, "  frame_buffer_count below max_clients + 2, slow clients "
+                  "can make the pipeline drop frames");
+  if (this->is_failed())
+    ESP_LOGE(TAG, "  Setup failed");
+}
+
+float StreamServer::get_setup_priority() const {
+  return setup_priority::AFTER_WIFI;
+}
+
+/* ---------------- server task ---------------- */
+void StreamServer::server_task(void *pv) {
+  StreamServer *server = (StreamServer *)pv;
+  // woken by every committed frame
+  if (!server->ring_->add_waiter(xTaskGetCurrentTaskHandle()))
+    ESP_LOGE(TAG, "Could not wait on the frame ring");
+  while (true)
+    server->serve_();
+}
+
+void StreamServer::serve_() {
+  fd_set read_fds, write_fds;
+  FD_ZERO(&read_fds);
+  FD_ZERO(&write_fds);
+  FD_SET(this->listen_fd_, &read_fds);
+  int max_fd = this->listen_fd_;
+  bool waiting = false, sending = false;
+  for (size_t i = 0; i < this->max_clients_; i++) {
+    const Client &client = this->clients_[i];
+    if (client.fd < 0)
+      continue;
+    // requests are read once, afterwards reads only notice disconnects
+    FD_SET(client.fd, &read_fds);
+    max_fd = std::max(max_fd, client.fd);
+    if (client.header_sent < client.header_len ||
+        (client.fb != nullptr && client.data_sent < client.fb->len)) {
+      FD_SET(client.fd, &write_fds);
+      sending = true;
+    } else if (client.streaming) {
+      waiting = true; // for the next frame
+    }
+  }
+  uint32_t timeout_ms = IDLE_POLL_MS;
+  if (waiting && !sending) {
+    // frames committed meanwhile left a notification, no wait for them
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SOCKET_CHECK_MS));
+    timeout_ms = 0;
+  } else if (waiting) {
+    timeout_ms = SEND_CHECK_MS;
+  }
+  struct timeval timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_usec = timeout_ms % 1000 * 1000;
+  if (select(max_fd + 1, &read_fds, &write_fds, nullptr, &timeout) < 0) {
+    vTaskDelay(pdMS_TO_TICKS(SEND_CHECK_MS));
+    return;
+  }
+
+  if (FD_ISSET(this->listen_fd_, &read_fds))
+    this->accept_();
+  for (size_t i = 0; i < this->max_clients_; i++) {
+    Client &client = this->clients_[i];
+    if (client.fd < 0)
+      continue;
+    if (FD_ISSET(client.fd, &read_fds) && !this->receive_(client)) {
+      this->close_(i);
+      continue;
+    }
+    if (!client.streaming)
+      continue;
+    if (client.fb == nullptr && client.header_sent == client.header_len) {
+      const uint32_t previous = client.cursor;
+      client.fb = this->ring_->acquire_latest(&client.cursor);
+      if (client.fb == nullptr)
+        continue;
+      if (client.fb->format != PIXFORMAT_JPEG) {
+        // uncompressed output, nothing to stream
+        this->ring_->release(client.fb);
+        client.fb = nullptr;
+        continue;
+      }
+      if (previous != 0)
+        this->skipped_[i] += client.cursor - previous - 1;
+      if (this->skip_unchanged_ &&
+          !client.unchanged.pass(*this->ring_->signature_of(client.fb),
+                                 esp_timer_get_time() / 1000)) {
+        // the browser keeps showing the previous frame
+        this->ring_->release(client.fb);
+        client.fb = nullptr;
+        this->unchanged_[i]++;
+        global_pipeline_stats.count_skipped_unchanged();
+        continue;
+      }
+      const int64_t captured_us =
+          this->ring_->times_of(client.fb)->captured_us;
+      client.header_len = snprintf(client.header, sizeof(client.header),
+                                   PART_HEADER, client.fb->len,
+                                   (uint32_t)(captured_us / 1000000),
+                                   (uint32_t)(captured_us % 1000000));
+      client.header_sent = 0;
+      client.data_sent = 0;
+    }
+    if (!this->send_(client))
+      this->close_(i);
+  }
+}
+
+void StreamServer::accept_() {
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof(addr);
+  const int fd =
+      accept(this->listen_fd_, (struct sockaddr *)&addr, &addr_len);
+  if (fd < 0)
+    return;
+  for (size_t i = 0; i < this->max_clients_; i++) {
+    Client &client = this->clients_[i];
+    if (client.fd >= 0)
+      continue;
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    client = Client{};
+    client.fd = fd;
+    client.unchanged.set_luma_threshold(this->luma_threshold_);
+    client.unchanged.set_keepalive(this->keepalive_ms_);
+    this->connection_[i]++;
+    return;
+  }
+  send(fd, BUSY_RESPONSE, strlen(BUSY_RESPONSE), 0);
+  close(fd);
+}
+
+// false when the client went away
+bool StreamServer::receive_(Client &client) {
+  char buf[128];
+  const ssize_t len = recv(client.fd, buf, sizeof(buf), 0);
+  if (len == 0)
+    return false;
+  if (len < 0)
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+  if (client.streaming)
+    return true;
+  // any request gets the stream, the rest of it is never read
+  client.streaming = true;
+  client.header_len = snprintf(client.header, sizeof(client.header), "%s",
+                               RESPONSE_HEADER);
+  client.header_sent = 0;
+  this->client_count_++;
+  return true;
+}
+
+// sends as much as the socket takes, false on errors
+bool StreamServer::send_(Client &client) {
+  while (client.header_sent < client.header_len) {
+    const ssize_t sent =
+        send(client.fd, client.header + client.header_sent,
+             client.header_len - client.header_sent, 0);
+    if (sent < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    client.header_sent += sent;
+  }
+  if (client.fb == nullptr)
+    return true;
+  // one large write per call, straight from the slot
+  while (client.data_sent < client.fb->len) {
+    const ssize_t sent = send(client.fd, client.fb->buf + client.data_sent,
+                              client.fb->len - client.data_sent, 0);
+    if (sent < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    client.data_sent += sent;
+  }
+  if (client.data_sent < client.fb->len)
+    return true;
+  this->ring_->release(client.fb);
+  client.fb = nullptr;
+  const size_t index = &client - this->clients_;
+  this->frames_sent_[index]++;
+  return true;
+}
+
+void StreamServer::close_(size_t index) {
+  Client &client = this->clients_[index];
+  if (client.fb != nullptr)
+    this->ring_->release(client.fb);
+  if (client.streaming)
+    this->client_count_--;
+  close(client.fd);
+  client = Client{};
+}
+
+/* ---------------- loop() ---------------- */
+void StreamServer::report_() {
+  const int64_t now_us = esp_timer_get_time();
+  const float seconds = (now_us - this->last_report_us_) / 1e6f;
+  this->last_report_us_ = now_us;
+  for (size_t i = 0; i < this->max_clients_; i++) {
+    const uint32_t connection = this->connection_[i].load();
+    const uint32_t frames = this->frames_sent_[i].load();
+    const uint32_t skipped = this->skipped_[i].load();
+    const uint32_t unchanged = this->unchanged_[i].load();
+    // a new connection in the slot starts counting from here
+    const bool same = connection == this->last_connection_[i];
+    if (same && frames != this->last_frames_sent_[i]) {
+      ESP_LOGD(TAG, "Client %u: %.1f fps, %u frames skipped, %u unchanged",
+               i, (frames - this->last_frames_sent_[i]) / seconds,
+               skipped - this->last_skipped_[i],
+               unchanged - this->last_unchanged_[i]);
+    }
+    this->last_connection_[i] = connection;
+    this->last_frames_sent_[i] = frames;
+    this->last_skipped_[i] = skipped;
+    this->last_unchanged_[i] = unchanged;
+  }
+}
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// multipart/x-mixed-replace MJPEG server reading the frame ring directly
+
+#pragma once
+
+#ifdef USE_ESP32
+
+#include "../esp32_camera/esp32_camera.h"
+#include "esphome/core/component.h"
+#include "esphome/core/defines.h"
+#include "frame_signature.h"
+#include "frame_ring.h"
+
+#ifdef USE_SENSOR
+#include "esphome/components/sensor/sensor.h"
+#endif
+
+#include <atomic>
+
+namespace esphome {
+namespace esp32_camera {
+
+static const uint8_t STREAM_SERVER_MAX_CLIENTS = 8;
+
+/* ---------------- StreamServer class ---------------- */
+// Serves MJPEG streams from its own task. Every client holds a reference on
+// the ring slot it is sending and its own cursor, so it moves on to the newest
+// frame when done: slow clients skip frames instead of holding back the
+// others. Frame data is sent straight from the slot. While clients wait for
+// the next frame, the task sleeps until the ring wakes it up.
+class StreamServer : public Component {
+public:
+  explicit StreamServer(ESP32Camera *camera);
+
+  /* setters */
+  void set_port(uint16_t port) { this->port_ = port; }
+  void set_max_clients(uint8_t max_clients) {
+    this->max_clients_ = max_clients;
+  }
+  void set_report_interval(uint32_t report_interval_ms) {
+    this->report_interval_ms_ = report_interval_ms;
+  }
+  // every client gets its own filter, they start at different frames
+  void set_skip_unchanged(uint8_t luma_threshold, uint32_t keepalive_ms);
+  void set_task_core(BaseType_t core) { this->task_core_ = core; }
+  void set_task_priority(uint8_t priority) {
+    this->task_priority_ = priority;
+  }
+#ifdef USE_SENSOR
+  void set_clients_sensor(sensor::Sensor *sensor) {
+    this->clients_sensor_ = sensor;
+  }
+#endif
+
+  /* public API (derivated) */
+  void setup() override;
+  void loop() override;
+  void dump_config() override;
+  float get_setup_priority() const override;
+
+protected:
+  struct Client {
+    int fd{-1};
+    bool streaming{false}; // request received, response started
+    camera_fb_t *fb{nullptr};
+    uint32_t cursor{0};
+    UnchangedFilter unchanged;
+    char header[160];
+    size_t header_len{0};
+    size_t header_sent{0};
+    size_t data_sent{0};
+  };
+
+  static void server_task(void *pv);
+  void serve_();
+  void accept_();
+  bool receive_(Client &client);
+  bool send_(Client &client);
+  void close_(size_t index);
+  void report_();
+
+  ESP32Camera *camera_;
+  FrameRing *ring_{nullptr};
+  uint16_t port_{8081};
+  uint8_t max_clients_{4};
+  uint32_t report_interval_ms_{60000};
+  BaseType_t task_core_{tskNO_AFFINITY};
+  uint8_t task_priority_{1};
+  bool skip_unchanged_{false};
+  uint8_t luma_threshold_{0};
+  uint32_t keepalive_ms_{0};
+#ifdef USE_SENSOR
+  sensor::Sensor *clients_sensor_{nullptr};
+#endif
+
+  /* server task only */
+  int listen_fd_{-1};
+  Client clients_[STREAM_SERVER_MAX_CLIENTS];
+
+  /* shared with loop(), per client slot */
+  std::atomic<uint8_t> client_count_{0};
+  std::atomic<uint32_t> frames_sent_[STREAM_SERVER_MAX_CLIENTS]{};
+  std::atomic<uint32_t> skipped_[STREAM_SERVER_MAX_CLIENTS]{};
+  std::atomic<uint32_t> unchanged_[STREAM_SERVER_MAX_CLIENTS]{};
+  std::atomic<uint32_t> connection_[STREAM_SERVER_MAX_CLIENTS]{};
+
+  /* loop() only */
+  uint8_t published_clients_{0};
+  uint32_t last_frames_sent_[STREAM_SERVER_MAX_CLIENTS]{};
+  uint32_t last_skipped_[STREAM_SERVER_MAX_CLIENTS]{};
+  uint32_t last_unchanged_[STREAM_SERVER_MAX_CLIENTS]{};
+  uint32_t last_connection_[STREAM_SERVER_MAX_CLIENTS]{};
+  int64_t last_report_us_{0};
+};
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Synthetic UVC source replacing usb_stream for pipeline benchmarks
+
+#if defined(USE_ESP32) && defined(USE_USB_WEBCAM_SYNTHETIC)
+
+#include "synthetic_source.h"
+
+#include "esphome/core/log.h"
+
+#include <esp_timer.h>
+#include <freertos/task.h>
+
+namespace esphome {
+namespace esp32_camera {
+
+static const char *const TAG = "usb_webcam.synthetic";
+
+/* ---------------- constructors ---------------- */
+SyntheticSource::SyntheticSource(ESP32Camera *camera) : camera_(camera) {
+  global_synthetic_source = this;
+}
+
+/* ---------------- setters ---------------- */
+void SyntheticSource::add_frame(const uint8_t *data, size_t offset, size_t len,
+                                uint16_t width, uint16_t height) {
+  this->frames_.push_back(Frame{data + offset, len, width, height});
+}
+void SyntheticSource::set_frame_interval(uint32_t frame_interval_us) {
+  this->frame_interval_us_ = frame_interval_us;
+}
+void SyntheticSource::set_jitter(uint32_t jitter_us) {
+  this->jitter_us_ = jitter_us;
+}
+void SyntheticSource::set_report_interval(uint32_t report_interval_ms) {
+  this->report_interval_ms_ = report_interval_ms;
+}
+void SyntheticSource::set_drive_stream(bool drive_stream) {
+  this->drive_stream_ = drive_stream;
+}
+
+/* ---------------- public API (derivated) ---------------- */
+void SyntheticSource::setup() {
+  this->camera_->add_image_callback(
+      [this](std::shared_ptr<CameraImage> image) { this->on_image_(image); });
+  // without a consumer loop() never picks frames up, keep a stream open so
+  // delivery is only limited by max_framerate
+  if (this->drive_stream_)
+    this->camera_->start_stream(IDLE);
+  this->last_report_us_ = esp_timer_get_time();
+  this->set_interval("report", this->report_interval_ms_,
+                     [this]() { this->report_(); });
+}
+
+void SyntheticSource::dump_config() {
+  ESP_LOGCONFIG(TAG, "Synthetic UVC source:");
+  ESP_LOGCONFIG(TAG, "  Frames: %u", this->frames_.size());
+  ESP_LOGCONFIG(TAG, "  Frame interval: %u us", this->frame_interval_us_);
+  ESP_LOGCONFIG(TAG, "  Jitter: %u us", this->jitter_us_);
+  ESP_LOGCONFIG(TAG, "  Report interval: %u ms", this->report_interval_ms_);
+  ESP_LOGCONFIG(TAG, "  Drive stream: %s", YESNO(this->drive_stream_));
+}
+
+float SyntheticSource::get_setup_priority() const {
+  return setup_priority::DATA;
+}
+
+/* ---------------- public API (specific) ---------------- */
+esp_err_t SyntheticSource::start(uvc_frame_callback_t *frame_cb,
+                                 void *frame_cb_arg, const FrameRing *ring) {
+  if (this->frames_.empty())
+    return ESP_ERR_INVALID_STATE;
+  this->frame_cb_ = frame_cb;
+  this->frame_cb_arg_ = frame_cb_arg;
+  this->ring_ = ring;
+  // same priority as the usb_stream sample task it stands in for
+  BaseType_t ret = xTaskCreate(&SyntheticSource::source_task,
+                               "synthetic_tsk", // name
+                               3072,            // stack size
+                               this,            // task pv params
+                               0,               // priority
+                               nullptr          // handle
+  );
+  return ret == pdPASS ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+/* ---------------- Internal methods ---------------- */
+void SyntheticSource::source_task(void *pv) {
+  auto *self = static_cast<SyntheticSource *>(pv);
+  uint32_t rng = 0x2545F491; // fixed seed keeps runs comparable
+  uint32_t sequence = 0;
+  int64_t next_us = esp_timer_get_time();
+
+  while (true) {
+    const Frame &src = self->frames_[sequence % self->frames_.size()];
+    uvc_frame_t frame = {};
+    frame.data = (void *)src.data;
+    frame.data_bytes = src.len;
+    frame.width = src.width;
+    frame.height = src.height;
+    frame.frame_format = UVC_FRAME_FORMAT_MJPEG;
+    frame.sequence = ++sequence;
+
+    self->emitted_++;
+    self->frame_cb_(&frame, self->frame_cb_arg_);
+
+    // uniform jitter in [-jitter, +jitter] around the nominal interval
+    next_us += self->frame_interval_us_;
+    int64_t deadline_us = next_us;
+    if (self->jitter_us_ != 0) {
+      rng = rng * 1664525 + 1013904223;
+      deadline_us += (int64_t)(rng % (2 * self->jitter_us_ + 1)) -
+                     (int64_t)self->jitter_us_;
+    }
+    int64_t wait_us = deadline_us - esp_timer_get_time();
+    if (wait_us > 0)
+      vTaskDelay(pdMS_TO_TICKS(wait_us / 1000) + 1);
+    else
+      next_us = esp_timer_get_time(); // overloaded, do not try to catch up
+  }
+}
+
+void SyntheticSource::on_image_(const std::shared_ptr<CameraImage> &image) {
+  // the frame timestamp is taken when the frame callback is entered
+  const struct timeval &captured = image->get_raw_buffer()->timestamp;
+  uint32_t latency_us = esp_timer_get_time() -
+                        (captured.tv_sec * 1000000LL + captured.tv_usec);
+  this->delivered_++;
+  this->latency_sum_us_ += latency_us;
+  if (latency_us > this->latency_max_us_)
+    this->latency_max_us_ = latency_us;
+}
+
+void SyntheticSource::report_() {
+  const int64_t now = esp_timer_get_time();
+  const float seconds = (now - this->last_report_us_) / 1e6f;
+  const uint32_t emitted = this->emitted_.load();
+  const uint32_t written = this->ring_->get_written();
+  const uint32_t overwritten = this->ring_->get_overwritten();
+  const uint32_t dropped_busy = this->ring_->get_dropped_busy();
+
+  const uint32_t emitted_delta = emitted - this->last_emitted_;
+  const uint32_t rejected = emitted_delta - (written - this->last_written_) -
+                            (dropped_busy - this->last_dropped_busy_);
+  ESP_LOGI(TAG,
+           "%.1f fps offered, %.1f fps delivered, dropped: %u rejected, %u "
+           "overwritten, %u busy",
+           emitted_delta / seconds, this->delivered_ / seconds, rejected,
+           overwritten - this->last_overwritten_,
+           dropped_busy - this->last_dropped_busy_);
+  if (this->delivered_ != 0) {
+    ESP_LOGI(TAG, "frame-to-callback latency: avg %u us, max %u us",
+             (uint32_t)(this->latency_sum_us_ / this->delivered_),
+             this->latency_max_us_);
+  }
+
+  this->last_report_us_ = now;
+  this->last_emitted_ = emitted;
+  this->last_written_ = written;
+  this->last_overwritten_ = overwritten;
+  this->last_dropped_busy_ = dropped_busy;
+  this->delivered_ = 0;
+  this->latency_sum_us_ = 0;
+  this->latency_max_us_ = 0;
+}
+
+SyntheticSource *
+    global_synthetic_source; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
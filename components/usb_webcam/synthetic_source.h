@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Synthetic UVC source replacing usb_stream for pipeline benchmarks
+
+#pragma once
+
+#if defined(USE_ESP32) && defined(USE_USB_WEBCAM_SYNTHETIC)
+
+#include "../esp32_camera/esp32_camera.h"
+#include "frame_ring.h"
+#include "usb_stream.h"
+
+#include <atomic>
+#include <vector>
+
+namespace esphome {
+namespace esp32_camera {
+
+/* ---------------- SyntheticSource class ---------------- */
+// Plays MJPEG files embedded at compile time into the UVC frame callback from
+// its own task, like the usb_stream sample task would, and periodically logs
+// delivered fps, drops and frame-to-callback latency.
+class SyntheticSource : public Component {
+public:
+  explicit SyntheticSource(ESP32Camera *camera);
+
+  /* setters */
+  void add_frame(const uint8_t *data, size_t offset, size_t len,
+                 uint16_t width, uint16_t height);
+  void set_frame_interval(uint32_t frame_interval_us);
+  void set_jitter(uint32_t jitter_us);
+  void set_report_interval(uint32_t report_interval_ms);
+  void set_drive_stream(bool drive_stream);
+
+  /* public API (derivated) */
+  void setup() override;
+  void dump_config() override;
+  float get_setup_priority() const override;
+  /* public API (specific) */
+  esp_err_t start(uvc_frame_callback_t *frame_cb, void *frame_cb_arg,
+                  const FrameRing *ring);
+
+protected:
+  struct Frame {
+    const uint8_t *data;
+    size_t len;
+    uint16_t width;
+    uint16_t height;
+  };
+
+  static void source_task(void *pv);
+  void on_image_(const std::shared_ptr<CameraImage> &image);
+  void report_();
+
+  ESP32Camera *camera_;
+  std::vector<Frame> frames_;
+  uint32_t frame_interval_us_{66666};
+  uint32_t jitter_us_{0};
+  uint32_t report_interval_ms_{10000};
+  bool drive_stream_{true};
+
+  uvc_frame_callback_t *frame_cb_{nullptr};
+  void *frame_cb_arg_{nullptr};
+  const FrameRing *ring_{nullptr};
+
+  /* written by the source task */
+  std::atomic<uint32_t> emitted_{0};
+  /* written by the main loop */
+  uint32_t delivered_{0};
+  uint64_t latency_sum_us_{0};
+  uint32_t latency_max_us_{0};
+  /* snapshot of the previous report */
+  uint32_t last_emitted_{0};
+  uint32_t last_written_{0};
+  uint32_t last_overwritten_{0};
+  uint32_t last_dropped_busy_{0};
+  int64_t last_report_us_{0};
+};
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+extern SyntheticSource *global_synthetic_source;
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
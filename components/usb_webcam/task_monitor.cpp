@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// CPU time and stack usage of the FreeRTOS tasks
+
+#ifdef USE_ESP32
+
+#include "task_monitor.h"
+
+#ifdef USE_USB_WEBCAM_TASK_STATS
+
+#include "esphome/core/log.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace esphome {
+namespace esp32_camera {
+
+static const char *const TAG = "usb_webcam.tasks";
+// room for tasks created between counting and taking the snapshot
+static const UBaseType_t SPARE_TASKS = 4;
+static const size_t MAX_CORES = 2;
+
+/* ---------------- public API (derivated) ---------------- */
+void TaskMonitor::setup() {
+  // the first report covers the time since setup
+  uint32_t total;
+  const UBaseType_t count = this->snapshot_(&total);
+  this->remember_(count, total);
+}
+
+void TaskMonitor::update() {
+  uint32_t total;
+  const UBaseType_t count = this->snapshot_(&total);
+  if (count == 0)
+    return;
+  // counters wrap around, only differences are meaningful
+  const uint32_t elapsed = total - this->last_total_;
+  if (elapsed == 0)
+    return;
+
+  this->used_.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    const TaskStatus_t &task = this->tasks_[i];
+    uint32_t last = 0; // created since, all of its time is new
+    for (const TaskSample &sample : this->last_) {
+      if (sample.number == task.xTaskNumber) {
+        last = sample.run_time;
+        break;
+      }
+    }
+    this->used_[i] = task.ulRunTimeCounter - last;
+  }
+  this->remember_(count, total);
+
+  // the idle task of a core runs whenever nothing else does
+  float load[MAX_CORES] = {100.0f, 100.0f};
+  for (size_t i = 0; i < count; i++) {
+    const TaskStatus_t &task = this->tasks_[i];
+    if (strncmp(task.pcTaskName, "IDLE", 4) == 0 &&
+        (size_t)task.xCoreID < MAX_CORES)
+      load[task.xCoreID] -= this->used_[i] * 100.0f / elapsed;
+  }
+#if CONFIG_FREERTOS_UNICORE
+  ESP_LOGD(TAG, "Load over %u ms: %.1f%%", elapsed / 1000, load[0]);
+#else
+  ESP_LOGD(TAG, "Load over %u ms: core 0 %.1f%%, core 1 %.1f%%",
+           elapsed / 1000, load[0], load[1]);
+#endif
+
+  std::vector<size_t> order(count);
+  for (size_t i = 0; i < count; i++)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+    return this->used_[a] > this->used_[b];
+  });
+  for (size_t i : order) {
+    const TaskStatus_t &task = this->tasks_[i];
+    ESP_LOGD(TAG, "  %-16s core %-3s priority %2u  %5.1f%%  stack left %u",
+             task.pcTaskName, task_core_name(task.xCoreID),
+             task.uxCurrentPriority, this->used_[i] * 100.0f / elapsed,
+             task.usStackHighWaterMark);
+  }
+}
+
+void TaskMonitor::dump_config() {
+  ESP_LOGCONFIG(TAG, "USB WebCamera task statistics:");
+  LOG_UPDATE_INTERVAL(this);
+}
+
+/* ---------------- internal methods ---------------- */
+UBaseType_t TaskMonitor::snapshot_(uint32_t *total) {
+  this->tasks_.resize(uxTaskGetNumberOfTasks() + SPARE_TASKS);
+  return uxTaskGetSystemState(this->tasks_.data(), this->tasks_.size(),
+                              total);
+}
+
+void TaskMonitor::remember_(UBaseType_t count, uint32_t total) {
+  this->last_total_ = total;
+  this->last_.clear();
+  for (size_t i = 0; i < count; i++) {
+    const TaskStatus_t &task = this->tasks_[i];
+    this->last_.push_back(TaskSample{task.xTaskNumber, task.ulRunTimeCounter});
+  }
+}
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
+
+#endif
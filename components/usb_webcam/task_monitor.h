@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// CPU time and stack usage of the FreeRTOS tasks
+
+#pragma once
+
+#ifdef USE_ESP32
+
+#include "esphome/core/component.h"
+#include "esphome/core/defines.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <vector>
+
+namespace esphome {
+namespace esp32_camera {
+
+// "0", "1" or "any" for dump_config
+inline const char *task_core_name(BaseType_t core) {
+  return core == 0 ? "0" : core == 1 ? "1" : "any";
+}
+
+#ifdef USE_USB_WEBCAM_TASK_STATS
+/* ---------------- TaskMonitor class ---------------- */
+// Logs the share of CPU time every task used since the previous update,
+// busiest first, with its core, priority and the smallest amount of stack it
+// ever had left, and the load of every core taken from its idle task. Needs
+// the FreeRTOS run time statistics, which the code generation enables.
+class TaskMonitor : public PollingComponent {
+public:
+  /* public API (derivated) */
+  void setup() override;
+  void update() override;
+  void dump_config() override;
+
+protected:
+  struct TaskSample {
+    UBaseType_t number;
+    uint32_t run_time;
+  };
+
+  // fills tasks_, 0 if it did not fit
+  UBaseType_t snapshot_(uint32_t *total);
+  // counters the next update is measured from
+  void remember_(UBaseType_t count, uint32_t total);
+
+  std::vector<TaskStatus_t> tasks_;
+  std::vector<TaskSample> last_;
+  std::vector<uint32_t> used_; // per entry of tasks_
+  uint32_t last_total_{0};
+};
+#endif
+
+} // namespace esp32_camera
+} // namespace esphome
+
+#endif
@@ -5,78 +5,311 @@
 #ifdef USE_ESP32
 
 #include "../esp32_camera/esp32_camera.h"
+#include "buffer_pool.h"
 #include "esp_timer.h"
+#include "frame_signature.h"
+#include "frame_processor.h"
+#include "frame_recorder.h"
+#include "frame_ring.h"
+#include "image_pool.h"
+#include "image_transcoder.h"
+#include "mjpeg.h"
+#include "motion_detector.h"
+#include "pipeline_stats.h"
+#include "rate_controller.h"
+#include "raw_convert.h"
+#include "synthetic_source.h"
+#include "task_monitor.h"
 #include "usb_stream.h"
 
 #ifdef CONFIG_ESP32_S3_USB_OTG
 #include "bsp/esp-bsp.h"
 #endif
 
+#include "esphome/core/application.h"
+#include "esphome/core/helpers.h"
 #include "esphome/core/log.h"
+#include "esphome/core/preferences.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <esp_timer.h>
-#include <freertos/event_groups.h>
 #include <freertos/task.h>
 
 static const char *const TAG = "usb_webcam";
-#define UVC_XFER_BUFFER_SIZE (150 * 1024) // requires PSRAM
+#define UVC_XFER_BUFFER_SIZE (150 * 1024) // until the resolution is known
+#define UVC_FRAME_LIST_MAX 32
+// intervals are in 100 ns units like in the UVC descriptors
+#define INTERVAL_PER_MS 10000
 
-#define BIT0_FRAME_START (0x01 << 0)
-#define BIT1_NEW_FRAME_START (0x01 << 1)
-#define BIT2_NEW_FRAME_END (0x01 << 2)
-
-static EventGroupHandle_t s_evt_handle;
 static uint32_t s_drop_frame_size = 0;
-static camera_fb_t s_fb;
+static bool s_validate_frames = true;
+// frames of formats that are not converted, logged from the USB callback
+static const int64_t UNSUPPORTED_LOG_INTERVAL_US = 10 * 1000000;
+static int64_t s_unsupported_log_us = -UNSUPPORTED_LOG_INTERVAL_US;
+static esphome::esp32_camera::FrameRing s_ring;
+static uint32_t s_fb_cursor = 0;
+// handed from the framebuffer task to loop(), which owns it once taken
+static std::atomic<camera_fb_t *> s_pending_fb{nullptr};
+
+/* device modes, filled by the state callback on connect */
+static uvc_frame_size_t s_frame_list[UVC_FRAME_LIST_MAX];
+static size_t s_frame_list_size = 0;
+static uvc_frame_size_t *s_frame_list_overflow = nullptr; // longer lists
+static size_t s_frame_list_overflow_size = 0;
+static std::atomic<size_t> s_frame_index{0}; // set on connect too
+static uint32_t s_frame_interval = 0; // currently negotiated
+static std::atomic<bool> s_connected{false};
+static std::atomic<bool> s_modes_changed{false};
+static std::atomic<bool> s_suspended{false};
+static std::atomic<uint8_t> s_skip_frames{0}; // left to drop after resume
+static uvc_config_t s_uvc_config; // kept to restart with other buffers
+
+/* mode of the last connected device, restored at boot so the first probe
+ * asks for the exact mode and buffers the device will end up with */
+struct CachedMode {
+  uint32_t list_hash; // identifies the device by the modes it advertises
+  uvc_frame_size_t frame;
+  uint32_t buffer_size;
+  uint8_t xfer_type; // UVC_XFER_UNKNOWN until measured with transfer: auto
+};
+static esphome::ESPPreferenceObject s_mode_pref;
+static CachedMode s_cached_mode{};
+// the mode picked by the configuration or the user, the one cached; modes
+// the rate controller steps to are not, 0 until a device connected
+static uint16_t s_selected_width = 0;
+static uint16_t s_selected_height = 0;
+
+/* transfer type, with transfer_type: auto each one is streamed for a while
+ * once per device and the one moving the most data is kept, main loop only */
+static const int64_t XFER_PROBE_US = 10 * 1000000;           // per type
+static const int64_t XFER_CONNECT_TIMEOUT_US = 10 * 1000000; // type unusable
+static bool s_xfer_auto = false;
+static bool s_xfer_known = false; // cached or measured for this device
+static uvc_xfer_t s_xfer_probing = UVC_XFER_UNKNOWN;
+static uint8_t s_xfer_measured = 0; // 1 << uvc_xfer_t
+static uint32_t s_xfer_throughput[UVC_XFER_UNKNOWN] = {0, 0}; // bytes/s
+static int64_t s_xfer_restart_us = 0;
+static int64_t s_xfer_start_us = 0; // 0 until connected
+static uint32_t s_xfer_start_bytes = 0;
+
+/* buffer sizing, set by the UVC callback and acted upon in loop() */
+static std::atomic<uint32_t> s_largest_frame{0}; // since the last resize
+static std::atomic<bool> s_buffers_short{false};
+static uint32_t s_failed_buffer_size = 0; // allocation failed, do not retry
+
+/* thumbnails and regions of interest, filled by the transcoder task and
+ * delivered from loop() */
+static esphome::esp32_camera::ImageBuffer
+    s_thumbnails[esphome::esp32_camera::THUMBNAIL_BUFFER_COUNT];
+static esphome::esp32_camera::ImageTranscoder *s_transcoder = nullptr;
+static esphome::esp32_camera::ImageBuffer
+    s_roi_buffers[esphome::esp32_camera::ROI_BUFFER_COUNT];
+
+/* uncompressed frames, converted in the usb_stream sample task */
+static esphome::esp32_camera::RawOutput s_raw_output =
+    esphome::esp32_camera::RAW_OUTPUT_JPEG;
+static esphome::esp32_camera::RawConverter *s_raw_converter = nullptr;
+static uint8_t s_jpeg_quality = 80;
+static std::atomic<bool> s_uncompressed{false}; // device sends raw frames
+
+/* unchanged frames, signed in the usb_stream sample task */
+static bool s_sign_frames = false;
+static esphome::esp32_camera::SignatureBuilder *s_signature_builder = nullptr;
+static esphome::esp32_camera::UnchangedFilter s_unchanged_filter;
+
+/* last delivered frame, referenced by the main loop for the snapshot cache */
+static camera_fb_t *s_snapshot_fb = nullptr;
 
 camera_fb_t *esp_camera_fb_get() {
-  xEventGroupSetBits(s_evt_handle, BIT0_FRAME_START);
-  xEventGroupWaitBits(s_evt_handle, BIT1_NEW_FRAME_START, true, true,
-                      portMAX_DELAY);
-  return &s_fb;
+  return s_ring.wait_latest(&s_fb_cursor, portMAX_DELAY);
 }
 
 void esp_camera_fb_return(camera_fb_t *fb) {
-  xEventGroupSetBits(s_evt_handle, BIT2_NEW_FRAME_END);
+  s_ring.release(fb);
   return;
 }
 
 namespace esphome {
 namespace esp32_camera {
 
-static void camera_frame_cb(uvc_frame_t *frame, void *ptr) {
-  if (!(xEventGroupGetBits(s_evt_handle) & BIT0_FRAME_START)) {
+/* images come from a fixed pool, delivering a frame never allocates */
+static_assert(ImagePool::NODE_COUNT >=
+                  3 + THUMBNAIL_BUFFER_COUNT + ROI_BUFFER_COUNT,
+              "one node per image slot, plus the next current image");
+static std::shared_ptr<CameraImage> make_image(camera_fb_t *fb,
+                                               uint8_t requesters) {
+  return std::allocate_shared<CameraImage>(ImagePoolAllocator<CameraImage>(),
+                                           fb, requesters);
+}
+
+static void stamp_frame(camera_fb_t *fb, const uvc_frame_t *frame,
+                        pixformat_t format, int64_t entry_us) {
+  fb->width = frame->width;
+  fb->height = frame->height;
+  fb->format = format;
+  fb->timestamp.tv_sec = entry_us / 1000000;
+  fb->timestamp.tv_usec = entry_us % 1000000;
+  *s_ring.times_of(fb) = FrameTimes{entry_us, 0, 0};
+}
+
+/* no slot taken: every one big enough is referenced, or none is while the
+ * slots are still being resized */
+static void count_unwritten(const uvc_frame_t *frame, size_t len) {
+  if (s_ring.fits(len)) {
+    ESP_LOGV(TAG, "No free slot for frame = %u", frame->sequence);
+    global_pipeline_stats.count_dropped_busy();
+  } else {
+    ESP_LOGV(TAG, "Dropping frame size %u, no slot holds it", len);
+    global_pipeline_stats.count_oversize();
+  }
+}
+
+/* created with the first frame, the decoder tables are big */
+static SignatureBuilder *signature_builder() {
+  if (s_signature_builder == nullptr)
+    s_signature_builder = new SignatureBuilder();
+  return s_signature_builder;
+}
+
+/* Uncompressed frames are converted straight into the slot, JPEG encoding
+ * one strip at a time; the frame only becomes visible once complete. */
+static void convert_raw_frame(const uvc_frame_t *frame, RawFormat format,
+                              int64_t entry_us) {
+  // 0 for JPEG, which is only known to fit once encoded
+  const size_t size = raw_output_size(s_raw_output, frame->width,
+                                      frame->height);
+  camera_fb_t *fb = s_ring.begin_write(size);
+  if (fb == nullptr) {
+    count_unwritten(frame, size);
+    return;
+  }
+  if (s_raw_converter == nullptr) {
+    s_raw_converter = new RawConverter();
+    s_raw_converter->set_quality(s_jpeg_quality);
+  }
+  size_t len = 0;
+  const JpegStatus status = s_raw_converter->convert(
+      format, (const uint8_t *)frame->data, frame->data_bytes, frame->width,
+      frame->height, s_raw_output, fb->buf, s_ring.capacity_of(fb), &len);
+  if (status != JPEG_OK) {
+    ESP_LOGV(TAG, "Dropping frame = %u: conversion failed (%u)",
+             frame->sequence, status);
+    s_ring.abort_write(fb);
+    if (status == JPEG_OVERFLOW) {
+      s_buffers_short = true;
+      global_pipeline_stats.count_oversize();
+    } else {
+      global_pipeline_stats.count_corrupt(MJPEG_TRUNCATED);
+    }
     return;
   }
+  fb->len = len;
+  if (s_sign_frames)
+    signature_builder()->from_raw(format, (const uint8_t *)frame->data,
+                                  frame->data_bytes, frame->width,
+                                  frame->height, s_ring.signature_of(fb));
+  stamp_frame(fb, frame,
+              s_raw_output == RAW_OUTPUT_RGB565      ? PIXFORMAT_RGB565
+              : s_raw_output == RAW_OUTPUT_GRAYSCALE ? PIXFORMAT_GRAYSCALE
+                                                     : PIXFORMAT_JPEG,
+              entry_us);
+  s_ring.commit_write(fb);
+  ESP_LOGV(TAG, "send frame = %u", frame->sequence);
+}
+
+static void camera_frame_cb(uvc_frame_t *frame, void *ptr) {
+  const int64_t entry_us = esp_timer_get_time();
   ESP_LOGV(
       TAG,
       "uvc frame format = %d, seq = %u, width = %u, height = %u, length = %u",
       frame->frame_format, frame->sequence, frame->width, frame->height,
       frame->data_bytes);
+  global_pipeline_stats.count_received(frame->data_bytes);
 
+  // the first frames after a resume may still be badly exposed; a resume
+  // storing a new count meanwhile must not be overwritten
+  uint8_t skip = s_skip_frames.load();
+  while (skip != 0 && !s_skip_frames.compare_exchange_weak(skip, skip - 1))
+    ;
+  if (skip != 0) {
+    ESP_LOGV(TAG, "Skipping frame = %u after resume", frame->sequence);
+    return;
+  }
   if (frame->data_bytes < s_drop_frame_size) {
     ESP_LOGV(TAG, "Dropping frame size %u < %u", frame->data_bytes,
              s_drop_frame_size);
+    global_pipeline_stats.count_dropped_too_small();
+    return;
+  }
+  const bool compressed = frame->frame_format == UVC_FRAME_FORMAT_MJPEG;
+  if (!compressed)
+    s_uncompressed = true;
+  // usb_stream truncates frames that overflow its buffer, ask for bigger
+  // buffers once frames come close and before many are lost; uncompressed
+  // frames always have the same size, they are short only when truncated
+  const size_t buffer_size = s_uvc_config.frame_buffer_size;
+  if (frame->data_bytes > s_largest_frame.load())
+    s_largest_frame = frame->data_bytes;
+  const size_t short_size =
+      compressed ? buffer_size - buffer_size / 8 : buffer_size;
+  if (buffer_size != 0 && frame->data_bytes >= short_size)
+    s_buffers_short = true;
+  if (buffer_size != 0 && frame->data_bytes >= buffer_size) {
+    ESP_LOGV(TAG, "Dropping truncated frame = %u", frame->sequence);
+    global_pipeline_stats.count_oversize();
     return;
   }
 
   switch (frame->frame_format) {
-  case UVC_FRAME_FORMAT_MJPEG:
-    s_fb.buf = (uint8_t *)frame->data;
-    s_fb.len = frame->data_bytes;
-    s_fb.width = frame->width;
-    s_fb.height = frame->height;
-    s_fb.format = PIXFORMAT_JPEG;
-    s_fb.timestamp.tv_sec = frame->sequence;
-    xEventGroupSetBits(s_evt_handle, BIT1_NEW_FRAME_START);
+  case UVC_FRAME_FORMAT_MJPEG: {
+    if (s_validate_frames) {
+      MjpegError error =
+          validate_mjpeg((const uint8_t *)frame->data, frame->data_bytes);
+      if (error != MJPEG_VALID) {
+        ESP_LOGV(TAG, "Dropping frame = %u: %s", frame->sequence,
+                 mjpeg_error_to_string(error));
+        global_pipeline_stats.count_corrupt(error);
+        return;
+      }
+    }
+    // never wait for consumers here, this runs in the usb_stream sample task
+    camera_fb_t *fb = s_ring.begin_write(frame->data_bytes);
+    if (fb == nullptr) {
+      count_unwritten(frame, frame->data_bytes);
+      return;
+    }
+    fb->len = frame->data_bytes;
+    stamp_frame(fb, frame, PIXFORMAT_JPEG, entry_us);
+    if (s_sign_frames)
+      signature_builder()->from_jpeg((const uint8_t *)frame->data, fb->len,
+                                     s_ring.signature_of(fb));
+    memcpy(fb->buf, frame->data, frame->data_bytes);
+    s_ring.commit_write(fb);
     ESP_LOGV(TAG, "send frame = %u", frame->sequence);
-    xEventGroupWaitBits(s_evt_handle, BIT2_NEW_FRAME_END, true, true,
-                        portMAX_DELAY);
-    ESP_LOGV(TAG, "send frame done = %u", frame->sequence);
+    break;
+  }
+  case UVC_FRAME_FORMAT_YUYV:
+    convert_raw_frame(frame, RAW_YUYV, entry_us);
+    break;
+  case UVC_FRAME_FORMAT_UYVY:
+    convert_raw_frame(frame, RAW_UYVY, entry_us);
+    break;
+  case UVC_FRAME_FORMAT_NV12:
+    convert_raw_frame(frame, RAW_NV12, entry_us);
+    break;
+  case UVC_FRAME_FORMAT_GRAY8:
+    convert_raw_frame(frame, RAW_GRAY8, entry_us);
     break;
   default:
-    ESP_LOGW(TAG, "Format not supported");
-    assert(0);
+    // offered by the camera but not converted here, e.g. H.264
+    global_pipeline_stats.count_corrupt(MJPEG_MISSING_SOI);
+    if (entry_us - s_unsupported_log_us >= UNSUPPORTED_LOG_INTERVAL_US) {
+      s_unsupported_log_us = entry_us;
+      ESP_LOGW(TAG, "Dropping frames of unsupported format %d",
+               frame->frame_format);
+    }
     break;
   }
 }
@@ -87,25 +320,52 @@ static void stream_state_changed_cb(usb_stream_state_t event, void *arg) {
     size_t frame_size = 0;
     size_t frame_index = 0;
     uvc_frame_size_list_get(NULL, &frame_size, &frame_index);
+    if (frame_size > UVC_FRAME_LIST_MAX) {
+      ESP_LOGW(TAG, "UVC: only first %u of %u frame sizes are used",
+               UVC_FRAME_LIST_MAX, frame_size);
+    }
     if (frame_size) {
       ESP_LOGI(TAG, "UVC: get frame list size = %u, current = %u", frame_size,
                frame_index);
-      uvc_frame_size_t *uvc_frame_list =
-          (uvc_frame_size_t *)malloc(frame_size * sizeof(uvc_frame_size_t));
+      // the whole list is copied out, only longer ones need a bigger buffer,
+      // kept for the next reconnect
+      uvc_frame_size_t *uvc_frame_list = s_frame_list;
+      if (frame_size > UVC_FRAME_LIST_MAX) {
+        if (frame_size > s_frame_list_overflow_size) {
+          free(s_frame_list_overflow);
+          s_frame_list_overflow =
+              (uvc_frame_size_t *)malloc(frame_size * sizeof(uvc_frame_size_t));
+          s_frame_list_overflow_size = frame_size;
+        }
+        uvc_frame_list = s_frame_list_overflow;
+      }
       uvc_frame_size_list_get(uvc_frame_list, NULL, NULL);
       for (size_t i = 0; i < frame_size; i++) {
-        ESP_LOGI(TAG, "\tframe[%u] = %ux%u", i, uvc_frame_list[i].width,
-                 uvc_frame_list[i].height);
+        ESP_LOGI(TAG, "\tframe[%u] = %ux%u, interval %u..%u step %u", i,
+                 uvc_frame_list[i].width, uvc_frame_list[i].height,
+                 uvc_frame_list[i].interval_min, uvc_frame_list[i].interval_max,
+                 uvc_frame_list[i].interval_step);
+      }
+      s_frame_list_size = std::min(frame_size, (size_t)UVC_FRAME_LIST_MAX);
+      s_frame_index = frame_index < s_frame_list_size ? frame_index : 0;
+      if (uvc_frame_list != s_frame_list) {
+        memcpy(s_frame_list, uvc_frame_list,
+               s_frame_list_size * sizeof(uvc_frame_size_t));
       }
-      free(uvc_frame_list);
     } else {
       ESP_LOGW(TAG, "UVC: get frame list size = %u", frame_size);
+      s_frame_list_size = 0;
     }
     ESP_LOGI(TAG, "Device connected");
+    // renegotiation needs usb_stream control calls, leave it to loop()
+    s_suspended = false;
+    s_connected = true;
+    s_modes_changed = true;
     break;
   }
   case STREAM_DISCONNECTED:
     ESP_LOGI(TAG, "Device disconnected");
+    s_connected = false;
     break;
   default:
     ESP_LOGE(TAG, "Unknown event");
@@ -113,43 +373,484 @@ static void stream_state_changed_cb(usb_stream_state_t event, void *arg) {
   }
 }
 
-esp_err_t esp_camera_init(ESP32CameraFrameSize fs, uint32_t fps) {
+/* Longest interval the device supports for this frame size that still
+ * delivers at least the requested rate, or its fastest one if even that is
+ * too slow. */
+static uint32_t closest_frame_interval(const uvc_frame_size_t &frame,
+                                       uint32_t interval) {
+  if (interval <= frame.interval_min)
+    return frame.interval_min;
+  if (interval >= frame.interval_max)
+    return frame.interval_max;
+  if (frame.interval_step != 0) {
+    // continuous range
+    return frame.interval_min + (interval - frame.interval_min) /
+                                    frame.interval_step * frame.interval_step;
+  }
+  // discrete intervals, usb_stream reports the bounds and the default one
+  if (frame.interval != 0 && frame.interval <= interval)
+    return frame.interval;
+  return frame.interval_min;
+}
+
+/* Frame interval to ask for before the device modes are known: the common
+ * 5 fps steps most cameras accept, never slower than requested. */
+static uint32_t standard_frame_interval(uint32_t interval) {
+  uint32_t fps = 5;
+  while (fps < 30 && FPS2INTERVAL(fps) > interval)
+    fps += 5;
+  return FPS2INTERVAL(fps);
+}
+
+/* MJPEG frames never exceed 8 bits per pixel, no point in growing any
+ * further; uncompressed ones take up to 16 and get some headroom, a frame
+ * filling the buffer exactly would be taken for a truncated one */
+static const uint32_t RAW_FRAME_HEADROOM = 4096;
+static uint32_t frame_buffer_limit_for(uint16_t width, uint16_t height) {
+  const uint32_t pixels = (uint32_t)width * height;
+  if (s_uncompressed)
+    return BufferPool::round_up(pixels * 2 + RAW_FRAME_HEADROOM);
+  return BufferPool::round_up(pixels);
+}
+
+/* and rarely 3 bits per pixel to start with, uncompressed frames have a
+ * fixed size */
+static uint32_t frame_buffer_size_for(uint16_t width, uint16_t height) {
+  if (s_uncompressed)
+    return frame_buffer_limit_for(width, height);
+  return BufferPool::round_up((uint32_t)width * height * 3 / 8);
+}
+
+/* a suspended stream stays suspended, it picks the new mode up on resume */
+static esp_err_t reset_frame_size(uint16_t width, uint16_t height,
+                                  uint32_t interval) {
+  if (s_suspended)
+    return uvc_frame_size_reset(width, height, interval);
+  esp_err_t ret = usb_streaming_control(STREAM_UVC, CTRL_SUSPEND, NULL);
+  if (ret != ESP_OK)
+    return ret;
+  ret = uvc_frame_size_reset(width, height, interval);
+  esp_err_t resumed = usb_streaming_control(STREAM_UVC, CTRL_RESUME, NULL);
+  return ret != ESP_OK ? ret : resumed;
+}
+
+static void release_stream_buffers() {
+  global_buffer_pool.release(s_uvc_config.xfer_buffer_a,
+                             s_uvc_config.xfer_buffer_size);
+  global_buffer_pool.release(s_uvc_config.xfer_buffer_b,
+                             s_uvc_config.xfer_buffer_size);
+  global_buffer_pool.release(s_uvc_config.frame_buffer,
+                             s_uvc_config.frame_buffer_size);
+  s_uvc_config.xfer_buffer_a = nullptr;
+  s_uvc_config.xfer_buffer_b = nullptr;
+  s_uvc_config.frame_buffer = nullptr;
+  s_uvc_config.xfer_buffer_size = 0;
+  s_uvc_config.frame_buffer_size = 0;
+}
+
+/* xfer_buffer_size >= frame_buffer_size, usb_stream wants both */
+static esp_err_t acquire_stream_buffers(uint32_t buffer_size) {
+  s_uvc_config.xfer_buffer_a = global_buffer_pool.acquire(buffer_size);
+  s_uvc_config.xfer_buffer_b = global_buffer_pool.acquire(buffer_size);
+  s_uvc_config.frame_buffer = global_buffer_pool.acquire(buffer_size);
+  s_uvc_config.xfer_buffer_size = buffer_size;
+  s_uvc_config.frame_buffer_size = buffer_size;
+  if (!s_uvc_config.frame_buffer || !s_uvc_config.xfer_buffer_a ||
+      !s_uvc_config.xfer_buffer_b) {
+    release_stream_buffers();
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+/* usb_stream buffers are fixed at config time, other buffers need a restart
+ * of the stream. The old buffers are given back first so the new ones can
+ * take their place; when the new ones do not fit, the stream comes back with
+ * the old settings and ESP_ERR_NO_MEM is returned. */
+static esp_err_t restart_streaming(uint16_t width, uint16_t height,
+                                   uint32_t interval, uint32_t buffer_size) {
+  buffer_size = BufferPool::round_up(buffer_size);
+  esp_err_t ret = usb_streaming_stop();
+  if (ret != ESP_OK)
+    return ret;
+  s_connected = false;
+  const uvc_config_t previous = s_uvc_config;
+  release_stream_buffers();
+  if (buffer_size != previous.frame_buffer_size)
+    global_buffer_pool.trim();
+  esp_err_t result = acquire_stream_buffers(buffer_size);
+  if (result == ESP_OK) {
+    s_uvc_config.frame_width = width;
+    s_uvc_config.frame_height = height;
+    s_uvc_config.frame_interval = interval;
+  } else {
+    ESP_LOGW(TAG, "No memory for %u byte buffers, keeping %u", buffer_size,
+             previous.frame_buffer_size);
+    ret = acquire_stream_buffers(previous.frame_buffer_size);
+    if (ret != ESP_OK)
+      return ret;
+  }
+  s_largest_frame = 0;
+  s_buffers_short = false;
+  // a transfer measurement starts over with the new connection
+  s_xfer_restart_us = esp_timer_get_time();
+  s_xfer_start_us = 0;
+
+  ret = uvc_streaming_config(&s_uvc_config);
+  if (ret != ESP_OK)
+    return ret;
+  ret = usb_streaming_state_register(&stream_state_changed_cb, NULL);
+  if (ret != ESP_OK)
+    return ret;
+  ret = usb_streaming_start();
+  if (ret != ESP_OK)
+    return ret;
+  s_suspended = false;
+  // frame slots must hold anything usb_stream can assemble
+  s_ring.resize(s_uvc_config.frame_buffer_size);
+  if (!s_ring.resize_pending())
+    global_buffer_pool.trim();
+  return result;
+}
+
+/* FNV-1a over the advertised modes */
+static uint32_t frame_list_hash() {
+  uint32_t hash = 2166136261UL;
+  const uint8_t *data = (const uint8_t *)s_frame_list;
+  for (size_t i = 0; i < s_frame_list_size * sizeof(uvc_frame_size_t); i++) {
+    hash ^= data[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+/* what a mode of the connected device starts with: the buffers it needed
+ * last time when it is the cached mode, else a guess from its size */
+static uint32_t start_buffer_size_for(const uvc_frame_size_t &frame) {
+  const uint32_t guess = frame_buffer_size_for(frame.width, frame.height);
+  if (s_cached_mode.buffer_size == 0 ||
+      s_cached_mode.frame.width != frame.width ||
+      s_cached_mode.frame.height != frame.height ||
+      s_cached_mode.list_hash != frame_list_hash())
+    return guess;
+  return std::max(guess, s_cached_mode.buffer_size);
+}
+
+/* restarting is worth it when buffers are too small or twice too big, the
+ * gap keeps buffers grown after overflows from shrinking back on reconnect */
+static bool needs_other_buffers(uint32_t buffer_size) {
+  const uint32_t current = s_uvc_config.frame_buffer_size;
+  return buffer_size > current || buffer_size < current / 2;
+}
+
+esp_err_t esp_camera_set_frame_interval(uint32_t interval) {
+  if (!s_connected || s_frame_list_size == 0)
+    return ESP_ERR_INVALID_STATE;
+  const uvc_frame_size_t &frame = s_frame_list[s_frame_index];
+  const uint32_t negotiated = closest_frame_interval(frame, interval);
+  if (negotiated == s_frame_interval)
+    return ESP_OK;
+
+  ESP_LOGD(TAG, "Renegotiating %ux%u at %.1f fps", frame.width, frame.height,
+           10000000.0f / negotiated);
+  esp_err_t ret = reset_frame_size(frame.width, frame.height, negotiated);
+  if (ret == ESP_OK)
+    s_frame_interval = negotiated;
+  return ret;
+}
+
+esp_err_t esp_camera_set_frame_size(uint16_t width, uint16_t height,
+                                    uint32_t interval) {
+  if (!s_connected)
+    return ESP_ERR_INVALID_STATE;
+  size_t index = 0;
+  while (index < s_frame_list_size && (s_frame_list[index].width != width ||
+                                       s_frame_list[index].height != height))
+    index++;
+  if (index == s_frame_list_size)
+    return ESP_ERR_NOT_SUPPORTED;
+
+  const uint32_t negotiated =
+      closest_frame_interval(s_frame_list[index], interval);
+  const uint32_t buffer_size = start_buffer_size_for(s_frame_list[index]);
+  esp_err_t ret;
+  if (needs_other_buffers(buffer_size)) {
+    ESP_LOGI(TAG, "Restarting stream for %ux%u with %u byte buffers", width,
+             height, buffer_size);
+    ret = restart_streaming(width, height, negotiated, buffer_size);
+  } else {
+    ret = reset_frame_size(width, height, negotiated);
+    s_largest_frame = 0;
+    if (ret == ESP_OK) {
+      // the mode to come back to after a reconnect
+      s_uvc_config.frame_width = width;
+      s_uvc_config.frame_height = height;
+      s_uvc_config.frame_interval = negotiated;
+    }
+  }
+  if (ret == ESP_OK) {
+    s_frame_index = index;
+    s_frame_interval = negotiated;
+    s_failed_buffer_size = 0;
+  }
+  return ret;
+}
+
+/* Devices plugged in again come back with the mode usb_stream was configured
+ * with, or their default one; the mode selected last is applied again. */
+esp_err_t esp_camera_restore_frame_size() {
+  if (!s_connected || s_frame_list_size == 0)
+    return ESP_ERR_INVALID_STATE;
+  const uvc_frame_size_t &frame = s_frame_list[s_frame_index];
+  const uint16_t width = s_uvc_config.frame_width;
+  const uint16_t height = s_uvc_config.frame_height;
+  if (frame.width == width && frame.height == height)
+    return ESP_OK;
+  // any resolution or another device, keep what it sends
+  esp_err_t ret = esp_camera_set_frame_size(width, height,
+                                            s_uvc_config.frame_interval);
+  if (ret == ESP_ERR_NOT_SUPPORTED)
+    return ESP_OK;
+  ESP_LOGI(TAG, "Device came back with %ux%u, restoring %ux%u", frame.width,
+           frame.height, width, height);
+  return ret;
+}
+
+/* Buffers follow the current resolution and the largest frame seen since
+ * the last resize: they grow by half when frames come close to overflowing
+ * them, up to 8 bits per pixel, and shrink when the device turns out to
+ * need much less than assumed before it connected. */
+esp_err_t esp_camera_fit_frame_buffers() {
+  s_buffers_short = false;
+  if (!s_connected || s_frame_list_size == 0)
+    return ESP_ERR_INVALID_STATE;
+  const uvc_frame_size_t &frame = s_frame_list[s_frame_index];
+  const uint32_t current = s_uvc_config.frame_buffer_size;
+  // a cached size is what this mode grew to before, not too much
+  uint32_t buffer_size =
+      std::max(start_buffer_size_for(frame),
+               s_largest_frame.load() + s_largest_frame.load() / 4);
+  if (s_largest_frame.load() >= current - current / 8)
+    buffer_size = std::max(buffer_size, current + current / 2);
+  buffer_size = std::min((uint32_t)BufferPool::round_up(buffer_size),
+                         frame_buffer_limit_for(frame.width, frame.height));
+  if (!needs_other_buffers(buffer_size) ||
+      (s_failed_buffer_size != 0 && buffer_size >= s_failed_buffer_size))
+    return ESP_OK;
+
+  ESP_LOGI(TAG, "Restarting stream for %ux%u: %u -> %u byte buffers",
+           frame.width, frame.height, current, buffer_size);
+  esp_err_t ret = restart_streaming(frame.width, frame.height,
+                                    s_frame_interval, buffer_size);
+  if (ret == ESP_ERR_NO_MEM)
+    s_failed_buffer_size = buffer_size;
+  return ret;
+}
+
+/* Suspending only stops the transfers, usb_stream keeps the committed probe
+ * result so resuming does not negotiate again. */
+esp_err_t esp_camera_suspend() {
+  if (!s_connected || s_suspended)
+    return ESP_ERR_INVALID_STATE;
+  esp_err_t ret = usb_streaming_control(STREAM_UVC, CTRL_SUSPEND, NULL);
+  if (ret == ESP_OK)
+    s_suspended = true;
+  return ret;
+}
+
+esp_err_t esp_camera_resume(uint8_t skip_frames) {
+  if (!s_connected || !s_suspended)
+    return ESP_ERR_INVALID_STATE;
+  s_skip_frames = skip_frames;
+  esp_err_t ret = usb_streaming_control(STREAM_UVC, CTRL_RESUME, NULL);
+  if (ret == ESP_OK)
+    s_suspended = false;
+  return ret;
+}
+
+size_t esp_camera_get_frame_sizes(const uvc_frame_size_t **list,
+                                  size_t *current) {
+  *list = s_frame_list;
+  *current = s_frame_index;
+  return s_connected ? s_frame_list_size : 0;
+}
+
+/* flash is only written when the device, its mode or the buffers changed;
+ * the selected mode is cached, with the buffers it grew to while streamed */
+void esp_camera_save_mode() {
+  if (!s_connected || s_frame_list_size == 0)
+    return;
+  const uvc_frame_size_t &current = s_frame_list[s_frame_index];
+  if (s_selected_width == 0) {
+    s_selected_width = current.width;
+    s_selected_height = current.height;
+  }
+  const uvc_frame_size_t *selected = nullptr;
+  for (size_t i = 0; i < s_frame_list_size; i++) {
+    if (s_frame_list[i].width == s_selected_width &&
+        s_frame_list[i].height == s_selected_height) {
+      selected = &s_frame_list[i];
+      break;
+    }
+  }
+  if (selected == nullptr) {
+    // another device without that mode, it starts over from its own
+    selected = &current;
+    s_selected_width = current.width;
+    s_selected_height = current.height;
+  }
+  CachedMode mode;
+  memset(&mode, 0, sizeof(CachedMode)); // compared with memcmp, padding too
+  mode.list_hash = frame_list_hash();
+  mode.frame = *selected;
+  if (selected == &current) {
+    mode.buffer_size = s_uvc_config.frame_buffer_size;
+  } else if (s_cached_mode.list_hash == mode.list_hash &&
+             memcmp(&s_cached_mode.frame, selected,
+                    sizeof(uvc_frame_size_t)) == 0) {
+    // streaming another mode says nothing about the buffers of this one
+    mode.buffer_size = s_cached_mode.buffer_size;
+  }
+  mode.xfer_type = s_xfer_auto && !s_xfer_known ? UVC_XFER_UNKNOWN
+                                                : s_uvc_config.xfer_type;
+  if (memcmp(&mode, &s_cached_mode, sizeof(CachedMode)) == 0)
+    return;
+  if (mode.list_hash != s_cached_mode.list_hash) {
+    ESP_LOGI(TAG, "New device, caching its modes");
+    // transfers of the previous device say nothing about this one
+    if (s_xfer_auto && s_xfer_known && s_xfer_probing == UVC_XFER_UNKNOWN) {
+      s_xfer_known = false;
+      mode.xfer_type = UVC_XFER_UNKNOWN;
+    }
+  }
+  ESP_LOGD(TAG, "Caching %ux%u with %u byte buffers", mode.frame.width,
+           mode.frame.height, mode.buffer_size);
+  s_cached_mode = mode;
+  s_mode_pref.save(&s_cached_mode);
+}
+
+/* the current mode becomes the selected one, cached for the next boot */
+void esp_camera_select_mode() {
+  if (!s_connected || s_frame_list_size == 0)
+    return;
+  s_selected_width = s_frame_list[s_frame_index].width;
+  s_selected_height = s_frame_list[s_frame_index].height;
+  esp_camera_save_mode();
+}
+
+static const char *xfer_type_to_string(uvc_xfer_t type) {
+  switch (type) {
+  case UVC_XFER_ISOC:
+    return "isochronous";
+  case UVC_XFER_BULK:
+    return "bulk";
+  default:
+    return "auto";
+  }
+}
+
+/* same mode and buffers, only the transfer type changes */
+static esp_err_t restart_with_xfer(uvc_xfer_t type) {
+  uint16_t width = s_uvc_config.frame_width;
+  uint16_t height = s_uvc_config.frame_height;
+  if (s_connected && s_frame_list_size != 0) {
+    width = s_frame_list[s_frame_index].width;
+    height = s_frame_list[s_frame_index].height;
+  }
+  s_uvc_config.xfer_type = type;
+  return restart_streaming(width, height, s_frame_interval,
+                           s_uvc_config.frame_buffer_size);
+}
+
+bool esp_camera_probing_transfer() {
+  return s_xfer_probing != UVC_XFER_UNKNOWN;
+}
+
+/* Streams with the current transfer type, then with the other one, each
+ * restarted and measured for XFER_PROBE_US from the moment the device is
+ * connected, and keeps the type that moved the most data. usb_stream
+ * itself picks the alternate setting with the biggest packets that still
+ * fits full speed. Returns true when probing started or ended. */
+bool esp_camera_probe_transfer() {
+#ifdef USE_USB_WEBCAM_SYNTHETIC
+  return false;
+#else
+  const int64_t now = esp_timer_get_time();
+  if (s_xfer_probing == UVC_XFER_UNKNOWN) {
+    if (!s_xfer_auto || s_xfer_known || !s_connected)
+      return false;
+    ESP_LOGI(TAG, "Measuring bulk and isochronous throughput");
+    s_xfer_probing = s_uvc_config.xfer_type;
+    s_xfer_measured = 0;
+    restart_with_xfer(s_xfer_probing);
+    return true;
+  }
+
+  const uvc_xfer_t type = s_xfer_probing;
+  if (s_xfer_start_us == 0) {
+    if (s_connected) {
+      s_xfer_start_us = now;
+      s_xfer_start_bytes = global_pipeline_stats.get_received();
+      return false;
+    }
+    if (now - s_xfer_restart_us < XFER_CONNECT_TIMEOUT_US)
+      return false;
+    ESP_LOGI(TAG, "No connection with %s transfers", xfer_type_to_string(type));
+    s_xfer_throughput[type] = 0;
+  } else {
+    if (now - s_xfer_start_us < XFER_PROBE_US)
+      return false;
+    const uint32_t bytes =
+        global_pipeline_stats.get_received() - s_xfer_start_bytes;
+    s_xfer_throughput[type] = bytes * 1000000.0f / (now - s_xfer_start_us);
+    ESP_LOGI(TAG, "Throughput with %s transfers: %.1f kB/s",
+             xfer_type_to_string(type), s_xfer_throughput[type] / 1000.0f);
+  }
+  s_xfer_measured |= 1U << type;
+
+  const uvc_xfer_t other =
+      type == UVC_XFER_BULK ? UVC_XFER_ISOC : UVC_XFER_BULK;
+  if ((s_xfer_measured & (1U << other)) == 0) {
+    s_xfer_probing = other;
+    restart_with_xfer(other);
+    return false;
+  }
+  const uvc_xfer_t best =
+      s_xfer_throughput[UVC_XFER_BULK] >= s_xfer_throughput[UVC_XFER_ISOC]
+          ? UVC_XFER_BULK
+          : UVC_XFER_ISOC;
+  ESP_LOGI(TAG, "Using %s transfers", xfer_type_to_string(best));
+  s_xfer_probing = UVC_XFER_UNKNOWN;
+  s_xfer_known = true;
+  if (best != type)
+    restart_with_xfer(best);
+  else
+    esp_camera_save_mode();
+  return true;
+#endif
+}
+
+esp_err_t esp_camera_init(ESP32CameraFrameSize fs, uint32_t frame_interval,
+                          size_t fb_count, ESP32CameraTransferType transfer) {
 #ifdef CONFIG_ESP32_S3_USB_OTG
   bsp_usb_mode_select_host();
   bsp_usb_host_power_mode(BSP_USB_HOST_POWER_MODE_USB_DEV, true);
 #endif
-  memset(&s_fb, 0, sizeof(camera_fb_t));
-  s_evt_handle = xEventGroupCreate();
-  if (s_evt_handle == NULL) {
-    ESP_LOGE(TAG, "Event group create failed");
-    assert(0);
-  }
-  /* malloc double buffer for usb payload, xfer_buffer_size >=
-   * frame_buffer_size*/
-  uint8_t *xfer_buffer_a = (uint8_t *)heap_caps_malloc_prefer(
-      UVC_XFER_BUFFER_SIZE, 2, MALLOC_CAP_SPIRAM, 0);
-  uint8_t *xfer_buffer_b = (uint8_t *)heap_caps_malloc_prefer(
-      UVC_XFER_BUFFER_SIZE, 2, MALLOC_CAP_SPIRAM, 0);
-  uint8_t *frame_buffer = (uint8_t *)heap_caps_malloc_prefer(
-      UVC_XFER_BUFFER_SIZE, 2, MALLOC_CAP_SPIRAM, 0);
-  if (!frame_buffer || !xfer_buffer_a || !xfer_buffer_b) {
-    ESP_LOGE(TAG, "Not enough memory");
-    return ESP_ERR_NO_MEM;
-  }
   uvc_config_t uvc_config = {
       .frame_width = 0,
       .frame_height = 0,
-      .frame_interval = FPS2INTERVAL(
-          15), // fps will be here, but more than 5 is unstable anyway, also it
-               // cannot be arbitrary, only 5, 10, 15,...
-      .xfer_buffer_size = UVC_XFER_BUFFER_SIZE,
-      .xfer_buffer_a = xfer_buffer_a,
-      .xfer_buffer_b = xfer_buffer_b,
-      .frame_buffer_size = UVC_XFER_BUFFER_SIZE,
-      .frame_buffer = frame_buffer,
+      // cannot be arbitrary, refined against the device list on connect
+      .frame_interval = standard_frame_interval(frame_interval),
+      // buffers are sized for the resolution below
+      .xfer_buffer_size = 0,
+      .xfer_buffer_a = NULL,
+      .xfer_buffer_b = NULL,
+      .frame_buffer_size = 0,
+      .frame_buffer = NULL,
       .frame_cb = &camera_frame_cb,
       .frame_cb_arg = NULL,
-      .xfer_type = UVC_XFER_BULK,
+      .xfer_type = transfer == ESP32_CAMERA_TRANSFER_ISOC ? UVC_XFER_ISOC
+                                                           : UVC_XFER_BULK,
       // .format_index = 0,
       // .frame_index = 0,
       // .interface = 1,
@@ -251,8 +952,53 @@ esp_err_t esp_camera_init(ESP32CameraFrameSize fs, uint32_t fps) {
   default:
     return ESP_ERR_INVALID_ARG;
   }
+  /* any resolution: the default size until the device tells its own */
+  uint32_t buffer_size = fs == ESP32_CAMERA_SIZE_ANY
+                             ? UVC_XFER_BUFFER_SIZE
+                             : frame_buffer_size_for(uvc_config.frame_width,
+                                                     uvc_config.frame_height);
+  /* the mode cached from the last boot knows better, as long as it is the
+   * configured size, so the device does not have to be probed twice or the
+   * stream restarted for other buffers once it connects */
+  s_mode_pref = global_preferences->make_preference<CachedMode>(
+      fnv1_hash("usb_webcam_mode"), true);
+  if (!s_mode_pref.load(&s_cached_mode))
+    memset(&s_cached_mode, 0, sizeof(CachedMode));
+  s_xfer_auto = transfer == ESP32_CAMERA_TRANSFER_AUTO;
+  if (s_xfer_auto && s_cached_mode.list_hash != 0 &&
+      s_cached_mode.xfer_type < UVC_XFER_UNKNOWN) {
+    uvc_config.xfer_type = (uvc_xfer_t)s_cached_mode.xfer_type;
+    s_xfer_known = true;
+  }
+  const uvc_frame_size_t &cached = s_cached_mode.frame;
+  const bool same_size = cached.width == uvc_config.frame_width &&
+                         cached.height == uvc_config.frame_height;
+  if (s_cached_mode.list_hash != 0 && s_cached_mode.buffer_size != 0 &&
+      (fs == ESP32_CAMERA_SIZE_ANY || same_size)) {
+    ESP_LOGD(TAG, "Starting with cached %ux%u mode", cached.width,
+             cached.height);
+    uvc_config.frame_width = cached.width;
+    uvc_config.frame_height = cached.height;
+    uvc_config.frame_interval = closest_frame_interval(cached, frame_interval);
+    buffer_size = s_cached_mode.buffer_size;
+  }
+  /* frames are copied out of the usb_stream frame buffer into the ring, so
+   * every slot must hold the largest frame usb_stream can assemble */
+  if (!s_ring.init(fb_count, buffer_size)) {
+    return ESP_ERR_NO_MEM;
+  }
+#ifdef USE_USB_WEBCAM_SYNTHETIC
+  /* benchmark build: frames come from embedded files instead of USB */
+  return global_synthetic_source->start(&camera_frame_cb, NULL, &s_ring);
+#endif
+  s_frame_interval = uvc_config.frame_interval;
+  s_uvc_config = uvc_config;
+  if (acquire_stream_buffers(s_ring.slot_size()) != ESP_OK) {
+    ESP_LOGE(TAG, "Not enough memory");
+    return ESP_ERR_NO_MEM;
+  }
   /* config to enable uvc function */
-  esp_err_t ret = uvc_streaming_config(&uvc_config);
+  esp_err_t ret = uvc_streaming_config(&s_uvc_config);
   if (ret != ESP_OK) {
     ESP_LOGE(TAG, "uvc streaming config failed");
     return ret;
@@ -283,10 +1029,9 @@ void ESP32Camera::setup() {
   this->last_update_ = esp_timer_get_time();
 
   /* initialize camera */
-  esp_err_t err = esp_camera_init(
-      this->frame_size,
-      1000 / this->max_update_interval_); // mui=1000/fps. error starts with 60
-                                          // fps but it is unrealistic already
+  esp_err_t err =
+      esp_camera_init(this->frame_size, this->requested_frame_interval_(),
+                      this->frame_buffer_count_, this->transfer_type_);
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "esp_camera_init failed: %s", esp_err_to_name(err));
     this->init_error_ = err;
@@ -296,16 +1041,23 @@ void ESP32Camera::setup() {
 
   /* initialize camera parameters */
   this->update_camera_parameters();
+  if (this->thumbnail_shift_ != 0 || this->roi_requesters_ != 0) {
+    s_transcoder = new ImageTranscoder(&s_ring);
+    if (!s_transcoder->start(this->transcoder_task_core_,
+                             this->transcoder_task_priority_)) {
+      delete s_transcoder;
+      s_transcoder = nullptr;
+    }
+  }
 
   /* initialize RTOS */
-  this->framebuffer_get_queue_ = xQueueCreate(1, sizeof(camera_fb_t *));
-  this->framebuffer_return_queue_ = xQueueCreate(1, sizeof(camera_fb_t *));
-  xTaskCreate(&ESP32Camera::framebuffer_task,
-              "framebuffer_tsk", // name
-              1024,              // stack size
-              nullptr,           // task pv params
-              2,                 // priority
-              nullptr            // handle
+  xTaskCreatePinnedToCore(&ESP32Camera::framebuffer_task,
+                          "framebuffer_tsk", // name
+                          3072, // stack size, room for motion analysis
+                          this, // task pv params
+                          this->framebuffer_task_priority_, // priority
+                          nullptr,                          // handle
+                          this->framebuffer_task_core_      // core
   );
 }
 
@@ -380,9 +1132,80 @@ void ESP32Camera::dump_config() {
     ESP_LOGCONFIG(TAG, "  Resolution: Any");
     break;
   };
+  const uvc_frame_size_t *frame_list;
+  size_t frame_index;
+  if (esp_camera_get_frame_sizes(&frame_list, &frame_index) != 0) {
+    ESP_LOGCONFIG(TAG, "  Current resolution: %ux%u",
+                  frame_list[frame_index].width,
+                  frame_list[frame_index].height);
+  }
   ESP_LOGCONFIG(TAG, "  Update interval: %u", this->max_update_interval_);
+  if (this->throttle_interval_ > this->max_update_interval_)
+    ESP_LOGCONFIG(TAG, "  Throttled interval: %u", this->throttle_interval_);
   ESP_LOGCONFIG(TAG, "  Idle interval: %u", this->idle_update_interval_);
   ESP_LOGCONFIG(TAG, "  Drop frame size: %u", s_drop_frame_size);
+  ESP_LOGCONFIG(TAG, "  Validate frames: %s", YESNO(s_validate_frames));
+  ESP_LOGCONFIG(TAG, "  Uncompressed output: %s",
+                s_raw_output == RAW_OUTPUT_RGB565      ? "RGB565"
+                : s_raw_output == RAW_OUTPUT_GRAYSCALE ? "Grayscale"
+                                                       : "JPEG");
+  if (s_raw_output == RAW_OUTPUT_JPEG)
+    ESP_LOGCONFIG(TAG, "  JPEG quality: %u", s_jpeg_quality);
+  ESP_LOGCONFIG(TAG, "  Suspend when idle: %s",
+                YESNO(this->suspend_when_idle_));
+  if (this->suspend_when_idle_) {
+    ESP_LOGCONFIG(TAG, "  Frames skipped after resume: %u",
+                  this->resume_skip_frames_);
+  }
+  if (s_frame_interval != 0) {
+    ESP_LOGCONFIG(TAG, "  Negotiated frame rate: %.1f fps",
+                  10000000.0f / s_frame_interval);
+  }
+  if (this->skip_unchanged_requesters_ != 0)
+    ESP_LOGCONFIG(TAG, "  Skip unchanged: luma threshold %u, %u ms keepalive",
+                  s_unchanged_filter.get_luma_threshold(),
+                  s_unchanged_filter.get_keepalive());
+  if (this->snapshot_max_age_ != 0)
+    ESP_LOGCONFIG(TAG, "  Snapshot cache: %u ms", this->snapshot_max_age_);
+  ESP_LOGCONFIG(TAG, "  Framebuffer task: core %s, priority %u",
+                task_core_name(this->framebuffer_task_core_),
+                this->framebuffer_task_priority_);
+  if (s_transcoder != nullptr)
+    ESP_LOGCONFIG(TAG, "  Transcoder task: core %s, priority %u",
+                  task_core_name(this->transcoder_task_core_),
+                  this->transcoder_task_priority_);
+  ESP_LOGCONFIG(TAG, "  Frame buffers: %u x %u bytes", s_ring.slot_count(),
+                s_ring.slot_size());
+  ESP_LOGCONFIG(TAG, "  USB buffers: 3 x %u bytes",
+                s_uvc_config.frame_buffer_size);
+  ESP_LOGCONFIG(TAG, "  Transfers: %s%s",
+                xfer_type_to_string(s_uvc_config.xfer_type),
+                s_xfer_auto ? " (auto)" : "");
+  for (uint8_t type = 0; type < UVC_XFER_UNKNOWN; type++) {
+    if (s_xfer_measured & (1U << type)) {
+      ESP_LOGCONFIG(TAG, "    %s: %.1f kB/s",
+                    xfer_type_to_string((uvc_xfer_t)type),
+                    s_xfer_throughput[type] / 1000.0f);
+    }
+  }
+  if (this->thumbnail_shift_ != 0) {
+    const uint8_t requesters = this->thumbnail_requesters_;
+    ESP_LOGCONFIG(TAG, "  Thumbnails: 1/%u for%s%s%s",
+                  1U << this->thumbnail_shift_,
+                  requesters & (1U << IDLE) ? " idle" : "",
+                  requesters & (1U << API_REQUESTER) ? " api" : "",
+                  requesters & (1U << WEB_REQUESTER) ? " web" : "");
+  }
+  static const char *const REQUESTER_NAMES[CAMERA_REQUESTER_COUNT] = {
+      "idle", "api", "web", "http"};
+  for (uint8_t r = 0; r < CAMERA_REQUESTER_COUNT; r++) {
+    if (!(this->roi_requesters_ & (1U << r)))
+      continue;
+    const CameraRoi &roi = this->rois_[r];
+    ESP_LOGCONFIG(TAG, "  Region for %s: %.0f%%,%.0f%% %.0f%%x%.0f%%",
+                  REQUESTER_NAMES[r], roi.x * 100, roi.y * 100,
+                  roi.width * 100, roi.height * 100);
+  }
 
   if (this->is_failed()) {
     ESP_LOGE(TAG, "  Setup Failed: %s", esp_err_to_name(this->init_error_));
@@ -391,53 +1214,153 @@ void ESP32Camera::dump_config() {
 }
 
 void ESP32Camera::loop() {
+  // device (re)connected, apply the rate current consumers need
+  if (s_modes_changed.exchange(false)) {
+    esp_camera_restore_frame_size();
+    this->update_frame_interval_();
+    this->resolution_callback_.call();
+    esp_camera_fit_frame_buffers();
+    esp_camera_save_mode();
+  }
+  // transfer_type: auto, the rate goes up while transfers are measured
+  if (esp_camera_probe_transfer())
+    this->update_frame_interval_();
+  // frames came close to overflowing the buffers
+  if (s_buffers_short.load())
+    esp_camera_fit_frame_buffers();
+  // frame slots still held by consumers when the buffers were resized
+  if (s_ring.resize_pending()) {
+    s_ring.reallocate_idle();
+    if (!s_ring.resize_pending())
+      global_buffer_pool.trim();
+  }
+
   // check if we can return the image
   if (this->can_return_image_()) {
     // return image
     auto *fb = this->current_image_->get_raw_buffer();
-    xQueueSend(this->framebuffer_return_queue_, &fb, portMAX_DELAY);
+    const int64_t released_us = esp_timer_get_time();
+    global_pipeline_stats.record_release(*s_ring.times_of(fb), released_us);
+#ifdef USE_USB_WEBCAM_RATE_CONTROL
+    if (global_rate_controller != nullptr)
+      global_rate_controller->record_release(
+          fb->len, released_us - s_ring.times_of(fb)->picked_us);
+#endif
+    esp_camera_fb_return(fb);
     this->current_image_.reset();
   }
+  // a stale cached frame is never served again, its slot goes back
+  if (s_snapshot_fb != nullptr && !this->snapshot_fresh_())
+    this->release_snapshot_();
+  for (auto &thumbnail : this->thumbnail_images_) {
+    if (thumbnail.use_count() == 1)
+      thumbnail.reset();
+  }
+  for (auto &roi_image : this->roi_images_) {
+    if (roi_image.use_count() == 1)
+      roi_image.reset();
+  }
+  // images the transcoder task finished since the last iteration
+  if (s_transcoder != nullptr)
+    this->deliver_transcoded_();
 
   // request idle image every idle_update_interval
   const uint64_t now = esp_timer_get_time() / 1000;
   if (this->idle_update_interval_ != 0 &&
       now - this->last_idle_request_ > this->idle_update_interval_) {
     this->last_idle_request_ = now;
+#ifdef USE_USB_WEBCAM_MOTION
+    // quiet scene, a gated idle update would show the same picture
+    if (global_motion_detector == nullptr ||
+        global_motion_detector->filter_requesters(1U << IDLE) != 0)
+      this->request_image(IDLE);
+#else
     this->request_image(IDLE);
+#endif
   }
+  // single requests a recent frame is good enough for
+  if (this->snapshot_requesters_ != 0)
+    this->serve_snapshot_();
 
+  // the framebuffer task only wakes the main loop while frames are wanted
+  this->frames_wanted_.store(this->has_requested_image_());
   // Check if we should fetch a new image
-  if (!this->has_requested_image_())
+  if (!this->has_requested_image_()) {
+    this->suspend_stream_if_idle_(now);
     return;
+  }
   if (this->current_image_.use_count() > 1) {
     // image is still in use
     return;
   }
-  if (now - this->last_update_ <= this->max_update_interval_)
+  if (now - this->last_update_ <= this->delivery_interval_())
     return;
 
-  // request new image
-  camera_fb_t *fb;
-  if (xQueueReceive(this->framebuffer_get_queue_, &fb, 0L) != pdTRUE) {
-    // no frame ready
+  // take the frame the framebuffer task woke us up for
+  camera_fb_t *fb = s_pending_fb.exchange(nullptr);
+  if (fb == nullptr) {
     ESP_LOGVV(TAG, "No frame ready");
     return;
   }
-
-  if (fb == nullptr) {
-    ESP_LOGW(TAG, "Got invalid frame from camera!");
-    xQueueSend(this->framebuffer_return_queue_, &fb, portMAX_DELAY);
+  // captured before the stream was suspended, requesters want a fresh one
+  if (s_ring.times_of(fb)->captured_us < this->resume_us_) {
+    esp_camera_fb_return(fb);
     return;
   }
-  this->current_image_ = std::make_shared<CameraImage>(
-      fb, this->single_requesters_ | this->stream_requesters_);
+  s_ring.times_of(fb)->picked_us = esp_timer_get_time();
+  uint8_t requesters = this->single_requesters_ | this->stream_requesters_;
+#ifdef USE_USB_WEBCAM_MOTION
+  // quiet scene, gated streams already have an equivalent frame; single
+  // requests are answered anyway, they would wait forever otherwise
+  if (global_motion_detector != nullptr)
+    requesters = this->single_requesters_ |
+                 global_motion_detector->filter_requesters(requesters);
+#endif
+  // static scene, streams opted in wait for a change or the keepalive
+  const uint8_t unchanged_requesters = this->stream_requesters_ &
+                                       ~this->single_requesters_ &
+                                       this->skip_unchanged_requesters_;
+  if (unchanged_requesters == 0) {
+    s_unchanged_filter.reset();
+  } else if ((requesters & unchanged_requesters) != 0 &&
+             !s_unchanged_filter.pass(*s_ring.signature_of(fb), now)) {
+    requesters &= ~unchanged_requesters;
+    global_pipeline_stats.count_skipped_unchanged();
+  }
+  // requesters configured for thumbnails or regions get their own image,
+  // made on the transcoder task and delivered on a later iteration
+  uint8_t deferred = 0;
+  const uint8_t transcoded_requesters =
+      requesters & (this->thumbnail_requesters_ | this->roi_requesters_) &
+      ~this->whole_frame_requesters_;
+  if (transcoded_requesters != 0 && fb->format == PIXFORMAT_JPEG &&
+      s_transcoder != nullptr) {
+    if (s_transcoder->busy()) {
+      // still working on an earlier frame, they get the next images
+      deferred = transcoded_requesters;
+      requesters &= ~transcoded_requesters;
+    } else {
+      requesters &= ~this->submit_transcode_(fb, transcoded_requesters);
+    }
+  }
+  this->current_image_ = make_image(fb, requesters);
+  this->cache_snapshot_(fb);
 
-  ESP_LOGD(TAG, "Got Image %u: %ux%u %uB", (unsigned int)fb->timestamp.tv_sec,
-           fb->width, fb->height, fb->len);
-  this->new_image_callback_.call(this->current_image_);
+  ESP_LOGD(TAG, "Got Image %u: %ux%u %uB", s_ring.sequence_of(fb), fb->width,
+           fb->height, fb->len);
+  if (requesters != 0)
+    this->new_image_callback_.call(this->current_image_);
+  if (this->resume_us_ != 0) {
+    const int64_t resume_us = esp_timer_get_time() - this->resume_us_;
+    ESP_LOGD(TAG, "First frame %.1f ms after resume", resume_us / 1000.0f);
+    global_pipeline_stats.record_resume(resume_us);
+    this->resume_us_ = 0;
+  }
+  global_pipeline_stats.count_delivered();
   this->last_update_ = now;
-  this->single_requesters_ = 0;
+  // single requests with an image in the making are answered by it
+  this->single_requesters_ &= deferred;
+  this->whole_frame_requesters_ &= ~requesters;
 }
 
 float ESP32Camera::get_setup_priority() const { return setup_priority::DATA; }
@@ -457,6 +1380,43 @@ void ESP32Camera::set_frame_size(ESP32CameraFrameSize size) {
 void ESP32Camera::set_drop_size(uint32_t drop_size) {
   s_drop_frame_size = drop_size;
 }
+void ESP32Camera::set_validate_frames(bool validate) {
+  s_validate_frames = validate;
+}
+void ESP32Camera::set_uncompressed_output(
+    ESP32CameraUncompressedOutput output) {
+  switch (output) {
+  case ESP32_CAMERA_UNCOMPRESSED_RGB565:
+    s_raw_output = RAW_OUTPUT_RGB565;
+    break;
+  case ESP32_CAMERA_UNCOMPRESSED_GRAYSCALE:
+    s_raw_output = RAW_OUTPUT_GRAYSCALE;
+    break;
+  default:
+    s_raw_output = RAW_OUTPUT_JPEG;
+    break;
+  }
+}
+void ESP32Camera::set_jpeg_quality(uint8_t quality) {
+  s_jpeg_quality = quality;
+}
+void ESP32Camera::set_frame_buffer_count(uint8_t count) {
+  this->frame_buffer_count_ = count;
+}
+void ESP32Camera::set_transfer_type(ESP32CameraTransferType type) {
+  this->transfer_type_ = type;
+}
+void ESP32Camera::set_thumbnail_scale(uint8_t shift) {
+  this->thumbnail_shift_ = shift;
+}
+void ESP32Camera::add_thumbnail_requester(CameraRequester requester) {
+  this->thumbnail_requesters_ |= (1U << requester);
+}
+void ESP32Camera::set_roi(CameraRequester requester, float x, float y,
+                          float width, float height) {
+  this->rois_[requester] = CameraRoi{x, y, width, height};
+  this->roi_requesters_ |= (1U << requester);
+}
 /* set fps */
 void ESP32Camera::set_max_update_interval(uint32_t max_update_interval) {
   this->max_update_interval_ = max_update_interval;
@@ -464,6 +1424,37 @@ void ESP32Camera::set_max_update_interval(uint32_t max_update_interval) {
 void ESP32Camera::set_idle_update_interval(uint32_t idle_update_interval) {
   this->idle_update_interval_ = idle_update_interval;
 }
+/* set suspend */
+void ESP32Camera::set_suspend_when_idle(bool suspend) {
+  this->suspend_when_idle_ = suspend;
+}
+void ESP32Camera::set_resume_skip_frames(uint8_t count) {
+  this->resume_skip_frames_ = count;
+}
+void ESP32Camera::set_snapshot_max_age(uint32_t max_age_ms) {
+  this->snapshot_max_age_ = max_age_ms;
+}
+void ESP32Camera::set_skip_unchanged(uint8_t luma_threshold,
+                                     uint32_t keepalive_ms) {
+  s_unchanged_filter.set_luma_threshold(luma_threshold);
+  s_unchanged_filter.set_keepalive(keepalive_ms);
+  s_sign_frames = true;
+}
+void ESP32Camera::add_skip_unchanged_requester(CameraRequester requester) {
+  this->skip_unchanged_requesters_ |= (1U << requester);
+}
+void ESP32Camera::set_framebuffer_task_core(BaseType_t core) {
+  this->framebuffer_task_core_ = core;
+}
+void ESP32Camera::set_framebuffer_task_priority(uint8_t priority) {
+  this->framebuffer_task_priority_ = priority;
+}
+void ESP32Camera::set_transcoder_task_core(BaseType_t core) {
+  this->transcoder_task_core_ = core;
+}
+void ESP32Camera::set_transcoder_task_priority(uint8_t priority) {
+  this->transcoder_task_priority_ = priority;
+}
 
 /* ---------------- public API (specific) ---------------- */
 void ESP32Camera::add_image_callback(
@@ -479,13 +1470,90 @@ void ESP32Camera::add_stream_stop_callback(std::function<void()> &&callback) {
 void ESP32Camera::start_stream(CameraRequester requester) {
   this->stream_start_callback_.call();
   this->stream_requesters_ |= (1U << requester);
+  this->frames_wanted_.store(true);
+  // speed up right away, the first streamed frames should not be slow
+  this->cancel_timeout("frame_interval");
+  this->update_frame_interval_();
+  this->resume_stream_();
 }
 void ESP32Camera::stop_stream(CameraRequester requester) {
   this->stream_stop_callback_.call();
   this->stream_requesters_ &= ~(1U << requester);
+  this->last_stream_ = esp_timer_get_time() / 1000;
+  // slow down lazily, clients often reconnect streams right away
+  this->set_timeout("frame_interval", FRAME_INTERVAL_LINGER_MS,
+                    [this]() { this->update_frame_interval_(); });
+}
+bool ESP32Camera::set_resolution(uint16_t width, uint16_t height,
+                                 bool persist) {
+  esp_err_t err = esp_camera_set_frame_size(width, height,
+                                            this->requested_frame_interval_());
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Cannot switch to %ux%u: %s", width, height,
+             esp_err_to_name(err));
+    return false;
+  }
+  ESP_LOGI(TAG, "Resolution switched to %ux%u", width, height);
+  if (persist)
+    esp_camera_select_mode();
+  this->resolution_callback_.call();
+  return true;
+}
+bool ESP32Camera::get_mode(size_t index, uint16_t *width,
+                           uint16_t *height) const {
+  const uvc_frame_size_t *frame_list;
+  size_t frame_index;
+  if (index >= esp_camera_get_frame_sizes(&frame_list, &frame_index))
+    return false;
+  *width = frame_list[index].width;
+  *height = frame_list[index].height;
+  return true;
 }
+bool ESP32Camera::get_current_mode(uint16_t *width, uint16_t *height) const {
+  const uvc_frame_size_t *frame_list;
+  size_t frame_index;
+  if (esp_camera_get_frame_sizes(&frame_list, &frame_index) == 0)
+    return false;
+  return this->get_mode(frame_index, width, height);
+}
+void ESP32Camera::set_throttle_interval(uint32_t interval_ms) {
+  this->throttle_interval_ = interval_ms;
+  this->update_frame_interval_();
+}
+std::vector<std::string> ESP32Camera::get_resolutions() const {
+  const uvc_frame_size_t *frame_list;
+  size_t frame_index;
+  size_t count = esp_camera_get_frame_sizes(&frame_list, &frame_index);
+  std::vector<std::string> resolutions;
+  for (size_t i = 0; i < count; i++) {
+    resolutions.push_back(str_sprintf("%ux%u", frame_list[i].width,
+                                      frame_list[i].height));
+  }
+  return resolutions;
+}
+std::string ESP32Camera::get_resolution() const {
+  const uvc_frame_size_t *frame_list;
+  size_t frame_index;
+  if (esp_camera_get_frame_sizes(&frame_list, &frame_index) == 0)
+    return "";
+  return str_sprintf("%ux%u", frame_list[frame_index].width,
+                     frame_list[frame_index].height);
+}
+void ESP32Camera::add_resolution_callback(std::function<void()> &&callback) {
+  this->resolution_callback_.add(std::move(callback));
+}
+FrameRing *ESP32Camera::get_frame_ring() { return &s_ring; }
 void ESP32Camera::request_image(CameraRequester requester) {
+  // thumbnails and regions are made from the full frame on delivery
+  const uint8_t cacheable =
+      ~(this->thumbnail_requesters_ | this->roi_requesters_);
+  if ((cacheable & (1U << requester)) && this->snapshot_fresh_()) {
+    this->snapshot_requesters_ |= (1U << requester);
+    return;
+  }
   this->single_requesters_ |= (1U << requester);
+  this->frames_wanted_.store(true);
+  this->resume_stream_();
 }
 void ESP32Camera::update_camera_parameters() {}
 
@@ -496,15 +1564,253 @@ bool ESP32Camera::has_requested_image_() const {
 bool ESP32Camera::can_return_image_() const {
   return this->current_image_.use_count() == 1;
 }
+bool ESP32Camera::snapshot_fresh_() const {
+  if (this->snapshot_max_age_ == 0 || s_snapshot_fb == nullptr)
+    return false;
+  // a resolution switch makes it stale right away
+  uint16_t width, height;
+  if (this->get_current_mode(&width, &height) &&
+      (s_snapshot_fb->width != width || s_snapshot_fb->height != height))
+    return false;
+  const int64_t age_us =
+      esp_timer_get_time() - s_ring.times_of(s_snapshot_fb)->captured_us;
+  return age_us <= this->snapshot_max_age_ * 1000LL;
+}
+void ESP32Camera::cache_snapshot_(camera_fb_t *fb) {
+  // the cache keeps its own reference, loop() returns the current image's
+  if (this->snapshot_max_age_ == 0 || !this->release_snapshot_())
+    return;
+  s_ring.retain(fb);
+  s_snapshot_fb = fb;
+}
+// false while consumers still hold an image served from it
+bool ESP32Camera::release_snapshot_() {
+  if (this->snapshot_image_.use_count() > 1)
+    return false;
+  this->snapshot_image_.reset();
+  if (s_snapshot_fb != nullptr) {
+    s_ring.release(s_snapshot_fb);
+    s_snapshot_fb = nullptr;
+  }
+  return true;
+}
+void ESP32Camera::serve_snapshot_() {
+  const uint8_t requesters = this->snapshot_requesters_;
+  this->snapshot_requesters_ = 0;
+  if (this->snapshot_image_.use_count() > 1 || !this->snapshot_fresh_()) {
+    // went stale since the request or still out, capture a fresh one
+    this->single_requesters_ |= requesters;
+    this->resume_stream_();
+    return;
+  }
+  this->snapshot_image_ = make_image(s_snapshot_fb, requesters);
+  ESP_LOGD(TAG, "Cached Image %u: %ux%u %uB, %.0f ms old",
+           s_ring.sequence_of(s_snapshot_fb), s_snapshot_fb->width,
+           s_snapshot_fb->height, s_snapshot_fb->len,
+           (esp_timer_get_time() -
+            s_ring.times_of(s_snapshot_fb)->captured_us) /
+               1000.0f);
+  this->new_image_callback_.call(this->snapshot_image_);
+}
+uint32_t ESP32Camera::delivery_interval_() const {
+  return std::max(this->max_update_interval_, this->throttle_interval_);
+}
+uint32_t ESP32Camera::requested_frame_interval_() const {
+  // without streams only idle and single images are needed, transfers are
+  // measured and pre-event footage recorded at the full rate
+  bool idle = !this->stream_requesters_ && this->idle_update_interval_ != 0 &&
+              !esp_camera_probing_transfer();
+#ifdef USE_USB_WEBCAM_RECORDER
+  if (global_frame_recorder != nullptr)
+    idle = false;
+#endif
+  uint64_t interval_ms = this->delivery_interval_();
+  if (idle)
+    interval_ms = std::max(interval_ms, (uint64_t)this->idle_update_interval_);
+  return std::min(interval_ms * INTERVAL_PER_MS, (uint64_t)UINT32_MAX);
+}
+void ESP32Camera::update_frame_interval_() {
+  esp_err_t err =
+      esp_camera_set_frame_interval(this->requested_frame_interval_());
+  if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+    ESP_LOGW(TAG, "Frame rate renegotiation failed: %s", esp_err_to_name(err));
+}
+void ESP32Camera::resume_stream_() {
+  if (!s_suspended)
+    return;
+  esp_err_t err = esp_camera_resume(this->resume_skip_frames_);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Stream resume failed: %s", esp_err_to_name(err));
+    return;
+  }
+  this->resume_us_ = esp_timer_get_time();
+  ESP_LOGD(TAG, "Stream resumed");
+}
+void ESP32Camera::suspend_stream_if_idle_(uint64_t now) {
+  if (!this->suspend_when_idle_ || s_suspended ||
+      now - this->last_stream_ < FRAME_INTERVAL_LINGER_MS ||
+      esp_camera_probing_transfer())
+    return;
+#ifdef USE_USB_WEBCAM_MOTION
+  // motion detection needs frames whether they are requested or not
+  if (global_motion_detector != nullptr)
+    return;
+#endif
+#ifdef USE_USB_WEBCAM_RECORDER
+  // neither does the pre-event recording
+  if (global_frame_recorder != nullptr)
+    return;
+#endif
+  esp_err_t err = esp_camera_suspend();
+  if (err == ESP_OK) {
+    ESP_LOGD(TAG, "Stream suspended, no frames requested");
+  } else if (err != ESP_ERR_INVALID_STATE) {
+    ESP_LOGW(TAG, "Stream cannot be suspended, keeping it running: %s",
+             esp_err_to_name(err));
+    this->suspend_when_idle_ = false;
+  }
+}
+
+// a free buffer of images not held by consumers, skipping the taken ones
+static size_t free_image_buffer(const std::shared_ptr<CameraImage> *images,
+                                size_t count, uint8_t *taken) {
+  for (size_t index = 0; index < count; index++) {
+    if (!images[index] && !(*taken & (1U << index))) {
+      *taken |= 1U << index;
+      return index;
+    }
+  }
+  return count;
+}
+
+/* the requesters whose images are in the making, 0 when none could be */
+uint8_t ESP32Camera::submit_transcode_(camera_fb_t *fb, uint8_t requesters) {
+  TranscodeJob jobs[TRANSCODE_MAX_JOBS];
+  size_t count = 0;
+  uint8_t submitted = 0;
+  const size_t frame_capacity = s_ring.capacity_of(fb);
+
+  const uint8_t thumbnail_requesters = requesters & this->thumbnail_requesters_;
+  if (thumbnail_requesters != 0) {
+    uint8_t taken = 0;
+    const size_t index = free_image_buffer(this->thumbnail_images_,
+                                           THUMBNAIL_BUFFER_COUNT, &taken);
+    if (index == THUMBNAIL_BUFFER_COUNT) {
+      // the full frame is sent instead
+      ESP_LOGV(TAG, "No free thumbnail buffer");
+    } else {
+      TranscodeJob &job = jobs[count++];
+      job = TranscodeJob{};
+      job.buffer = &s_thumbnails[index];
+      // thumbnails almost always fit the scaled slot size
+      job.capacity = frame_capacity >> this->thumbnail_shift_;
+      job.index = index;
+      job.requesters = thumbnail_requesters;
+      job.shift = this->thumbnail_shift_;
+      submitted |= thumbnail_requesters;
+    }
+  }
+
+  // one image per distinct region
+  uint8_t roi_requesters = requesters & this->roi_requesters_;
+  uint8_t taken = 0;
+  for (uint8_t r = 0; r < CAMERA_REQUESTER_COUNT && roi_requesters; r++) {
+    if (!(roi_requesters & (1U << r)))
+      continue;
+    const CameraRoi &roi = this->rois_[r];
+    uint8_t same = 0;
+    for (uint8_t other = r; other < CAMERA_REQUESTER_COUNT; other++) {
+      if ((roi_requesters & (1U << other)) && this->rois_[other] == roi)
+        same |= 1U << other;
+    }
+    roi_requesters &= ~same;
+    const size_t index =
+        free_image_buffer(this->roi_images_, ROI_BUFFER_COUNT, &taken);
+    if (index == ROI_BUFFER_COUNT) {
+      ESP_LOGV(TAG, "No free region buffer");
+      continue;
+    }
+    TranscodeJob &job = jobs[count++];
+    job = TranscodeJob{};
+    job.buffer = &s_roi_buffers[index];
+    // the crop keeps the coefficients, so its size follows the area; the
+    // full frame is sent instead when it does not fit
+    job.capacity = std::min(
+        frame_capacity,
+        (size_t)(frame_capacity * roi.width * roi.height * 1.25f) + 2048);
+    job.index = index;
+    job.requesters = same;
+    job.x = fb->width * roi.x;
+    job.y = fb->height * roi.y;
+    job.width = ceilf(fb->width * roi.width);
+    job.height = ceilf(fb->height * roi.height);
+    submitted |= same;
+  }
+
+  for (size_t i = 0; i < count; i++)
+    jobs[i].singles = jobs[i].requesters & this->single_requesters_;
+  if (count == 0 || !s_transcoder->submit(fb, jobs, count))
+    return 0;
+  return submitted;
+}
+
+void ESP32Camera::deliver_transcoded_() {
+  TranscodeJob jobs[TRANSCODE_MAX_JOBS];
+  const size_t count = s_transcoder->collect(jobs);
+  for (size_t i = 0; i < count; i++) {
+    const TranscodeJob &job = jobs[i];
+    const bool thumbnail = job.shift != 0;
+    if (job.status != JPEG_OK) {
+      ESP_LOGD(TAG, "No %s: %s", thumbnail ? "thumbnail" : "region",
+               jpeg_status_to_string(job.status));
+      // the next frame goes out whole to them instead
+      this->whole_frame_requesters_ |= job.requesters;
+      this->single_requesters_ |= job.singles;
+      if (job.singles != 0)
+        this->resume_stream_();
+      continue;
+    }
+    const camera_fb_t &fb = job.buffer->fb;
+    ESP_LOGD(TAG, "%s: %ux%u %uB in %u us", thumbnail ? "Thumbnail" : "Region",
+             fb.width, fb.height, fb.len, job.elapsed_us);
+    std::shared_ptr<CameraImage> &image =
+        thumbnail ? this->thumbnail_images_[job.index]
+                  : this->roi_images_[job.index];
+    image = make_image(&job.buffer->fb, job.requesters);
+    this->new_image_callback_.call(image);
+  }
+}
 
 void ESP32Camera::framebuffer_task(void *pv) {
+  ESP32Camera *camera = (ESP32Camera *)pv;
   while (true) {
     camera_fb_t *framebuffer = esp_camera_fb_get();
-    xQueueSend(global_esp32_camera->framebuffer_get_queue_, &framebuffer,
-               portMAX_DELAY);
-    xQueueReceive(global_esp32_camera->framebuffer_return_queue_, &framebuffer,
-                  portMAX_DELAY);
-    esp_camera_fb_return(framebuffer);
+#ifdef USE_USB_WEBCAM_PROCESSORS
+    // handed over first, the processors run on the other core meanwhile
+    if (global_frame_processors != nullptr)
+      global_frame_processors->offer(framebuffer);
+#endif
+#ifdef USE_USB_WEBCAM_MOTION
+    if (global_motion_detector != nullptr)
+      global_motion_detector->analyze(framebuffer);
+#endif
+#ifdef USE_USB_WEBCAM_RECORDER
+    if (global_frame_recorder != nullptr)
+      global_frame_recorder->add_frame(framebuffer);
+#endif
+    s_ring.times_of(framebuffer)->queued_us = esp_timer_get_time();
+    // replace a frame loop() has not picked up yet with the fresher one
+    camera_fb_t *stale = s_pending_fb.exchange(framebuffer);
+    if (stale != nullptr)
+      esp_camera_fb_return(stale);
+#ifdef USE_WAKE_LOOP_THREADSAFE
+    // deliver now instead of whenever the main loop wakes up next; frames
+    // nobody asked for are only returned, that can wait
+    if (camera->frames_wanted_.load())
+      App.wake_loop_threadsafe();
+#else
+    (void)camera;
+#endif
   }
 }
 
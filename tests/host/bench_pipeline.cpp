@@ -0,0 +1,213 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Pipeline benchmark: MJPEG frames are fed through the fake usb_stream into
+// the frame callback at a set rate and jitter, and the real ESP32Camera
+// delivers them to a consumer. Reports delivered fps, drops and
+// frame-to-callback latency.
+//
+//   bench_pipeline [--fps N] [--jitter-us N] [--seconds N] [--max-fps N]
+//                  [--hold-ms N] [frame.jpg ...]
+//
+// Without files, generated 640x480 frames are used. --max-fps limits the
+// delivery like max_framerate, --hold-ms keeps every image that long in the
+// consumer like a slow client would.
+
+#include "../esp32_camera/esp32_camera.h"
+#include "fake_uvc.h"
+#include "frame_ring.h"
+#include "jpeg_codec.h"
+#include "pipeline_stats.h"
+#include "test_util.h"
+
+#include "esphome/core/application.h"
+
+#include <esp_timer.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace esphome;
+using namespace esphome::esp32_camera;
+
+struct Options {
+  float fps{30};
+  uint32_t jitter_us{0};
+  float seconds{10};
+  float max_fps{0}; // 0: as fast as frames come
+  uint32_t hold_ms{0};
+  std::vector<std::string> files;
+};
+
+static bool parse(int argc, char **argv, Options *options) {
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--fps" && has_value) {
+      options->fps = atof(argv[++i]);
+    } else if (arg == "--jitter-us" && has_value) {
+      options->jitter_us = atoi(argv[++i]);
+    } else if (arg == "--seconds" && has_value) {
+      options->seconds = atof(argv[++i]);
+    } else if (arg == "--max-fps" && has_value) {
+      options->max_fps = atof(argv[++i]);
+    } else if (arg == "--hold-ms" && has_value) {
+      options->hold_ms = atoi(argv[++i]);
+    } else if (arg.rfind("--", 0) == 0) {
+      return false;
+    } else {
+      options->files.push_back(arg);
+    }
+  }
+  return options->fps > 0 && options->seconds > 0;
+}
+
+struct Frame {
+  std::vector<uint8_t> data;
+  uint16_t width;
+  uint16_t height;
+};
+
+static bool load_frames(const Options &options, std::vector<Frame> *frames) {
+  for (const auto &file : options.files) {
+    FILE *f = fopen(file.c_str(), "rb");
+    if (f == nullptr) {
+      fprintf(stderr, "cannot open %s\n", file.c_str());
+      return false;
+    }
+    Frame frame;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+      frame.data.insert(frame.data.end(), chunk, chunk + n);
+    fclose(f);
+    JpegDecoder decoder;
+    if (decoder.begin(frame.data.data(), frame.data.size()) != JPEG_OK) {
+      fprintf(stderr, "%s is not a baseline JPEG\n", file.c_str());
+      return false;
+    }
+    frame.width = decoder.get_width();
+    frame.height = decoder.get_height();
+    frames->push_back(std::move(frame));
+  }
+  if (frames->empty()) {
+    for (uint32_t phase = 0; phase < 8; phase++) {
+      test_util::Planes scene = test_util::make_scene(640, 480, phase * 10);
+      frames->push_back(Frame{test_util::encode_jpeg(scene, 2, 1, 80), 640,
+                              480});
+    }
+  }
+  // one mode, every frame must have its size
+  for (const auto &frame : *frames) {
+    if (frame.width != frames->front().width ||
+        frame.height != frames->front().height) {
+      fprintf(stderr, "frames differ in size\n");
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse(argc, argv, &options)) {
+    fprintf(stderr, "usage: %s [--fps N] [--jitter-us N] [--seconds N] "
+                    "[--max-fps N] [--hold-ms N] [frame.jpg ...]\n",
+            argv[0]);
+    return 2;
+  }
+  std::vector<Frame> frames;
+  if (!load_frames(options, &frames))
+    return 2;
+  const uint16_t width = frames.front().width;
+  const uint16_t height = frames.front().height;
+
+  fake_uvc::Device device;
+  device.modes.push_back(
+      fake_uvc::mode(width, height, (uint32_t)(10000000 / options.fps)));
+  device.jitter_us = options.jitter_us;
+  device.source = [&frames](uint32_t sequence, uint16_t, uint16_t,
+                            std::vector<uint8_t> &frame) {
+    frame = frames[sequence % frames.size()].data;
+  };
+  fake_uvc::attach(device);
+
+  ESP32Camera camera;
+  camera.set_name("bench");
+  camera.set_max_update_interval(
+      options.max_fps > 0 ? (uint32_t)(1000 / options.max_fps) : 0);
+  camera.set_idle_update_interval(0);
+  camera.set_suspend_when_idle(false);
+  // measuring both transfer types would restart the stream twice
+  camera.set_transfer_type(ESP32_CAMERA_TRANSFER_BULK);
+
+  std::vector<uint32_t> latencies;
+  latencies.reserve(options.seconds * options.fps + 16);
+  std::deque<std::pair<int64_t, std::shared_ptr<CameraImage>>> held;
+  camera.add_image_callback(
+      [&latencies, &held, &options](std::shared_ptr<CameraImage> image) {
+        // the frame timestamp is taken when the frame callback is entered
+        const struct timeval &captured = image->get_raw_buffer()->timestamp;
+        const int64_t now = esp_timer_get_time();
+        latencies.push_back(now - (captured.tv_sec * 1000000LL +
+                                   captured.tv_usec));
+        if (options.hold_ms != 0)
+          held.emplace_back(now + options.hold_ms * 1000LL, image);
+      });
+
+  App.register_component(&camera);
+  App.setup();
+  camera.start_stream(WEB_REQUESTER);
+
+  const int64_t start_us = esp_timer_get_time();
+  const uint32_t duration_ms = options.seconds * 1000;
+  while (esp_timer_get_time() - start_us < duration_ms * 1000LL) {
+    App.loop();
+    const int64_t now = esp_timer_get_time();
+    while (!held.empty() && held.front().first <= now)
+      held.pop_front();
+  }
+  const float seconds = (esp_timer_get_time() - start_us) / 1e6f;
+
+  const FrameRing *ring = camera.get_frame_ring();
+  const fake_uvc::Counters counters = fake_uvc::counters();
+  const PipelineStats &stats = global_pipeline_stats;
+  printf("%ux%u, %zu frame(s) of %zu bytes avg, %.1f s\n", width, height,
+         frames.size(),
+         [&frames]() {
+           size_t sum = 0;
+           for (const auto &frame : frames)
+             sum += frame.data.size();
+           return sum / frames.size();
+         }(),
+         seconds);
+  printf("%.1f fps offered, %.1f fps delivered\n", counters.emitted / seconds,
+         latencies.size() / seconds);
+  printf("dropped: %u busy, %u oversize, %u corrupt, %u overwritten in the "
+         "ring, %u not picked up\n",
+         stats.get_dropped_busy(), stats.get_oversize(), stats.get_corrupt(),
+         ring->get_overwritten(),
+         ring->get_written() - (uint32_t)latencies.size());
+  if (!latencies.empty()) {
+    std::sort(latencies.begin(), latencies.end());
+    uint64_t sum = 0;
+    for (uint32_t latency : latencies)
+      sum += latency;
+    printf("frame-to-callback latency: avg %u us, p50 %u us, p95 %u us, max "
+           "%u us\n",
+           (uint32_t)(sum / latencies.size()),
+           latencies[latencies.size() / 2],
+           latencies[latencies.size() * 95 / 100], latencies.back());
+  }
+
+  // as a test: frames must come through, at the offered rate when nothing
+  // limits the delivery
+  CHECK(counters.emitted > 0);
+  CHECK(!latencies.empty());
+  if (options.max_fps == 0 && options.hold_ms == 0)
+    CHECK(latencies.size() >= counters.emitted * 8 / 10);
+  test_util::finish();
+}
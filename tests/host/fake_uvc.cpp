@@ -0,0 +1,273 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Fake UVC device behind the usb_stream API of the host build
+
+#include "fake_uvc.h"
+
+#include <esp_timer.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+namespace fake_uvc {
+
+static std::mutex s_lock; // guards everything below but the counters
+static std::condition_variable s_changed;
+static Device s_device;
+static uvc_config_t s_config;
+static state_callback_t s_state_cb = nullptr;
+static void *s_state_arg = nullptr;
+static std::thread s_thread;
+static bool s_running = false;
+static bool s_connected = false;
+static bool s_suspended = false;
+static size_t s_mode = 0;
+static uint32_t s_interval = 0;
+
+static std::atomic<uint32_t> s_starts{0};
+static std::atomic<uint32_t> s_resets{0};
+static std::atomic<uint32_t> s_emitted{0};
+static std::atomic<uint32_t> s_truncated{0};
+
+uvc_frame_size_t mode(uint16_t width, uint16_t height, uint32_t interval) {
+  return uvc_frame_size_t{width, height, interval, interval, interval, 0};
+}
+
+void attach(const Device &device) {
+  std::lock_guard<std::mutex> guard(s_lock);
+  s_device = device;
+}
+
+Counters counters() {
+  return Counters{s_starts.load(), s_resets.load(), s_emitted.load(),
+                  s_truncated.load()};
+}
+uint16_t current_width() {
+  std::lock_guard<std::mutex> guard(s_lock);
+  return s_device.modes[s_mode].width;
+}
+uint16_t current_height() {
+  std::lock_guard<std::mutex> guard(s_lock);
+  return s_device.modes[s_mode].height;
+}
+uint32_t current_interval() {
+  std::lock_guard<std::mutex> guard(s_lock);
+  return s_interval;
+}
+bool suspended() {
+  std::lock_guard<std::mutex> guard(s_lock);
+  return s_suspended;
+}
+
+/* what a device negotiates: the mode of that size and the closest interval
+ * it supports */
+static size_t find_mode(uint16_t width, uint16_t height) {
+  for (size_t i = 0; i < s_device.modes.size(); i++) {
+    if (s_device.modes[i].width == width && s_device.modes[i].height == height)
+      return i;
+  }
+  return s_device.default_mode;
+}
+static uint32_t clamp_interval(const uvc_frame_size_t &mode,
+                               uint32_t interval) {
+  return std::max(mode.interval_min, std::min(interval, mode.interval_max));
+}
+
+/* the usb_stream sample task: connects, then emits frames at the negotiated
+ * interval into the frame buffer of the configuration */
+static void sample_task() {
+  std::unique_lock<std::mutex> lock(s_lock);
+  if (s_changed.wait_for(lock,
+                         std::chrono::milliseconds(s_device.connect_delay_ms),
+                         []() { return !s_running; }))
+    return;
+  s_mode = find_mode(s_config.frame_width, s_config.frame_height);
+  s_interval = clamp_interval(s_device.modes[s_mode], s_config.frame_interval);
+  s_connected = true;
+  s_suspended = false;
+  lock.unlock();
+  s_state_cb(STREAM_CONNECTED, s_state_arg);
+  lock.lock();
+
+  uint32_t rng = 0x2545F491; // same sequence as the synthetic source
+  uint32_t sequence = 0;
+  std::vector<uint8_t> frame;
+  int64_t next_us = esp_timer_get_time();
+  while (s_running) {
+    if (s_suspended) {
+      s_changed.wait(lock, []() { return !s_running || !s_suspended; });
+      next_us = esp_timer_get_time();
+      continue;
+    }
+    const uvc_frame_size_t mode = s_device.modes[s_mode];
+    const uint32_t interval_us = s_interval / 10;
+    frame.clear();
+    lock.unlock();
+    s_device.source(++sequence, mode.width, mode.height, frame);
+    lock.lock();
+    if (!s_running)
+      break;
+
+    if (!frame.empty() && !s_suspended) {
+      const size_t len =
+          std::min(frame.size(), (size_t)s_config.frame_buffer_size);
+      if (len < frame.size())
+        s_truncated++;
+      memcpy(s_config.frame_buffer, frame.data(), len);
+      uvc_frame_t uvc = {};
+      uvc.data = s_config.frame_buffer;
+      uvc.data_bytes = len;
+      uvc.width = mode.width;
+      uvc.height = mode.height;
+      uvc.frame_format = s_device.format;
+      uvc.sequence = sequence;
+      uvc_frame_callback_t *frame_cb = s_config.frame_cb;
+      void *frame_cb_arg = s_config.frame_cb_arg;
+      lock.unlock();
+      s_emitted++;
+      frame_cb(&uvc, frame_cb_arg);
+      lock.lock();
+    }
+
+    next_us += interval_us;
+    int64_t deadline_us = next_us;
+    if (s_device.jitter_us != 0) {
+      rng = rng * 1664525 + 1013904223;
+      deadline_us += (int64_t)(rng % (2 * s_device.jitter_us + 1)) -
+                     (int64_t)s_device.jitter_us;
+    }
+    const int64_t wait_us = deadline_us - esp_timer_get_time();
+    if (wait_us > 0) {
+      s_changed.wait_for(lock, std::chrono::microseconds(wait_us),
+                         []() { return !s_running; });
+    } else {
+      next_us = esp_timer_get_time(); // overloaded, do not try to catch up
+    }
+  }
+}
+
+void replug() {
+  std::unique_lock<std::mutex> lock(s_lock);
+  if (!s_running)
+    return;
+  s_running = false;
+  s_connected = false;
+  lock.unlock();
+  s_changed.notify_all();
+  s_thread.join();
+  s_state_cb(STREAM_DISCONNECTED, s_state_arg);
+  lock.lock();
+  s_running = true;
+  s_thread = std::thread(sample_task);
+}
+
+} // namespace fake_uvc
+
+using namespace fake_uvc;
+
+esp_err_t uvc_streaming_config(const uvc_config_t *config) {
+  std::lock_guard<std::mutex> guard(s_lock);
+  if (s_running || config->frame_buffer == nullptr ||
+      config->frame_cb == nullptr)
+    return ESP_ERR_INVALID_STATE;
+  s_config = *config;
+  return ESP_OK;
+}
+
+esp_err_t usb_streaming_state_register(state_callback_t cb, void *user_ptr) {
+  std::lock_guard<std::mutex> guard(s_lock);
+  s_state_cb = cb;
+  s_state_arg = user_ptr;
+  return ESP_OK;
+}
+
+esp_err_t usb_streaming_start() {
+  std::lock_guard<std::mutex> guard(s_lock);
+  if (s_running || s_device.modes.empty() || !s_device.source)
+    return ESP_ERR_INVALID_STATE;
+  s_running = true;
+  s_starts++;
+  s_thread = std::thread(sample_task);
+  return ESP_OK;
+}
+
+esp_err_t usb_streaming_stop() {
+  std::unique_lock<std::mutex> lock(s_lock);
+  if (!s_running)
+    return ESP_ERR_INVALID_STATE;
+  s_running = false;
+  const bool connected = s_connected;
+  s_connected = false;
+  lock.unlock();
+  s_changed.notify_all();
+  s_thread.join();
+  if (connected)
+    s_state_cb(STREAM_DISCONNECTED, s_state_arg);
+  return ESP_OK;
+}
+
+esp_err_t usb_streaming_connect_wait(size_t timeout_ms) {
+  std::unique_lock<std::mutex> lock(s_lock);
+  if (!s_changed.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                          []() { return s_connected; }))
+    return ESP_ERR_TIMEOUT;
+  return ESP_OK;
+}
+
+esp_err_t usb_streaming_control(usb_stream_t stream, stream_ctrl_t ctrl_type,
+                                void *ctrl_value) {
+  (void)ctrl_value;
+  std::lock_guard<std::mutex> guard(s_lock);
+  if (stream != STREAM_UVC)
+    return ESP_ERR_NOT_SUPPORTED;
+  if (!s_connected)
+    return ESP_ERR_INVALID_STATE;
+  switch (ctrl_type) {
+  case CTRL_SUSPEND:
+    s_suspended = true;
+    break;
+  case CTRL_RESUME:
+    s_suspended = false;
+    break;
+  default:
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+  s_changed.notify_all();
+  return ESP_OK;
+}
+
+esp_err_t uvc_frame_size_list_get(uvc_frame_size_t *frame_list,
+                                  size_t *list_size, size_t *cur_index) {
+  std::lock_guard<std::mutex> guard(s_lock);
+  if (frame_list != nullptr) {
+    std::copy(s_device.modes.begin(), s_device.modes.end(), frame_list);
+  }
+  if (list_size != nullptr)
+    *list_size = s_device.modes.size();
+  if (cur_index != nullptr)
+    *cur_index = s_mode;
+  return ESP_OK;
+}
+
+/* usb_stream only allows it while the stream is suspended */
+esp_err_t uvc_frame_size_reset(uint16_t frame_width, uint16_t frame_height,
+                               uint32_t frame_interval) {
+  std::lock_guard<std::mutex> guard(s_lock);
+  if (!s_suspended)
+    return ESP_ERR_INVALID_STATE;
+  size_t index = 0;
+  while (index < s_device.modes.size() &&
+         (s_device.modes[index].width != frame_width ||
+          s_device.modes[index].height != frame_height))
+    index++;
+  if (index == s_device.modes.size())
+    return ESP_ERR_INVALID_ARG;
+  s_mode = index;
+  s_interval = clamp_interval(s_device.modes[index], frame_interval);
+  s_resets++;
+  return ESP_OK;
+}
@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Fake UVC device behind the usb_stream API of the host build
+
+#pragma once
+
+#include "usb_stream.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace fake_uvc {
+
+// fills frame with the encoded frame of that mode, an empty frame is skipped;
+// frames longer than the usb_stream buffer arrive truncated like on USB
+using FrameSource = std::function<void(uint32_t sequence, uint16_t width,
+                                       uint16_t height,
+                                       std::vector<uint8_t> &frame)>;
+
+struct Device {
+  std::vector<uvc_frame_size_t> modes;
+  size_t default_mode{0}; // when the requested size is not advertised
+  uvc_frame_format format{UVC_FRAME_FORMAT_MJPEG};
+  FrameSource source;
+  uint32_t jitter_us{0}; // uniform in [-jitter, +jitter] around the interval
+  uint32_t connect_delay_ms{20};
+};
+
+// a fixed interval mode, in 100 ns units like the descriptors
+uvc_frame_size_t mode(uint16_t width, uint16_t height, uint32_t interval);
+
+// the device the next usb_streaming_start() connects to
+void attach(const Device &device);
+// unplugged and plugged in again, it comes back with the configured mode
+void replug();
+
+struct Counters {
+  uint32_t starts;  // usb_streaming_start() calls
+  uint32_t resets;  // uvc_frame_size_reset() calls
+  uint32_t emitted; // frame callbacks
+  uint32_t truncated;
+};
+Counters counters();
+// what the device currently streams
+uint16_t current_width();
+uint16_t current_height();
+uint32_t current_interval();
+bool suspended();
+
+} // namespace fake_uvc
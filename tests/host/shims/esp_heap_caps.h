@@ -0,0 +1,20 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Host build: every capability is plain malloc, tests make it run out
+// through host_heap_fail_after()
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+void *heap_caps_malloc(size_t size, uint32_t caps);
+void *heap_caps_malloc_prefer(size_t size, size_t num, ...);
+void heap_caps_free(void *ptr);
+
+// the next count allocations succeed, later ones fail; negative never fails
+void host_heap_fail_after(int count);
@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Host build: esp_timer, heap_caps and error names
+
+#include <esp_err.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+
+static const auto START = std::chrono::steady_clock::now();
+static std::atomic<int> s_heap_left{-1};
+
+int64_t esp_timer_get_time() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - START)
+      .count();
+}
+
+static void *host_malloc(size_t size) {
+  int left = s_heap_left.load();
+  while (left >= 0) {
+    if (left == 0)
+      return nullptr;
+    if (s_heap_left.compare_exchange_weak(left, left - 1))
+      break;
+  }
+  return malloc(size);
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+  (void)caps;
+  return host_malloc(size);
+}
+
+void *heap_caps_malloc_prefer(size_t size, size_t num, ...) {
+  (void)num;
+  return host_malloc(size);
+}
+
+void heap_caps_free(void *ptr) { free(ptr); }
+
+void host_heap_fail_after(int count) { s_heap_left = count; }
+
+const char *esp_err_to_name(esp_err_t code) {
+  switch (code) {
+  case ESP_OK:
+    return "ESP_OK";
+  case ESP_FAIL:
+    return "ESP_FAIL";
+  case ESP_ERR_NO_MEM:
+    return "ESP_ERR_NO_MEM";
+  case ESP_ERR_INVALID_ARG:
+    return "ESP_ERR_INVALID_ARG";
+  case ESP_ERR_INVALID_STATE:
+    return "ESP_ERR_INVALID_STATE";
+  case ESP_ERR_INVALID_SIZE:
+    return "ESP_ERR_INVALID_SIZE";
+  case ESP_ERR_NOT_FOUND:
+    return "ESP_ERR_NOT_FOUND";
+  case ESP_ERR_NOT_SUPPORTED:
+    return "ESP_ERR_NOT_SUPPORTED";
+  case ESP_ERR_TIMEOUT:
+    return "ESP_ERR_TIMEOUT";
+  default:
+    return "UNKNOWN ERROR";
+  }
+}
@@ -0,0 +1,8 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Host build: microseconds of the steady clock since the process started
+
+#pragma once
+
+#include <cstdint>
+
+int64_t esp_timer_get_time();
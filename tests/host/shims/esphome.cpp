@@ -0,0 +1,202 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Host build: logging, scheduler, main loop, helpers and preferences
+
+#include "esphome/core/application.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/log.h"
+#include "esphome/core/preferences.h"
+
+#include <esp_timer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <thread>
+
+namespace esphome {
+
+/* ---------------- logging ---------------- */
+static int log_level() {
+  static const int LEVEL = []() {
+    const char *env = getenv("USB_WEBCAM_LOG");
+    return env != nullptr ? atoi(env) : (int)HOST_LOG_WARN;
+  }();
+  return LEVEL;
+}
+
+bool host_log_enabled(int level) { return level <= log_level(); }
+
+void host_log(int level, const char *tag, const char *format, ...) {
+  static const char LETTERS[] = "EWICDVV";
+  char line[512];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  fprintf(stderr, "[%8.3f][%c][%s] %s\n", esp_timer_get_time() / 1e6,
+          LETTERS[level], tag, line);
+}
+
+/* ---------------- time ---------------- */
+uint32_t millis() { return esp_timer_get_time() / 1000; }
+uint32_t micros() { return esp_timer_get_time(); }
+void delay(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+/* ---------------- Component class ---------------- */
+void Component::schedule_(const std::string &name, uint32_t delay_ms,
+                          bool repeat, std::function<void()> &&callback) {
+  this->cancel_(name, repeat);
+  this->scheduled_.push_back(Scheduled{name, delay_ms, millis() + delay_ms,
+                                       repeat, std::move(callback)});
+}
+bool Component::cancel_(const std::string &name, bool repeat) {
+  auto it = std::find_if(this->scheduled_.begin(), this->scheduled_.end(),
+                         [&](const Scheduled &item) {
+                           return item.name == name && item.repeat == repeat;
+                         });
+  if (it == this->scheduled_.end())
+    return false;
+  this->scheduled_.erase(it);
+  return true;
+}
+void Component::set_timeout(const std::string &name, uint32_t timeout_ms,
+                            std::function<void()> &&callback) {
+  this->schedule_(name, timeout_ms, false, std::move(callback));
+}
+void Component::set_interval(const std::string &name, uint32_t interval_ms,
+                             std::function<void()> &&callback) {
+  this->schedule_(name, interval_ms, true, std::move(callback));
+}
+bool Component::cancel_timeout(const std::string &name) {
+  return this->cancel_(name, false);
+}
+bool Component::cancel_interval(const std::string &name) {
+  return this->cancel_(name, true);
+}
+void Component::run_scheduled(uint32_t now_ms) {
+  // callbacks may schedule again, collect first
+  std::vector<std::function<void()>> due;
+  for (auto it = this->scheduled_.begin(); it != this->scheduled_.end();) {
+    if ((int32_t)(now_ms - it->next_ms) < 0) {
+      ++it;
+      continue;
+    }
+    due.push_back(it->callback);
+    if (it->repeat) {
+      it->next_ms = now_ms + it->interval_ms;
+      ++it;
+    } else {
+      it = this->scheduled_.erase(it);
+    }
+  }
+  for (auto &callback : due)
+    callback();
+}
+
+void PollingComponent::start_poller() {
+  this->set_interval("update", this->update_interval_,
+                     [this]() { this->update(); });
+}
+
+/* ---------------- Application class ---------------- */
+void Application::register_component(Component *component) {
+  this->components_.push_back(component);
+}
+void Application::setup() {
+  std::stable_sort(this->components_.begin(), this->components_.end(),
+                   [](Component *a, Component *b) {
+                     return a->get_setup_priority() > b->get_setup_priority();
+                   });
+  for (auto *component : this->components_) {
+    component->setup();
+    if (auto *poller = dynamic_cast<PollingComponent *>(component))
+      poller->start_poller();
+  }
+  for (auto *component : this->components_)
+    component->dump_config();
+}
+void Application::loop() {
+  for (auto *component : this->components_) {
+    if (component->is_failed())
+      continue;
+    component->loop();
+    component->run_scheduled(millis());
+  }
+  std::unique_lock<std::mutex> lock(this->lock_);
+  this->wake_.wait_for(lock, std::chrono::milliseconds(this->loop_interval_),
+                       [this]() { return this->woken_; });
+  this->woken_ = false;
+}
+void Application::run_for(uint32_t duration_ms,
+                          const std::function<bool()> &stop) {
+  const uint32_t start = millis();
+  while (millis() - start < duration_ms) {
+    this->loop();
+    if (stop && stop())
+      return;
+  }
+}
+void Application::wake_loop_threadsafe() {
+  this->wakes_++;
+  {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    this->woken_ = true;
+  }
+  this->wake_.notify_one();
+}
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+Application App;
+
+/* ---------------- helpers ---------------- */
+uint32_t fnv1_hash(const std::string &str) {
+  uint32_t hash = 2166136261UL;
+  for (char c : str) {
+    hash *= 16777619UL;
+    hash ^= (uint8_t)c;
+  }
+  return hash;
+}
+
+std::string str_sprintf(const char *fmt, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buffer, sizeof(buffer), fmt, args);
+  va_end(args);
+  return buffer;
+}
+
+/* ---------------- preferences ---------------- */
+static std::map<uint32_t, std::vector<uint8_t>> s_preferences;
+static uint32_t s_preference_saves = 0;
+
+std::vector<uint8_t> &host_preference(uint32_t key) {
+  return s_preferences[key];
+}
+uint32_t host_preference_saves() { return s_preference_saves; }
+
+bool ESPPreferenceObject::save_(const void *src, size_t len) {
+  const uint8_t *bytes = (const uint8_t *)src;
+  s_preferences[this->key_].assign(bytes, bytes + len);
+  s_preference_saves++;
+  return true;
+}
+bool ESPPreferenceObject::load_(void *dest, size_t len) {
+  auto it = s_preferences.find(this->key_);
+  if (it == s_preferences.end() || it->second.size() != len)
+    return false;
+  memcpy(dest, it->second.data(), len);
+  return true;
+}
+
+static ESPPreferences s_host_preferences;
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+ESPPreferences *global_preferences = &s_host_preferences;
+
+} // namespace esphome
@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Host build: the main loop, sleeping like ESPHome does between iterations
+// unless woken from another thread
+
+#pragma once
+
+#include "esphome/core/component.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace esphome {
+
+class Application {
+public:
+  void register_component(Component *component);
+  // setup() by descending priority, then one loop() so intervals start
+  void setup();
+  // one iteration: every loop() and what is scheduled, then the sleep
+  void loop();
+  // iterations for that long, checking stop between them
+  void run_for(uint32_t duration_ms, const std::function<bool()> &stop = {});
+  void wake_loop_threadsafe();
+
+  uint32_t get_loop_interval() const { return this->loop_interval_; }
+  void set_loop_interval(uint32_t loop_interval_ms) {
+    this->loop_interval_ = loop_interval_ms;
+  }
+  uint32_t get_wakes() const { return this->wakes_.load(); }
+
+protected:
+  std::vector<Component *> components_;
+  uint32_t loop_interval_{16};
+  std::mutex lock_;
+  std::condition_variable wake_;
+  bool woken_{false};
+  std::atomic<uint32_t> wakes_{0};
+};
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+extern Application App;
+
+} // namespace esphome
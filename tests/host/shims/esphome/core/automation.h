@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Host build: triggers and actions without templated values
+
+#pragma once
+
+#include "esphome/core/component.h"
+#include "esphome/core/helpers.h"
+
+namespace esphome {
+
+template <typename... Ts> class Trigger {
+public:
+  void trigger(Ts... x) { (void)sizeof...(x); }
+};
+
+template <typename... Ts> class Action {
+public:
+  virtual ~Action() = default;
+  virtual void play(Ts... x) = 0;
+};
+
+template <typename T, typename... X> class TemplatableValue {
+public:
+  TemplatableValue() = default;
+  TemplatableValue(T value) : value_(value) {}
+  T value(X... x) const { return this->value_; }
+
+protected:
+  T value_{};
+};
+
+template <typename T> class Parented {
+public:
+  Parented() = default;
+  explicit Parented(T *parent) : parent_(parent) {}
+  void set_parent(T *parent) { this->parent_ = parent; }
+
+protected:
+  T *parent_{nullptr};
+};
+
+} // namespace esphome
+
+#define TEMPLATABLE_VALUE(type, name)                                          \
+protected:                                                                     \
+  TemplatableValue<type, Ts...> name##_{};                                     \
+                                                                               \
+public:                                                                        \
+  template <typename V> void set_##name(V name) { this->name##_ = name; }
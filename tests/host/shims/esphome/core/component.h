@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Host build: components with the named timeouts and intervals of ESPHome,
+// run by App.loop() on the thread calling it
+
+#pragma once
+
+#include "esphome/core/defines.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace esphome {
+
+namespace setup_priority {
+static const float BUS = 1000.0f;
+static const float IO = 900.0f;
+static const float HARDWARE = 800.0f;
+static const float DATA = 600.0f;
+static const float PROCESSOR = 400.0f;
+static const float AFTER_WIFI = 250.0f;
+static const float LATE = -100.0f;
+} // namespace setup_priority
+
+class Component {
+public:
+  virtual ~Component() = default;
+  virtual void setup() {}
+  virtual void loop() {}
+  virtual void dump_config() {}
+  virtual float get_setup_priority() const { return setup_priority::DATA; }
+
+  void mark_failed() { this->failed_ = true; }
+  bool is_failed() const { return this->failed_; }
+  void status_set_warning() {}
+  void status_clear_warning() {}
+
+  // called by App.loop(), runs what is due
+  void run_scheduled(uint32_t now_ms);
+
+protected:
+  struct Scheduled {
+    std::string name;
+    uint32_t interval_ms;
+    uint32_t next_ms;
+    bool repeat;
+    std::function<void()> callback;
+  };
+
+  /* same name replaces the previous one, like in ESPHome */
+  void set_timeout(const std::string &name, uint32_t timeout_ms,
+                   std::function<void()> &&callback);
+  void set_interval(const std::string &name, uint32_t interval_ms,
+                    std::function<void()> &&callback);
+  bool cancel_timeout(const std::string &name);
+  bool cancel_interval(const std::string &name);
+
+  void schedule_(const std::string &name, uint32_t delay_ms, bool repeat,
+                 std::function<void()> &&callback);
+  bool cancel_(const std::string &name, bool repeat);
+
+  std::vector<Scheduled> scheduled_;
+  bool failed_{false};
+};
+
+class PollingComponent : public Component {
+public:
+  PollingComponent() = default;
+  explicit PollingComponent(uint32_t update_interval)
+      : update_interval_(update_interval) {}
+  virtual void update() = 0;
+  // App.setup() starts the updates once setup() ran
+  void start_poller();
+  void set_update_interval(uint32_t update_interval) {
+    this->update_interval_ = update_interval;
+  }
+  uint32_t get_update_interval() const { return this->update_interval_; }
+
+protected:
+  uint32_t update_interval_{60000};
+};
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+
+} // namespace esphome
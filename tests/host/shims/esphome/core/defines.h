@@ -0,0 +1,10 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Host build: the optional parts of the component under test, no entities
+
+#pragma once
+
+#define USE_WAKE_LOOP_THREADSAFE
+#define USE_USB_WEBCAM_MOTION
+#define USE_USB_WEBCAM_PROCESSORS
+#define USE_USB_WEBCAM_RATE_CONTROL
+#define USE_USB_WEBCAM_RECORDER
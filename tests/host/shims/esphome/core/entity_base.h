@@ -0,0 +1,19 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Host build: named entities
+
+#pragma once
+
+#include <string>
+
+namespace esphome {
+
+class EntityBase {
+public:
+  const std::string &get_name() const { return this->name_; }
+  void set_name(const char *name) { this->name_ = name; }
+
+protected:
+  std::string name_;
+};
+
+} // namespace esphome
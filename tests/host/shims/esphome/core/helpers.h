@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Host build: the ESPHome helpers the component uses
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define YESNO(b) ((b) ? "YES" : "NO")
+
+namespace esphome {
+
+template <typename... X> class CallbackManager;
+
+template <typename... Ts> class CallbackManager<void(Ts...)> {
+public:
+  void add(std::function<void(Ts...)> &&callback) {
+    this->callbacks_.push_back(std::move(callback));
+  }
+  void call(Ts... args) {
+    for (auto &cb : this->callbacks_)
+      cb(args...);
+  }
+  size_t size() const { return this->callbacks_.size(); }
+
+protected:
+  std::vector<std::function<void(Ts...)>> callbacks_;
+};
+
+uint32_t fnv1_hash(const std::string &str);
+std::string str_sprintf(const char *fmt, ...)
+    __attribute__((format(printf, 1, 2)));
+
+} // namespace esphome
@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Host build: log lines go to stderr, USB_WEBCAM_LOG=0..5 picks the level
+
+#pragma once
+
+namespace esphome {
+
+enum HostLogLevel {
+  HOST_LOG_ERROR = 0,
+  HOST_LOG_WARN,
+  HOST_LOG_INFO,
+  HOST_LOG_CONFIG,
+  HOST_LOG_DEBUG,
+  HOST_LOG_VERBOSE,
+  HOST_LOG_VERY_VERBOSE,
+};
+
+bool host_log_enabled(int level);
+void host_log(int level, const char *tag, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+} // namespace esphome
+
+#define ESP_HOST_LOG(level, tag, ...)                                         \
+  do {                                                                         \
+    if (::esphome::host_log_enabled(level))                                    \
+      ::esphome::host_log(level, tag, __VA_ARGS__);                            \
+  } while (0)
+
+#define ESP_LOGE(tag, ...)                                                     \
+  ESP_HOST_LOG(::esphome::HOST_LOG_ERROR, tag, __VA_ARGS__)
+#define ESP_LOGW(tag, ...)                                                     \
+  ESP_HOST_LOG(::esphome::HOST_LOG_WARN, tag, __VA_ARGS__)
+#define ESP_LOGI(tag, ...)                                                     \
+  ESP_HOST_LOG(::esphome::HOST_LOG_INFO, tag, __VA_ARGS__)
+#define ESP_LOGCONFIG(tag, ...)                                                \
+  ESP_HOST_LOG(::esphome::HOST_LOG_CONFIG, tag, __VA_ARGS__)
+#define ESP_LOGD(tag, ...)                                                     \
+  ESP_HOST_LOG(::esphome::HOST_LOG_DEBUG, tag, __VA_ARGS__)
+#define ESP_LOGV(tag, ...)                                                     \
+  ESP_HOST_LOG(::esphome::HOST_LOG_VERBOSE, tag, __VA_ARGS__)
+#define ESP_LOGVV(tag, ...)                                                    \
+  ESP_HOST_LOG(::esphome::HOST_LOG_VERY_VERBOSE, tag, __VA_ARGS__)
+
+#define LOG_UPDATE_INTERVAL(this)                                              \
+  ESP_LOGCONFIG(TAG, "  Update Interval: %.1fs",                               \
+                (this)->get_update_interval() / 1000.0f)
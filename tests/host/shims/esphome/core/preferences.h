@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Host build: preferences kept in memory for the lifetime of the process,
+// tests seed or inspect them through host_preference()
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace esphome {
+
+std::vector<uint8_t> &host_preference(uint32_t key);
+uint32_t host_preference_saves();
+
+class ESPPreferenceObject {
+public:
+  ESPPreferenceObject() = default;
+  explicit ESPPreferenceObject(uint32_t key) : key_(key), valid_(true) {}
+
+  template <typename T> bool save(const T *src) {
+    if (!this->valid_)
+      return false;
+    return this->save_(src, sizeof(T));
+  }
+  template <typename T> bool load(T *dest) {
+    if (!this->valid_)
+      return false;
+    return this->load_(dest, sizeof(T));
+  }
+
+protected:
+  bool save_(const void *src, size_t len);
+  bool load_(void *dest, size_t len);
+
+  uint32_t key_{0};
+  bool valid_{false};
+};
+
+class ESPPreferences {
+public:
+  template <typename T>
+  ESPPreferenceObject make_preference(uint32_t type, bool in_flash = false) {
+    (void)in_flash;
+    return ESPPreferenceObject(type);
+  }
+  bool sync() { return true; }
+};
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+extern ESPPreferences *global_preferences;
+
+} // namespace esphome
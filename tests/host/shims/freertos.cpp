@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Host build: FreeRTOS tasks, notifications and queues on std::thread
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct tskTaskControlBlock {
+  std::string name;
+  std::mutex lock;
+  std::condition_variable notified;
+  uint32_t notifications{0};
+};
+
+struct QueueDefinition {
+  std::mutex lock;
+  std::condition_variable changed;
+  std::deque<std::vector<uint8_t>> items;
+  UBaseType_t length;
+  UBaseType_t item_size;
+};
+
+static thread_local TaskHandle_t t_current = nullptr;
+static const auto START = std::chrono::steady_clock::now();
+
+/* false once the timeout passed, portMAX_DELAY waits forever */
+template <typename Predicate>
+static bool wait_for(std::condition_variable &cv,
+                     std::unique_lock<std::mutex> &lock, TickType_t timeout,
+                     Predicate ready) {
+  if (timeout == portMAX_DELAY) {
+    cv.wait(lock, ready);
+    return true;
+  }
+  return cv.wait_for(lock, std::chrono::milliseconds(timeout), ready);
+}
+
+BaseType_t xPortGetCoreID() { return 0; }
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name,
+                                   uint32_t stack_size, void *pv,
+                                   UBaseType_t priority, TaskHandle_t *handle,
+                                   BaseType_t core) {
+  (void)stack_size;
+  (void)priority;
+  (void)core;
+  auto *tcb = new tskTaskControlBlock();
+  tcb->name = name;
+  if (handle != nullptr)
+    *handle = tcb;
+  // tasks never return, the process ends with them still running
+  std::thread([task, pv, tcb]() {
+    t_current = tcb;
+    task(pv);
+  }).detach();
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name,
+                       uint32_t stack_size, void *pv, UBaseType_t priority,
+                       TaskHandle_t *handle) {
+  return xTaskCreatePinnedToCore(task, name, stack_size, pv, priority, handle,
+                                 tskNO_AFFINITY);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  if (t_current == nullptr) {
+    t_current = new tskTaskControlBlock();
+    t_current->name = "main";
+  }
+  return t_current;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  {
+    std::lock_guard<std::mutex> guard(task->lock);
+    task->notifications++;
+  }
+  task->notified.notify_all();
+  return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout) {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> lock(self->lock);
+  wait_for(self->notified, lock, timeout,
+           [self]() { return self->notifications != 0; });
+  const uint32_t value = self->notifications;
+  if (value != 0)
+    self->notifications = clear ? 0 : value - 1;
+  return value;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - START)
+      .count();
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  auto *queue = new QueueDefinition();
+  queue->length = length;
+  queue->item_size = item_size;
+  return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item,
+                      TickType_t timeout) {
+  std::unique_lock<std::mutex> lock(queue->lock);
+  if (!wait_for(queue->changed, lock, timeout, [queue]() {
+        return queue->items.size() < queue->length;
+      }))
+    return pdFALSE;
+  const uint8_t *bytes = (const uint8_t *)item;
+  queue->items.emplace_back(bytes, bytes + queue->item_size);
+  lock.unlock();
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t timeout) {
+  std::unique_lock<std::mutex> lock(queue->lock);
+  if (!wait_for(queue->changed, lock, timeout,
+                [queue]() { return !queue->items.empty(); }))
+    return pdFALSE;
+  if (queue->item_size != 0)
+    memcpy(item, queue->items.front().data(), queue->item_size);
+  queue->items.pop_front();
+  lock.unlock();
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  std::lock_guard<std::mutex> guard(queue->lock);
+  return queue->items.size();
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  QueueHandle_t queue = xQueueCreate(1, 0);
+  xQueueSend(queue, nullptr, 0);
+  return queue;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout) {
+  return xQueueReceive(semaphore, nullptr, timeout);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  return xQueueSend(semaphore, nullptr, 0);
+}
@@ -0,0 +1,32 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Host build: FreeRTOS types on top of std::thread, one tick per millisecond
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// like in ESP-IDF, where FreeRTOS pulls these in
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t StackType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xffffffffu
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portTICK_PERIOD_MS 1
+#define configTICK_RATE_HZ 1000
+#define configMAX_PRIORITIES 25
+#define tskNO_AFFINITY 0x7fffffff
+#define portNUM_PROCESSORS 2
+
+BaseType_t xPortGetCoreID();
@@ -0,0 +1,12 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Host build: a mutex is a queue of one empty item, like in FreeRTOS
+
+#pragma once
+
+#include "queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
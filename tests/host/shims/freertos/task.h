@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Host build: tasks are detached threads, notifications a counter per task
+
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct tskTaskControlBlock *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name,
+                       uint32_t stack_size, void *pv, UBaseType_t priority,
+                       TaskHandle_t *handle);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name,
+                                   uint32_t stack_size, void *pv,
+                                   UBaseType_t priority, TaskHandle_t *handle,
+                                   BaseType_t core);
+// threads not created as tasks get a handle on first use
+TaskHandle_t xTaskGetCurrentTaskHandle();
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
@@ -0,0 +1,11 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Host build: lwIP sockets are the BSD API
+
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Host build: the usb_stream API, implemented by the fake device of the
+// tests (fake_uvc.h) instead of USB
+
+#pragma once
+
+#include "esp_err.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/time.h>
+#include <time.h>
+
+typedef enum {
+  UVC_FRAME_FORMAT_UNKNOWN = 0,
+  UVC_FRAME_FORMAT_ANY = 0,
+  UVC_FRAME_FORMAT_UNCOMPRESSED,
+  UVC_FRAME_FORMAT_COMPRESSED,
+  UVC_FRAME_FORMAT_YUYV,
+  UVC_FRAME_FORMAT_UYVY,
+  UVC_FRAME_FORMAT_RGB,
+  UVC_FRAME_FORMAT_BGR,
+  UVC_FRAME_FORMAT_MJPEG,
+  UVC_FRAME_FORMAT_H264,
+  UVC_FRAME_FORMAT_GRAY8,
+  UVC_FRAME_FORMAT_GRAY16,
+  UVC_FRAME_FORMAT_NV12 = 18,
+} uvc_frame_format;
+
+typedef struct uvc_frame {
+  void *data;
+  size_t data_bytes;
+  uint32_t width;
+  uint32_t height;
+  uvc_frame_format frame_format;
+  size_t step;
+  uint32_t sequence;
+  struct timeval capture_time;
+  struct timespec capture_time_finished;
+  void *source;
+  uint8_t library_owns_data;
+  void *metadata;
+  size_t metadata_bytes;
+} uvc_frame_t;
+
+typedef void(uvc_frame_callback_t)(struct uvc_frame *frame, void *user_ptr);
+
+typedef enum { UVC_XFER_ISOC = 0, UVC_XFER_BULK, UVC_XFER_UNKNOWN } uvc_xfer_t;
+
+typedef struct {
+  uint16_t frame_width;
+  uint16_t frame_height;
+  uint32_t frame_interval;
+  uint32_t xfer_buffer_size;
+  uint8_t *xfer_buffer_a;
+  uint8_t *xfer_buffer_b;
+  uint32_t frame_buffer_size;
+  uint8_t *frame_buffer;
+  uvc_frame_callback_t *frame_cb;
+  void *frame_cb_arg;
+  uvc_xfer_t xfer_type;
+  uint8_t format_index;
+  uint8_t frame_index;
+  uint16_t interface;
+  uint16_t interface_alt;
+  uint8_t ep_addr;
+  uint32_t ep_mps;
+  uint32_t flags;
+} uvc_config_t;
+
+typedef struct {
+  uint16_t width;
+  uint16_t height;
+  uint32_t interval;
+  uint32_t interval_min;
+  uint32_t interval_max;
+  uint32_t interval_step;
+} uvc_frame_size_t;
+
+typedef enum { STREAM_UVC = 0, STREAM_UAC_SPK, STREAM_UAC_MIC } usb_stream_t;
+typedef enum {
+  CTRL_NONE,
+  CTRL_SUSPEND,
+  CTRL_RESUME,
+  CTRL_UAC_MUTE,
+  CTRL_UAC_VOLUME,
+} stream_ctrl_t;
+typedef enum { STREAM_CONNECTED = 0, STREAM_DISCONNECTED } usb_stream_state_t;
+typedef void (*state_callback_t)(usb_stream_state_t state, void *user_ptr);
+
+#define FPS2INTERVAL(fps) (10000000ul / fps)
+#define INTERVAL2FPS(interval) (10000000ul / interval)
+#define FLAG_UVC_SUSPEND_AFTER_START (1 << 0)
+
+esp_err_t uvc_streaming_config(const uvc_config_t *config);
+esp_err_t usb_streaming_start(void);
+esp_err_t usb_streaming_stop(void);
+esp_err_t usb_streaming_connect_wait(size_t timeout_ms);
+esp_err_t usb_streaming_state_register(state_callback_t cb, void *user_ptr);
+esp_err_t usb_streaming_control(usb_stream_t stream, stream_ctrl_t ctrl_type,
+                                void *ctrl_value);
+esp_err_t uvc_frame_size_list_get(uvc_frame_size_t *frame_list,
+                                  size_t *list_size, size_t *cur_index);
+esp_err_t uvc_frame_size_reset(uint16_t frame_width, uint16_t frame_height,
+                               uint32_t frame_interval);
@@ -0,0 +1,109 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Fast start: buffers that grew on one boot are what the next boot starts
+// with, without a restart to shrink or grow them once the device connects
+
+#include "../esp32_camera/esp32_camera.h"
+#include "fake_uvc.h"
+#include "frame_ring.h"
+#include "test_util.h"
+
+#include "esphome/core/application.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/preferences.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace esphome;
+using namespace esphome::esp32_camera;
+
+static const uint16_t WIDTH = 320;
+static const uint16_t HEIGHT = 240;
+// far beyond the 3 bits per pixel buffers start with
+static const uint32_t GROWN_SIZE = 64 * 1024;
+
+static std::vector<uint8_t> s_frame;
+
+static void start_camera(ESP32Camera &camera) {
+  fake_uvc::Device device;
+  device.modes = {fake_uvc::mode(WIDTH, HEIGHT, 333333)};
+  // buffers are fitted on connect before the first frame is in
+  device.source = [](uint32_t sequence, uint16_t, uint16_t,
+                     std::vector<uint8_t> &frame) {
+    if (sequence >= 5)
+      frame = s_frame;
+  };
+  fake_uvc::attach(device);
+  camera.set_frame_size(ESP32_CAMERA_SIZE_320X240);
+  camera.set_max_update_interval(0);
+  camera.set_idle_update_interval(0);
+  camera.set_suspend_when_idle(false);
+  camera.set_transfer_type(ESP32_CAMERA_TRANSFER_BULK);
+  App.register_component(&camera);
+  App.setup();
+  camera.start_stream(WEB_REQUESTER);
+}
+
+// first boot, in a child process for fresh statics on the second one; the
+// cached mode is written to fd
+static void first_boot(int fd) {
+  ESP32Camera camera;
+  start_camera(camera);
+  const FrameRing *ring = camera.get_frame_ring();
+  std::vector<uint8_t> &cached = host_preference(fnv1_hash("usb_webcam_mode"));
+  App.run_for(5000, [ring, &cached]() {
+    return ring->slot_size() >= GROWN_SIZE && !cached.empty() &&
+           fake_uvc::current_width() == WIDTH;
+  });
+  App.run_for(300);
+  CHECK_MSG(ring->slot_size() >= GROWN_SIZE, "buffers at %zu bytes",
+            ring->slot_size());
+  CHECK(!cached.empty());
+  if (write(fd, cached.data(), cached.size()) != (ssize_t)cached.size())
+    CHECK(false);
+  test_util::finish();
+}
+
+int main() {
+  // noise at high quality makes a frame of most of a byte per pixel
+  s_frame = test_util::encode_jpeg(
+      test_util::make_scene(WIDTH, HEIGHT, 0, 40), 2, 1, 95);
+  printf("%zu byte frames\n", s_frame.size());
+
+  fflush(stdout);
+  int fds[2];
+  CHECK(pipe(fds) == 0);
+  const pid_t child = fork();
+  if (child == 0) {
+    close(fds[0]);
+    first_boot(fds[1]);
+  }
+  close(fds[1]);
+  std::vector<uint8_t> cached;
+  uint8_t chunk[256];
+  ssize_t n;
+  while ((n = read(fds[0], chunk, sizeof(chunk))) > 0)
+    cached.insert(cached.end(), chunk, chunk + n);
+  int status = 0;
+  waitpid(child, &status, 0);
+  CHECK_MSG(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+            "first boot failed");
+  CHECK(!cached.empty());
+  host_preference(fnv1_hash("usb_webcam_mode")) = cached;
+
+  // second boot, the grown buffers are kept
+  ESP32Camera camera;
+  uint32_t delivered = 0;
+  camera.add_image_callback(
+      [&delivered](std::shared_ptr<CameraImage>) { delivered++; });
+  start_camera(camera);
+  App.run_for(1500);
+  const FrameRing *ring = camera.get_frame_ring();
+  printf("second boot: %u start(s), %zu byte slots, %u delivered\n",
+         fake_uvc::counters().starts, ring->slot_size(), delivered);
+  CHECK_MSG(fake_uvc::counters().starts == 1, "stream restarted");
+  CHECK(ring->slot_size() >= GROWN_SIZE);
+  CHECK(fake_uvc::counters().truncated == 0);
+  CHECK(delivered >= 20);
+  test_util::finish();
+}
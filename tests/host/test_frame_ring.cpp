@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// FrameRing: newest frame first, recycling, busy drops, slot capacity, waiters,
+// running out of memory
+
+#include "buffer_pool.h"
+#include "frame_ring.h"
+#include "test_util.h"
+
+#include <atomic>
+#include <cstring>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <thread>
+
+using namespace esphome::esp32_camera;
+
+static camera_fb_t *write(FrameRing &ring, size_t len, uint8_t fill) {
+  camera_fb_t *fb = ring.begin_write(len);
+  if (fb == nullptr)
+    return nullptr;
+  memset(fb->buf, fill, len);
+  fb->len = len;
+  ring.commit_write(fb);
+  return fb;
+}
+
+static void test_newest_first() {
+  FrameRing ring;
+  CHECK(ring.init(3, 1000));
+  CHECK(ring.slot_size() == 16 * 1024); // whole pool granules
+  uint32_t cursor = 0;
+  CHECK(ring.acquire_latest(&cursor) == nullptr);
+  write(ring, 100, 1);
+  camera_fb_t *second = write(ring, 100, 2);
+  camera_fb_t *fb = ring.acquire_latest(&cursor);
+  CHECK(fb == second);
+  CHECK(fb->buf[0] == 2);
+  // nothing newer than what the cursor has seen
+  CHECK(ring.acquire_latest(&cursor) == nullptr);
+  ring.release(fb);
+  CHECK(ring.get_written() == 2);
+}
+
+static void test_recycles_oldest_unreferenced() {
+  FrameRing ring;
+  CHECK(ring.init(3, 1000));
+  uint32_t cursor = 0;
+  write(ring, 10, 1);
+  camera_fb_t *held = ring.acquire_latest(&cursor);
+  write(ring, 10, 2);
+  write(ring, 10, 3);
+  // all slots used, the held one must survive
+  camera_fb_t *fourth = write(ring, 10, 4);
+  CHECK(fourth != nullptr && fourth != held);
+  CHECK(held->buf[0] == 1);
+  CHECK(ring.get_overwritten() == 1);
+
+}
+
+static void test_busy_drop() {
+  FrameRing ring;
+  CHECK(ring.init(3, 1000));
+  // every slot referenced: the producer drops instead of waiting
+  uint32_t cursor = 0;
+  for (uint8_t i = 0; i < 3; i++) {
+    write(ring, 10, i);
+    CHECK(ring.acquire_latest(&cursor) != nullptr);
+  }
+  CHECK(ring.begin_write(10) == nullptr);
+  CHECK(ring.get_dropped_busy() == 1);
+}
+
+static void test_capacity() {
+  FrameRing ring;
+  CHECK(ring.init(2, 16 * 1024));
+  // too big is not busy
+  CHECK(!ring.fits(16 * 1024 + 1));
+  CHECK(ring.begin_write(16 * 1024 + 1) == nullptr);
+  CHECK(ring.get_dropped_busy() == 0);
+
+  // a held slot keeps its old buffer until released
+  uint32_t cursor = 0;
+  camera_fb_t *held = write(ring, 10, 1);
+  CHECK(ring.acquire_latest(&cursor) == held);
+  ring.resize(48 * 1024);
+  CHECK(ring.resize_pending());
+  CHECK(ring.slot_size() == 48 * 1024);
+  CHECK(ring.capacity_of(held) == 16 * 1024);
+  camera_fb_t *fb = ring.begin_write(48 * 1024);
+  CHECK(fb != nullptr && fb != held);
+  if (fb != nullptr) {
+    CHECK(ring.capacity_of(fb) == 48 * 1024);
+    ring.abort_write(fb);
+  }
+  ring.release(held);
+  ring.reallocate_idle();
+  CHECK(!ring.resize_pending());
+  CHECK(ring.capacity_of(held) == 48 * 1024);
+}
+
+static void test_wait_latest_wakes() {
+  FrameRing ring;
+  CHECK(ring.init(3, 1000));
+  std::thread producer([&ring]() {
+    vTaskDelay(20);
+    write(ring, 10, 7);
+  });
+  uint32_t cursor = 0;
+  const int64_t start = esp_timer_get_time();
+  camera_fb_t *fb = ring.wait_latest(&cursor, pdMS_TO_TICKS(2000));
+  CHECK(fb != nullptr);
+  CHECK(esp_timer_get_time() - start < 1000000);
+  if (fb != nullptr)
+    ring.release(fb);
+  producer.join();
+}
+
+// the framebuffer task and the stream server wait at the same time
+static void test_every_waiter_wakes() {
+  FrameRing ring;
+  CHECK(ring.init(3, 1000));
+  std::atomic<int> woken{0};
+  auto waiter = [&ring, &woken]() {
+    uint32_t cursor = 0;
+    camera_fb_t *fb = ring.wait_latest(&cursor, pdMS_TO_TICKS(2000));
+    if (fb == nullptr)
+      return;
+    woken++;
+    ring.release(fb);
+  };
+  std::thread first(waiter), second(waiter);
+  vTaskDelay(20);
+  const int64_t start = esp_timer_get_time();
+  write(ring, 10, 7);
+  first.join();
+  second.join();
+  CHECK_MSG(woken == 2, "%d of 2 waiters got the frame", woken.load());
+  CHECK(esp_timer_get_time() - start < 1000000);
+}
+
+static void test_out_of_memory() {
+  global_buffer_pool.trim();
+  const size_t in_use = global_buffer_pool.get_in_use();
+  // the third slot gets no buffer, the first two go back to the pool
+  host_heap_fail_after(2);
+  FrameRing ring;
+  CHECK(!ring.init(3, 1000));
+  host_heap_fail_after(-1);
+  CHECK(global_buffer_pool.get_in_use() == in_use);
+  CHECK(global_buffer_pool.get_cached() == 2 * BufferPool::GRANULE);
+  // nothing is left behind for a second attempt
+  CHECK(ring.init(3, 1000));
+  CHECK(global_buffer_pool.get_in_use() == in_use + 3 * BufferPool::GRANULE);
+  CHECK(write(ring, 100, 1) != nullptr);
+}
+
+int main() {
+  test_newest_first();
+  test_recycles_oldest_unreferenced();
+  test_busy_drop();
+  test_capacity();
+  test_wait_latest_wakes();
+  test_every_waiter_wakes();
+  test_out_of_memory();
+  test_util::finish();
+}
@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Delivering frames never allocates: the images come from the fixed pool
+
+#include "../esp32_camera/esp32_camera.h"
+#include "fake_uvc.h"
+#include "image_pool.h"
+#include "test_util.h"
+
+#include "esphome/core/application.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace esphome;
+using namespace esphome::esp32_camera;
+
+// operator new of the thread running loop(), while counting
+static thread_local bool t_counting = false;
+static std::atomic<uint32_t> s_allocations{0};
+
+void *operator new(size_t size) {
+  if (t_counting)
+    s_allocations++;
+  void *ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+
+int main() {
+  const std::vector<uint8_t> jpeg =
+      test_util::encode_jpeg(test_util::make_scene(320, 240, 0), 2, 1, 80);
+  fake_uvc::Device device;
+  device.modes = {fake_uvc::mode(320, 240, 333333)};
+  device.source = [&jpeg](uint32_t, uint16_t, uint16_t,
+                          std::vector<uint8_t> &frame) { frame = jpeg; };
+  fake_uvc::attach(device);
+
+  ESP32Camera camera;
+  camera.set_max_update_interval(0);
+  camera.set_idle_update_interval(0);
+  camera.set_suspend_when_idle(false);
+  camera.set_transfer_type(ESP32_CAMERA_TRANSFER_BULK);
+  // a consumer holds on to the image until the next iteration
+  std::shared_ptr<CameraImage> held;
+  uint32_t delivered = 0;
+  camera.add_image_callback([&](std::shared_ptr<CameraImage> image) {
+    delivered++;
+    held = image;
+  });
+  App.register_component(&camera);
+  App.setup();
+  camera.start_stream(API_REQUESTER);
+  camera.start_stream(WEB_REQUESTER);
+  App.run_for(500);
+
+  delivered = 0;
+  t_counting = true;
+  App.run_for(1000, [&]() {
+    // done sending
+    held.reset();
+    return false;
+  });
+  t_counting = false;
+  printf("%u images, %u allocations, %u heap fallbacks, %u nodes in use\n",
+         delivered, s_allocations.load(),
+         global_image_pool.get_heap_fallbacks(),
+         global_image_pool.get_in_use());
+  CHECK(delivered >= 20);
+  CHECK_MSG(s_allocations == 0, "%u allocations delivering %u images",
+            s_allocations.load(), delivered);
+  CHECK(global_image_pool.get_heap_fallbacks() == 0);
+  test_util::finish();
+}
@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Motion detection: the background catches up with small brightness changes,
+// gated streams pause while the scene is quiet, single requests never do
+
+#include "../esp32_camera/esp32_camera.h"
+#include "fake_uvc.h"
+#include "motion_detector.h"
+#include "test_util.h"
+
+#include "esphome/core/application.h"
+
+#include <algorithm>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+using namespace esphome;
+using namespace esphome::esp32_camera;
+
+static const uint16_t WIDTH = 320;
+static const uint16_t HEIGHT = 240;
+
+static camera_fb_t frame_of(std::vector<uint8_t> &data) {
+  camera_fb_t fb{};
+  fb.buf = data.data();
+  fb.len = data.size();
+  fb.width = WIDTH;
+  fb.height = HEIGHT;
+  fb.format = PIXFORMAT_JPEG;
+  return fb;
+}
+
+// a change smaller than one luma level per 16 analyses used to be lost
+static void check_background() {
+  const test_util::Planes scene = test_util::make_scene(WIDTH, HEIGHT, 0);
+  test_util::Planes brighter = scene;
+  for (auto &y : brighter.y)
+    y = std::min(255, y + 5);
+  std::vector<uint8_t> before = test_util::encode_jpeg(scene, 2, 1, 90);
+  std::vector<uint8_t> after = test_util::encode_jpeg(brighter, 2, 1, 90);
+  camera_fb_t before_fb = frame_of(before);
+  camera_fb_t after_fb = frame_of(after);
+
+  MotionDetector detector;
+  detector.set_analysis_interval(0);
+  detector.set_luma_threshold(0); // any difference left counts
+  detector.set_area_threshold(1e-6f);
+  detector.set_hold_time(50);
+  detector.analyze(&before_fb);
+  for (int i = 0; i < 200; i++)
+    detector.analyze(&after_fb);
+  // the step itself was motion, only a difference still left is now
+  vTaskDelay(pdMS_TO_TICKS(100));
+  detector.analyze(&after_fb);
+  CHECK_MSG(!detector.is_active(), "background did not converge");
+}
+
+int main() {
+  check_background();
+
+  std::vector<std::vector<uint8_t>> frames;
+  for (uint32_t phase = 0; phase < 8; phase++)
+    frames.push_back(test_util::encode_jpeg(
+        test_util::make_scene(WIDTH, HEIGHT, phase * 10), 2, 1, 80));
+  std::atomic<bool> moving{false};
+  fake_uvc::Device device;
+  device.modes = {fake_uvc::mode(WIDTH, HEIGHT, 333333)};
+  device.source = [&frames, &moving](uint32_t sequence, uint16_t, uint16_t,
+                                     std::vector<uint8_t> &frame) {
+    frame = frames[moving ? sequence % frames.size() : 0];
+  };
+  fake_uvc::attach(device);
+
+  ESP32Camera camera;
+  camera.set_max_update_interval(0);
+  camera.set_idle_update_interval(0);
+  camera.set_suspend_when_idle(false);
+  camera.set_transfer_type(ESP32_CAMERA_TRANSFER_BULK);
+  uint32_t api_images = 0;
+  camera.add_image_callback([&api_images](std::shared_ptr<CameraImage> image) {
+    if (image->was_requested_by(API_REQUESTER))
+      api_images++;
+  });
+  MotionDetector motion;
+  motion.set_analysis_interval(0);
+  motion.set_hold_time(300);
+  motion.add_gated_requester(API_REQUESTER);
+  App.register_component(&camera);
+  App.register_component(&motion);
+  App.setup();
+
+  // quiet scene, the gated stream is held back
+  camera.start_stream(API_REQUESTER);
+  App.run_for(1000);
+  CHECK_MSG(api_images == 0, "%u images while quiet", api_images);
+  camera.stop_stream(API_REQUESTER);
+
+  // a single request is answered all the same
+  camera.request_image(API_REQUESTER);
+  App.run_for(1000, [&api_images]() { return api_images != 0; });
+  CHECK_MSG(api_images == 1, "%u images for a single request", api_images);
+
+  // motion, the stream goes on
+  api_images = 0;
+  moving = true;
+  camera.start_stream(API_REQUESTER);
+  App.run_for(1000);
+  CHECK_MSG(api_images >= 10, "%u images during motion", api_images);
+  test_util::finish();
+}
@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Rate control: a consumer too slow for the configured mode makes the
+// controller step the resolution down, the next boot still starts with the
+// selected mode after the device was plugged in again
+
+#include "../esp32_camera/esp32_camera.h"
+#include "fake_uvc.h"
+#include "rate_controller.h"
+#include "test_util.h"
+
+#include "esphome/core/application.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/preferences.h"
+
+#include <cstring>
+#include <esp_timer.h>
+#include <map>
+
+using namespace esphome;
+using namespace esphome::esp32_camera;
+
+// frames at 30 fps are held this long while throttled
+static const int64_t HOLD_US = 100 * 1000;
+
+static bool streams(ESP32Camera &camera, uint16_t width, uint16_t height) {
+  uint16_t w, h;
+  return camera.get_current_mode(&w, &h) && w == width && h == height &&
+         fake_uvc::current_width() == width &&
+         fake_uvc::current_height() == height;
+}
+
+// the mode in the cached preference, after its device hash
+static bool cached_mode(uint16_t *width, uint16_t *height) {
+  const std::vector<uint8_t> &cached =
+      host_preference(fnv1_hash("usb_webcam_mode"));
+  if (cached.size() < 8)
+    return false;
+  memcpy(width, &cached[4], sizeof(uint16_t));
+  memcpy(height, &cached[6], sizeof(uint16_t));
+  return true;
+}
+
+static bool caches(uint16_t width, uint16_t height) {
+  uint16_t w, h;
+  return cached_mode(&w, &h) && w == width && h == height;
+}
+
+int main() {
+  std::map<uint32_t, std::vector<uint8_t>> frames; // by width
+  fake_uvc::Device device;
+  device.modes = {fake_uvc::mode(640, 480, 333333),
+                  fake_uvc::mode(320, 240, 333333)};
+  device.source = [&frames](uint32_t, uint16_t width, uint16_t height,
+                            std::vector<uint8_t> &frame) {
+    auto &cached = frames[width];
+    if (cached.empty())
+      cached = test_util::encode_jpeg(
+          test_util::make_scene(width, height, 0), 2, 1, 80);
+    frame = cached;
+  };
+  // sources run on the sample thread, encode up front
+  for (const auto &mode : device.modes) {
+    std::vector<uint8_t> frame;
+    device.source(0, mode.width, mode.height, frame);
+  }
+  fake_uvc::attach(device);
+
+  ESP32Camera camera;
+  camera.set_frame_size(ESP32_CAMERA_SIZE_640X480);
+  camera.set_max_update_interval(0);
+  camera.set_idle_update_interval(0);
+  camera.set_suspend_when_idle(false);
+  camera.set_transfer_type(ESP32_CAMERA_TRANSFER_BULK);
+  RateController controller(&camera);
+  controller.set_evaluation_interval(500);
+  // a consumer holding on to every image until it is done sending
+  std::shared_ptr<CameraImage> held;
+  int64_t held_since_us = 0;
+  camera.add_image_callback([&](std::shared_ptr<CameraImage> image) {
+    held = image;
+    held_since_us = esp_timer_get_time();
+  });
+  App.register_component(&camera);
+  App.register_component(&controller);
+  App.setup();
+  camera.start_stream(WEB_REQUESTER);
+  auto consume = [&](int64_t hold_us) {
+    if (held && esp_timer_get_time() - held_since_us >= hold_us)
+      held.reset();
+  };
+
+  App.run_for(2000, [&]() {
+    consume(0);
+    return streams(camera, 640, 480) && caches(640, 480);
+  });
+  CHECK(streams(camera, 640, 480));
+  CHECK(caches(640, 480));
+
+  // too slow for 640x480, the controller steps down
+  App.run_for(5000, [&]() {
+    consume(HOLD_US);
+    return streams(camera, 320, 240);
+  });
+  CHECK_MSG(streams(camera, 320, 240), "resolution not stepped down");
+
+  // plugged in again, the adapted mode is restored and saved again
+  fake_uvc::replug();
+  App.run_for(2000, [&]() {
+    consume(HOLD_US);
+    return false;
+  });
+  uint16_t width = 0, height = 0;
+  cached_mode(&width, &height);
+  printf("streaming %ux%u, caching %ux%u\n", fake_uvc::current_width(),
+         fake_uvc::current_height(), width, height);
+  CHECK(streams(camera, 320, 240));
+  CHECK_MSG(caches(640, 480), "the controller's mode was cached: %ux%u",
+            width, height);
+
+  // a mode the user picks is cached
+  CHECK(camera.set_resolution(320, 240, true));
+  CHECK(caches(320, 240));
+  held.reset();
+  test_util::finish();
+}
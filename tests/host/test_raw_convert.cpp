@@ -0,0 +1,213 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Uncompressed frames: the word-at-a-time row kernels against a per-pixel
+// reference, JPEG output against the source, and XGA YUY2 frames, whose size
+// is a multiple of the buffer granularity, through the camera
+
+#include "../esp32_camera/esp32_camera.h"
+#include "fake_uvc.h"
+#include "pipeline_stats.h"
+#include "raw_convert.h"
+#include "test_util.h"
+
+#include "esphome/core/application.h"
+
+#include <cstring>
+#include <random>
+
+using namespace esphome;
+using namespace esphome::esp32_camera;
+
+/* ---------------- per-pixel reference ---------------- */
+static uint8_t clamp(int32_t value) {
+  return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+// BT.601 limited range, big endian RGB565
+static uint16_t ref_rgb565(uint8_t y, uint8_t u, uint8_t v) {
+  const int32_t c = 298 * (y - 16), d = u - 128, e = v - 128;
+  const uint8_t r = clamp((c + 409 * e + 128) >> 8);
+  const uint8_t g = clamp((c - 100 * d - 208 * e + 128) >> 8);
+  const uint8_t b = clamp((c + 516 * d + 128) >> 8);
+  return (r & 0xF8) << 8 | (g & 0xFC) << 3 | b >> 3;
+}
+
+// the bytes of pixel x of a packed 4:2:2 row
+static void ref_yuv422(const uint8_t *src, bool uyvy, size_t x, uint8_t *y,
+                       uint8_t *u, uint8_t *v) {
+  const uint8_t *pair = src + x / 2 * 4;
+  *y = pair[(uyvy ? 1 : 0) + x % 2 * 2];
+  *u = pair[uyvy ? 0 : 1];
+  *v = pair[uyvy ? 2 : 3];
+}
+
+static void check_kernels() {
+  std::mt19937 random(7);
+  for (size_t width = 2; width <= 38; width += 2) {
+    std::vector<uint8_t> src(width * 2), uv(width);
+    for (auto &byte : src)
+      byte = random();
+    for (auto &byte : uv)
+      byte = random();
+    for (bool uyvy : {false, true}) {
+      std::vector<uint8_t> gray(width), y(width), u(width / 2), v(width / 2);
+      std::vector<uint8_t> rgb(width * 2);
+      yuv422_to_gray(src.data(), uyvy, gray.data(), width);
+      yuv422_split(src.data(), uyvy, y.data(), u.data(), v.data(), width);
+      yuv422_to_rgb565(src.data(), uyvy, rgb.data(), width);
+      for (size_t x = 0; x < width; x++) {
+        uint8_t ry, ru, rv;
+        ref_yuv422(src.data(), uyvy, x, &ry, &ru, &rv);
+        const uint16_t pixel = rgb[x * 2] << 8 | rgb[x * 2 + 1];
+        CHECK_MSG(gray[x] == ry && y[x] == ry && u[x / 2] == ru &&
+                      v[x / 2] == rv && pixel == ref_rgb565(ry, ru, rv),
+                  "%s width %zu pixel %zu", uyvy ? "UYVY" : "YUYV", width,
+                  x);
+      }
+    }
+    // NV12 rows read the luma from src
+    std::vector<uint8_t> rgb(width * 2);
+    nv12_to_rgb565(src.data(), uv.data(), rgb.data(), width);
+    for (size_t x = 0; x < width; x++) {
+      const uint16_t pixel = rgb[x * 2] << 8 | rgb[x * 2 + 1];
+      CHECK_MSG(pixel == ref_rgb565(src[x], uv[x / 2 * 2], uv[x / 2 * 2 + 1]),
+                "NV12 width %zu pixel %zu", width, x);
+    }
+  }
+}
+
+/* ---------------- whole frames ---------------- */
+static std::vector<uint8_t> pack_yuyv(const test_util::Planes &image) {
+  std::vector<uint8_t> out(image.width * image.height * 2);
+  for (size_t i = 0; i < image.width * image.height; i += 2) {
+    out[i * 2] = image.y[i];
+    out[i * 2 + 1] = (image.cb[i] + image.cb[i + 1] + 1) / 2;
+    out[i * 2 + 2] = image.y[i + 1];
+    out[i * 2 + 3] = (image.cr[i] + image.cr[i + 1] + 1) / 2;
+  }
+  return out;
+}
+
+static std::vector<uint8_t> pack_nv12(const test_util::Planes &image) {
+  const size_t width = image.width;
+  std::vector<uint8_t> out(image.y);
+  for (size_t y = 0; y < image.height; y += 2) {
+    for (size_t x = 0; x < width; x += 2) {
+      out.push_back(image.cb[y * width + x]);
+      out.push_back(image.cr[y * width + x]);
+    }
+  }
+  return out;
+}
+
+static void check_frames() {
+  // not a multiple of the MCU size, the padding is filled from the edges
+  const test_util::Planes scene = test_util::make_scene(200, 150, 0);
+  const std::vector<uint8_t> yuyv = pack_yuyv(scene);
+  const std::vector<uint8_t> nv12 = pack_nv12(scene);
+  RawConverter converter;
+  converter.set_quality(90);
+  std::vector<uint8_t> out(200 * 150 * 2);
+  size_t len = 0;
+
+  CHECK(converter.convert(RAW_YUYV, yuyv.data(), yuyv.size(), 200, 150,
+                          RAW_OUTPUT_GRAYSCALE, out.data(), out.size(),
+                          &len) == JPEG_OK);
+  CHECK(len == 200 * 150 &&
+        memcmp(out.data(), scene.y.data(), scene.y.size()) == 0);
+  CHECK(converter.convert(RAW_NV12, nv12.data(), nv12.size(), 200, 150,
+                          RAW_OUTPUT_RGB565, out.data(), out.size(),
+                          &len) == JPEG_OK);
+  bool same = len == out.size();
+  for (size_t i = 0; same && i < 200 * 150; i++) {
+    const size_t chroma = 200 * 150 + (i / 200 / 2 * 200) + i % 200 / 2 * 2;
+    same = (out[i * 2] << 8 | out[i * 2 + 1]) ==
+           ref_rgb565(nv12[i], nv12[chroma], nv12[chroma + 1]);
+  }
+  CHECK_MSG(same, "NV12 frame differs from the reference");
+  // a frame one byte short is not converted
+  CHECK(converter.convert(RAW_YUYV, yuyv.data(), yuyv.size() - 1, 200, 150,
+                          RAW_OUTPUT_GRAYSCALE, out.data(), out.size(),
+                          &len) == JPEG_CORRUPT);
+
+  const struct {
+    RawFormat format;
+    const std::vector<uint8_t> &frame;
+    const char *name;
+  } jpegs[] = {{RAW_YUYV, yuyv, "YUYV"}, {RAW_NV12, nv12, "NV12"}};
+  for (const auto &jpeg : jpegs) {
+    const JpegStatus status = converter.convert(
+        jpeg.format, jpeg.frame.data(), jpeg.frame.size(), 200, 150,
+        RAW_OUTPUT_JPEG, out.data(), out.size(), &len);
+    CHECK_MSG(status == JPEG_OK, "%s: %s", jpeg.name,
+              jpeg_status_to_string(status));
+    const test_util::Planes decoded = test_util::decode_jpeg(out.data(), len);
+    CHECK(decoded.width == 200 && decoded.height == 150);
+    if (decoded.width != 200)
+      continue;
+    const double psnr = test_util::psnr(decoded.y, scene.y);
+    printf("%s to JPEG: %zu bytes, %.1f dB\n", jpeg.name, len, psnr);
+    CHECK_MSG(psnr >= 35, "%s to JPEG: %.1f dB", jpeg.name, psnr);
+  }
+}
+
+// 1024 x 768 x 2 bytes are exactly 96 x 16K, the buffers need headroom
+static void check_camera() {
+  const std::vector<uint8_t> frame =
+      pack_yuyv(test_util::make_scene(1024, 768, 0));
+  fake_uvc::Device device;
+  device.modes = {fake_uvc::mode(1024, 768, 666666)};
+  device.format = UVC_FRAME_FORMAT_YUYV;
+  device.source = [&frame](uint32_t, uint16_t, uint16_t,
+                           std::vector<uint8_t> &out) { out = frame; };
+  fake_uvc::attach(device);
+
+  ESP32Camera camera;
+  camera.set_max_update_interval(0);
+  camera.set_idle_update_interval(0);
+  camera.set_suspend_when_idle(false);
+  camera.set_transfer_type(ESP32_CAMERA_TRANSFER_BULK);
+  camera.set_frame_size(ESP32_CAMERA_SIZE_1024X768);
+  camera.set_uncompressed_output(ESP32_CAMERA_UNCOMPRESSED_GRAYSCALE);
+  uint32_t delivered = 0;
+  bool luma = true;
+  camera.add_image_callback([&delivered, &luma, &frame](
+                                std::shared_ptr<CameraImage> image) {
+    const camera_fb_t *fb = image->get_raw_buffer();
+    delivered++;
+    luma = luma && fb->format == PIXFORMAT_GRAYSCALE &&
+           fb->len == 1024 * 768 && fb->buf[0] == frame[0] &&
+           fb->buf[fb->len - 1] == frame[frame.size() - 2];
+  });
+  App.register_component(&camera);
+  App.setup();
+  camera.start_stream(WEB_REQUESTER);
+
+  // a restart to raw sized buffers, then every frame
+  App.run_for(1000);
+  const uint32_t starts = fake_uvc::counters().starts;
+  const uint32_t truncated = fake_uvc::counters().truncated;
+  delivered = 0;
+  App.run_for(1000);
+  printf("XGA YUY2: %u frames in 1 s, %u starts\n", delivered, starts);
+  CHECK_MSG(delivered >= 10, "%u frames delivered", delivered);
+  CHECK(luma);
+  CHECK(fake_uvc::counters().starts == starts);
+  CHECK(fake_uvc::counters().truncated == truncated);
+
+  // a format nothing converts is counted and dropped
+  device.format = UVC_FRAME_FORMAT_H264;
+  fake_uvc::attach(device);
+  App.run_for(200);
+  const uint32_t corrupt = global_pipeline_stats.get_corrupt();
+  delivered = 0;
+  App.run_for(500);
+  CHECK_MSG(delivered == 0, "%u H.264 frames delivered", delivered);
+  CHECK(global_pipeline_stats.get_corrupt() > corrupt);
+}
+
+int main() {
+  check_kernels();
+  check_frames();
+  check_camera();
+  test_util::finish();
+}
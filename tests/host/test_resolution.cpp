@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Runtime resolution: a switch without a stream restart survives the device
+// being plugged in again
+
+#include "../esp32_camera/esp32_camera.h"
+#include "fake_uvc.h"
+#include "test_util.h"
+
+#include "esphome/core/application.h"
+
+#include <map>
+
+using namespace esphome;
+using namespace esphome::esp32_camera;
+
+static uint16_t s_delivered_width = 0;
+
+static bool streams(ESP32Camera &camera, uint16_t width, uint16_t height) {
+  uint16_t w, h;
+  return camera.get_current_mode(&w, &h) && w == width && h == height &&
+         fake_uvc::current_width() == width &&
+         fake_uvc::current_height() == height;
+}
+
+int main() {
+  std::map<uint32_t, std::vector<uint8_t>> frames; // by width
+  fake_uvc::Device device;
+  device.modes = {fake_uvc::mode(640, 480, 333333),
+                  fake_uvc::mode(800, 600, 333333),
+                  fake_uvc::mode(1280, 720, 333333)};
+  device.source = [&frames](uint32_t, uint16_t width, uint16_t height,
+                            std::vector<uint8_t> &frame) {
+    auto &cached = frames[width];
+    if (cached.empty())
+      cached = test_util::encode_jpeg(
+          test_util::make_scene(width, height, 0), 2, 1, 50);
+    frame = cached;
+  };
+  // sources run on the sample thread, encode up front
+  for (const auto &mode : device.modes) {
+    std::vector<uint8_t> frame;
+    device.source(0, mode.width, mode.height, frame);
+  }
+  fake_uvc::attach(device);
+
+  ESP32Camera camera;
+  camera.set_max_update_interval(0);
+  camera.set_idle_update_interval(0);
+  camera.set_suspend_when_idle(false);
+  camera.set_transfer_type(ESP32_CAMERA_TRANSFER_BULK);
+  camera.add_image_callback([](std::shared_ptr<CameraImage> image) {
+    s_delivered_width = image->get_raw_buffer()->width;
+  });
+  App.register_component(&camera);
+  App.setup();
+  camera.start_stream(WEB_REQUESTER);
+
+  App.run_for(2000, [&camera]() { return streams(camera, 640, 480); });
+  CHECK(streams(camera, 640, 480));
+
+  // bigger buffers, the stream restarts
+  CHECK(camera.set_resolution(800, 600));
+  App.run_for(2000, [&camera]() { return streams(camera, 800, 600); });
+  CHECK(streams(camera, 800, 600));
+  const uint32_t starts = fake_uvc::counters().starts;
+
+  // same buffers, only the frame size is reset
+  CHECK(camera.set_resolution(640, 480));
+  CHECK(fake_uvc::counters().starts == starts);
+  App.run_for(300);
+  CHECK(streams(camera, 640, 480));
+
+  // usb_stream was last configured with 800x600
+  fake_uvc::replug();
+  App.run_for(2000, [&camera]() {
+    return s_delivered_width == 640 && streams(camera, 640, 480);
+  });
+  App.run_for(300);
+  CHECK(streams(camera, 640, 480));
+  CHECK(camera.get_resolution() == "640x480");
+  CHECK(s_delivered_width == 640);
+  test_util::finish();
+}
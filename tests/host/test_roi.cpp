@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Regions of interest: the lossless crop against the same area of the decoded
+// full frame, and delivery of regions cut on the transcoder task
+
+#include "../esp32_camera/esp32_camera.h"
+#include "fake_uvc.h"
+#include "mjpeg.h"
+#include "test_util.h"
+
+#include "esphome/core/application.h"
+
+#include <algorithm>
+#include <memory>
+
+using namespace esphome;
+using namespace esphome::esp32_camera;
+
+static const uint16_t WIDTH = 640;
+static const uint16_t HEIGHT = 480;
+
+// every plane of crop equals the area of full at left, top
+static bool same_area(const test_util::Planes &crop,
+                      const test_util::Planes &full, size_t left,
+                      size_t top) {
+  if (crop.width == 0 || left + crop.width > full.width ||
+      top + crop.height > full.height)
+    return false;
+  for (size_t y = 0; y < crop.height; y++) {
+    const size_t from = (top + y) * full.width + left;
+    const size_t to = y * crop.width;
+    for (size_t x = 0; x < crop.width; x++) {
+      if (crop.y[to + x] != full.y[from + x] ||
+          crop.cb[to + x] != full.cb[from + x] ||
+          crop.cr[to + x] != full.cr[from + x])
+        return false;
+    }
+  }
+  return true;
+}
+
+static void check_cropper(const std::vector<uint8_t> &frame, size_t mcu_height,
+                          const char *name) {
+  const test_util::Planes full =
+      test_util::decode_jpeg(frame.data(), frame.size());
+  MjpegCropper cropper;
+  std::vector<uint8_t> out(frame.size());
+  // inside, at the bottom right edge, and smaller than one MCU
+  const uint16_t regions[][4] = {
+      {100, 70, 200, 150}, {500, 400, 200, 200}, {33, 21, 3, 3}};
+  for (const auto &region : regions) {
+    size_t len;
+    uint16_t width, height;
+    const JpegStatus status =
+        cropper.crop(frame.data(), frame.size(), region[0], region[1],
+                     region[2], region[3], out.data(), out.size(), &len,
+                     &width, &height);
+    CHECK_MSG(status == JPEG_OK, "%s: %s", name,
+              jpeg_status_to_string(status));
+    if (status != JPEG_OK)
+      continue;
+    const size_t left = region[0] / 16 * 16;
+    const size_t top = region[1] / mcu_height * mcu_height;
+    const test_util::Planes crop = test_util::decode_jpeg(out.data(), len);
+    printf("%s %ux%u at %zu,%zu: %zu bytes\n", name, width, height, left, top,
+           len);
+    CHECK(crop.width == width && crop.height == height);
+    CHECK(left + width >= std::min<size_t>(region[0] + region[2], WIDTH));
+    CHECK(top + height >= std::min<size_t>(region[1] + region[3], HEIGHT));
+    CHECK_MSG(same_area(crop, full, left, top), "%s %ux%u at %zu,%zu", name,
+              width, height, left, top);
+  }
+}
+
+int main() {
+  const test_util::Planes scene = test_util::make_scene(WIDTH, HEIGHT, 0);
+  const std::vector<uint8_t> frame_422 =
+      test_util::encode_jpeg(scene, 2, 1, 80);
+  check_cropper(frame_422, 8, "4:2:2");
+  check_cropper(test_util::encode_jpeg(scene, 2, 2, 80), 16, "4:2:0");
+
+  // regions through the camera, cut on the transcoder task
+  fake_uvc::Device device;
+  device.modes = {fake_uvc::mode(WIDTH, HEIGHT, 333333)};
+  device.source = [&frame_422](uint32_t, uint16_t, uint16_t,
+                               std::vector<uint8_t> &frame) {
+    frame = frame_422;
+  };
+  fake_uvc::attach(device);
+
+  ESP32Camera camera;
+  camera.set_max_update_interval(0);
+  camera.set_idle_update_interval(0);
+  camera.set_suspend_when_idle(false);
+  camera.set_transfer_type(ESP32_CAMERA_TRANSFER_BULK);
+  camera.set_roi(API_REQUESTER, 0.25f, 0.25f, 0.5f, 0.5f);
+  std::shared_ptr<CameraImage> region;
+  uint32_t regions = 0, full_frames = 0;
+  camera.add_image_callback(
+      [&region, &regions, &full_frames](std::shared_ptr<CameraImage> image) {
+        if (image->was_requested_by(API_REQUESTER)) {
+          region = image;
+          regions++;
+        } else {
+          full_frames++;
+        }
+      });
+  App.register_component(&camera);
+  App.setup();
+
+  // a single request is answered by the region alone
+  camera.request_image(API_REQUESTER);
+  App.run_for(2000, [&region]() { return region != nullptr; });
+  CHECK(region != nullptr);
+  if (region) {
+    const camera_fb_t *fb = region->get_raw_buffer();
+    CHECK(fb->width == WIDTH / 2 && fb->height == HEIGHT / 2);
+    const test_util::Planes decoded =
+        test_util::decode_jpeg(fb->buf, fb->len);
+    CHECK(same_area(decoded,
+                    test_util::decode_jpeg(frame_422.data(), frame_422.size()),
+                    WIDTH / 4, HEIGHT / 4));
+  }
+  CHECK(full_frames == 0);
+
+  // a stream of regions next to a full frame stream
+  region.reset();
+  regions = 0;
+  camera.start_stream(API_REQUESTER);
+  camera.start_stream(WEB_REQUESTER);
+  App.run_for(1000, [&region]() {
+    region.reset();
+    return false;
+  });
+  printf("1 s streaming: %u regions, %u full frames\n", regions, full_frames);
+  CHECK(regions >= 10);
+  CHECK(full_frames >= 10);
+  test_util::finish();
+}
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Snapshot cache: a single request within max_age is answered with the
+// cached frame, whose slot goes back to the ring once it is older
+
+#include "../esp32_camera/esp32_camera.h"
+#include "fake_uvc.h"
+#include "frame_ring.h"
+#include "test_util.h"
+
+#include "esphome/core/application.h"
+
+using namespace esphome;
+using namespace esphome::esp32_camera;
+
+static const uint32_t MAX_AGE_MS = 200;
+
+int main() {
+  const std::vector<uint8_t> jpeg =
+      test_util::encode_jpeg(test_util::make_scene(320, 240, 0), 2, 1, 80);
+  fake_uvc::Device device;
+  device.modes = {fake_uvc::mode(320, 240, 333333)};
+  device.source = [&jpeg](uint32_t, uint16_t, uint16_t,
+                          std::vector<uint8_t> &frame) { frame = jpeg; };
+  fake_uvc::attach(device);
+
+  ESP32Camera camera;
+  camera.set_max_update_interval(0);
+  camera.set_idle_update_interval(0);
+  camera.set_suspend_when_idle(false);
+  camera.set_transfer_type(ESP32_CAMERA_TRANSFER_BULK);
+  camera.set_snapshot_max_age(MAX_AGE_MS);
+  // two slots: while the cache pins one and the framebuffer task holds the
+  // pending frame in the other, every new frame is dropped
+  camera.set_frame_buffer_count(2);
+  std::shared_ptr<CameraImage> image;
+  uint32_t images = 0;
+  camera.add_image_callback(
+      [&image, &images](std::shared_ptr<CameraImage> delivered) {
+        image = delivered;
+        images++;
+      });
+  App.register_component(&camera);
+  App.setup();
+  const FrameRing *ring = camera.get_frame_ring();
+  App.run_for(2000, [ring]() { return ring->get_written() >= 3; });
+
+  camera.request_image(API_REQUESTER);
+  App.run_for(1000, [&image]() { return image != nullptr; });
+  CHECK(image != nullptr);
+  const uint32_t captured = ring->sequence_of(image->get_raw_buffer());
+  image.reset();
+
+  // answered from the cache
+  camera.request_image(API_REQUESTER);
+  App.run_for(100, [&image]() { return image != nullptr; });
+  CHECK(image != nullptr && images == 2);
+  if (image)
+    CHECK(ring->sequence_of(image->get_raw_buffer()) == captured);
+  image.reset();
+
+  // past max_age the slot is released and frames are written again
+  App.run_for(MAX_AGE_MS + 100);
+  const uint32_t dropped = ring->get_dropped_busy();
+  const uint32_t written = ring->get_written();
+  App.run_for(500);
+  printf("%u frames written, %u dropped after max_age\n",
+         ring->get_written() - written, ring->get_dropped_busy() - dropped);
+  CHECK_MSG(ring->get_dropped_busy() == dropped,
+            "%u frames dropped while the cache pinned a slot",
+            ring->get_dropped_busy() - dropped);
+  CHECK(ring->get_written() - written >= 10);
+
+  // a stale cache is not served
+  camera.request_image(API_REQUESTER);
+  App.run_for(1000, [&image]() { return image != nullptr; });
+  CHECK(image != nullptr);
+  if (image)
+    CHECK(ring->sequence_of(image->get_raw_buffer()) != captured);
+  image.reset();
+  test_util::finish();
+}
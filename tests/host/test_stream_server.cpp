@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Stream server: whole JPEG parts right after capture, a stalled client does
+// not hold back the others, clients beyond max_clients are turned away
+
+#include "../esp32_camera/esp32_camera.h"
+#include "fake_uvc.h"
+#include "stream_server.h"
+#include "test_util.h"
+
+#include "esphome/core/application.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <esp_timer.h>
+#include <lwip/sockets.h>
+#include <string>
+#include <thread>
+
+using namespace esphome;
+using namespace esphome::esp32_camera;
+
+static const uint16_t PORT = 18081;
+static const char *const REQUEST = "GET / HTTP/1.1\r\n\r\n";
+
+static int connect_client(int receive_buffer = 0) {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (receive_buffer != 0)
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer,
+               sizeof(receive_buffer));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(PORT);
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// reads parts for duration_ms and checks every one of them
+struct Reader {
+  uint32_t parts{0};
+  uint32_t broken{0};
+  std::vector<int64_t> latencies_us; // X-Timestamp to the last byte
+
+  void run(int fd, uint32_t duration_ms) {
+    std::string data;
+    const int64_t end_us = esp_timer_get_time() + duration_ms * 1000;
+    struct timeval timeout = {0, 10000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char buf[4096];
+    while (esp_timer_get_time() < end_us) {
+      const ssize_t len = recv(fd, buf, sizeof(buf), 0);
+      if (len == 0)
+        break;
+      if (len > 0)
+        data.append(buf, len);
+      this->parse_(data);
+    }
+  }
+
+protected:
+  void parse_(std::string &data) {
+    while (true) {
+      const size_t part = data.find("\r\n--frame\r\n");
+      const size_t body = data.find("\r\n\r\n", part + 2);
+      if (part == std::string::npos || body == std::string::npos)
+        return;
+      const std::string header = data.substr(part, body - part);
+      unsigned len = 0, sec = 0, usec = 0;
+      const char *length = strstr(header.c_str(), "Content-Length: ");
+      const char *stamp = strstr(header.c_str(), "X-Timestamp: ");
+      if (length == nullptr || stamp == nullptr ||
+          sscanf(length, "Content-Length: %u", &len) != 1 ||
+          sscanf(stamp, "X-Timestamp: %u.%u", &sec, &usec) != 2) {
+        this->broken++;
+        data.erase(0, body);
+        continue;
+      }
+      if (data.size() < body + 4 + len)
+        return;
+      const uint8_t *jpeg = (const uint8_t *)data.data() + body + 4;
+      if (len < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8 ||
+          jpeg[len - 2] != 0xFF || jpeg[len - 1] != 0xD9)
+        this->broken++;
+      this->parts++;
+      this->latencies_us.push_back(esp_timer_get_time() -
+                                   ((int64_t)sec * 1000000 + usec));
+      data.erase(0, body + 4 + len);
+    }
+  }
+};
+
+static int64_t median(std::vector<int64_t> values) {
+  if (values.empty())
+    return 0;
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+int main() {
+  std::vector<std::vector<uint8_t>> frames;
+  for (uint32_t phase = 0; phase < 4; phase++)
+    frames.push_back(test_util::encode_jpeg(
+        test_util::make_scene(320, 240, phase * 10), 2, 1, 80));
+  fake_uvc::Device device;
+  device.modes = {fake_uvc::mode(320, 240, 333333)};
+  device.source = [&frames](uint32_t sequence, uint16_t, uint16_t,
+                            std::vector<uint8_t> &frame) {
+    frame = frames[sequence % frames.size()];
+  };
+  fake_uvc::attach(device);
+
+  ESP32Camera camera;
+  camera.set_max_update_interval(0);
+  camera.set_idle_update_interval(0);
+  camera.set_transfer_type(ESP32_CAMERA_TRANSFER_BULK);
+  camera.set_frame_buffer_count(4); // max_clients + 2
+  StreamServer server(&camera);
+  server.set_port(PORT);
+  server.set_max_clients(2);
+  App.register_component(&camera);
+  App.register_component(&server);
+  App.setup();
+
+  // a client that asks for the stream and never reads
+  const int stalled = connect_client(4096);
+  CHECK(stalled >= 0);
+  send(stalled, REQUEST, strlen(REQUEST), 0);
+
+  const int fd = connect_client();
+  CHECK(fd >= 0);
+  send(fd, REQUEST, strlen(REQUEST), 0);
+  Reader reader;
+  std::thread thread([&reader, fd]() { reader.run(fd, 2000); });
+  App.run_for(500);
+
+  // both slots are taken
+  const int refused = connect_client();
+  std::string response(64, '\0');
+  struct timeval timeout = {1, 0};
+  setsockopt(refused, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  App.run_for(200);
+  const ssize_t len = recv(refused, &response[0], response.size() - 1, 0);
+  CHECK_MSG(len > 0 && response.find(" 503 ") != std::string::npos,
+            "third client got: %s", response.c_str());
+  close(refused);
+
+  App.run_for(1500);
+  thread.join();
+  const int64_t latency_us = median(reader.latencies_us);
+  printf("2 s: %u parts, %u broken, median latency %.2f ms\n", reader.parts,
+         reader.broken, latency_us / 1000.0);
+  CHECK_MSG(reader.parts >= 45, "%u parts next to a stalled client",
+            reader.parts);
+  CHECK(reader.broken == 0);
+  // sent when the ring wakes the server, not on the next poll
+  CHECK_MSG(latency_us < 2000, "median latency %lld us",
+            (long long)latency_us);
+  close(fd);
+  close(stalled);
+  test_util::finish();
+}
@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Thumbnails: the scaled JPEG against a box downscale of the decoded frame,
+// and delivery of thumbnails made on the transcoder task
+
+#include "../esp32_camera/esp32_camera.h"
+#include "fake_uvc.h"
+#include "mjpeg.h"
+#include "test_util.h"
+
+#include "esphome/core/application.h"
+
+#include <memory>
+
+using namespace esphome;
+using namespace esphome::esp32_camera;
+
+static const uint16_t WIDTH = 640;
+static const uint16_t HEIGHT = 480;
+
+// the luma of image averaged over factor x factor blocks
+static std::vector<uint8_t> box_downscale(const test_util::Planes &image,
+                                          size_t factor) {
+  const size_t width = image.width / factor;
+  const size_t height = image.height / factor;
+  std::vector<uint8_t> out(width * height);
+  for (size_t y = 0; y < height; y++) {
+    for (size_t x = 0; x < width; x++) {
+      uint32_t sum = 0;
+      for (size_t dy = 0; dy < factor; dy++)
+        for (size_t dx = 0; dx < factor; dx++)
+          sum += image.y[(y * factor + dy) * image.width + x * factor + dx];
+      out[y * width + x] = (sum + factor * factor / 2) / (factor * factor);
+    }
+  }
+  return out;
+}
+
+static void check_scaler(const std::vector<uint8_t> &frame,
+                         const test_util::Planes &decoded, const char *name) {
+  MjpegScaler scaler;
+  std::vector<uint8_t> out(frame.size());
+  for (uint8_t shift = 1; shift <= 3; shift++) {
+    size_t len;
+    uint16_t width, height;
+    const JpegStatus status =
+        scaler.scale(frame.data(), frame.size(), shift, out.data(),
+                     out.size(), &len, &width, &height);
+    CHECK_MSG(status == JPEG_OK, "%s 1/%u: %s", name, 1U << shift,
+              jpeg_status_to_string(status));
+    if (status != JPEG_OK)
+      continue;
+    CHECK(width == WIDTH >> shift && height == HEIGHT >> shift);
+    const test_util::Planes thumbnail = test_util::decode_jpeg(out.data(), len);
+    CHECK(thumbnail.width == width && thumbnail.height == height);
+    const double psnr =
+        test_util::psnr(thumbnail.y, box_downscale(decoded, 1U << shift));
+    printf("%s 1/%u: %zu bytes, %.1f dB\n", name, 1U << shift, len, psnr);
+    CHECK_MSG(psnr >= 35, "%s 1/%u: %.1f dB", name, 1U << shift, psnr);
+  }
+}
+
+int main() {
+  const test_util::Planes scene = test_util::make_scene(WIDTH, HEIGHT, 0);
+  const std::vector<uint8_t> frame_422 =
+      test_util::encode_jpeg(scene, 2, 1, 90);
+  const std::vector<uint8_t> frame_420 =
+      test_util::encode_jpeg(scene, 2, 2, 90);
+  const test_util::Planes decoded_422 =
+      test_util::decode_jpeg(frame_422.data(), frame_422.size());
+  check_scaler(frame_422, decoded_422, "4:2:2");
+  check_scaler(frame_420,
+               test_util::decode_jpeg(frame_420.data(), frame_420.size()),
+               "4:2:0");
+
+  // thumbnails through the camera, made on the transcoder task
+  fake_uvc::Device device;
+  device.modes = {fake_uvc::mode(WIDTH, HEIGHT, 333333)};
+  device.source = [&frame_422](uint32_t, uint16_t, uint16_t,
+                               std::vector<uint8_t> &frame) {
+    frame = frame_422;
+  };
+  fake_uvc::attach(device);
+
+  ESP32Camera camera;
+  camera.set_max_update_interval(0);
+  camera.set_idle_update_interval(0);
+  camera.set_suspend_when_idle(false);
+  camera.set_transfer_type(ESP32_CAMERA_TRANSFER_BULK);
+  camera.set_thumbnail_scale(2);
+  camera.add_thumbnail_requester(API_REQUESTER);
+  std::shared_ptr<CameraImage> thumbnail;
+  uint32_t full_frames = 0;
+  camera.add_image_callback(
+      [&thumbnail, &full_frames](std::shared_ptr<CameraImage> image) {
+        if (image->was_requested_by(API_REQUESTER))
+          thumbnail = image;
+        else
+          full_frames++;
+      });
+  App.register_component(&camera);
+  App.setup();
+
+  // a single request is answered by the thumbnail alone
+  camera.request_image(API_REQUESTER);
+  App.run_for(2000, [&thumbnail]() { return thumbnail != nullptr; });
+  CHECK(thumbnail != nullptr);
+  if (thumbnail) {
+    const camera_fb_t *fb = thumbnail->get_raw_buffer();
+    CHECK(fb->width == WIDTH / 4 && fb->height == HEIGHT / 4);
+    CHECK(fb->format == PIXFORMAT_JPEG);
+    const test_util::Planes decoded =
+        test_util::decode_jpeg(fb->buf, fb->len);
+    CHECK(decoded.width == WIDTH / 4 && decoded.height == HEIGHT / 4);
+    if (decoded.width == WIDTH / 4)
+      CHECK(test_util::psnr(decoded.y, box_downscale(decoded_422, 4)) >= 35);
+  }
+  CHECK(full_frames == 0);
+
+  // a stream with thumbnails next to a full frame stream
+  thumbnail.reset();
+  camera.start_stream(API_REQUESTER);
+  camera.start_stream(WEB_REQUESTER);
+  uint32_t thumbnails = 0;
+  App.run_for(1000, [&thumbnail, &thumbnails]() {
+    if (thumbnail) {
+      thumbnails++;
+      thumbnail.reset();
+    }
+    return false;
+  });
+  printf("1 s streaming: %u thumbnails, %u full frames\n", thumbnails,
+         full_frames);
+  CHECK(thumbnails >= 10);
+  CHECK(full_frames >= 10);
+  test_util::finish();
+}
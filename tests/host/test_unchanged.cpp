@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Unchanged frames: sensor noise on a static scene is held back, a box that
+// moved passes, for MJPEG and uncompressed frames and through the camera
+
+#include "../esp32_camera/esp32_camera.h"
+#include "fake_uvc.h"
+#include "frame_signature.h"
+#include "test_util.h"
+
+#include "esphome/core/application.h"
+
+#include <atomic>
+#include <functional>
+
+using namespace esphome;
+using namespace esphome::esp32_camera;
+
+static const uint16_t WIDTH = 640;
+static const uint16_t HEIGHT = 480;
+static const uint8_t NOISE = 12;
+static const uint8_t LUMA_THRESHOLD = 4;
+
+static test_util::Planes scene(uint32_t phase, uint32_t seed) {
+  return test_util::make_scene(WIDTH, HEIGHT, phase, NOISE, seed);
+}
+
+static std::vector<uint8_t> pack_yuyv(const test_util::Planes &image) {
+  std::vector<uint8_t> out(image.width * image.height * 2);
+  for (size_t i = 0; i < image.width * image.height; i += 2) {
+    out[i * 2] = image.y[i];
+    out[i * 2 + 1] = image.cb[i];
+    out[i * 2 + 2] = image.y[i + 1];
+    out[i * 2 + 3] = image.cr[i];
+  }
+  return out;
+}
+
+// the first frame passes, noisy copies of it do not, the moved box does
+static void check_filter(const char *name,
+                         const std::function<bool(const test_util::Planes &,
+                                                  FrameSignature *)> &sign) {
+  UnchangedFilter filter;
+  filter.set_luma_threshold(LUMA_THRESHOLD);
+  filter.set_keepalive(10000);
+  FrameSignature signature;
+  CHECK(sign(scene(0, 1), &signature));
+  CHECK(filter.pass(signature, 0));
+  uint32_t passed = 0;
+  for (uint32_t seed = 2; seed < 12; seed++) {
+    CHECK(sign(scene(0, seed), &signature));
+    if (filter.pass(signature, seed))
+      passed++;
+  }
+  CHECK(sign(scene(3, 12), &signature));
+  const bool moved = filter.pass(signature, 20);
+  printf("%s: %u of 10 noisy frames passed, moved box %s\n", name, passed,
+         moved ? "passed" : "held back");
+  CHECK_MSG(passed == 0, "%s: %u noisy frames passed", name, passed);
+  CHECK_MSG(moved, "%s: moved box held back", name);
+  // the moved box is the reference now, the keepalive lets it through again
+  CHECK(!filter.pass(signature, 30));
+  CHECK(filter.pass(signature, 10020));
+}
+
+int main() {
+  SignatureBuilder builder;
+  check_filter("MJPEG", [&builder](const test_util::Planes &image,
+                                   FrameSignature *signature) {
+    const std::vector<uint8_t> jpeg = test_util::encode_jpeg(image, 2, 1, 80);
+    return builder.from_jpeg(jpeg.data(), jpeg.size(), signature) &&
+           signature->width == WIDTH && signature->height == HEIGHT;
+  });
+  check_filter("YUYV", [&builder](const test_util::Planes &image,
+                                  FrameSignature *signature) {
+    const std::vector<uint8_t> yuyv = pack_yuyv(image);
+    return builder.from_raw(RAW_YUYV, yuyv.data(), yuyv.size(), WIDTH, HEIGHT,
+                            signature);
+  });
+  // a broken frame has no signature and always passes
+  FrameSignature signature;
+  const uint8_t broken[] = {0xFF, 0xD8, 0xFF, 0xD9};
+  CHECK(!builder.from_jpeg(broken, sizeof(broken), &signature));
+  CHECK(signature.width == 0);
+
+  // through the camera: noisy frames of the static scene, then a moved box
+  std::vector<std::vector<uint8_t>> noisy;
+  for (uint32_t seed = 1; seed <= 4; seed++)
+    noisy.push_back(test_util::encode_jpeg(scene(0, seed), 2, 1, 80));
+  const std::vector<uint8_t> moved =
+      test_util::encode_jpeg(scene(3, 5), 2, 1, 80);
+  std::atomic<bool> box_moved{false};
+  fake_uvc::Device device;
+  device.modes = {fake_uvc::mode(WIDTH, HEIGHT, 333333)};
+  device.source = [&](uint32_t sequence, uint16_t, uint16_t,
+                      std::vector<uint8_t> &frame) {
+    frame = box_moved ? moved : noisy[sequence % noisy.size()];
+  };
+  fake_uvc::attach(device);
+
+  ESP32Camera camera;
+  camera.set_max_update_interval(0);
+  camera.set_idle_update_interval(0);
+  camera.set_suspend_when_idle(false);
+  camera.set_transfer_type(ESP32_CAMERA_TRANSFER_BULK);
+  camera.set_skip_unchanged(LUMA_THRESHOLD, 10000);
+  camera.add_skip_unchanged_requester(WEB_REQUESTER);
+  uint32_t delivered = 0;
+  camera.add_image_callback(
+      [&delivered](std::shared_ptr<CameraImage>) { delivered++; });
+  App.register_component(&camera);
+  App.setup();
+  camera.start_stream(WEB_REQUESTER);
+
+  App.run_for(1500);
+  const uint32_t static_frames = delivered;
+  box_moved = true;
+  App.run_for(1000, [&delivered, static_frames]() {
+    return delivered > static_frames;
+  });
+  printf("camera: %u frames of the static scene, %u after the box moved\n",
+         static_frames, delivered - static_frames);
+  CHECK_MSG(static_frames == 1, "%u frames of a static scene delivered",
+            static_frames);
+  CHECK(delivered > static_frames);
+  test_util::finish();
+}
@@ -0,0 +1,209 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Checks, test images and a reference JPEG decoder for the host tests
+
+#include "test_util.h"
+
+#include "jpeg_codec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unistd.h>
+
+using esphome::esp32_camera::JPEG_OK;
+using esphome::esp32_camera::JpegComponent;
+using esphome::esp32_camera::JpegDecoder;
+using esphome::esp32_camera::JpegEncoder;
+using esphome::esp32_camera::jpeg_quality_tables;
+
+namespace test_util {
+
+static int s_failures = 0;
+
+void fail(const char *file, int line, const char *what) {
+  fprintf(stderr, "%s:%d: CHECK failed: %s\n", file, line, what);
+  s_failures++;
+}
+
+void finish() {
+  fflush(stdout);
+  fprintf(stderr, "%s\n", s_failures == 0 ? "PASS" : "FAIL");
+  fflush(stderr);
+  _exit(s_failures == 0 ? 0 : 1);
+}
+
+Planes::Planes(size_t w, size_t h)
+    : width(w), height(h), y(w * h), cb(w * h), cr(w * h) {}
+
+static uint8_t clamp8(int value) {
+  return (uint8_t)std::max(0, std::min(255, value));
+}
+
+Planes make_scene(size_t width, size_t height, uint32_t phase, uint8_t noise,
+                  uint32_t seed) {
+  Planes image(width, height);
+  uint32_t rng = seed;
+  const size_t box = std::max<size_t>(width / 6, 8);
+  const size_t box_x = (phase * 7) % (width - box);
+  const size_t box_y = height / 3;
+  for (size_t row = 0; row < height; row++) {
+    for (size_t col = 0; col < width; col++) {
+      int luma = 40 + (int)(150 * col / width) + (int)(40 * row / height);
+      if (((col / 16) + (row / 16)) % 2 == 0 && row > height * 2 / 3)
+        luma -= 30; // texture for the scaler
+      if (col >= box_x && col < box_x + box && row >= box_y &&
+          row < box_y + box)
+        luma = 230;
+      if (noise != 0) {
+        rng = rng * 1664525 + 1013904223;
+        luma += (int)((rng >> 16) % (2 * noise + 1)) - noise;
+      }
+      const size_t i = row * width + col;
+      image.y[i] = clamp8(luma);
+      image.cb[i] = clamp8(128 + (int)(60 * row / height) - 30);
+      image.cr[i] = clamp8(128 - (int)(60 * col / width) + 30);
+    }
+  }
+  return image;
+}
+
+/* box averaged and edge padded plane of one component */
+static std::vector<uint8_t> sample_plane(const std::vector<uint8_t> &plane,
+                                         size_t width, size_t height,
+                                         size_t fx, size_t fy, size_t out_w,
+                                         size_t out_h) {
+  std::vector<uint8_t> out(out_w * out_h);
+  for (size_t row = 0; row < out_h; row++) {
+    for (size_t col = 0; col < out_w; col++) {
+      int sum = 0;
+      for (size_t dy = 0; dy < fy; dy++) {
+        for (size_t dx = 0; dx < fx; dx++) {
+          const size_t x = std::min(col * fx + dx, width - 1);
+          const size_t y = std::min(row * fy + dy, height - 1);
+          sum += plane[y * width + x];
+        }
+      }
+      out[row * out_w + col] = (uint8_t)((sum + fx * fy / 2) / (fx * fy));
+    }
+  }
+  return out;
+}
+
+std::vector<uint8_t> encode_jpeg(const Planes &image, uint8_t h, uint8_t v,
+                                 uint8_t quality) {
+  const JpegComponent components[3] = {
+      {1, h, v, 0, 0, 0}, {2, 1, 1, 1, 1, 1}, {3, 1, 1, 1, 1, 1}};
+  uint16_t quant[2][64];
+  jpeg_quality_tables(quality, quant);
+  const size_t mcus_x = (image.width + 8 * h - 1) / (8 * h);
+  const size_t mcus_y = (image.height + 8 * v - 1) / (8 * v);
+  std::vector<uint8_t> planes[3];
+  size_t widths[3];
+  const std::vector<uint8_t> *sources[3] = {&image.y, &image.cb, &image.cr};
+  for (size_t c = 0; c < 3; c++) {
+    const size_t fx = c == 0 ? 1 : h, fy = c == 0 ? 1 : v;
+    const size_t bw = c == 0 ? h : 1, bh = c == 0 ? v : 1;
+    widths[c] = mcus_x * bw * 8;
+    planes[c] = sample_plane(*sources[c], image.width, image.height, fx, fy,
+                             widths[c], mcus_y * bh * 8);
+  }
+
+  std::vector<uint8_t> out(image.width * image.height * 2 + 4096);
+  JpegEncoder encoder;
+  encoder.begin(out.data(), out.size(), image.width, image.height, 3,
+                components, quant);
+  for (size_t my = 0; my < mcus_y; my++) {
+    for (size_t mx = 0; mx < mcus_x; mx++) {
+      for (size_t c = 0; c < 3; c++) {
+        const size_t bw = components[c].h, bh = components[c].v;
+        for (size_t by = 0; by < bh; by++) {
+          for (size_t bx = 0; bx < bw; bx++) {
+            const size_t x = (mx * bw + bx) * 8, y = (my * bh + by) * 8;
+            encoder.encode_block(c, &planes[c][y * widths[c] + x],
+                                 widths[c]);
+          }
+        }
+      }
+    }
+  }
+  out.resize(encoder.finish());
+  return out;
+}
+
+Planes decode_jpeg(const uint8_t *data, size_t len) {
+  JpegDecoder decoder;
+  if (decoder.begin(data, len) != JPEG_OK ||
+      decoder.get_component_count() != 3)
+    return Planes();
+  decoder.set_block_size(8);
+  const size_t hmax = decoder.get_hmax(), vmax = decoder.get_vmax();
+  const size_t mcus_x = decoder.get_mcus_x(), mcus_y = decoder.get_mcus_y();
+  const size_t full_w = mcus_x * hmax * 8, full_h = mcus_y * vmax * 8;
+  Planes padded(full_w, full_h);
+  std::vector<uint8_t> *targets[3] = {&padded.y, &padded.cb, &padded.cr};
+
+  double basis[8][8];
+  for (int x = 0; x < 8; x++) {
+    for (int u = 0; u < 8; u++)
+      basis[x][u] = (u == 0 ? std::sqrt(0.5) : 1.0) *
+                    std::cos((2 * x + 1) * u * M_PI / 16) / 2;
+  }
+  int32_t coef[64];
+  for (size_t my = 0; my < mcus_y; my++) {
+    for (size_t mx = 0; mx < mcus_x; mx++) {
+      if (!decoder.begin_mcu())
+        return Planes();
+      for (size_t c = 0; c < 3; c++) {
+        const JpegComponent &component = decoder.get_component(c);
+        // pixels of this component cover this many full resolution ones
+        const size_t fx = hmax / component.h, fy = vmax / component.v;
+        for (size_t by = 0; by < component.v; by++) {
+          for (size_t bx = 0; bx < component.h; bx++) {
+            if (!decoder.decode_block(c, coef))
+              return Planes();
+            for (int y = 0; y < 8; y++) {
+              for (int x = 0; x < 8; x++) {
+                double sum = 0;
+                for (int v = 0; v < 8; v++) {
+                  for (int u = 0; u < 8; u++)
+                    sum += basis[x][u] * basis[y][v] * coef[v * 8 + u];
+                }
+                const uint8_t pixel = clamp8((int)std::lround(sum + 128));
+                const size_t px = ((mx * component.h + bx) * 8 + x) * fx;
+                const size_t py = ((my * component.v + by) * 8 + y) * fy;
+                for (size_t dy = 0; dy < fy; dy++) {
+                  for (size_t dx = 0; dx < fx; dx++)
+                    (*targets[c])[(py + dy) * full_w + px + dx] = pixel;
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  // the padding is not part of the image
+  const size_t width = decoder.get_width(), height = decoder.get_height();
+  Planes image(width, height);
+  std::vector<uint8_t> *outputs[3] = {&image.y, &image.cb, &image.cr};
+  for (size_t c = 0; c < 3; c++) {
+    for (size_t row = 0; row < height; row++)
+      std::copy_n(&(*targets[c])[row * full_w], width,
+                  &(*outputs[c])[row * width]);
+  }
+  return image;
+}
+
+double psnr(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b) {
+  if (a.size() != b.size() || a.empty())
+    return 0;
+  double sum = 0;
+  for (size_t i = 0; i < a.size(); i++) {
+    const double diff = (double)a[i] - b[i];
+    sum += diff * diff;
+  }
+  if (sum == 0)
+    return 99;
+  return 10 * std::log10(255.0 * 255.0 * a.size() / sum);
+}
+
+} // namespace test_util
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Checks, test images and a reference JPEG decoder for the host tests
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// counts failures instead of stopping, finish() turns them into the exit code
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond))                                                               \
+      test_util::fail(__FILE__, __LINE__, #cond);                              \
+  } while (0)
+#define CHECK_MSG(cond, ...)                                                   \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      test_util::fail(__FILE__, __LINE__, #cond);                              \
+      fprintf(stderr, "    " __VA_ARGS__);                                     \
+      fprintf(stderr, "\n");                                                   \
+    }                                                                          \
+  } while (0)
+
+namespace test_util {
+
+void fail(const char *file, int line, const char *what);
+// exit code, ends the process without joining the FreeRTOS tasks, which
+// never return
+[[noreturn]] void finish();
+
+/* ---------------- images ---------------- */
+// full resolution Y, Cb and Cr planes
+struct Planes {
+  size_t width{0};
+  size_t height{0};
+  std::vector<uint8_t> y, cb, cr;
+  Planes() = default;
+  Planes(size_t w, size_t h);
+};
+
+// gradients and a few shapes moving with phase, noise adds +-noise to luma
+Planes make_scene(size_t width, size_t height, uint32_t phase,
+                  uint8_t noise = 0, uint32_t seed = 1);
+// baseline JPEG with luma sampled h x v times the chroma (1x1, 2x1, 2x2)
+std::vector<uint8_t> encode_jpeg(const Planes &image, uint8_t h, uint8_t v,
+                                 uint8_t quality);
+// float IDCT, chroma replicated back to full resolution; empty on errors
+Planes decode_jpeg(const uint8_t *data, size_t len);
+
+// of the luma planes, same size only
+double psnr(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b);
+
+} // namespace test_util
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// The framebuffer task wakes the main loop for frames somebody asked for
+// only
+
+#include "../esp32_camera/esp32_camera.h"
+#include "fake_uvc.h"
+#include "test_util.h"
+
+#include "esphome/core/application.h"
+
+using namespace esphome;
+using namespace esphome::esp32_camera;
+
+int main() {
+  const std::vector<uint8_t> jpeg =
+      test_util::encode_jpeg(test_util::make_scene(320, 240, 0), 2, 1, 80);
+  fake_uvc::Device device;
+  device.modes = {fake_uvc::mode(320, 240, 333333)};
+  device.source = [&jpeg](uint32_t, uint16_t, uint16_t,
+                          std::vector<uint8_t> &frame) { frame = jpeg; };
+  fake_uvc::attach(device);
+
+  ESP32Camera camera;
+  camera.set_max_update_interval(0);
+  camera.set_idle_update_interval(0);
+  // frames keep coming without any requester
+  camera.set_suspend_when_idle(false);
+  camera.set_transfer_type(ESP32_CAMERA_TRANSFER_BULK);
+  uint32_t delivered = 0;
+  camera.add_image_callback(
+      [&delivered](std::shared_ptr<CameraImage>) { delivered++; });
+  App.register_component(&camera);
+  App.setup();
+
+  App.run_for(300);
+  uint32_t emitted = fake_uvc::counters().emitted;
+  uint32_t wakes = App.get_wakes();
+  App.run_for(1000);
+  emitted = fake_uvc::counters().emitted - emitted;
+  wakes = App.get_wakes() - wakes;
+  printf("idle: %u frames, %u wakes\n", emitted, wakes);
+  CHECK(emitted >= 20);
+  CHECK_MSG(wakes <= 2, "%u wakes without requesters", wakes);
+
+  camera.start_stream(WEB_REQUESTER);
+  emitted = fake_uvc::counters().emitted;
+  wakes = App.get_wakes();
+  App.run_for(1000);
+  emitted = fake_uvc::counters().emitted - emitted;
+  wakes = App.get_wakes() - wakes;
+  printf("streaming: %u frames, %u wakes, %u delivered\n", emitted, wakes,
+         delivered);
+  CHECK(wakes >= emitted * 8 / 10);
+  CHECK(delivered >= emitted * 8 / 10);
+  test_util::finish();
+}